@@ -0,0 +1,445 @@
+/*
+Headless benchmark over a fixed corpus of scenes, prints one JSON document to stdout.
+
+Usage: shapeware-bench [--scene <name>] [--out <file>] [--threads <n>] [--trace <file>]
+
+`--threads` runs meshing and normals on a job system with n workers, serial by default.
+`--trace` writes a Chrome trace of all scenes to the given file, see shapeware/trace.h.
+Correctness checks live in the separate Verify target.
+*/
+
+#include <kinc/log.h>
+#include <kinc/system.h>
+#include <krink/system.h>
+#include <shapeware/csg.h>
+#include <shapeware/graph.h>
+#include <shapeware/jobs.h>
+#include <shapeware/mc.h>
+#include <shapeware/mesh.h>
+#include <shapeware/ops.h>
+#include <shapeware/sdf.h>
+#include <shapeware/shapes.h>
+#include <shapeware/stats.h>
+#include <shapeware/trace.h>
+#include <shapeware/transform.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define BENCH_MEMORY (1024ull * 1024ull * 1024ull)
+#define BENCH_SDF_EVALS 100000
+
+typedef struct bench_scene {
+	const char *name;
+	void (*build)(sw_graph_t *g);
+	float halfsidelen;
+	int steps;
+} bench_scene_t;
+
+typedef struct bench_result {
+	int nodes;
+	double graph_ms;
+	double generate_ms;
+	double sdf_evals_per_sec;
+	double mc_ms;
+	double mc_cells_per_sec;
+	double triangles_per_sec;
+	int triangles;
+	int vertices;
+	double mesh_build_ms;
+	double normal_ms;
+	uint64_t peak_memory;
+	// Library heap peak per operation above the usage before it, see util/memory.h
+	size_t generate_peak;
+	size_t mc_peak;
+	size_t mesh_build_peak;
+	size_t normal_peak;
+	size_t scratch_peak; // Of the calling thread over all operations
+#ifdef SW_STATS_ENABLED
+	sw_stats_t stats;
+#endif
+} bench_result_t;
+
+// Scenes
+
+static int add_translated(sw_graph_t *g, int parent, sw_type_t t, void *data, int size, float x,
+                          float y, float z) {
+	int id = sw_graph_insert_node(g, parent, t, "", data, size);
+	sw_transform_translation_t tr = (sw_transform_translation_t){.x = x, .y = y, .z = z};
+	sw_graph_insert_node(g, id, SW_TRANSFORM_TRANSLATION, "", &tr, sizeof(tr));
+	return id;
+}
+
+static void scene_sphere(sw_graph_t *g) {
+	sw_shapes_sphere_t s = sw_shapes_default_sphere();
+	sw_graph_insert_node(g, -1, SW_SHAPE_SPHERE, "Sphere", &s, sizeof(s));
+}
+
+static void scene_box(sw_graph_t *g) {
+	sw_shapes_box_t s = sw_shapes_default_box();
+	sw_graph_insert_node(g, -1, SW_SHAPE_BOX, "Box", &s, sizeof(s));
+}
+
+static void scene_torus(sw_graph_t *g) {
+	sw_shapes_torus_t s = sw_shapes_default_torus();
+	sw_graph_insert_node(g, -1, SW_SHAPE_TORUS, "Torus", &s, sizeof(s));
+}
+
+// Same model as `Sources/dummy.c`
+static void scene_dummy_csg(sw_graph_t *g) {
+	sw_shapes_sphere_t s1 = sw_shapes_default_sphere();
+	sw_shapes_sphere_t s2 = sw_shapes_default_sphere();
+	sw_shapes_ellipsoid_t s3 = sw_shapes_default_ellipsoid();
+	s1.m.r = 1.0f;
+	s1.m.g = 0.0f;
+	s1.m.b = 0.0f;
+	s2.m.r = 0.0f;
+	s2.m.g = 0.0f;
+	s2.m.b = 1.0f;
+	s3.r = (kr_vec3_t){.x = 0.5f, .y = 0.5f, .z = 2.5f};
+	s3.m.r = 0.0f;
+	s3.m.g = 1.0f;
+	s3.m.b = 0.0f;
+	int s1_id = add_translated(g, -1, SW_SHAPE_SPHERE, &s1, sizeof(s1), -0.25f, 0.0f, 0.0f);
+	int s2_id = add_translated(g, -1, SW_SHAPE_SPHERE, &s2, sizeof(s2), 0.25f, 0.0f, 0.0f);
+	int s3_id = sw_graph_insert_node(g, -1, SW_SHAPE_ELLIPSOID, "Ellipsoid 1", &s3, sizeof(s3));
+
+	sw_csg_smooth_t smunion = (sw_csg_smooth_t){.k = 0.05f};
+	int smunion_id =
+	    sw_graph_insert_node(g, -1, SW_CSG_SMOOTH_UNION, "Smooth Union", &smunion, sizeof(smunion));
+	sw_graph_set_parent(g, s1_id, smunion_id);
+	sw_graph_set_parent(g, s2_id, smunion_id);
+
+	sw_csg_smooth_subtraction_t subtr =
+	    (sw_csg_smooth_subtraction_t){.subtractor_id = s3_id, .k = 0.05f};
+	int subtr_id = sw_graph_insert_node(g, -1, SW_CSG_SMOOTH_SUBTRACTION, "Smooth Subtraction",
+	                                    &subtr, sizeof(subtr));
+	sw_graph_set_parent(g, s3_id, subtr_id);
+	sw_graph_set_parent(g, smunion_id, subtr_id);
+
+	sw_shapes_box_frame_t s4 = sw_shapes_default_box_frame();
+	s4.b = (kr_vec3_t){.x = 1.2f, .y = 1.2f, .z = 1.2f};
+	sw_graph_insert_node(g, -1, SW_SHAPE_BOX_FRAME, "Box Frame", &s4, sizeof(s4));
+}
+
+// Top level nodes are combined as a union
+static void scene_spheres(sw_graph_t *g, int count) {
+	int side = (int)ceilf(cbrtf((float)count));
+	float spacing = 2.0f / side;
+	sw_shapes_sphere_t s = sw_shapes_default_sphere();
+	s.r = spacing * 0.6f;
+	for (int i = 0; i < count; ++i) {
+		int x = i % side;
+		int y = (i / side) % side;
+		int z = i / (side * side);
+		add_translated(g, -1, SW_SHAPE_SPHERE, &s, sizeof(s), -1.0f + (x + 0.5f) * spacing,
+		               -1.0f + (y + 0.5f) * spacing, -1.0f + (z + 0.5f) * spacing);
+	}
+}
+
+static void scene_union_1k(sw_graph_t *g) {
+	scene_spheres(g, 1000);
+}
+
+static void scene_union_10k(sw_graph_t *g) {
+	scene_spheres(g, 10000);
+}
+
+// The spheres of `scene_spheres` grouped under nested unions of up to `fanout` children
+static void scene_tree(sw_graph_t *g, int count, int fanout) {
+	scene_spheres(g, count);
+	int *level = (int *)malloc(count * sizeof(int));
+	assert(level != NULL);
+	int size = 0;
+	sw_iter_t it;
+	sw_node_t *n;
+	sw_foreach(n, g, &it, -1) level[size++] = sw_graph_get_node_id(g, n);
+	while (size > fanout) {
+		int groups = 0;
+		for (int i = 0; i < size; i += fanout) {
+			int id = sw_graph_insert_node(g, -1, SW_CSG_UNION, "", NULL, 0);
+			for (int j = i; j < i + fanout && j < size; ++j) sw_graph_set_parent(g, level[j], id);
+			level[groups++] = id;
+		}
+		size = groups;
+	}
+	free(level);
+}
+
+static void scene_tree_10k(sw_graph_t *g) {
+	scene_tree(g, 10000, 16);
+}
+
+static void scene_op(sw_graph_t *g, sw_type_t t, void *data, int size) {
+	int op = sw_graph_insert_node(g, -1, t, "", data, size);
+	sw_shapes_box_t b = sw_shapes_default_box();
+	b.b = (kr_vec3_t){.x = 0.4f, .y = 1.0f, .z = 0.4f};
+	sw_graph_insert_node(g, op, SW_SHAPE_BOX, "", &b, sizeof(b));
+}
+
+static void scene_twisted(sw_graph_t *g) {
+	sw_ops_twist_t op = sw_ops_default_twist();
+	scene_op(g, SW_OPS_TWIST, &op, sizeof(op));
+}
+
+static void scene_bent(sw_graph_t *g) {
+	sw_ops_bend_t op = sw_ops_default_bend();
+	scene_op(g, SW_OPS_BEND, &op, sizeof(op));
+}
+
+static void scene_displaced(sw_graph_t *g) {
+	sw_ops_sin_displacement_t op = sw_ops_default_sin_displacement();
+	int id = sw_graph_insert_node(g, -1, SW_OPS_SIN_DISPLACEMENT, "", &op, sizeof(op));
+	sw_shapes_sphere_t s = sw_shapes_default_sphere();
+	s.r = 1.0f;
+	sw_graph_insert_node(g, id, SW_SHAPE_SPHERE, "", &s, sizeof(s));
+}
+
+static void scene_repeat(sw_graph_t *g) {
+	sw_ops_repeat_t op = (sw_ops_repeat_t){.c = {.x = 0.5f, .y = 0.5f, .z = 0.5f},
+	                                       .l = {.x = 3.0f, .y = 3.0f, .z = 3.0f}};
+	int id = sw_graph_insert_node(g, -1, SW_OPS_REPEAT, "", &op, sizeof(op));
+	sw_shapes_sphere_t s = sw_shapes_default_sphere();
+	s.r = 0.15f;
+	sw_graph_insert_node(g, id, SW_SHAPE_SPHERE, "", &s, sizeof(s));
+}
+
+static void scene_repeat_inf(sw_graph_t *g) {
+	sw_ops_repeat_inf_t op = (sw_ops_repeat_inf_t){.x = 0.5f, .y = 0.5f, .z = 0.5f};
+	int id = sw_graph_insert_node(g, -1, SW_OPS_REPEAT_INF, "", &op, sizeof(op));
+	sw_shapes_torus_t t = sw_shapes_default_torus();
+	t.t = (kr_vec2_t){.x = 0.15f, .y = 0.05f};
+	sw_graph_insert_node(g, id, SW_SHAPE_TORUS, "", &t, sizeof(t));
+}
+
+static const bench_scene_t scenes[] = {
+    {"sphere", scene_sphere, 1.5f, 96},
+    {"box", scene_box, 1.5f, 96},
+    {"torus", scene_torus, 1.5f, 96},
+    {"dummy_csg", scene_dummy_csg, 1.5f, 96},
+    {"union_1k", scene_union_1k, 1.2f, 32},
+    {"union_10k", scene_union_10k, 1.2f, 16},
+    {"tree_10k", scene_tree_10k, 1.2f, 16},
+    {"twisted", scene_twisted, 1.5f, 96},
+    {"bent", scene_bent, 1.5f, 96},
+    {"displaced", scene_displaced, 1.5f, 96},
+    {"repeat", scene_repeat, 2.0f, 96},
+    {"repeat_inf", scene_repeat_inf, 2.0f, 96},
+};
+
+// Measurements
+
+static uint64_t peak_memory(void) {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return pmc.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static kr_vec3_t zero_normal(void *param, kr_vec3_t pos) {
+	return (kr_vec3_t){.x = 0.0f, .y = 0.0f, .z = 0.0f};
+}
+
+static void count_triangle(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c, kr_vec3_t ca,
+                           kr_vec3_t cb, kr_vec3_t cc) {
+	++*(int *)param;
+}
+
+static size_t op_base;
+
+static void op_begin(void) {
+	sw_memory_reset_peak();
+	op_base = sw_memory_get_stats().current;
+}
+
+static size_t op_peak(void) {
+	return sw_memory_get_stats().peak - op_base;
+}
+
+static bench_result_t run_scene(const bench_scene_t *scene, sw_jobs_t *jobs) {
+	bench_result_t r = (bench_result_t){0};
+	sw_graph_t g;
+	sw_graph_init(&g, 64, 4096);
+	double start = kinc_time();
+	scene->build(&g);
+	r.graph_ms = (kinc_time() - start) * 1000.0;
+	r.nodes = g.size;
+	sw_stats_reset();
+	sw_scratch_reset_peak();
+
+	op_begin();
+	start = kinc_time();
+	sw_sdf_t *sdf = sw_sdf_generate(&g, -1);
+	r.generate_ms = (kinc_time() - start) * 1000.0;
+	r.generate_peak = op_peak();
+
+	// Fixed seed, every run evaluates the same points
+	sw_sdf_stack_frame_t *stack = sw_sdf_stack_init(sdf);
+	uint32_t seed = 42;
+	float sink = 0.0f;
+	start = kinc_time();
+	for (int i = 0; i < BENCH_SDF_EVALS; ++i) {
+		float p[3];
+		for (int k = 0; k < 3; ++k) {
+			seed = seed * 1664525u + 1013904223u;
+			p[k] = ((seed >> 8) / 16777216.0f * 2.0f - 1.0f) * scene->halfsidelen;
+		}
+		sink += sw_sdf_compute(sdf, (kr_vec3_t){.x = p[0], .y = p[1], .z = p[2]}, stack);
+	}
+	r.sdf_evals_per_sec = BENCH_SDF_EVALS / (kinc_time() - start);
+	if (isnan(sink)) kinc_log(KINC_LOG_LEVEL_WARNING, "NaN distance in scene %s", scene->name);
+
+	sw_mc_chunk_t chunk = (sw_mc_chunk_t){.halfsidelen = scene->halfsidelen, .steps = scene->steps};
+	op_begin();
+	start = kinc_time();
+	sw_mc_process_sdf_chunk_color(sdf, &chunk, count_triangle, &r.triangles, jobs);
+	double mc_seconds = kinc_time() - start;
+	r.mc_peak = op_peak();
+	r.mc_ms = mc_seconds * 1000.0;
+	r.mc_cells_per_sec = (double)scene->steps * scene->steps * scene->steps / mc_seconds;
+	r.triangles_per_sec = r.triangles / mc_seconds;
+
+	op_begin();
+	sw_mesh_t *m = sw_mesh_init(r.triangles, r.triangles, zero_normal, NULL);
+	start = kinc_time();
+	sw_mc_process_sdf_chunk_color(sdf, &chunk, sw_mesh_add_triangle, m, jobs);
+	r.mesh_build_ms = (kinc_time() - start) * 1000.0;
+	r.mesh_build_peak = op_peak();
+	r.vertices = sw_mesh_vert_count(m);
+
+	op_begin();
+	start = kinc_time();
+	sw_mesh_sdf_normals(m, sdf, jobs);
+	r.normal_ms = (kinc_time() - start) * 1000.0;
+	r.normal_peak = op_peak();
+	r.scratch_peak = sw_scratch_peak();
+
+	r.peak_memory = peak_memory();
+#ifdef SW_STATS_ENABLED
+	r.stats = *sw_stats_get();
+	sw_stats_log(&g);
+#endif
+	sw_mesh_destroy(m);
+	sw_sdf_stack_destroy(stack);
+	sw_sdf_destroy(sdf);
+	sw_graph_destroy(&g);
+	return r;
+}
+
+static void print_result(FILE *out, const bench_scene_t *scene, const bench_result_t *r,
+                         bool last) {
+	fprintf(out,
+	        "    {\"name\": \"%s\", \"nodes\": %d, \"steps\": %d, \"graph_ms\": %.3f, "
+	        "\"generate_ms\": %.3f, \"sdf_evals_per_sec\": %.0f, \"mc_ms\": %.3f, "
+	        "\"mc_cells_per_sec\": %.0f, \"triangles\": %d, \"vertices\": %d, "
+	        "\"triangles_per_sec\": %.0f, \"mesh_build_ms\": %.3f, \"normal_ms\": %.3f, "
+	        "\"peak_memory_bytes\": %llu, \"op_peak_bytes\": {\"generate\": %llu, \"mc\": %llu, "
+	        "\"mesh_build\": %llu, \"normals\": %llu, \"scratch\": %llu}",
+	        scene->name, r->nodes, scene->steps, r->graph_ms, r->generate_ms, r->sdf_evals_per_sec,
+	        r->mc_ms, r->mc_cells_per_sec, r->triangles, r->vertices, r->triangles_per_sec,
+	        r->mesh_build_ms, r->normal_ms, (unsigned long long)r->peak_memory,
+	        (unsigned long long)r->generate_peak,
+	        (unsigned long long)r->mc_peak, (unsigned long long)r->mesh_build_peak,
+	        (unsigned long long)r->normal_peak, (unsigned long long)r->scratch_peak);
+#ifdef SW_STATS_ENABLED
+	const sw_stats_t *s = &r->stats;
+	fprintf(out,
+	        ", \"stats\": {\"sdf_evals\": %llu, \"instructions\": %llu, \"mc_cells\": %llu, "
+	        "\"mc_cells_empty\": %llu, \"mc_cells_active\": %llu, \"mesh_lookups\": %llu, "
+	        "\"mesh_collisions\": %llu, \"allocations\": %llu}",
+	        (unsigned long long)s->sdf_evals, (unsigned long long)s->instructions,
+	        (unsigned long long)s->mc_cells, (unsigned long long)s->mc_cells_empty,
+	        (unsigned long long)s->mc_cells_active, (unsigned long long)s->mesh_lookups,
+	        (unsigned long long)s->mesh_collisions, (unsigned long long)s->allocations);
+#endif
+	fprintf(out, "}%s\n", last ? "" : ",");
+}
+
+int kickstart(int argc, char **argv) {
+	const char *only = NULL;
+	const char *out_path = NULL;
+	const char *trace_path = NULL;
+	int threads = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			only = argv[++i];
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			out_path = argv[++i];
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			trace_path = argv[++i];
+	}
+
+	void *mem = malloc(BENCH_MEMORY);
+	assert(mem != NULL);
+	kr_init(mem, BENCH_MEMORY, NULL, 0);
+
+	FILE *out = stdout;
+	if (out_path != NULL) {
+		out = fopen(out_path, "w");
+		if (out == NULL) {
+			kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for writing", out_path);
+			return 1;
+		}
+	}
+
+	int count = (int)(sizeof(scenes) / sizeof(scenes[0]));
+	int last = count - 1;
+	if (only != NULL) {
+		for (last = count - 1; last >= 0 && strcmp(scenes[last].name, only) != 0; --last)
+			;
+		if (last < 0) {
+			kinc_log(KINC_LOG_LEVEL_ERROR, "Unknown scene '%s'", only);
+			return 1;
+		}
+	}
+
+	sw_jobs_t *jobs = threads > 0 ? sw_jobs_init(threads, 0) : NULL;
+	if (trace_path != NULL) {
+		sw_trace_thread_name("main", -1);
+		sw_trace_start(0);
+	}
+	fprintf(out, "{\n  \"version\": 1,\n  \"threads\": %d,\n  \"scenes\": [\n", threads);
+	for (int i = 0; i < count; ++i) {
+		if (only != NULL && strcmp(scenes[i].name, only) != 0) continue;
+		bench_result_t r = run_scene(&scenes[i], jobs);
+		print_result(out, &scenes[i], &r, i == last);
+		fflush(out);
+	}
+	fprintf(out, "  ]\n}\n");
+	sw_jobs_destroy(jobs);
+	if (trace_path != NULL) {
+		sw_trace_stop();
+		sw_trace_write(trace_path);
+		sw_trace_release();
+	}
+
+	if (out != stdout) fclose(out);
+	kr_destroy();
+	free(mem);
+	return 0;
+}
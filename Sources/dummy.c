@@ -18,7 +18,6 @@
 #include <shapeware/graph.h>
 #include <shapeware/mc.h>
 #include <shapeware/mesh.h>
-#include <shapeware/raymarch.h>
 #include <shapeware/sdf.h>
 #include <shapeware/shapes.h>
 #include <shapeware/transform.h>
@@ -115,26 +114,15 @@ static void init_pipeline(void) {
 	mvp_mat = kinc_matrix4x4_multiply(&mvp_mat, &model_mat);
 }
 
-typedef struct sdf_normal_arg {
-	const sw_sdf_t *sdf;
-	sw_sdf_stack_frame_t *stack;
-} sdf_normal_arg_t;
-
-static kr_vec3_t vertex_normal(void *param, kr_vec3_t pos) {
-	return sw_raymarch_surface_normal(((sdf_normal_arg_t *)param)->sdf,
-	                                  ((sdf_normal_arg_t *)param)->stack, pos);
-}
-
 static void sdf_to_buffer(const sw_sdf_t *sdf) {
-	sdf_normal_arg_t arg = (sdf_normal_arg_t){.sdf = sdf, .stack = sw_sdf_stack_init(sdf)};
-	sw_mesh_t *m = sw_mesh_init(1000, 1000, vertex_normal, &arg);
-	sw_mc_process_sdf_chunk_color(sdf,
-	                              &(sw_mc_chunk_t){.halfsidelen = 1.5f,
-	                                               .iso_level = 0.0f,
-	                                               .steps = 30,
-	                                               .origin = {.x = 0.0f, .y = 0.0f, .z = 0.0f}},
-	                              sw_mesh_add_triangle, m);
-	sw_sdf_stack_destroy(arg.stack);
+	// Normals come from the sampled lattice, no normal callback needed
+	sw_mesh_t *m = sw_mesh_init(1000, 1000, NULL, NULL);
+	sw_mc_process_sdf_chunk_normal(sdf,
+	                               &(sw_mc_chunk_t){.halfsidelen = 1.5f,
+	                                                .iso_level = 0.0f,
+	                                                .steps = 30,
+	                                                .origin = {.x = 0.0f, .y = 0.0f, .z = 0.0f}},
+	                               sw_mesh_add_triangle_normal, m, NULL);
 	kinc_g4_vertex_buffer_init(&vert_buff, sw_mesh_vert_count(m), &structure, KINC_G4_USAGE_STATIC,
 	                           0);
 	float *verts = kinc_g4_vertex_buffer_lock_all(&vert_buff);
@@ -246,11 +234,11 @@ int kickstart(int argc, char **argv) {
 
 	sw_mc_process_sdf_chunk(sdf,
 	                        &(sw_mc_chunk_t){.halfsidelen = 1.0f, .iso_level = 0.0f, .steps = 10},
-	                        print_triangle, NULL);
+	                        print_triangle, NULL, NULL);
 
 	sw_mc_process_sdf_chunk_color(
 	    sdf, &(sw_mc_chunk_t){.halfsidelen = 1.0f, .iso_level = 0.0f, .steps = 10},
-	    print_triangle_color, NULL);
+	    print_triangle_color, NULL, NULL);
 
 	kinc_init("Shapeware Demo", 1280, 720, NULL, NULL);
 	kinc_set_update_callback(update, NULL);
@@ -6,8 +6,67 @@
 #include <kinc/log.h>
 #include <kinc/math/core.h>
 #include <kinc/system.h>
-#include <krink/memory.h>
 #include <string.h>
+#include <util/memory.h>
+
+// Layout of the graph in stored files, the links are rebuilt on load
+typedef struct sw_graph_file_header {
+	int node_cap, data_cap;
+	int size;
+	int data_top;
+	sw_node_t *nodes;
+	uint8_t *data;
+} sw_graph_file_header_t;
+
+static const sw_node_links_t sw_no_links = {-1, -1, -1, -1};
+
+static sw_node_links_t *sw_graph_children(sw_graph_t *g, int parent) {
+	return parent >= 0 ? &g->links[parent] : &g->roots;
+}
+
+static void sw_graph_link(sw_graph_t *g, int id) {
+	sw_node_links_t *p = sw_graph_children(g, g->nodes[id].parent);
+	// Nodes are mostly added with the highest id so far, search from the end
+	int prev = p->last_child;
+	while (prev > id) prev = g->links[prev].prev_sibling;
+	int next = prev >= 0 ? g->links[prev].next_sibling : p->first_child;
+	g->links[id].prev_sibling = prev;
+	g->links[id].next_sibling = next;
+	if (prev >= 0)
+		g->links[prev].next_sibling = id;
+	else
+		p->first_child = id;
+	if (next >= 0)
+		g->links[next].prev_sibling = id;
+	else
+		p->last_child = id;
+}
+
+static void sw_graph_unlink(sw_graph_t *g, int id) {
+	sw_node_links_t *p = sw_graph_children(g, g->nodes[id].parent);
+	sw_node_links_t *l = &g->links[id];
+	if (l->prev_sibling >= 0)
+		g->links[l->prev_sibling].next_sibling = l->next_sibling;
+	else
+		p->first_child = l->next_sibling;
+	if (l->next_sibling >= 0)
+		g->links[l->next_sibling].prev_sibling = l->prev_sibling;
+	else
+		p->last_child = l->prev_sibling;
+	l->prev_sibling = -1;
+	l->next_sibling = -1;
+}
+
+static void sw_graph_rebuild_links(sw_graph_t *g) {
+	g->links = (sw_node_links_t *)sw_malloc(g->node_cap * sizeof(sw_node_links_t));
+	assert(g->links);
+	for (int i = 0; i < g->node_cap; ++i) g->links[i] = sw_no_links;
+	g->roots = sw_no_links;
+	g->free_hint = 0;
+	// Ascending ids, every node is appended to its list
+	for (int i = 0; i < g->node_cap; ++i)
+		if (g->nodes[i].type != SW_FREE_NODE) sw_graph_link(g, i);
+}
 
 void sw_graph_init(sw_graph_t *g, int reserve_nodes, int reserve_data) {
 	assert(reserve_nodes > 0 && reserve_data > 0);
@@ -15,18 +74,21 @@ void sw_graph_init(sw_graph_t *g, int reserve_nodes, int reserve_data) {
 	g->data_top = 0;
 	g->node_cap = reserve_nodes;
 	g->data_cap = reserve_data;
-	g->nodes = (sw_node_t *)kr_malloc(reserve_nodes * sizeof(sw_node_t));
+	g->nodes = (sw_node_t *)sw_malloc(reserve_nodes * sizeof(sw_node_t));
 	assert(g->nodes);
 	for (int i = 0; i < reserve_nodes; ++i) g->nodes[i].type = SW_FREE_NODE;
-	g->data = (uint8_t *)kr_malloc(reserve_data);
+	g->data = (uint8_t *)sw_malloc(reserve_data);
 	assert(g->data);
+	sw_graph_rebuild_links(g);
 }
 
 void sw_graph_destroy(sw_graph_t *g) {
-	if (g->nodes) kr_free(g->nodes);
-	if (g->data) kr_free(g->data);
+	if (g->nodes) sw_free(g->nodes);
+	if (g->data) sw_free(g->data);
+	if (g->links) sw_free(g->links);
 	g->nodes = NULL;
 	g->data = NULL;
+	g->links = NULL;
 	g->size = 0;
 	g->node_cap = 0;
 	g->data_top = 0;
@@ -35,14 +97,19 @@ void sw_graph_destroy(sw_graph_t *g) {
 
 static int sw_get_next_free(sw_graph_t *g) {
 	if (g->size >= g->node_cap) {
-		g->nodes = (sw_node_t *)kr_realloc(g->nodes, g->node_cap * 2 * sizeof(sw_node_t));
+		g->nodes = (sw_node_t *)sw_realloc(g->nodes, g->node_cap * 2 * sizeof(sw_node_t));
 		assert(g->nodes);
 		for (int i = g->node_cap; i < g->node_cap * 2; ++i) g->nodes[i].type = SW_FREE_NODE;
+		g->links = (sw_node_links_t *)sw_realloc(g->links,
+		                                         g->node_cap * 2 * sizeof(sw_node_links_t));
+		assert(g->links);
+		for (int i = g->node_cap; i < g->node_cap * 2; ++i) g->links[i] = sw_no_links;
 		g->node_cap *= 2;
 	}
-	for (int i = 0; i < g->node_cap; ++i)
+	for (int i = g->free_hint; i < g->node_cap; ++i)
 		if (g->nodes[i].type == SW_FREE_NODE) {
 			++g->size;
+			g->free_hint = i + 1;
 			return i;
 		}
 	kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to get empty node");
@@ -54,7 +121,7 @@ static int sw_internal_insert_data(sw_graph_t *g, int size, void *data) {
 	assert(size % 4 == 0 && size > 0);
 
 	if (g->data_cap <= g->data_top + size) {
-		g->data = (uint8_t *)kr_realloc(g->data, g->data_cap * 2);
+		g->data = (uint8_t *)sw_realloc(g->data, g->data_cap * 2);
 		assert(g->data);
 		g->data_cap *= 2;
 	}
@@ -83,6 +150,7 @@ int sw_graph_insert_node(sw_graph_t *g, int parent, sw_type_t t, const char *nam
 	else
 		g->nodes[ret].start = -1;
 	sw_internal_rename_node(g, ret, name);
+	sw_graph_link(g, ret);
 	return ret;
 }
 
@@ -95,7 +163,10 @@ void sw_graph_delete_node(sw_graph_t *g, int id, sw_delete_op_t op) {
 	       op == SW_DELOP_DEL_NODE_AND_REPARENT);
 	int start = g->nodes[id].start;
 	int size = g->nodes[id].size;
+	// Children stay linked to the freed id, like their parent index
+	sw_graph_unlink(g, id);
 	g->nodes[id].type = SW_FREE_NODE;
+	if (id < g->free_hint) g->free_hint = id;
 	int move_size = g->data_top - (start + size);
 	if (move_size > 0) {
 		void *res = memmove(&g->data[start], &g->data[start + size], move_size);
@@ -118,7 +189,7 @@ void sw_graph_delete_node(sw_graph_t *g, int id, sw_delete_op_t op) {
 		sw_iter_t it;
 		sw_node_t *n;
 		sw_foreach(n, g, &it, id) {
-			n->parent = g->nodes[id].parent;
+			sw_graph_set_parent(g, sw_graph_get_node_id(g, n), g->nodes[id].parent);
 		}
 	} break;
 	case SW_DELOP_DEL_NODE_ONLY:
@@ -146,7 +217,11 @@ void *sw_graph_get_data(sw_graph_t *g, sw_node_t *n) {
 
 void sw_graph_set_parent(sw_graph_t *g, int id, int parent) {
 	assert(id > -1 && id < g->node_cap);
+	if (parent < -1) parent = -1;
+	bool linked = g->nodes[id].type != SW_FREE_NODE;
+	if (linked) sw_graph_unlink(g, id);
 	g->nodes[id].parent = parent;
+	if (linked) sw_graph_link(g, id);
 }
 
 sw_type_t sw_graph_type(sw_graph_t *g, int id) {
@@ -155,17 +230,13 @@ sw_type_t sw_graph_type(sw_graph_t *g, int id) {
 
 bool sw_graph_has_children(sw_graph_t *g, int id, sw_type_t *ignore, int ignore_size) {
 	assert(id > -1 && id < g->node_cap);
-	for (int i = 0; i < g->size; ++i) {
-		if (g->nodes[i].type == SW_FREE_NODE) continue;
-		bool found = false;
-		if (g->nodes[i].parent == id) {
-			found = true;
-			for (int j = 0; j < ignore_size; ++j)
-				if (g->nodes[i].type == ignore[j]) {
-					found = false;
-					break;
-				}
-		}
+	for (int i = g->links[id].first_child; i >= 0; i = g->links[i].next_sibling) {
+		bool found = true;
+		for (int j = 0; j < ignore_size; ++j)
+			if (g->nodes[i].type == ignore[j]) {
+				found = false;
+				break;
+			}
 		if (found) return true;
 	}
 	return false;
@@ -177,6 +248,9 @@ void sw_graph_deep_copy(sw_graph_t *target, const sw_graph_t *src) {
 	target->size = src->size;
 	memcpy(target->nodes, src->nodes, src->node_cap * sizeof(sw_node_t));
 	memcpy(target->data, src->data, src->data_cap);
+	memcpy(target->links, src->links, src->node_cap * sizeof(sw_node_links_t));
+	target->roots = src->roots;
+	target->free_hint = src->free_hint;
 }
 
 // Iterating
@@ -184,21 +258,17 @@ void sw_graph_deep_copy(sw_graph_t *target, const sw_graph_t *src) {
 sw_node_t *sw_iter_begin(sw_graph_t *g, sw_iter_t *it, int parent) {
 	it->parent = parent;
 	it->last = -1;
+	it->next = sw_graph_children(g, parent)->first_child;
 	it->g = g;
 	return sw_iter_next(it);
 }
 
 sw_node_t *sw_iter_next(sw_iter_t *it) {
-	if (it->last + 1 >= it->g->node_cap) return NULL;
-	for (int i = it->last + 1; i < it->g->size; ++i) {
-		if (it->g->nodes[i].type == SW_FREE_NODE) continue;
-		if (it->g->nodes[i].parent == it->parent) {
-			it->last = i;
-			return &it->g->nodes[i];
-		}
-	}
-	it->last = it->g->node_cap;
-	return NULL;
+	it->last = it->next;
+	if (it->last < 0) return NULL;
+	// Taken before the caller gets the node, which may leave the list
+	it->next = it->g->links[it->last].next_sibling;
+	return &it->g->nodes[it->last];
 }
 
 // Serializing
@@ -210,7 +280,11 @@ void sw_graph_store(sw_graph_t *g, const char *filename) {
 		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for writing", filename);
 		return;
 	}
-	kinc_file_writer_write(&writer, g, sizeof(sw_graph_t));
+	sw_graph_file_header_t header = (sw_graph_file_header_t){.node_cap = g->node_cap,
+	                                                         .data_cap = g->data_cap,
+	                                                         .size = g->size,
+	                                                         .data_top = g->data_top};
+	kinc_file_writer_write(&writer, &header, sizeof(header));
 	kinc_file_writer_write(&writer, g->nodes, g->node_cap * sizeof(sw_node_t));
 	kinc_file_writer_write(&writer, g->data, g->data_top);
 	kinc_file_writer_close(&writer);
@@ -223,12 +297,18 @@ void sw_graph_load(sw_graph_t *g, const char *filename) {
 		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for reading", filename);
 		return;
 	}
-	kinc_file_reader_read(&reader, g, sizeof(sw_graph_t));
-	g->nodes = (sw_node_t *)kr_malloc(g->node_cap * sizeof(sw_node_t));
+	sw_graph_file_header_t header;
+	kinc_file_reader_read(&reader, &header, sizeof(header));
+	*g = (sw_graph_t){.node_cap = header.node_cap,
+	                  .data_cap = header.data_cap,
+	                  .size = header.size,
+	                  .data_top = header.data_top};
+	g->nodes = (sw_node_t *)sw_malloc(g->node_cap * sizeof(sw_node_t));
 	assert(g->nodes);
 	kinc_file_reader_read(&reader, g->nodes, g->node_cap * sizeof(sw_node_t));
-	g->data = (uint8_t *)kr_malloc(g->data_cap);
+	g->data = (uint8_t *)sw_malloc(g->data_cap);
 	assert(g->data);
 	kinc_file_reader_read(&reader, g->data, g->data_top);
 	kinc_file_reader_close(&reader);
+	sw_graph_rebuild_links(g);
 }
@@ -22,12 +22,24 @@ typedef struct sw_node {
 	sw_type_t type;
 } sw_node_t;
 
+// Children of a node as a doubly linked list in ascending id order, `-1` marks the ends
+typedef struct sw_node_links {
+	int first_child;
+	int last_child;
+	int prev_sibling;
+	int next_sibling;
+} sw_node_links_t;
+
 typedef struct sw_graph {
 	int node_cap, data_cap;
 	int size;
 	int data_top;
 	sw_node_t *nodes;
 	uint8_t *data;
+	// Derived from the parents and not stored, change parents with `sw_graph_set_parent` only
+	sw_node_links_t *links; // Per node
+	sw_node_links_t roots;  // Children of `-1`
+	int free_hint;          // No free node below
 } sw_graph_t;
 
 void sw_graph_init(sw_graph_t *g, int reserve_nodes, int reserve_data);
@@ -46,9 +58,11 @@ void sw_graph_deep_copy(sw_graph_t *target, const sw_graph_t *src);
 
 // Iterating
 
+// Visits the children in ascending id order, the returned node may be deleted or reparented
 typedef struct sw_iter {
 	int parent;
 	int last;
+	int next;
 	sw_graph_t *g;
 } sw_iter_t;
 
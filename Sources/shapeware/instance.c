@@ -0,0 +1,222 @@
+#include "instance.h"
+
+#include "csg.h"
+#include "misc.h"
+#include "ops.h"
+#include "sdf.h"
+#include "shared.h"
+#include "trace.h"
+#include "transform.h"
+
+#include <util/memory.h>
+
+#include <assert.h>
+#include <math.h>
+
+typedef struct sw_instance_cell {
+	kr_vec3_t half; // Half extents of the cell
+	kr_vec3_t *tris; // Three positions and three colors per triangle
+	int count;
+	int cap;
+	bool outside;
+} sw_instance_cell_t;
+
+static bool sw_instance_is_evaluated(sw_type_t t) {
+	sw_node_type_group_t g = sw_node_type_group_get(t);
+	return g != SW_NODE_TYPE_DUMMY && g != SW_NODE_TYPE_TRANSFORM;
+}
+
+static int sw_instance_child_count(sw_graph_t *g, int parent) {
+	int count = 0;
+	sw_iter_t it;
+	sw_node_t *n;
+	sw_foreach(n, g, &it, parent) {
+		if (sw_instance_is_evaluated(n->type)) ++count;
+	}
+	return count;
+}
+
+static int sw_instance_find_of_type(sw_graph_t *g, int parent, sw_type_t t) {
+	sw_iter_t it;
+	sw_node_t *n;
+	sw_foreach(n, g, &it, parent) {
+		if (n->type == t) return sw_graph_get_node_id(g, n);
+	}
+	return -1;
+}
+
+static bool sw_instance_valid(sw_graph_t *g, int node) {
+	sw_node_t *n = sw_graph_get_node(g, node);
+	if (n->type != SW_OPS_REPEAT && n->type != SW_OPS_REPEAT_INF) return false;
+	// Ops with several children only evaluate the last one
+	if (sw_instance_child_count(g, node) != 1) return false;
+	kr_vec3_t c;
+	if (n->type == SW_OPS_REPEAT) {
+		sw_ops_repeat_t *op = (sw_ops_repeat_t *)sw_graph_get_data(g, n);
+		// Cells at fractional limits are only partly visible
+		if (op->l.x < 0.0f || op->l.y < 0.0f || op->l.z < 0.0f || op->l.x != floorf(op->l.x) ||
+		    op->l.y != floorf(op->l.y) || op->l.z != floorf(op->l.z))
+			return false;
+		c = op->c;
+	}
+	else
+		c = *(sw_ops_repeat_inf_t *)sw_graph_get_data(g, n);
+	if (c.x <= 0.0f || c.y <= 0.0f || c.z <= 0.0f) return false;
+
+	for (int id = n->parent; id >= 0; id = sw_graph_get_node(g, id)->parent) {
+		sw_type_t t = sw_graph_type(g, id);
+		if (t == SW_CSG_UNION) continue;
+		if (t == SW_MISC_EMPTY && sw_instance_child_count(g, id) == 1) continue;
+		return false;
+	}
+	return true;
+}
+
+int sw_instance_find(sw_graph_t *g, int *nodes, int max) {
+	assert(g != NULL && (nodes != NULL || max == 0));
+	int count = 0;
+	// Ids are not dense, deleted nodes leave free slots below `node_cap`
+	for (int i = 0; i < g->node_cap && count < max; ++i) {
+		sw_type_t t = g->nodes[i].type;
+		if (t == SW_FREE_NODE) continue;
+		if ((t == SW_OPS_REPEAT || t == SW_OPS_REPEAT_INF) && sw_instance_valid(g, i))
+			nodes[count++] = i;
+	}
+	return count;
+}
+
+// Inverse of the transform `sw_sdf_transform` applies to positions
+static kr_matrix4x4_t sw_instance_node_matrix(sw_graph_t *g, int id) {
+	kr_matrix4x4_t m = kr_matrix4x4_identity();
+	int rotation = sw_instance_find_of_type(g, id, SW_TRANSFORM_ROTATION);
+	int translation = sw_instance_find_of_type(g, id, SW_TRANSFORM_TRANSLATION);
+	if (rotation >= 0) {
+		kr_vec3_t *r = sw_graph_get_data(g, sw_graph_get_node(g, rotation));
+		kr_matrix4x4_t rm = kr_matrix4x4_rotation(-r->z, -r->x, -r->y);
+		m = kr_matrix4x4_multmat(&m, &rm);
+	}
+	if (translation >= 0) {
+		kr_vec3_t *t = sw_graph_get_data(g, sw_graph_get_node(g, translation));
+		kr_matrix4x4_t tm = kr_matrix4x4_translation(-t->x, t->y, t->z);
+		m = kr_matrix4x4_multmat(&tm, &m);
+	}
+	return m;
+}
+
+static kr_vec3_t sw_instance_transform_point(kr_matrix4x4_t *m, kr_vec3_t p) {
+	kr_vec4_t r = kr_matrix4x4_multvec(m, (kr_vec4_t){p.x, p.y, p.z, 1.0f});
+	return (kr_vec3_t){r.x, r.y, r.z};
+}
+
+static void sw_instance_add_triangle(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c,
+                                     kr_vec3_t ca, kr_vec3_t cb, kr_vec3_t cc) {
+	sw_instance_cell_t *cell = (sw_instance_cell_t *)param;
+	kr_vec3_t v[6] = {a, b, c, ca, cb, cc};
+	for (int i = 0; i < 3; ++i) {
+		if (fabsf(v[i].x) >= cell->half.x || fabsf(v[i].y) >= cell->half.y ||
+		    fabsf(v[i].z) >= cell->half.z)
+			cell->outside = true;
+	}
+	if (cell->outside) return;
+	if (cell->count + 6 > cell->cap) {
+		cell->cap = cell->cap > 0 ? cell->cap * 2 : 6 * 1024;
+		cell->tris = (kr_vec3_t *)sw_realloc(cell->tris, cell->cap * sizeof(kr_vec3_t));
+		assert(cell->tris != NULL);
+	}
+	for (int i = 0; i < 6; ++i) cell->tris[cell->count++] = v[i];
+}
+
+static void sw_instance_push(sw_instances_t *instances, int *cap, kr_matrix4x4_t m) {
+	if (instances->count == *cap) {
+		*cap = *cap > 0 ? *cap * 2 : 256;
+		instances->transforms =
+		    (kr_matrix4x4_t *)sw_realloc(instances->transforms, *cap * sizeof(kr_matrix4x4_t));
+		assert(instances->transforms != NULL);
+	}
+	instances->transforms[instances->count++] = m;
+}
+
+bool sw_instance_repeat(sw_graph_t *g, int node, const sw_mc_chunk_t *chunk,
+                        sw_add_triangle_color_func_t f, void *f_param, sw_instances_t *instances,
+                        sw_jobs_t *jobs) {
+	assert(g != NULL && chunk != NULL && chunk->steps > 0 && instances != NULL);
+	if (!sw_instance_valid(g, node)) return false;
+	sw_trace_scope_t trace = sw_trace_begin("instance_repeat");
+
+	sw_node_t *n = sw_graph_get_node(g, node);
+	kr_vec3_t c, l = {INFINITY, INFINITY, INFINITY};
+	if (n->type == SW_OPS_REPEAT) {
+		sw_ops_repeat_t *op = (sw_ops_repeat_t *)sw_graph_get_data(g, n);
+		c = op->c;
+		l = op->l;
+	}
+	else
+		c = *(sw_ops_repeat_inf_t *)sw_graph_get_data(g, n);
+
+	// Mesh the cell around the origin at the lattice spacing of the scene
+	sw_instance_cell_t cell = {.half = kr_vec3_mult(c, 0.5f)};
+	float step = chunk->halfsidelen * 2.0f / chunk->steps;
+	float halfsidelen = fmaxf(fmaxf(cell.half.x, cell.half.y), cell.half.z);
+	int steps = (int)ceilf(halfsidelen * 2.0f / step);
+	sw_mc_chunk_t cell_chunk = {.origin = {0.0f, 0.0f, 0.0f},
+	                            .halfsidelen = halfsidelen,
+	                            .steps = steps > 0 ? steps : 1,
+	                            .iso_level = chunk->iso_level};
+	sw_sdf_t *sdf = sw_sdf_generate_local(g, node);
+	sw_mc_process_sdf_chunk_color(sdf, &cell_chunk, sw_instance_add_triangle, &cell, jobs);
+	sw_sdf_destroy(sdf);
+	if (cell.outside) {
+		sw_free(cell.tris);
+		sw_trace_end(&trace, 0);
+		return false;
+	}
+	if (f != NULL) {
+		for (int i = 0; i < cell.count; i += 6)
+			f(f_param, cell.tris[i], cell.tris[i + 1], cell.tris[i + 2], cell.tris[i + 3],
+			  cell.tris[i + 4], cell.tris[i + 5]);
+	}
+	sw_free(cell.tris);
+
+	kr_matrix4x4_t world = kr_matrix4x4_identity();
+	for (int id = node; id >= 0; id = sw_graph_get_node(g, id)->parent) {
+		kr_matrix4x4_t m = sw_instance_node_matrix(g, id);
+		world = kr_matrix4x4_multmat(&m, &world);
+	}
+	kr_matrix4x4_t inverse = kr_matrix4x4_inverse(&world);
+
+	// Cells whose bounding sphere overlaps the chunk, the transforms are rigid
+	float radius = kr_vec3_length(cell.half);
+	kr_vec3_t center = sw_instance_transform_point(&inverse, chunk->origin);
+	float reach = chunk->halfsidelen * sqrtf(3.0f) + radius;
+	int lo[3], hi[3];
+	float cv[3] = {c.x, c.y, c.z}, lv[3] = {l.x, l.y, l.z}, pv[3] = {center.x, center.y, center.z};
+	for (int a = 0; a < 3; ++a) {
+		lo[a] = (int)fmaxf(ceilf((pv[a] - reach) / cv[a]), -lv[a]);
+		hi[a] = (int)fminf(floorf((pv[a] + reach) / cv[a]), lv[a]);
+	}
+
+	*instances = (sw_instances_t){.node = node};
+	int cap = 0;
+	for (int z = lo[2]; z <= hi[2]; ++z) {
+		for (int y = lo[1]; y <= hi[1]; ++y) {
+			for (int x = lo[0]; x <= hi[0]; ++x) {
+				kr_matrix4x4_t offset = kr_matrix4x4_translation(x * c.x, y * c.y, z * c.z);
+				kr_matrix4x4_t m = kr_matrix4x4_multmat(&world, &offset);
+				kr_vec3_t p = sw_instance_transform_point(&m, (kr_vec3_t){0.0f, 0.0f, 0.0f});
+				if (fabsf(p.x - chunk->origin.x) > chunk->halfsidelen + radius ||
+				    fabsf(p.y - chunk->origin.y) > chunk->halfsidelen + radius ||
+				    fabsf(p.z - chunk->origin.z) > chunk->halfsidelen + radius)
+					continue;
+				sw_instance_push(instances, &cap, m);
+			}
+		}
+	}
+	sw_trace_end(&trace, instances->count);
+	return true;
+}
+
+void sw_instance_release(sw_instances_t *instances) {
+	assert(instances != NULL);
+	sw_free(instances->transforms);
+	*instances = (sw_instances_t){.node = -1};
+}
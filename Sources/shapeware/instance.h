@@ -0,0 +1,56 @@
+/**
+ * @file instance.h
+ * @brief Instancing of repetition domains. The contents of a `SW_OPS_REPEAT` or `SW_OPS_REPEAT_INF`
+ * node are identical in every cell, so a single cell is meshed and the repetitions are output as
+ * transforms instead of extracting the surface of every copy.
+ */
+#pragma once
+
+#include "graph.h"
+#include "jobs.h"
+#include "mc.h"
+
+#include <krink/math/matrix.h>
+#include <stdbool.h>
+
+typedef struct sw_instances {
+	int node;                    // The repeat node
+	kr_matrix4x4_t *transforms;  // Cell space to world space for every repetition
+	int count;
+} sw_instances_t;
+
+/**
+ * @brief Find repeat nodes that can be instanced: they have a single child and are only combined
+ * with the rest of the scene by unions, so their surface does not depend on anything else.
+ *
+ * @param g
+ * @param nodes Receives up to `max` node ids
+ * @param max
+ * @return int Number of nodes written
+ */
+int sw_instance_find(sw_graph_t *g, int *nodes, int max);
+
+/**
+ * @brief Mesh a single cell of a repeat node and list the transforms of all repetitions within
+ * `chunk`, for `SW_OPS_REPEAT` additionally limited by `l`. The cell is meshed at the lattice spacing
+ * of `chunk`. The rest of the scene can be meshed with `sw_sdf_generate_excluding`, overlaps with it
+ * are kept.
+ *
+ * Fails without calling `f` if the node can not be instanced, see `sw_instance_find`, or if the
+ * surface reaches out of the cell, i.e. neighbouring repetitions would interact.
+ *
+ * @param g
+ * @param node
+ * @param chunk Region and resolution the scene is meshed with
+ * @param f Receives the triangles in cell space, normals can be computed with
+ * `sw_sdf_generate_local`
+ * @param f_param
+ * @param instances Initialized on success, release with `sw_instance_release`
+ * @param jobs
+ * @return bool
+ */
+bool sw_instance_repeat(sw_graph_t *g, int node, const sw_mc_chunk_t *chunk,
+                        sw_add_triangle_color_func_t f, void *f_param, sw_instances_t *instances,
+                        sw_jobs_t *jobs);
+
+void sw_instance_release(sw_instances_t *instances);
@@ -0,0 +1,371 @@
+#include "jobs.h"
+#include "trace.h"
+
+#include <kinc/system.h>
+#include <kinc/threads/atomic.h>
+#include <kinc/threads/mutex.h>
+#include <kinc/threads/thread.h>
+#include <kinc/threads/threadlocal.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// Capacity of each deque, tasks that do not fit run inline on the submitting thread
+#define SW_JOBS_QUEUE_SIZE 1024
+// Seconds a waiting thread sleeps when there is nothing to help with
+#define SW_JOBS_IDLE_WAIT 0.001
+
+typedef struct sw_task {
+	void (*fn)(void *);
+	void *param;
+} sw_task_t;
+
+// Owner pushes and pops at the bottom, thieves take from the top
+typedef struct sw_deque {
+	kinc_mutex_t lock;
+	sw_task_t tasks[SW_JOBS_QUEUE_SIZE];
+	int top;
+	int bottom;
+} sw_deque_t;
+
+typedef struct sw_jobs_slot {
+	sw_arena_t scratch;
+	bool has_scratch;
+	sw_sdf_stack_frame_t *stack;
+	size_t stack_size;
+} sw_jobs_slot_t;
+
+struct sw_jobs {
+	sw_jobs_backend_t backend;
+	bool pool; // Built-in thread pool, otherwise `backend` is provided by the host
+	int worker_count;
+	sw_jobs_slot_t *slots;
+	kinc_mutex_t lock; // Dependency bookkeeping
+
+	// Built-in pool, deque `worker_count` receives tasks from threads outside the pool
+	kinc_thread_t *threads;
+	sw_deque_t *queues;
+	kinc_semaphore_t wake;
+	kinc_thread_local_t slot_id; // Slot + 1, 0 for threads outside the pool
+	struct sw_jobs_worker_arg *args;
+	volatile int running;
+};
+
+typedef struct sw_jobs_worker_arg {
+	sw_jobs_t *jobs;
+	int slot;
+} sw_jobs_worker_arg_t;
+
+int sw_jobs_fetch_add(volatile int *p) {
+	for (;;) {
+		int old = *p;
+		if (KINC_ATOMIC_COMPARE_EXCHANGE(p, old, old + 1)) return old;
+	}
+}
+
+static bool sw_deque_pop(sw_deque_t *q, sw_task_t *task) {
+	bool found = false;
+	kinc_mutex_lock(&q->lock);
+	if (q->bottom > q->top) {
+		*task = q->tasks[--q->bottom % SW_JOBS_QUEUE_SIZE];
+		found = true;
+	}
+	kinc_mutex_unlock(&q->lock);
+	return found;
+}
+
+static bool sw_deque_steal(sw_deque_t *q, sw_task_t *task) {
+	bool found = false;
+	kinc_mutex_lock(&q->lock);
+	if (q->bottom > q->top) {
+		*task = q->tasks[q->top++ % SW_JOBS_QUEUE_SIZE];
+		found = true;
+	}
+	if (q->top == q->bottom) q->top = q->bottom = 0;
+	kinc_mutex_unlock(&q->lock);
+	return found;
+}
+
+static bool sw_deque_push(sw_deque_t *q, sw_task_t task) {
+	bool pushed = false;
+	kinc_mutex_lock(&q->lock);
+	if (q->bottom - q->top < SW_JOBS_QUEUE_SIZE) {
+		q->tasks[q->bottom++ % SW_JOBS_QUEUE_SIZE] = task;
+		pushed = true;
+	}
+	kinc_mutex_unlock(&q->lock);
+	return pushed;
+}
+
+int sw_jobs_slot_count(sw_jobs_t *jobs) {
+	return jobs == NULL ? 1 : jobs->worker_count + 1;
+}
+
+int sw_jobs_current_slot(sw_jobs_t *jobs) {
+	if (jobs == NULL) return 0;
+	int slot;
+	if (jobs->pool)
+		slot = (int)(intptr_t)kinc_thread_local_get(&jobs->slot_id) - 1;
+	else
+		slot = jobs->backend.worker_index(jobs->backend.user);
+	return slot < 0 ? jobs->worker_count : slot;
+}
+
+static bool sw_jobs_try_run(sw_jobs_t *jobs, int slot) {
+	sw_task_t task;
+	bool found = sw_deque_pop(&jobs->queues[slot], &task);
+	for (int i = 1; !found && i <= jobs->worker_count; ++i)
+		found = sw_deque_steal(&jobs->queues[(slot + i) % (jobs->worker_count + 1)], &task);
+	if (found) task.fn(task.param);
+	return found;
+}
+
+static void sw_jobs_worker(void *param) {
+	sw_jobs_worker_arg_t *arg = (sw_jobs_worker_arg_t *)param;
+	sw_jobs_t *jobs = arg->jobs;
+	kinc_thread_local_set(&jobs->slot_id, (void *)(intptr_t)(arg->slot + 1));
+	sw_trace_thread_name("worker", arg->slot);
+	while (jobs->running) {
+		if (!sw_jobs_try_run(jobs, arg->slot)) kinc_semaphore_acquire(&jobs->wake);
+	}
+	sw_scratch_thread_release();
+}
+
+static void sw_jobs_pool_submit(void *user, void (*fn)(void *), void *param) {
+	sw_jobs_t *jobs = (sw_jobs_t *)user;
+	if (sw_deque_push(&jobs->queues[sw_jobs_current_slot(jobs)], (sw_task_t){fn, param}))
+		kinc_semaphore_release(&jobs->wake, 1);
+	else
+		fn(param);
+}
+
+static void sw_jobs_init_slots(sw_jobs_t *jobs, size_t scratch_size) {
+	int count = jobs->worker_count + 1;
+	jobs->slots = (sw_jobs_slot_t *)sw_malloc(count * sizeof(sw_jobs_slot_t));
+	assert(jobs->slots != NULL);
+	memset(jobs->slots, 0, count * sizeof(sw_jobs_slot_t));
+	for (int i = 0; i < count && scratch_size > 0; ++i) {
+		sw_arena_init(&jobs->slots[i].scratch, scratch_size);
+		jobs->slots[i].has_scratch = true;
+	}
+	kinc_mutex_init(&jobs->lock);
+}
+
+sw_jobs_t *sw_jobs_init(int worker_count, size_t scratch_size) {
+	if (worker_count <= 0) worker_count = kinc_hardware_threads() - 1;
+	if (worker_count < 1) worker_count = 1;
+	if (worker_count > SW_JOBS_MAX_WORKERS) worker_count = SW_JOBS_MAX_WORKERS;
+	sw_jobs_t *jobs = (sw_jobs_t *)sw_malloc(sizeof(sw_jobs_t));
+	assert(jobs != NULL);
+	memset(jobs, 0, sizeof(sw_jobs_t));
+	jobs->pool = true;
+	jobs->worker_count = worker_count;
+	jobs->backend = (sw_jobs_backend_t){
+	    .user = jobs, .worker_count = worker_count, .submit = sw_jobs_pool_submit};
+	sw_jobs_init_slots(jobs, scratch_size);
+
+	jobs->queues = (sw_deque_t *)sw_malloc((worker_count + 1) * sizeof(sw_deque_t));
+	jobs->threads = (kinc_thread_t *)sw_malloc(worker_count * sizeof(kinc_thread_t));
+	assert(jobs->queues != NULL && jobs->threads != NULL);
+	for (int i = 0; i <= worker_count; ++i) {
+		kinc_mutex_init(&jobs->queues[i].lock);
+		jobs->queues[i].top = jobs->queues[i].bottom = 0;
+	}
+	kinc_semaphore_init(&jobs->wake, 0, 0x7fffffff);
+	kinc_thread_local_init(&jobs->slot_id);
+	jobs->running = 1;
+
+	jobs->args = (sw_jobs_worker_arg_t *)sw_malloc(worker_count * sizeof(sw_jobs_worker_arg_t));
+	assert(jobs->args != NULL);
+	for (int i = 0; i < worker_count; ++i) {
+		jobs->args[i] = (sw_jobs_worker_arg_t){.jobs = jobs, .slot = i};
+		kinc_thread_init(&jobs->threads[i], sw_jobs_worker, &jobs->args[i]);
+	}
+	return jobs;
+}
+
+sw_jobs_t *sw_jobs_init_backend(const sw_jobs_backend_t *backend, size_t scratch_size) {
+	assert(backend != NULL && backend->submit != NULL && backend->worker_index != NULL);
+	assert(backend->worker_count > 0);
+	sw_jobs_t *jobs = (sw_jobs_t *)sw_malloc(sizeof(sw_jobs_t));
+	assert(jobs != NULL);
+	memset(jobs, 0, sizeof(sw_jobs_t));
+	jobs->backend = *backend;
+	jobs->worker_count = backend->worker_count;
+	sw_jobs_init_slots(jobs, scratch_size);
+	return jobs;
+}
+
+void sw_jobs_destroy(sw_jobs_t *jobs) {
+	if (jobs == NULL) return;
+	if (jobs->pool) {
+		KINC_ATOMIC_EXCHANGE_32(&jobs->running, 0);
+		kinc_semaphore_release(&jobs->wake, jobs->worker_count);
+		for (int i = 0; i < jobs->worker_count; ++i) kinc_thread_wait_and_destroy(&jobs->threads[i]);
+		for (int i = 0; i <= jobs->worker_count; ++i) {
+			assert(jobs->queues[i].bottom == jobs->queues[i].top);
+			kinc_mutex_destroy(&jobs->queues[i].lock);
+		}
+		kinc_semaphore_destroy(&jobs->wake);
+		kinc_thread_local_destroy(&jobs->slot_id);
+		sw_free(jobs->args);
+		sw_free(jobs->threads);
+		sw_free(jobs->queues);
+	}
+	for (int i = 0; i <= jobs->worker_count; ++i) {
+		if (jobs->slots[i].has_scratch) sw_arena_destroy(&jobs->slots[i].scratch);
+		if (jobs->slots[i].stack != NULL) sw_sdf_stack_destroy(jobs->slots[i].stack);
+	}
+	sw_free(jobs->slots);
+	kinc_mutex_destroy(&jobs->lock);
+	sw_free(jobs);
+}
+
+static void sw_jobs_schedule(sw_jobs_t *jobs, void (*fn)(void *), void *param) {
+	jobs->backend.submit(jobs->backend.user, fn, param);
+}
+
+// Block on `s` until it can be acquired, threads of the pool keep executing tasks meanwhile so
+// nested waits cannot starve the pool
+static void sw_jobs_wait_semaphore(sw_jobs_t *jobs, kinc_semaphore_t *s) {
+	if (!jobs->pool) {
+		kinc_semaphore_acquire(s);
+		return;
+	}
+	int slot = sw_jobs_current_slot(jobs);
+	while (!kinc_semaphore_try_to_acquire(s, 0.0)) {
+		if (!sw_jobs_try_run(jobs, slot) && kinc_semaphore_try_to_acquire(s, SW_JOBS_IDLE_WAIT))
+			return;
+	}
+}
+
+static void sw_job_run(void *param) {
+	sw_job_t *job = (sw_job_t *)param;
+	sw_jobs_t *jobs = job->jobs;
+	job->fn(job->param, sw_jobs_current_slot(jobs));
+
+	kinc_mutex_lock(&jobs->lock);
+	job->done = 1;
+	for (int i = 0; i < job->dependent_count; ++i) {
+		sw_job_t *d = job->dependents[i];
+		if (--d->pending == 0) sw_jobs_schedule(jobs, sw_job_run, d);
+	}
+	kinc_mutex_unlock(&jobs->lock);
+	kinc_semaphore_release(&job->finished, 1);
+}
+
+void sw_jobs_submit(sw_jobs_t *jobs, sw_job_t *job, sw_job_func_t fn, void *param, sw_job_t **deps,
+                    int dep_count) {
+	assert(job != NULL && fn != NULL && (deps != NULL || dep_count == 0));
+	job->jobs = jobs;
+	job->fn = fn;
+	job->param = param;
+	job->done = 0;
+	job->dependent_count = 0;
+	if (jobs == NULL) {
+		// Dependencies were submitted before and therefore already ran
+		fn(param, 0);
+		job->done = 1;
+		return;
+	}
+	kinc_semaphore_init(&job->finished, 0, 1);
+
+	kinc_mutex_lock(&jobs->lock);
+	job->pending = 0;
+	for (int i = 0; i < dep_count; ++i) {
+		if (deps[i]->done) continue;
+		assert(deps[i]->dependent_count < SW_JOBS_MAX_DEPENDENTS);
+		deps[i]->dependents[deps[i]->dependent_count++] = job;
+		++job->pending;
+	}
+	bool ready = job->pending == 0;
+	kinc_mutex_unlock(&jobs->lock);
+	if (ready) sw_jobs_schedule(jobs, sw_job_run, job);
+}
+
+void sw_jobs_wait(sw_jobs_t *jobs, sw_job_t *job) {
+	assert(job != NULL && job->jobs == jobs);
+	if (jobs == NULL) return;
+	sw_jobs_wait_semaphore(jobs, &job->finished);
+	kinc_semaphore_destroy(&job->finished);
+}
+
+bool sw_job_done(const sw_job_t *job) {
+	return job->done != 0;
+}
+
+typedef struct sw_jobs_for {
+	sw_jobs_t *jobs;
+	sw_jobs_range_func_t fn;
+	void *param;
+	int begin;
+	int end;
+	int grain;
+	int chunk_count;
+	volatile int next_chunk;
+	kinc_semaphore_t helpers_done;
+} sw_jobs_for_t;
+
+static void sw_jobs_for_run(sw_jobs_for_t *f, int slot) {
+	for (;;) {
+		int c = sw_jobs_fetch_add(&f->next_chunk);
+		if (c >= f->chunk_count) break;
+		int b = f->begin + c * f->grain;
+		int e = f->end - b > f->grain ? b + f->grain : f->end;
+		f->fn(f->param, b, e, slot);
+	}
+}
+
+static void sw_jobs_for_helper(void *param) {
+	sw_jobs_for_t *f = (sw_jobs_for_t *)param;
+	sw_jobs_for_run(f, sw_jobs_current_slot(f->jobs));
+	kinc_semaphore_release(&f->helpers_done, 1);
+}
+
+void sw_jobs_parallel_for(sw_jobs_t *jobs, int begin, int end, int grain, sw_jobs_range_func_t fn,
+                          void *param) {
+	assert(fn != NULL && grain > 0);
+	if (end <= begin) return;
+	if (jobs == NULL) {
+		for (int b = begin; b < end; b += grain) fn(param, b, end - b > grain ? b + grain : end, 0);
+		return;
+	}
+	sw_jobs_for_t f = (sw_jobs_for_t){.jobs = jobs,
+	                                  .fn = fn,
+	                                  .param = param,
+	                                  .begin = begin,
+	                                  .end = end,
+	                                  .grain = grain,
+	                                  .chunk_count = (end - begin + grain - 1) / grain,
+	                                  .next_chunk = 0};
+	// Chunks are claimed dynamically, one helper per worker is enough to balance the load
+	int helpers = f.chunk_count - 1 < jobs->worker_count ? f.chunk_count - 1 : jobs->worker_count;
+	kinc_semaphore_init(&f.helpers_done, 0, helpers > 0 ? helpers : 1);
+	for (int i = 0; i < helpers; ++i) sw_jobs_schedule(jobs, sw_jobs_for_helper, &f);
+	sw_jobs_for_run(&f, sw_jobs_current_slot(jobs));
+	// Helpers reference `f` on this stack, all of them have to be done before returning
+	for (int i = 0; i < helpers; ++i) sw_jobs_wait_semaphore(jobs, &f.helpers_done);
+	kinc_semaphore_destroy(&f.helpers_done);
+}
+
+sw_arena_t *sw_jobs_scratch(sw_jobs_t *jobs, int slot) {
+	if (jobs == NULL) return NULL;
+	assert(slot >= 0 && slot <= jobs->worker_count);
+	return jobs->slots[slot].has_scratch ? &jobs->slots[slot].scratch : NULL;
+}
+
+sw_sdf_stack_frame_t *sw_jobs_sdf_stack(sw_jobs_t *jobs, const sw_sdf_t *sdf, int slot) {
+	assert(jobs != NULL && sdf != NULL && slot >= 0 && slot <= jobs->worker_count);
+	sw_jobs_slot_t *s = &jobs->slots[slot];
+	// Keyed by size, a new SDF may be allocated at the address of a destroyed one
+	size_t size = sw_sdf_stack_size(sdf);
+	if (s->stack == NULL || s->stack_size < size) {
+		if (s->stack != NULL) sw_sdf_stack_destroy(s->stack);
+		s->stack = sw_sdf_stack_init(sdf);
+		s->stack_size = size;
+	}
+	return s->stack;
+}
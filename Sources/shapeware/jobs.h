@@ -0,0 +1,134 @@
+/**
+ * @file jobs.h
+ * @brief Job system shared by all parallel code paths: a work-stealing thread pool with parallel
+ * for, jobs with dependencies that double as futures, per-worker scratch memory and SDF stacks.
+ * Hosts with their own scheduler can plug it in through `sw_jobs_backend_t` instead.
+ *
+ * Every function taking a `sw_jobs_t *` accepts `NULL` and runs serially on the calling thread.
+ *
+ * Entry points that evaluate the SDF over a grid take a context. Mesh post processing (welding,
+ * simplification, cache and fetch optimization, meshlets) does not: each of those is a greedy pass
+ * where every step depends on the previous one, and none of them evaluates the SDF. The ray
+ * marching helpers trace a single ray with a caller provided stack, parallelize over rays with
+ * `sw_jobs_parallel_for` and `sw_jobs_sdf_stack` instead.
+ */
+#pragma once
+
+#include "sdf.h"
+
+#include <kinc/threads/semaphore.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <util/arena.h>
+
+#define SW_JOBS_MAX_WORKERS 64
+#define SW_JOBS_MAX_DEPENDENTS 16
+
+typedef struct sw_jobs sw_jobs_t;
+
+/**
+ * @brief Job and range callbacks receive the slot of the executing thread, use it to index
+ * per-worker data. Slots are in `[0, sw_jobs_slot_count(jobs))`.
+ */
+typedef void (*sw_job_func_t)(void *param, int slot);
+typedef void (*sw_jobs_range_func_t)(void *param, int begin, int end, int slot);
+
+/**
+ * @brief Scheduler interface of the host application.
+ */
+typedef struct sw_jobs_backend {
+	void *user;
+	int worker_count;
+	// Run `task(task_param)` asynchronously on one of the host workers
+	void (*submit)(void *user, void (*task)(void *), void *task_param);
+	// Index of the calling host worker in `[0, worker_count)`, `-1` for any other thread
+	int (*worker_index)(void *user);
+} sw_jobs_backend_t;
+
+/**
+ * @brief A job and its future. The storage is owned by the caller and has to stay valid until
+ * `sw_jobs_wait` returned, which must be called exactly once per submitted job.
+ */
+typedef struct sw_job {
+	sw_jobs_t *jobs;
+	sw_job_func_t fn;
+	void *param;
+	int pending; // Unfinished dependencies
+	volatile int done;
+	struct sw_job *dependents[SW_JOBS_MAX_DEPENDENTS];
+	int dependent_count;
+	kinc_semaphore_t finished;
+} sw_job_t;
+
+/**
+ * @brief Start a thread pool.
+ *
+ * @param worker_count Number of threads, `0` uses all hardware threads but one, as the calling
+ * thread takes part while waiting
+ * @param scratch_size Bytes of scratch memory per slot, see `sw_jobs_scratch`
+ * @return sw_jobs_t*
+ */
+sw_jobs_t *sw_jobs_init(int worker_count, size_t scratch_size);
+
+/**
+ * @brief Run on the scheduler of the host. Waiting blocks the calling thread, so nested waits inside
+ * tasks require a host scheduler that tolerates blocked workers.
+ *
+ * @param backend Copied
+ * @param scratch_size
+ * @return sw_jobs_t*
+ */
+sw_jobs_t *sw_jobs_init_backend(const sw_jobs_backend_t *backend, size_t scratch_size);
+void sw_jobs_destroy(sw_jobs_t *jobs);
+
+/**
+ * @brief Number of slots: one per worker plus one shared by all other threads. Only one thread
+ * outside the workers should use a context at a time.
+ */
+int sw_jobs_slot_count(sw_jobs_t *jobs);
+int sw_jobs_current_slot(sw_jobs_t *jobs);
+
+/**
+ * @brief Schedule `fn` once all `deps` have finished.
+ *
+ * @param jobs
+ * @param job Caller owned storage of the job
+ * @param fn
+ * @param param
+ * @param deps Jobs that were submitted before, may be `NULL`
+ * @param dep_count
+ */
+void sw_jobs_submit(sw_jobs_t *jobs, sw_job_t *job, sw_job_func_t fn, void *param, sw_job_t **deps,
+                    int dep_count);
+
+/**
+ * @brief Wait for a job to finish, executing other work in the meantime.
+ */
+void sw_jobs_wait(sw_jobs_t *jobs, sw_job_t *job);
+bool sw_job_done(const sw_job_t *job);
+
+/**
+ * @brief Atomically increment `*p`.
+ *
+ * @return int The value before the increment
+ */
+int sw_jobs_fetch_add(volatile int *p);
+
+/**
+ * @brief Call `fn` on consecutive subranges of `[begin, end)` of at most `grain` elements, in
+ * parallel. Returns once the whole range is processed.
+ */
+void sw_jobs_parallel_for(sw_jobs_t *jobs, int begin, int end, int grain, sw_jobs_range_func_t fn,
+                          void *param);
+
+/**
+ * @brief Scratch arena of a slot, the owner of the slot resets it as needed.
+ *
+ * @return sw_arena_t* `NULL` if the context was created without scratch memory
+ */
+sw_arena_t *sw_jobs_scratch(sw_jobs_t *jobs, int slot);
+
+/**
+ * @brief SDF stack of a slot large enough for `sdf`, kept and only grown across calls.
+ */
+sw_sdf_stack_frame_t *sw_jobs_sdf_stack(sw_jobs_t *jobs, const sw_sdf_t *sdf, int slot);
@@ -88,13 +88,22 @@ static kr_vec3_t sw_vec3_clampv(kr_vec3_t x, kr_vec3_t min_val, kr_vec3_t max_va
 }
 
 static kr_vec3_t sw_dumbround(kr_vec3_t v) {
-	v = kr_vec3_addf(v, 0.5f);
-	return (kr_vec3_t){.x = (float)((int)v.x), .y = (float)((int)v.y), .z = (float)((int)v.z)};
+	// Halves round up, negative values included
+	return (kr_vec3_t){.x = floorf(v.x + 0.5f), .y = floorf(v.y + 0.5f), .z = floorf(v.z + 0.5f)};
 }
 
 static kr_vec3_t sw_vec3_mod(kr_vec3_t x, kr_vec3_t y) {
-	return (kr_vec3_t){
-	    .x = x.x - floorf(x.x / y.x), .y = x.y - floorf(x.y / y.y), .z = x.y - floorf(x.y / y.y)};
+	return (kr_vec3_t){.x = x.x - y.x * floorf(x.x / y.x),
+	                   .y = x.y - y.y * floorf(x.y / y.y),
+	                   .z = x.z - y.z * floorf(x.z / y.z)};
+}
+
+static int sw_mini(int a, int b) {
+	return a < b ? a : b;
+}
+
+static int sw_maxi(int a, int b) {
+	return a > b ? a : b;
 }
 
 static float sw_clampf(float x, float min_val, float max_val) {
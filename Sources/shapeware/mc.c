@@ -5,9 +5,21 @@ http://paulbourke.net/geometry/polygonise/
 
 #include "mc.h"
 #include "mtables.h"
+#include "stats.h"
+#include "trace.h"
 
+#include <assert.h>
+#include <kinc/threads/atomic.h>
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
+#include <util/hash.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+// Blocks of layers that resample the planes at their start are kept at least this long, which
+// bounds the extra SDF evaluations to one plane in this many
+#define SW_MC_MIN_BLOCK_LAYERS 8
 
 typedef struct gridcell {
 	kr_vec3_t p[8];
@@ -19,6 +31,18 @@ typedef struct gridcell_color {
 	kr_vec4_t val[8];
 } gridcell_color_t;
 
+typedef struct gridcell_normal {
+	kr_vec3_t p[8];
+	kr_vec4_t val[8];
+	kr_vec3_t n[8]; // Gradients, not normalized
+} gridcell_normal_t;
+
+// Corners of the edges in the order of the edge table, from the lower to the higher lattice point.
+// Every edge is interpolated in this direction, so the cells sharing an edge produce bit identical
+// vertices that weld exactly
+static const int edge_corners[12][2] = {{0, 1}, {1, 2}, {3, 2}, {0, 3}, {4, 5}, {5, 6},
+                                        {7, 6}, {4, 7}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
 static bool kr_vec3_lt(const kr_vec3_t left, const kr_vec3_t right) {
 	if (left.x < right.x)
 		return true;
@@ -38,10 +62,14 @@ static bool kr_vec3_lt(const kr_vec3_t left, const kr_vec3_t right) {
 	return false;
 }
 
+static float interpolation_factor(float isolevel, float valp1, float valp2) {
+	float t = (fabsf(valp2 - valp1) > 1e-5f) ? (isolevel - valp1) / (valp2 - valp1) : 0.5f;
+	return fmaxf(fminf(t, 1.0f), 0.0f);
+}
+
 static kr_vec3_t vertex_interpolate(float isolevel, kr_vec3_t p1, kr_vec3_t p2, float valp1,
                                     float valp2) {
-	float t = (fabsf(valp2 - valp1) > 1e-5f) ? (isolevel - valp1) / (valp2 - valp1) : 0.5f;
-	t = fmaxf(fminf(t, 1.0f), 0.0f);
+	float t = interpolation_factor(isolevel, valp1, valp2);
 	return kr_vec3_addv(p1, kr_vec3_mult(kr_vec3_subv(p2, p1), t));
 }
 
@@ -71,36 +99,24 @@ static void polygonise(gridcell_t grid, float isolevel, sw_add_triangle_func_t t
 	if (grid.val[7] < isolevel) cubeindex |= 128;
 
 	/* Cube is entirely in/out of the surface */
-	if (edge_table[cubeindex] == 0) return;
+	SW_STATS_INC(mc_cells);
+	if (edge_table[cubeindex] == 0) {
+		SW_STATS_INC(mc_cells_empty);
+		return;
+	}
+	SW_STATS_INC(mc_cells_active);
 
 	/* Find the vertices where the surface intersects the cube */
-	if (edge_table[cubeindex] & 1)
-		vertlist[0] = vertex_interpolate(isolevel, grid.p[0], grid.p[1], grid.val[0], grid.val[1]);
-	if (edge_table[cubeindex] & 2)
-		vertlist[1] = vertex_interpolate(isolevel, grid.p[1], grid.p[2], grid.val[1], grid.val[2]);
-	if (edge_table[cubeindex] & 4)
-		vertlist[2] = vertex_interpolate(isolevel, grid.p[2], grid.p[3], grid.val[2], grid.val[3]);
-	if (edge_table[cubeindex] & 8)
-		vertlist[3] = vertex_interpolate(isolevel, grid.p[3], grid.p[0], grid.val[3], grid.val[0]);
-	if (edge_table[cubeindex] & 16)
-		vertlist[4] = vertex_interpolate(isolevel, grid.p[4], grid.p[5], grid.val[4], grid.val[5]);
-	if (edge_table[cubeindex] & 32)
-		vertlist[5] = vertex_interpolate(isolevel, grid.p[5], grid.p[6], grid.val[5], grid.val[6]);
-	if (edge_table[cubeindex] & 64)
-		vertlist[6] = vertex_interpolate(isolevel, grid.p[6], grid.p[7], grid.val[6], grid.val[7]);
-	if (edge_table[cubeindex] & 128)
-		vertlist[7] = vertex_interpolate(isolevel, grid.p[7], grid.p[4], grid.val[7], grid.val[4]);
-	if (edge_table[cubeindex] & 256)
-		vertlist[8] = vertex_interpolate(isolevel, grid.p[0], grid.p[4], grid.val[0], grid.val[4]);
-	if (edge_table[cubeindex] & 512)
-		vertlist[9] = vertex_interpolate(isolevel, grid.p[1], grid.p[5], grid.val[1], grid.val[5]);
-	if (edge_table[cubeindex] & 1024)
-		vertlist[10] = vertex_interpolate(isolevel, grid.p[2], grid.p[6], grid.val[2], grid.val[6]);
-	if (edge_table[cubeindex] & 2048)
-		vertlist[11] = vertex_interpolate(isolevel, grid.p[3], grid.p[7], grid.val[3], grid.val[7]);
+	for (int e = 0; e < 12; ++e) {
+		if ((edge_table[cubeindex] & (1 << e)) == 0) continue;
+		int a = edge_corners[e][0];
+		int b = edge_corners[e][1];
+		vertlist[e] = vertex_interpolate(isolevel, grid.p[a], grid.p[b], grid.val[a], grid.val[b]);
+	}
 
 	/* Create the triangle */
 	for (int i = 0; tri_table[cubeindex][i] != -1; i += 3) {
+		SW_STATS_INC(triangles);
 		triangle_cb(t_param, vertlist[tri_table[cubeindex][i]],
 		            vertlist[tri_table[cubeindex][i + 1]], vertlist[tri_table[cubeindex][i + 2]]);
 	}
@@ -125,96 +141,27 @@ static void polygonise_color(gridcell_color_t grid, float isolevel,
 	if (grid.val[7].w < isolevel) cubeindex |= 128;
 
 	/* Cube is entirely in/out of the surface */
-	if (edge_table[cubeindex] == 0) return;
+	SW_STATS_INC(mc_cells);
+	if (edge_table[cubeindex] == 0) {
+		SW_STATS_INC(mc_cells_empty);
+		return;
+	}
+	SW_STATS_INC(mc_cells_active);
 
 	/* Find the vertices where the surface intersects the cube */
-	if (edge_table[cubeindex] & 1) {
-		vertlist[0] =
-		    vertex_interpolate(isolevel, grid.p[0], grid.p[1], grid.val[0].w, grid.val[1].w);
-		colorlist[0] = (grid.val[0].w < grid.val[1].w)
-		                   ? (kr_vec3_t){grid.val[0].x, grid.val[0].y, grid.val[0].z}
-		                   : (kr_vec3_t){grid.val[1].x, grid.val[1].y, grid.val[1].z};
-	}
-	if (edge_table[cubeindex] & 2) {
-		vertlist[1] =
-		    vertex_interpolate(isolevel, grid.p[1], grid.p[2], grid.val[1].w, grid.val[2].w);
-		colorlist[1] = (grid.val[1].w < grid.val[2].w)
-		                   ? (kr_vec3_t){grid.val[1].x, grid.val[1].y, grid.val[1].z}
-		                   : (kr_vec3_t){grid.val[2].x, grid.val[2].y, grid.val[2].z};
-	}
-	if (edge_table[cubeindex] & 4) {
-		vertlist[2] =
-		    vertex_interpolate(isolevel, grid.p[2], grid.p[3], grid.val[2].w, grid.val[3].w);
-		colorlist[2] = (grid.val[2].w < grid.val[3].w)
-		                   ? (kr_vec3_t){grid.val[2].x, grid.val[2].y, grid.val[2].z}
-		                   : (kr_vec3_t){grid.val[3].x, grid.val[3].y, grid.val[3].z};
-	}
-	if (edge_table[cubeindex] & 8) {
-		vertlist[3] =
-		    vertex_interpolate(isolevel, grid.p[3], grid.p[0], grid.val[3].w, grid.val[0].w);
-		colorlist[3] = (grid.val[3].w < grid.val[0].w)
-		                   ? (kr_vec3_t){grid.val[3].x, grid.val[3].y, grid.val[3].z}
-		                   : (kr_vec3_t){grid.val[0].x, grid.val[0].y, grid.val[0].z};
-	}
-	if (edge_table[cubeindex] & 16) {
-		vertlist[4] =
-		    vertex_interpolate(isolevel, grid.p[4], grid.p[5], grid.val[4].w, grid.val[5].w);
-		colorlist[4] = (grid.val[4].w < grid.val[5].w)
-		                   ? (kr_vec3_t){grid.val[4].x, grid.val[4].y, grid.val[4].z}
-		                   : (kr_vec3_t){grid.val[5].x, grid.val[5].y, grid.val[5].z};
-	}
-	if (edge_table[cubeindex] & 32) {
-		vertlist[5] =
-		    vertex_interpolate(isolevel, grid.p[5], grid.p[6], grid.val[5].w, grid.val[6].w);
-		colorlist[5] = (grid.val[5].w < grid.val[6].w)
-		                   ? (kr_vec3_t){grid.val[5].x, grid.val[5].y, grid.val[5].z}
-		                   : (kr_vec3_t){grid.val[6].x, grid.val[6].y, grid.val[6].z};
-	}
-	if (edge_table[cubeindex] & 64) {
-		vertlist[6] =
-		    vertex_interpolate(isolevel, grid.p[6], grid.p[7], grid.val[6].w, grid.val[7].w);
-		colorlist[6] = (grid.val[6].w < grid.val[7].w)
-		                   ? (kr_vec3_t){grid.val[6].x, grid.val[6].y, grid.val[6].z}
-		                   : (kr_vec3_t){grid.val[7].x, grid.val[7].y, grid.val[7].z};
-	}
-	if (edge_table[cubeindex] & 128) {
-		vertlist[7] =
-		    vertex_interpolate(isolevel, grid.p[7], grid.p[4], grid.val[7].w, grid.val[4].w);
-		colorlist[7] = (grid.val[7].w < grid.val[4].w)
-		                   ? (kr_vec3_t){grid.val[7].x, grid.val[7].y, grid.val[7].z}
-		                   : (kr_vec3_t){grid.val[4].x, grid.val[4].y, grid.val[4].z};
-	}
-	if (edge_table[cubeindex] & 256) {
-		vertlist[8] =
-		    vertex_interpolate(isolevel, grid.p[0], grid.p[4], grid.val[0].w, grid.val[4].w);
-		colorlist[8] = (grid.val[0].w < grid.val[4].w)
-		                   ? (kr_vec3_t){grid.val[0].x, grid.val[0].y, grid.val[0].z}
-		                   : (kr_vec3_t){grid.val[4].x, grid.val[4].y, grid.val[4].z};
-	}
-	if (edge_table[cubeindex] & 512) {
-		vertlist[9] =
-		    vertex_interpolate(isolevel, grid.p[1], grid.p[5], grid.val[1].w, grid.val[5].w);
-		colorlist[9] = (grid.val[1].w < grid.val[5].w)
-		                   ? (kr_vec3_t){grid.val[1].x, grid.val[1].y, grid.val[1].z}
-		                   : (kr_vec3_t){grid.val[5].x, grid.val[5].y, grid.val[5].z};
-	}
-	if (edge_table[cubeindex] & 1024) {
-		vertlist[10] =
-		    vertex_interpolate(isolevel, grid.p[2], grid.p[6], grid.val[2].w, grid.val[6].w);
-		colorlist[10] = (grid.val[2].w < grid.val[6].w)
-		                    ? (kr_vec3_t){grid.val[2].x, grid.val[2].y, grid.val[2].z}
-		                    : (kr_vec3_t){grid.val[6].x, grid.val[6].y, grid.val[6].z};
-	}
-	if (edge_table[cubeindex] & 2048) {
-		vertlist[11] =
-		    vertex_interpolate(isolevel, grid.p[3], grid.p[7], grid.val[3].w, grid.val[7].w);
-		colorlist[11] = (grid.val[3].w < grid.val[7].w)
-		                    ? (kr_vec3_t){grid.val[3].x, grid.val[3].y, grid.val[3].z}
-		                    : (kr_vec3_t){grid.val[7].x, grid.val[7].y, grid.val[7].z};
+	for (int e = 0; e < 12; ++e) {
+		if ((edge_table[cubeindex] & (1 << e)) == 0) continue;
+		int a = edge_corners[e][0];
+		int b = edge_corners[e][1];
+		kr_vec4_t va = grid.val[a];
+		kr_vec4_t vb = grid.val[b];
+		vertlist[e] = vertex_interpolate(isolevel, grid.p[a], grid.p[b], va.w, vb.w);
+		colorlist[e] = va.w < vb.w ? (kr_vec3_t){va.x, va.y, va.z} : (kr_vec3_t){vb.x, vb.y, vb.z};
 	}
 
 	/* Create the triangle */
 	for (int i = 0; tri_table[cubeindex][i] != -1; i += 3) {
+		SW_STATS_INC(triangles);
 		triangle_cb(t_param, vertlist[tri_table[cubeindex][i]],
 		            vertlist[tri_table[cubeindex][i + 1]], vertlist[tri_table[cubeindex][i + 2]],
 		            colorlist[tri_table[cubeindex][i]], colorlist[tri_table[cubeindex][i + 1]],
@@ -222,53 +169,112 @@ static void polygonise_color(gridcell_color_t grid, float isolevel,
 	}
 }
 
-static void set_cube_points(kr_vec3_t o, float s, kr_vec3_t *p) {
-	p[0] = (kr_vec3_t){o.x, o.y, o.z};
-	p[1] = (kr_vec3_t){o.x + s, o.y, o.z};
-	p[2] = (kr_vec3_t){o.x + s, o.y, o.z + s};
-	p[3] = (kr_vec3_t){o.x, o.y, o.z + s};
-	p[4] = (kr_vec3_t){o.x, o.y + s, o.z};
-	p[5] = (kr_vec3_t){o.x + s, o.y + s, o.z};
-	p[6] = (kr_vec3_t){o.x + s, o.y + s, o.z + s};
-	p[7] = (kr_vec3_t){o.x, o.y + s, o.z + s};
+// Like `polygonise_color`, normals are interpolated along the edges like the positions. The caller
+// classifies the corners into `cubeindex` first to skip the gradients of cells without surface
+static void polygonise_normal(const gridcell_normal_t *grid, uint8_t cubeindex, float isolevel,
+                              sw_add_triangle_normal_func_t triangle_cb, void *t_param) {
+	kr_vec3_t vertlist[12];
+	kr_vec3_t normallist[12];
+	kr_vec3_t colorlist[12];
+	SW_STATS_INC(mc_cells);
+	if (edge_table[cubeindex] == 0) {
+		SW_STATS_INC(mc_cells_empty);
+		return;
+	}
+	SW_STATS_INC(mc_cells_active);
+
+	for (int e = 0; e < 12; ++e) {
+		if ((edge_table[cubeindex] & (1 << e)) == 0) continue;
+		int a = edge_corners[e][0];
+		int b = edge_corners[e][1];
+		kr_vec4_t va = grid->val[a];
+		kr_vec4_t vb = grid->val[b];
+		vertlist[e] = vertex_interpolate(isolevel, grid->p[a], grid->p[b], va.w, vb.w);
+		float t = interpolation_factor(isolevel, va.w, vb.w);
+		kr_vec3_t n =
+		    kr_vec3_addv(grid->n[a], kr_vec3_mult(kr_vec3_subv(grid->n[b], grid->n[a]), t));
+		float len = kr_vec3_length(n);
+		normallist[e] = len > 0.0f ? kr_vec3_mult(n, 1.0f / len) : n;
+		colorlist[e] = va.w < vb.w ? (kr_vec3_t){va.x, va.y, va.z} : (kr_vec3_t){vb.x, vb.y, vb.z};
+	}
+
+	for (int i = 0; tri_table[cubeindex][i] != -1; i += 3) {
+		SW_STATS_INC(triangles);
+		int a = tri_table[cubeindex][i];
+		int b = tri_table[cubeindex][i + 1];
+		int c = tri_table[cubeindex][i + 2];
+		triangle_cb(t_param, vertlist[a], vertlist[b], vertlist[c], normallist[a], normallist[b],
+		            normallist[c], colorlist[a], colorlist[b], colorlist[c]);
+	}
 }
 
-static void comp_gridcell(gridcell_t *c, sw_density_func_t f, void *p, kr_vec3_t o, float s) {
-	set_cube_points(o, s, c->p);
-	for (int i = 0; i < 8; ++i) c->val[i] = f(p, c->p[i]);
+// Lattice points are computed from their indices, every cell sharing a point samples the exact same
+// position and any subset of layers can be processed independently
+static kr_vec3_t lattice_point(kr_vec3_t bnl, float s, int x, int y, int z) {
+	return (kr_vec3_t){bnl.x + x * s, bnl.y + y * s, bnl.z + z * s};
 }
 
-static void comp_gridcell_color(gridcell_color_t *c, sw_density_color_func_t f, void *p,
-                                kr_vec3_t o, float s) {
-	set_cube_points(o, s, c->p);
-	for (int i = 0; i < 8; ++i) c->val[i] = f(p, c->p[i]);
+// Corner offsets in the order of `set_cube_points`
+static const int cube_corners[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1},
+                                       {0, 1, 0}, {1, 1, 0}, {1, 1, 1}, {0, 1, 1}};
+
+static void set_cube_points(kr_vec3_t bnl, float s, int x, int y, int z, kr_vec3_t *p) {
+	p[0] = lattice_point(bnl, s, x, y, z);
+	p[1] = lattice_point(bnl, s, x + 1, y, z);
+	p[2] = lattice_point(bnl, s, x + 1, y, z + 1);
+	p[3] = lattice_point(bnl, s, x, y, z + 1);
+	p[4] = lattice_point(bnl, s, x, y + 1, z);
+	p[5] = lattice_point(bnl, s, x + 1, y + 1, z);
+	p[6] = lattice_point(bnl, s, x + 1, y + 1, z + 1);
+	p[7] = lattice_point(bnl, s, x, y + 1, z + 1);
 }
 
-void sw_mc_process_custom_chunk(const sw_mc_custom_t *init) {
+// Cells from `x0`, `y0` to the end of the chunk in layer `zi`
+static void sw_mc_custom_layer(const sw_mc_custom_t *init, int x0, int y0, int zi) {
 	float step = (init->chunk.halfsidelen * 2.0f) / init->chunk.steps;
 	kr_vec3_t bnl = kr_vec3_addf(init->chunk.origin, -init->chunk.halfsidelen);
-	float z = bnl.z;
-	for (int zi = 0; zi < init->chunk.steps; ++zi) {
-		float y = bnl.y;
-		for (int yi = 0; yi < init->chunk.steps; ++yi) {
-			float x = bnl.x;
-			for (int xi = 0; xi < init->chunk.steps; ++xi) {
-				gridcell_t c;
-				comp_gridcell(&c, init->density, init->density_param, (kr_vec3_t){x, y, z}, step);
-				polygonise(c, init->chunk.iso_level, init->add_tris, init->add_tris_param);
-				x += step;
-			}
-			y += step;
+	for (int yi = y0; yi < init->chunk.steps; ++yi) {
+		for (int xi = x0; xi < init->chunk.steps; ++xi) {
+			gridcell_t c;
+			set_cube_points(bnl, step, xi, yi, zi, c.p);
+			for (int i = 0; i < 8; ++i) c.val[i] = init->density(init->density_param, c.p[i]);
+			polygonise(c, init->chunk.iso_level, init->add_tris, init->add_tris_param);
 		}
-		z += step;
 	}
 }
 
+static void sw_mc_custom_color_layer(const sw_mc_custom_color_t *init, int x0, int y0, int zi) {
+	float step = (init->chunk.halfsidelen * 2.0f) / init->chunk.steps;
+	kr_vec3_t bnl = kr_vec3_addf(init->chunk.origin, -init->chunk.halfsidelen);
+	for (int yi = y0; yi < init->chunk.steps; ++yi) {
+		for (int xi = x0; xi < init->chunk.steps; ++xi) {
+			gridcell_color_t c;
+			set_cube_points(bnl, step, xi, yi, zi, c.p);
+			for (int i = 0; i < 8; ++i) c.val[i] = init->density(init->density_param, c.p[i]);
+			polygonise_color(c, init->chunk.iso_level, init->add_tris, init->add_tris_param);
+		}
+	}
+}
+
+void sw_mc_process_custom_chunk(const sw_mc_custom_t *init) {
+	sw_trace_scope_t trace = sw_trace_begin("mc_block");
+	for (int zi = 0; zi < init->chunk.steps; ++zi) sw_mc_custom_layer(init, 0, 0, zi);
+	sw_trace_end(&trace, 0);
+}
+
 typedef struct sdf_arg {
 	const sw_sdf_t *sdf;
 	sw_sdf_stack_frame_t *stack;
 } sdf_arg_t;
 
+uint64_t sw_mc_chunk_hash(const sw_mc_chunk_t *chunk, uint64_t seed) {
+	// Hash the fields one by one, padding bytes are not guaranteed to be zero
+	uint64_t h = sw_hash_bytes(seed, &chunk->origin, sizeof(chunk->origin));
+	h = sw_hash_bytes(h, &chunk->halfsidelen, sizeof(chunk->halfsidelen));
+	h = sw_hash_int(h, chunk->steps);
+	return sw_hash_bytes(h, &chunk->iso_level, sizeof(chunk->iso_level));
+}
+
 static float sdf_compute_wrapper(void *a, kr_vec3_t p) {
 	sdf_arg_t *arg = (sdf_arg_t *)a;
 	return sw_sdf_compute(arg->sdf, p, arg->stack);
@@ -279,47 +285,738 @@ static kr_vec4_t sdf_compute_wrapper_color(void *a, kr_vec3_t p) {
 	return sw_sdf_compute_color(arg->sdf, p, arg->stack);
 }
 
+// Triangles of one z layer recorded by a worker, replayed in layer order for a deterministic output
+typedef struct sw_mc_layer {
+	kr_vec3_t *data;
+	int count;
+	int cap;
+} sw_mc_layer_t;
+
+typedef struct sw_mc_parallel {
+	const sw_sdf_t *sdf;
+	const sw_mc_chunk_t *chunk;
+	sw_jobs_t *jobs;
+	bool color;
+	int first[3]; // First cell per axis, the chunk is extracted from there to its end
+	sw_mc_layer_t *layers;
+} sw_mc_parallel_t;
+
+static void sw_mc_record(sw_mc_layer_t *l, const kr_vec3_t *v, int n) {
+	if (l->count + n > l->cap) {
+		l->cap = l->cap == 0 ? 384 : l->cap * 2;
+		l->data = (kr_vec3_t *)sw_realloc(l->data, l->cap * sizeof(kr_vec3_t));
+		assert(l->data != NULL);
+	}
+	for (int i = 0; i < n; ++i) l->data[l->count++] = v[i];
+}
+
+static void sw_mc_record_triangle(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c) {
+	sw_mc_record((sw_mc_layer_t *)param, (kr_vec3_t[]){a, b, c}, 3);
+}
+
+static void sw_mc_record_triangle_color(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c,
+                                        kr_vec3_t ca, kr_vec3_t cb, kr_vec3_t cc) {
+	sw_mc_record((sw_mc_layer_t *)param, (kr_vec3_t[]){a, b, c, ca, cb, cc}, 6);
+}
+
+static void sw_mc_record_triangle_normal(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c,
+                                         kr_vec3_t na, kr_vec3_t nb, kr_vec3_t nc, kr_vec3_t ca,
+                                         kr_vec3_t cb, kr_vec3_t cc) {
+	sw_mc_record((sw_mc_layer_t *)param, (kr_vec3_t[]){a, b, c, na, nb, nc, ca, cb, cc}, 9);
+}
+
+static void sw_mc_record_layer(sw_mc_parallel_t *p, sdf_arg_t *a, int zi) {
+	if (p->color)
+		sw_mc_custom_color_layer(&(sw_mc_custom_color_t){.add_tris = sw_mc_record_triangle_color,
+		                                                 .add_tris_param = &p->layers[zi],
+		                                                 .chunk = *p->chunk,
+		                                                 .density = sdf_compute_wrapper_color,
+		                                                 .density_param = a},
+		                         p->first[0], p->first[1], zi);
+	else
+		sw_mc_custom_layer(&(sw_mc_custom_t){.add_tris = sw_mc_record_triangle,
+		                                     .add_tris_param = &p->layers[zi],
+		                                     .chunk = *p->chunk,
+		                                     .density = sdf_compute_wrapper,
+		                                     .density_param = a},
+		                   p->first[0], p->first[1], zi);
+}
+
+static void sw_mc_parallel_layers(void *param, int begin, int end, int slot) {
+	sw_mc_parallel_t *p = (sw_mc_parallel_t *)param;
+	sw_trace_scope_t trace = sw_trace_begin("mc_block");
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sdf_arg_t a = (sdf_arg_t){.sdf = p->sdf};
+	a.stack = p->jobs != NULL
+	              ? sw_jobs_sdf_stack(p->jobs, p->sdf, slot)
+	              : (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(p->sdf));
+	for (int zi = begin; zi < end; ++zi) sw_mc_record_layer(p, &a, zi);
+	sw_scratch_end(mark);
+	sw_trace_end(&trace, begin);
+}
+
+static void sw_mc_alloc_layers(sw_mc_parallel_t *p) {
+	int steps = p->chunk->steps;
+	p->layers = (sw_mc_layer_t *)sw_malloc(steps * sizeof(sw_mc_layer_t));
+	assert(p->layers != NULL);
+	memset(p->layers, 0, steps * sizeof(sw_mc_layer_t));
+}
+
+// Emit the recorded triangles in layer order and free them, only frees if both callbacks are `NULL`
+static void sw_mc_replay_layers(sw_mc_parallel_t *p, sw_add_triangle_func_t f,
+                                sw_add_triangle_color_func_t fc, void *f_param) {
+	int steps = p->chunk->steps;
+	sw_trace_scope_t trace = sw_trace_begin("mc_replay");
+	for (int zi = 0; zi < steps; ++zi) {
+		const kr_vec3_t *v = p->layers[zi].data;
+		if (fc != NULL)
+			for (int i = 0; i < p->layers[zi].count; i += 6)
+				fc(f_param, v[i], v[i + 1], v[i + 2], v[i + 3], v[i + 4], v[i + 5]);
+		else if (f != NULL)
+			for (int i = 0; i < p->layers[zi].count; i += 3) f(f_param, v[i], v[i + 1], v[i + 2]);
+		sw_free(p->layers[zi].data);
+	}
+	sw_free(p->layers);
+	p->layers = NULL;
+	sw_trace_end(&trace, steps);
+}
+
+static void sw_mc_process_sdf_parallel(sw_mc_parallel_t *p, sw_add_triangle_func_t f,
+                                       sw_add_triangle_color_func_t fc, void *f_param) {
+	sw_mc_alloc_layers(p);
+	sw_jobs_parallel_for(p->jobs, 0, p->chunk->steps, 1, sw_mc_parallel_layers, p);
+	sw_mc_replay_layers(p, f, fc, f_param);
+}
+
 void sw_mc_process_sdf_chunk(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
-                             sw_add_triangle_func_t f, void *f_param) {
-	sw_sdf_stack_frame_t *stack = sw_sdf_stack_init(sdf);
-	sdf_arg_t a = (sdf_arg_t){.sdf = sdf, .stack = stack};
+                             sw_add_triangle_func_t f, void *f_param, sw_jobs_t *jobs) {
+	if (jobs != NULL) {
+		sw_mc_parallel_t p = (sw_mc_parallel_t){.sdf = sdf, .chunk = chunk, .jobs = jobs};
+		sw_mc_process_sdf_parallel(&p, f, NULL, f_param);
+		return;
+	}
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sdf_arg_t a = (sdf_arg_t){
+	    .sdf = sdf, .stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf))};
 	sw_mc_process_custom_chunk(&(sw_mc_custom_t){.add_tris = f,
 	                                             .add_tris_param = f_param,
 	                                             .chunk = *chunk,
 	                                             .density = sdf_compute_wrapper,
 	                                             .density_param = &a});
-	sw_sdf_stack_destroy(stack);
+	sw_scratch_end(mark);
 }
 
 void sw_mc_process_custom_chunk_color(const sw_mc_custom_color_t *init) {
-	float step = (init->chunk.halfsidelen * 2.0f) / init->chunk.steps;
-	kr_vec3_t bnl = kr_vec3_addf(init->chunk.origin, -init->chunk.halfsidelen);
-	float z = bnl.z;
-	for (int zi = 0; zi < init->chunk.steps; ++zi) {
-		float y = bnl.y;
-		for (int yi = 0; yi < init->chunk.steps; ++yi) {
-			float x = bnl.x;
-			for (int xi = 0; xi < init->chunk.steps; ++xi) {
-				gridcell_color_t c;
-				comp_gridcell_color(&c, init->density, init->density_param, (kr_vec3_t){x, y, z},
-				                    step);
-				polygonise_color(c, init->chunk.iso_level, init->add_tris, init->add_tris_param);
-				x += step;
-			}
-			y += step;
-		}
-		z += step;
-	}
+	sw_trace_scope_t trace = sw_trace_begin("mc_block");
+	for (int zi = 0; zi < init->chunk.steps; ++zi) sw_mc_custom_color_layer(init, 0, 0, zi);
+	sw_trace_end(&trace, 0);
 }
 
 void sw_mc_process_sdf_chunk_color(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
-                                   sw_add_triangle_color_func_t f, void *f_param) {
-	sw_sdf_stack_frame_t *stack = sw_sdf_stack_init(sdf);
-	sdf_arg_t a = (sdf_arg_t){.sdf = sdf, .stack = stack};
+                                   sw_add_triangle_color_func_t f, void *f_param,
+                                   sw_jobs_t *jobs) {
+	if (jobs != NULL) {
+		sw_mc_parallel_t p =
+		    (sw_mc_parallel_t){.sdf = sdf, .chunk = chunk, .jobs = jobs, .color = true};
+		sw_mc_process_sdf_parallel(&p, NULL, f, f_param);
+		return;
+	}
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sdf_arg_t a = (sdf_arg_t){
+	    .sdf = sdf, .stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf))};
 	sw_mc_process_custom_chunk_color(&(sw_mc_custom_color_t){.add_tris = f,
 	                                                         .add_tris_param = f_param,
 	                                                         .chunk = *chunk,
 	                                                         .density = sdf_compute_wrapper_color,
 	                                                         .density_param = &a});
-	sw_sdf_stack_destroy(stack);
+	sw_scratch_end(mark);
+}
+
+// Symmetric extraction
+
+typedef struct sw_mc_mirror {
+	uint32_t flags;
+	float plane[3]; // Coordinates of the planes, equal to the chunk origin
+	float snap;     // Vertices closer to a plane are moved onto it
+} sw_mc_mirror_t;
+
+static kr_vec3_t sw_mc_mirror_vertex(const sw_mc_mirror_t *m, kr_vec3_t v, uint32_t mask) {
+	float *c[3] = {&v.x, &v.y, &v.z};
+	for (int a = 0; a < 3; ++a) {
+		if ((m->flags & (1u << a)) == 0) continue;
+		float d = *c[a] - m->plane[a];
+		// Snapped vertices are equal on both sides, `-0.0f` would not weld with `0.0f`
+		if (fabsf(d) <= m->snap)
+			*c[a] = m->plane[a];
+		else if ((mask & (1u << a)) != 0)
+			*c[a] = m->plane[a] - d;
+	}
+	return v;
+}
+
+static bool sw_mc_on_plane(const sw_mc_mirror_t *m, const kr_vec3_t *v, int axis) {
+	const float *c[3] = {&v->x, &v->y, &v->z};
+	return *c[axis] == m->plane[axis];
+}
+
+uint32_t sw_mc_process_sdf_chunk_symmetric(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                           sw_add_triangle_color_func_t f, void *f_param,
+                                           sw_jobs_t *jobs) {
+	assert(sdf != NULL && chunk != NULL && chunk->steps > 0 && f != NULL);
+	uint32_t flags = sw_sdf_mirror_flags(sdf);
+	// The planes have to lie on the lattice, in the middle of the chunk
+	if (chunk->steps % 2 != 0) flags = 0;
+	const float origin[3] = {chunk->origin.x, chunk->origin.y, chunk->origin.z};
+	for (int a = 0; a < 3; ++a) {
+		if (origin[a] != 0.0f) flags &= ~(1u << a);
+	}
+	if (flags == 0) {
+		sw_mc_process_sdf_chunk_color(sdf, chunk, f, f_param, jobs);
+		return 0;
+	}
+
+	sw_mc_parallel_t p = (sw_mc_parallel_t){.sdf = sdf, .chunk = chunk, .jobs = jobs, .color = true};
+	for (int a = 0; a < 3; ++a) p.first[a] = (flags & (1u << a)) != 0 ? chunk->steps / 2 : 0;
+	sw_mc_alloc_layers(&p);
+	sw_jobs_parallel_for(jobs, p.first[2], chunk->steps, 1, sw_mc_parallel_layers, &p);
+
+	sw_mc_mirror_t m = {.flags = flags,
+	                    .plane = {origin[0], origin[1], origin[2]},
+	                    .snap = chunk->halfsidelen * 2.0f / chunk->steps * 1e-3f};
+	sw_trace_scope_t trace = sw_trace_begin("mc_mirror");
+	// Every combination of the mirrored axes, starting with the sampled side
+	for (uint32_t mask = 0; mask < 8; ++mask) {
+		if ((mask & ~flags) != 0) continue;
+		// Mirroring an odd number of axes turns the triangles inside out
+		bool flip = ((mask & 1u) ^ ((mask >> 1) & 1u) ^ ((mask >> 2) & 1u)) != 0;
+		for (int zi = p.first[2]; zi < chunk->steps; ++zi) {
+			const kr_vec3_t *v = p.layers[zi].data;
+			for (int i = 0; i < p.layers[zi].count; i += 6) {
+				kr_vec3_t a = sw_mc_mirror_vertex(&m, v[i], mask);
+				kr_vec3_t b = sw_mc_mirror_vertex(&m, v[i + 1], mask);
+				kr_vec3_t c = sw_mc_mirror_vertex(&m, v[i + 2], mask);
+				// Triangles within a plane are their own mirror image
+				bool skip = false;
+				for (int axis = 0; axis < 3 && !skip; ++axis)
+					skip = (mask & (1u << axis)) != 0 && sw_mc_on_plane(&m, &a, axis) &&
+					       sw_mc_on_plane(&m, &b, axis) && sw_mc_on_plane(&m, &c, axis);
+				if (skip) continue;
+				if (flip)
+					f(f_param, a, c, b, v[i + 3], v[i + 5], v[i + 4]);
+				else
+					f(f_param, a, b, c, v[i + 3], v[i + 4], v[i + 5]);
+			}
+		}
+	}
+	sw_trace_end(&trace, (int)flags);
+	sw_mc_replay_layers(&p, NULL, NULL, NULL);
+	return flags;
+}
+
+// Asynchronous extraction
+
+struct sw_mc_task {
+	sw_mc_parallel_t p;
+	sw_mc_chunk_t chunk;
+	sw_add_triangle_color_func_t f;
+	void *f_param;
+	sw_mc_task_done_func_t done;
+	void *done_param;
+	volatile int next_layer;
+	volatile int layers_done;
+	volatile int cancelled;
+	bool completed;
+	volatile int done_slot; // Slot running `done`, `-1` otherwise
+	int worker_count;
+	sw_job_t *workers;
+	sw_job_t finish;
+};
+
+static void sw_mc_task_layers(void *param, int slot) {
+	sw_mc_task_t *t = (sw_mc_task_t *)param;
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sdf_arg_t a = (sdf_arg_t){.sdf = t->p.sdf};
+	a.stack = t->p.jobs != NULL
+	              ? sw_jobs_sdf_stack(t->p.jobs, t->p.sdf, slot)
+	              : (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(t->p.sdf));
+	// Layers are claimed one by one, so a cancellation takes effect after at most one layer
+	while (!t->cancelled) {
+		int zi = sw_jobs_fetch_add(&t->next_layer);
+		if (zi >= t->chunk.steps) break;
+		sw_trace_scope_t trace = sw_trace_begin("mc_block");
+		sw_mc_record_layer(&t->p, &a, zi);
+		sw_trace_end(&trace, zi);
+		sw_jobs_fetch_add(&t->layers_done);
+	}
+	sw_scratch_end(mark);
+}
+
+static void sw_mc_task_finish(void *param, int slot) {
+	sw_mc_task_t *t = (sw_mc_task_t *)param;
+	t->completed = !t->cancelled;
+	if (t->completed)
+		sw_mc_replay_layers(&t->p, NULL, t->f, t->f_param);
+	else
+		sw_mc_replay_layers(&t->p, NULL, NULL, NULL);
+	if (t->done != NULL) {
+		t->done_slot = slot;
+		t->done(t->done_param, t, t->completed);
+		t->done_slot = -1;
+	}
+}
+
+sw_mc_task_t *sw_mc_submit(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                           sw_add_triangle_color_func_t f, void *f_param,
+                           sw_mc_task_done_func_t done, void *done_param, sw_jobs_t *jobs) {
+	assert(sdf != NULL && chunk != NULL && chunk->steps > 0 && f != NULL);
+	sw_mc_task_t *t = (sw_mc_task_t *)sw_malloc(sizeof(sw_mc_task_t));
+	assert(t != NULL);
+	*t = (sw_mc_task_t){.chunk = *chunk,
+	                    .f = f,
+	                    .f_param = f_param,
+	                    .done = done,
+	                    .done_param = done_param,
+	                    .done_slot = -1};
+	t->p = (sw_mc_parallel_t){.sdf = sdf, .chunk = &t->chunk, .jobs = jobs, .color = true};
+	sw_mc_alloc_layers(&t->p);
+
+	int slots = jobs != NULL ? sw_jobs_slot_count(jobs) : 1;
+	t->worker_count = slots < chunk->steps ? slots : chunk->steps;
+	t->workers = (sw_job_t *)sw_malloc(t->worker_count * sizeof(sw_job_t));
+	sw_job_t **deps = (sw_job_t **)sw_malloc(t->worker_count * sizeof(sw_job_t *));
+	assert(t->workers != NULL && deps != NULL);
+	for (int i = 0; i < t->worker_count; ++i) {
+		sw_jobs_submit(jobs, &t->workers[i], sw_mc_task_layers, t, NULL, 0);
+		deps[i] = &t->workers[i];
+	}
+	sw_jobs_submit(jobs, &t->finish, sw_mc_task_finish, t, deps, t->worker_count);
+	sw_free(deps);
+	return t;
+}
+
+sw_mc_progress_t sw_mc_task_progress(const sw_mc_task_t *t) {
+	assert(t != NULL);
+	uint64_t layer = (uint64_t)t->chunk.steps * t->chunk.steps;
+	return (sw_mc_progress_t){.cells_done = layer * t->layers_done,
+	                          .cells_total = layer * t->chunk.steps};
+}
+
+void sw_mc_task_cancel(sw_mc_task_t *t) {
+	assert(t != NULL);
+	KINC_ATOMIC_EXCHANGE_32(&t->cancelled, 1);
+}
+
+bool sw_mc_task_done(const sw_mc_task_t *t) {
+	assert(t != NULL);
+	return sw_job_done(&t->finish);
+}
+
+bool sw_mc_task_wait(sw_mc_task_t *t) {
+	assert(t != NULL);
+	// Called from `done`, the finish job would wait for itself
+	assert(t->done_slot < 0 || t->done_slot != sw_jobs_current_slot(t->p.jobs));
+	for (int i = 0; i < t->worker_count; ++i) sw_jobs_wait(t->p.jobs, &t->workers[i]);
+	sw_jobs_wait(t->p.jobs, &t->finish);
+	bool completed = t->completed;
+	sw_free(t->workers);
+	sw_free(t);
+	return completed;
+}
+
+// Progressive extraction
+
+struct sw_mc_progressive {
+	const sw_sdf_t *sdf;
+	sw_mc_chunk_t chunk;
+	int levels;
+	int level; // Next level to extract
+	sw_samples_t *samples; // Samples of the last extracted level
+	int samples_steps;
+	sw_samples_format_t format;
+	float band;
+	bool lattice_normals;
+};
+
+typedef struct sw_mc_refine {
+	sw_mc_progressive_t *p;
+	sw_jobs_t *jobs;
+	kr_vec3_t bnl;
+	float step;
+	int steps;
+	float offset; // Subtracted from the stored distances
+	sw_samples_t *samples;
+	volatile int evaluated;
+} sw_mc_refine_t;
+
+static void sw_mc_refine_planes(void *param, int begin, int end, int slot) {
+	sw_mc_refine_t *r = (sw_mc_refine_t *)param;
+	const sw_samples_t *prev = r->p->samples;
+	int n = r->steps + 1;
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_sdf_stack_frame_t *stack =
+	    r->jobs != NULL ? sw_jobs_sdf_stack(r->jobs, r->p->sdf, slot)
+	                    : (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(r->p->sdf));
+	kr_vec4_t *row = (kr_vec4_t *)sw_scratch_alloc(n * sizeof(kr_vec4_t));
+	int evaluated = 0;
+	for (int z = begin; z < end; ++z) {
+		for (int y = 0; y < n; ++y) {
+			for (int x = 0; x < n; ++x) {
+				// Even lattice points of a level coincide exactly with the points of the previous
+				// one. Storing them again is exact for floats and halves, the integer formats add
+				// the rounding of the new block
+				if (prev != NULL && (x | y | z) % 2 == 0)
+					row[x] = sw_samples_get(prev, x / 2, y / 2, z / 2);
+				else {
+					row[x] = sw_sdf_compute_color(r->p->sdf,
+					                              lattice_point(r->bnl, r->step, x, y, z), stack);
+					row[x].w -= r->offset;
+					++evaluated;
+				}
+			}
+			sw_samples_store_row(r->samples, y, z, row);
+		}
+	}
+	sw_scratch_end(mark);
+	// Rarely contended, one update per block of planes
+	for (;;) {
+		int old = r->evaluated;
+		if (KINC_ATOMIC_COMPARE_EXCHANGE(&r->evaluated, old, old + evaluated)) break;
+	}
+}
+
+// `planes` holds the samples of the planes `zi` and `zi + 1`
+static void sw_mc_cached_layer(const kr_vec4_t *planes, int steps, kr_vec3_t bnl, float step,
+                               int zi, float iso_level, sw_add_triangle_color_func_t f,
+                               void *f_param) {
+	int n = steps + 1;
+	for (int yi = 0; yi < steps; ++yi) {
+		for (int xi = 0; xi < steps; ++xi) {
+			gridcell_color_t c;
+			set_cube_points(bnl, step, xi, yi, zi, c.p);
+			for (int i = 0; i < 8; ++i)
+				c.val[i] = planes[((size_t)cube_corners[i][2] * n + yi + cube_corners[i][1]) * n +
+				                  xi + cube_corners[i][0]];
+			polygonise_color(c, iso_level, f, f_param);
+		}
+	}
+}
+
+// Central differences of the samples around a lattice point, one sided at the borders. `planes`
+// holds the planes `zi - 1` to `zi + 2`, those outside of the lattice are not read.
+static kr_vec3_t sw_mc_lattice_gradient(const kr_vec4_t *planes, int steps, int zi, int x, int y,
+                                        int z) {
+	size_t n = (size_t)steps + 1;
+	int x0 = x > 0 ? x - 1 : x, x1 = x < steps ? x + 1 : x;
+	int y0 = y > 0 ? y - 1 : y, y1 = y < steps ? y + 1 : y;
+	int z0 = z > 0 ? z - 1 : z, z1 = z < steps ? z + 1 : z;
+	const kr_vec4_t *plane = planes + (z - zi + 1) * n * n;
+	const kr_vec4_t *below = planes + (z0 - zi + 1) * n * n;
+	const kr_vec4_t *above = planes + (z1 - zi + 1) * n * n;
+	return (kr_vec3_t){(plane[y * n + x1].w - plane[y * n + x0].w) / (x1 - x0),
+	                   (plane[y1 * n + x].w - plane[y0 * n + x].w) / (y1 - y0),
+	                   (above[y * n + x].w - below[y * n + x].w) / (z1 - z0)};
+}
+
+// Like `sw_mc_cached_layer` with normals from the lattice, `planes` holds the planes `zi - 1` to
+// `zi + 2`
+static void sw_mc_normal_layer(const kr_vec4_t *planes, int steps, kr_vec3_t bnl, float step,
+                               int zi, float iso_level, sw_add_triangle_normal_func_t f,
+                               void *f_param) {
+	size_t n = (size_t)steps + 1;
+	for (int yi = 0; yi < steps; ++yi) {
+		for (int xi = 0; xi < steps; ++xi) {
+			gridcell_normal_t c;
+			set_cube_points(bnl, step, xi, yi, zi, c.p);
+			for (int i = 0; i < 8; ++i) {
+				int x = xi + cube_corners[i][0];
+				int y = yi + cube_corners[i][1];
+				c.val[i] = planes[(cube_corners[i][2] + 1) * n * n + y * n + x];
+			}
+			// Skip the gradients of cells without surface
+			uint8_t cubeindex = 0;
+			for (int i = 0; i < 8; ++i)
+				if (c.val[i].w < iso_level) cubeindex |= 1 << i;
+			if (edge_table[cubeindex] != 0) {
+				for (int i = 0; i < 8; ++i) {
+					c.n[i] = sw_mc_lattice_gradient(planes, steps, zi, xi + cube_corners[i][0],
+					                                yi + cube_corners[i][1],
+					                                zi + cube_corners[i][2]);
+				}
+			}
+			polygonise_normal(&c, cubeindex, iso_level, f, f_param);
+		}
+	}
+}
+
+sw_mc_progressive_t *sw_mc_progressive_init(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                            int levels) {
+	assert(sdf != NULL && chunk != NULL && levels > 0);
+	assert(chunk->steps % (1 << (levels - 1)) == 0);
+	sw_mc_progressive_t *p = (sw_mc_progressive_t *)sw_malloc(sizeof(sw_mc_progressive_t));
+	assert(p != NULL);
+	*p = (sw_mc_progressive_t){
+	    .sdf = sdf, .chunk = *chunk, .levels = levels, .format = SW_SAMPLES_F32};
+	return p;
+}
+
+void sw_mc_progressive_destroy(sw_mc_progressive_t *p) {
+	assert(p != NULL);
+	sw_samples_destroy(p->samples);
+	sw_free(p);
+}
+
+void sw_mc_progressive_set_format(sw_mc_progressive_t *p, sw_samples_format_t format, float band) {
+	assert(p != NULL && p->level == 0);
+	p->format = format;
+	p->band = band;
+}
+
+void sw_mc_progressive_set_lattice_normals(sw_mc_progressive_t *p, bool enabled) {
+	assert(p != NULL);
+	p->lattice_normals = enabled;
+}
+
+static void sw_mc_load_plane(const sw_samples_t *s, int steps, int z, kr_vec4_t *plane) {
+	if (z < 0 || z > steps) return;
+	for (int y = 0; y <= steps; ++y) sw_samples_load_row(s, y, z, plane + (size_t)y * (steps + 1));
+}
+
+bool sw_mc_progressive_finished(const sw_mc_progressive_t *p) {
+	return p->level >= p->levels;
+}
+
+bool sw_mc_progressive_step(sw_mc_progressive_t *p, sw_mesh_t *m, sw_mc_level_t *info,
+                            sw_jobs_t *jobs) {
+	assert(p != NULL && m != NULL);
+	if (sw_mc_progressive_finished(p)) return false;
+	sw_trace_scope_t trace = sw_trace_begin("mc_progressive");
+	int steps = p->chunk.steps >> (p->levels - 1 - p->level);
+	size_t n = (size_t)steps + 1;
+	sw_mc_refine_t r = (sw_mc_refine_t){
+	    .p = p,
+	    .jobs = jobs,
+	    .bnl = kr_vec3_addf(p->chunk.origin, -p->chunk.halfsidelen),
+	    .step = (p->chunk.halfsidelen * 2.0f) / steps,
+	    .steps = steps,
+	    // Relative distances keep the sign exact through the quantization
+	    .offset = p->format == SW_SAMPLES_F32 ? 0.0f : p->chunk.iso_level,
+	    .samples = sw_samples_init((int[3]){(int)n, (int)n, (int)n}, p->format, p->band)};
+	sw_jobs_parallel_for(jobs, 0, (int)n, 1, sw_mc_refine_planes, &r);
+	sw_samples_destroy(p->samples);
+	p->samples = r.samples;
+	p->samples_steps = steps;
+
+	sw_mesh_reset(m);
+	// A window of the planes `zi - 1` to `zi + 2` for lattice normals, `zi` and `zi + 1` otherwise
+	int window = p->lattice_normals ? 4 : 2;
+	int below = p->lattice_normals ? 1 : 0;
+	float iso_level = p->chunk.iso_level - r.offset;
+	kr_vec4_t *planes = (kr_vec4_t *)sw_malloc(window * n * n * sizeof(kr_vec4_t));
+	assert(planes != NULL);
+	for (int i = 0; i < window - 1; ++i)
+		sw_mc_load_plane(p->samples, steps, i - below, planes + i * n * n);
+	for (int zi = 0; zi < steps; ++zi) {
+		sw_mc_load_plane(p->samples, steps, zi + window - 1 - below,
+		                 planes + (window - 1) * n * n);
+		if (p->lattice_normals)
+			sw_mc_normal_layer(planes, steps, r.bnl, r.step, zi, iso_level,
+			                   sw_mesh_add_triangle_normal, m);
+		else
+			sw_mc_cached_layer(planes, steps, r.bnl, r.step, zi, iso_level, sw_mesh_add_triangle,
+			                   m);
+		memmove(planes, planes + n * n, (window - 1) * n * n * sizeof(kr_vec4_t));
+	}
+	sw_free(planes);
+	if (info != NULL)
+		*info = (sw_mc_level_t){.level = p->level,
+		                        .steps = steps,
+		                        .evaluated = (uint64_t)r.evaluated,
+		                        .reused = n * n * n - (uint64_t)r.evaluated,
+		                        .cache_bytes = sw_samples_bytes(p->samples)};
+	++p->level;
+	// The finest samples are not needed anymore
+	if (sw_mc_progressive_finished(p)) {
+		sw_samples_destroy(p->samples);
+		p->samples = NULL;
+	}
+	sw_trace_end(&trace, steps);
+	return true;
+}
+
+void sw_mc_process_sdf_progressive(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk, int levels,
+                                   sw_mesh_t *m, sw_mc_level_func_t f, void *f_param,
+                                   sw_jobs_t *jobs) {
+	sw_mc_progressive_t *p = sw_mc_progressive_init(sdf, chunk, levels);
+	sw_mc_level_t info;
+	while (sw_mc_progressive_step(p, m, &info, jobs))
+		if (f != NULL) f(f_param, m, &info);
+	sw_mc_progressive_destroy(p);
+}
+
+// Multiple iso levels
+
+typedef struct sw_mc_multi {
+	const sw_sdf_t *sdf;
+	const sw_mc_chunk_t *chunk;
+	const float *iso_levels;
+	int count;
+	sw_jobs_t *jobs;
+	int block_count;
+	sw_mc_layer_t *layers; // `count` rows of `steps` layers
+} sw_mc_multi_t;
+
+static void sw_mc_sample_plane(const sw_sdf_t *sdf, sw_sdf_stack_frame_t *stack, kr_vec3_t bnl,
+                               float step, int steps, int z, kr_vec4_t *plane) {
+	int n = steps + 1;
+	for (int y = 0; y < n; ++y)
+		for (int x = 0; x < n; ++x)
+			plane[y * n + x] = sw_sdf_compute_color(sdf, lattice_point(bnl, step, x, y, z), stack);
+}
+
+// Number of blocks to split `steps` layers into, a few per slot but none shorter than `min_layers`
+static int sw_mc_block_count(sw_jobs_t *jobs, int steps, int per_slot, int min_layers) {
+	if (jobs == NULL) return 1;
+	int count = sw_jobs_slot_count(jobs) * per_slot;
+	if (count > steps / min_layers) count = steps / min_layers;
+	return count > 0 ? count : 1;
+}
+
+static void sw_mc_multi_block(sw_mc_multi_t *m, int begin, int end, int slot) {
+	int steps = m->chunk->steps;
+	size_t n = (size_t)steps + 1;
+	float step = (m->chunk->halfsidelen * 2.0f) / steps;
+	kr_vec3_t bnl = kr_vec3_addf(m->chunk->origin, -m->chunk->halfsidelen);
+	sw_trace_scope_t trace = sw_trace_begin("mc_block");
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_sdf_stack_frame_t *stack =
+	    m->jobs != NULL ? sw_jobs_sdf_stack(m->jobs, m->sdf, slot)
+	                    : (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(m->sdf));
+	// Two planes at a time, the first plane of a block is sampled by both neighbouring blocks
+	kr_vec4_t *planes = (kr_vec4_t *)sw_malloc(2 * n * n * sizeof(kr_vec4_t));
+	assert(planes != NULL);
+	sw_mc_sample_plane(m->sdf, stack, bnl, step, steps, begin, planes);
+	for (int zi = begin; zi < end; ++zi) {
+		if (zi > begin) memcpy(planes, planes + n * n, n * n * sizeof(kr_vec4_t));
+		sw_mc_sample_plane(m->sdf, stack, bnl, step, steps, zi + 1, planes + n * n);
+		for (int i = 0; i < m->count; ++i)
+			sw_mc_cached_layer(planes, steps, bnl, step, zi, m->iso_levels[i],
+			                   sw_mc_record_triangle_color, &m->layers[(size_t)i * steps + zi]);
+	}
+	sw_free(planes);
+	sw_scratch_end(mark);
+	sw_trace_end(&trace, begin);
+}
+
+static void sw_mc_multi_blocks(void *param, int begin, int end, int slot) {
+	sw_mc_multi_t *m = (sw_mc_multi_t *)param;
+	int steps = m->chunk->steps;
+	// Balanced, so no block is shorter than `steps / block_count` layers
+	for (int b = begin; b < end; ++b)
+		sw_mc_multi_block(m, (int)((int64_t)b * steps / m->block_count),
+		                  (int)((int64_t)(b + 1) * steps / m->block_count), slot);
+}
+
+void sw_mc_process_sdf_chunk_multi(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                   const float *iso_levels, int count,
+                                   sw_add_triangle_color_func_t f, void *const *f_params,
+                                   sw_jobs_t *jobs) {
+	assert(sdf != NULL && chunk != NULL && chunk->steps > 0 && f != NULL);
+	assert(iso_levels != NULL && f_params != NULL && count > 0);
+	int steps = chunk->steps;
+	sw_mc_multi_t m = (sw_mc_multi_t){
+	    .sdf = sdf, .chunk = chunk, .iso_levels = iso_levels, .count = count, .jobs = jobs};
+	size_t layer_count = (size_t)count * steps;
+	m.layers = (sw_mc_layer_t *)sw_malloc(layer_count * sizeof(sw_mc_layer_t));
+	assert(m.layers != NULL);
+	memset(m.layers, 0, layer_count * sizeof(sw_mc_layer_t));
+	// Few large blocks, every block samples its first plane again
+	m.block_count = sw_mc_block_count(jobs, steps, 4, SW_MC_MIN_BLOCK_LAYERS);
+	sw_jobs_parallel_for(jobs, 0, m.block_count, 1, sw_mc_multi_blocks, &m);
+
+	sw_trace_scope_t trace = sw_trace_begin("mc_replay");
+	for (int i = 0; i < count; ++i) {
+		for (int zi = 0; zi < steps; ++zi) {
+			sw_mc_layer_t *l = &m.layers[(size_t)i * steps + zi];
+			for (int t = 0; t < l->count; t += 6)
+				f(f_params[i], l->data[t], l->data[t + 1], l->data[t + 2], l->data[t + 3],
+				  l->data[t + 4], l->data[t + 5]);
+			sw_free(l->data);
+		}
+	}
+	sw_free(m.layers);
+	sw_trace_end(&trace, count);
+}
+
+// Lattice normals
+
+typedef struct sw_mc_normals {
+	const sw_sdf_t *sdf;
+	const sw_mc_chunk_t *chunk;
+	sw_jobs_t *jobs;
+	int block_count;
+	sw_mc_layer_t *layers;
+} sw_mc_normals_t;
+
+static void sw_mc_normals_block(sw_mc_normals_t *m, int begin, int end, int slot) {
+	int steps = m->chunk->steps;
+	size_t n = (size_t)steps + 1;
+	float step = (m->chunk->halfsidelen * 2.0f) / steps;
+	kr_vec3_t bnl = kr_vec3_addf(m->chunk->origin, -m->chunk->halfsidelen);
+	sw_trace_scope_t trace = sw_trace_begin("mc_block");
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_sdf_stack_frame_t *stack =
+	    m->jobs != NULL ? sw_jobs_sdf_stack(m->jobs, m->sdf, slot)
+	                    : (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(m->sdf));
+	// The planes `zi - 1` to `zi + 2`, the first three planes of a block are sampled again
+	kr_vec4_t *planes = (kr_vec4_t *)sw_malloc(4 * n * n * sizeof(kr_vec4_t));
+	assert(planes != NULL);
+	for (int i = 0; i < 3; ++i) {
+		int z = begin + i - 1;
+		if (z >= 0 && z <= steps)
+			sw_mc_sample_plane(m->sdf, stack, bnl, step, steps, z, planes + i * n * n);
+	}
+	for (int zi = begin; zi < end; ++zi) {
+		if (zi + 2 <= steps)
+			sw_mc_sample_plane(m->sdf, stack, bnl, step, steps, zi + 2, planes + 3 * n * n);
+		sw_mc_normal_layer(planes, steps, bnl, step, zi, m->chunk->iso_level,
+		                   sw_mc_record_triangle_normal, &m->layers[zi]);
+		memmove(planes, planes + n * n, 3 * n * n * sizeof(kr_vec4_t));
+	}
+	sw_free(planes);
+	sw_scratch_end(mark);
+	sw_trace_end(&trace, begin);
+}
+
+static void sw_mc_normals_blocks(void *param, int begin, int end, int slot) {
+	sw_mc_normals_t *m = (sw_mc_normals_t *)param;
+	int steps = m->chunk->steps;
+	for (int b = begin; b < end; ++b)
+		sw_mc_normals_block(m, (int)((int64_t)b * steps / m->block_count),
+		                    (int)((int64_t)(b + 1) * steps / m->block_count), slot);
+}
+
+void sw_mc_process_sdf_chunk_normal(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                    sw_add_triangle_normal_func_t f, void *f_param,
+                                    sw_jobs_t *jobs) {
+	assert(sdf != NULL && chunk != NULL && chunk->steps > 0 && f != NULL);
+	int steps = chunk->steps;
+	sw_mc_normals_t m = (sw_mc_normals_t){.sdf = sdf, .chunk = chunk, .jobs = jobs};
+	m.layers = (sw_mc_layer_t *)sw_malloc(steps * sizeof(sw_mc_layer_t));
+	assert(m.layers != NULL);
+	memset(m.layers, 0, steps * sizeof(sw_mc_layer_t));
+	// Every block samples three planes again, so blocks are three times as long as for several iso
+	// levels to keep the same bound
+	m.block_count = sw_mc_block_count(jobs, steps, 2, 3 * SW_MC_MIN_BLOCK_LAYERS);
+	sw_jobs_parallel_for(jobs, 0, m.block_count, 1, sw_mc_normals_blocks, &m);
+
+	sw_trace_scope_t trace = sw_trace_begin("mc_replay");
+	for (int zi = 0; zi < steps; ++zi) {
+		sw_mc_layer_t *l = &m.layers[zi];
+		for (int t = 0; t < l->count; t += 9)
+			f(f_param, l->data[t], l->data[t + 1], l->data[t + 2], l->data[t + 3], l->data[t + 4],
+			  l->data[t + 5], l->data[t + 6], l->data[t + 7], l->data[t + 8]);
+		sw_free(l->data);
+	}
+	sw_free(m.layers);
+	sw_trace_end(&trace, steps);
 }
@@ -7,7 +7,12 @@
 #pragma once
 
 #include <krink/math/vector.h>
+#include <stdbool.h>
+#include <stdint.h>
 
+#include "jobs.h"
+#include "mesh.h"
+#include "samples.h"
 #include "sdf.h"
 
 typedef float (*sw_density_func_t)(void *, kr_vec3_t);
@@ -15,6 +20,10 @@ typedef kr_vec4_t (*sw_density_color_func_t)(void *, kr_vec3_t);
 typedef void (*sw_add_triangle_func_t)(void *, kr_vec3_t, kr_vec3_t, kr_vec3_t);
 typedef void (*sw_add_triangle_color_func_t)(void *, kr_vec3_t, kr_vec3_t, kr_vec3_t, kr_vec3_t,
                                              kr_vec3_t, kr_vec3_t);
+// Positions, normals and colors
+typedef void (*sw_add_triangle_normal_func_t)(void *, kr_vec3_t, kr_vec3_t, kr_vec3_t, kr_vec3_t,
+                                              kr_vec3_t, kr_vec3_t, kr_vec3_t, kr_vec3_t,
+                                              kr_vec3_t);
 
 typedef struct sw_mc_chunk {
 	kr_vec3_t origin;
@@ -23,6 +32,16 @@ typedef struct sw_mc_chunk {
 	float iso_level;
 } sw_mc_chunk_t;
 
+/**
+ * @brief Hash of the chunk settings, chained onto `seed`. Combine with `sw_sdf_hash` to address
+ * meshing results by content.
+ *
+ * @param chunk
+ * @param seed
+ * @return uint64_t
+ */
+uint64_t sw_mc_chunk_hash(const sw_mc_chunk_t *chunk, uint64_t seed);
+
 typedef struct sw_mc_custom {
 	const sw_mc_chunk_t chunk;
 	sw_density_func_t density;
@@ -59,12 +78,17 @@ void sw_mc_process_custom_chunk_color(const sw_mc_custom_color_t *init);
  * @brief Extract surface in a given grid chunk using a SDF outputs triangles using the provided
  * callback function.
  *
+ * With a job context the z layers are extracted in parallel and `f` is called on the calling
+ * thread afterwards, in the same order as without one.
+ *
  * @param sdf
  * @param chunk
  * @param f
+ * @param f_param
+ * @param jobs May be `NULL`
  */
 void sw_mc_process_sdf_chunk(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
-                             sw_add_triangle_func_t f, void *f_param);
+                             sw_add_triangle_func_t f, void *f_param, sw_jobs_t *jobs);
 
 /**
  * @brief Extract surface in a given grid chunk using a colored SDF outputs triangles using the
@@ -73,6 +97,205 @@ void sw_mc_process_sdf_chunk(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
  * @param sdf
  * @param chunk
  * @param f
+ * @param f_param
+ * @param jobs May be `NULL`, see `sw_mc_process_sdf_chunk`
  */
 void sw_mc_process_sdf_chunk_color(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
-                                   sw_add_triangle_color_func_t f, void *f_param);
+                                   sw_add_triangle_color_func_t f, void *f_param,
+                                   sw_jobs_t *jobs);
+
+/**
+ * @brief Like `sw_mc_process_sdf_chunk_color`, but exploits a mirror at the root of the SDF, see
+ * `sw_sdf_mirror_flags`. Only the positive side of every mirror plane is sampled, the triangles are
+ * mirrored with their winding fixed and vertices on a plane are snapped onto it, so they weld with
+ * their mirror image. The planes have to lie on the lattice: the chunk is centered on them and
+ * `steps` is even, otherwise the full chunk is extracted. Up to 8 times less sampling for a model
+ * mirrored along all axes.
+ *
+ * @param sdf
+ * @param chunk
+ * @param f
+ * @param f_param
+ * @param jobs May be `NULL`
+ * @return uint32_t The `sw_ops_mirror_flag_t` that were exploited, `0` for a full extraction
+ */
+uint32_t sw_mc_process_sdf_chunk_symmetric(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                           sw_add_triangle_color_func_t f, void *f_param,
+                                           sw_jobs_t *jobs);
+
+/**
+ * @brief Like `sw_mc_process_sdf_chunk_color` with the same triangles in the same order, adding
+ * normals from central differences of the lattice samples. They are interpolated along the edges
+ * like the positions, so no extra SDF evaluations are needed, unlike a normal callback of the mesh
+ * which samples the SDF around every new vertex. Serially every lattice point is sampled once.
+ * With `jobs` the layers are split into blocks of at least 24 layers and each block samples the
+ * three planes at its start again, which adds at most one evaluation in 8.
+ *
+ * @param sdf
+ * @param chunk
+ * @param f E.g. `sw_mesh_add_triangle_normal`
+ * @param f_param
+ * @param jobs May be `NULL`
+ */
+void sw_mc_process_sdf_chunk_normal(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                    sw_add_triangle_normal_func_t f, void *f_param,
+                                    sw_jobs_t *jobs);
+
+/**
+ * @brief Extract the surfaces of several iso levels, e.g. offset shells of the same model, from a
+ * single sampling pass. The triangles of each level are the same as those of
+ * `sw_mc_process_sdf_chunk_color` with that level and arrive in the same order, one level after
+ * the other. Serially every lattice point is sampled once. With `jobs` the layers are split into
+ * blocks of at least 8 layers and each block samples its first plane again, which adds at most
+ * one evaluation in 8.
+ *
+ * @param sdf
+ * @param chunk `iso_level` is ignored
+ * @param iso_levels
+ * @param count
+ * @param f
+ * @param f_params Passed to `f` with the triangles of the level at the same index, e.g. a mesh per
+ * level with `sw_mesh_add_triangle`
+ * @param jobs May be `NULL`
+ */
+void sw_mc_process_sdf_chunk_multi(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                   const float *iso_levels, int count,
+                                   sw_add_triangle_color_func_t f, void *const *f_params,
+                                   sw_jobs_t *jobs);
+
+typedef struct sw_mc_task sw_mc_task_t;
+
+/**
+ * @brief Called once when a task finished, on the thread that ran its last part. The task is not
+ * finished before the callback returns, so it must not call `sw_mc_task_wait` on it.
+ *
+ * @param param
+ * @param task
+ * @param completed `false` if the task was cancelled and no triangles were emitted
+ */
+typedef void (*sw_mc_task_done_func_t)(void *param, sw_mc_task_t *task, bool completed);
+
+typedef struct sw_mc_progress {
+	uint64_t cells_done;
+	uint64_t cells_total;
+} sw_mc_progress_t;
+
+/**
+ * @brief Extract a colored surface in the background, the asynchronous counterpart of
+ * `sw_mc_process_sdf_chunk_color`. Layers are sampled on the workers of `jobs`, afterwards `f` is
+ * called for all triangles in the same order as the synchronous version, on one worker thread,
+ * followed by `done`.
+ *
+ * `sdf` has to stay valid and unchanged until the task is done. Every task must be released with
+ * `sw_mc_task_wait` exactly once, e.g. after `sw_mc_task_done` returned `true`.
+ *
+ * @param sdf
+ * @param chunk Copied
+ * @param f
+ * @param f_param
+ * @param done May be `NULL`
+ * @param done_param
+ * @param jobs If `NULL` the task runs to completion before this function returns
+ * @return sw_mc_task_t*
+ */
+sw_mc_task_t *sw_mc_submit(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                           sw_add_triangle_color_func_t f, void *f_param,
+                           sw_mc_task_done_func_t done, void *done_param, sw_jobs_t *jobs);
+
+sw_mc_progress_t sw_mc_task_progress(const sw_mc_task_t *t);
+
+/**
+ * @brief Stop sampling after the layers currently in progress. Nothing is emitted once a task is
+ * cancelled before its triangles are replayed, `done` is still called.
+ *
+ * @param t
+ */
+void sw_mc_task_cancel(sw_mc_task_t *t);
+
+bool sw_mc_task_done(const sw_mc_task_t *t);
+
+/**
+ * @brief Wait for the task, executing other work in the meantime, and release it. Must not be
+ * called from the `done` callback of the same task, which would wait for itself.
+ *
+ * @param t
+ * @return bool `true` if all triangles were emitted, `false` if the task was cancelled
+ */
+bool sw_mc_task_wait(sw_mc_task_t *t);
+
+typedef struct sw_mc_progressive sw_mc_progressive_t;
+
+typedef struct sw_mc_level {
+	int level; // `0` is the coarsest
+	int steps;
+	uint64_t evaluated; // SDF samples taken for this level
+	uint64_t reused;    // Samples taken over from the previous level
+	size_t cache_bytes; // Memory of the kept samples
+} sw_mc_level_t;
+
+typedef void (*sw_mc_level_func_t)(void *param, sw_mesh_t *m, const sw_mc_level_t *level);
+
+/**
+ * @brief Coarse to fine extraction for interactive previews. Level `i` of `levels` samples the
+ * chunk with `chunk->steps >> (levels - 1 - i)` steps, every level doubles the resolution of the
+ * previous one and reuses its samples where the lattices coincide, so the finest level evaluates
+ * only 7/8 of its lattice points. Every lattice point is sampled once, unlike the cell by cell
+ * sampling of `sw_mc_process_sdf_chunk_color`. The samples of one level are kept between steps.
+ *
+ * @param sdf Has to stay valid and unchanged until the extraction is destroyed
+ * @param chunk Copied, `steps` must be divisible by `2^(levels - 1)`
+ * @param levels
+ * @return sw_mc_progressive_t*
+ */
+sw_mc_progressive_t *sw_mc_progressive_init(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                            int levels);
+void sw_mc_progressive_destroy(sw_mc_progressive_t *p);
+bool sw_mc_progressive_finished(const sw_mc_progressive_t *p);
+
+/**
+ * @brief Keep the samples between levels in a quantized format, see `samples.h` for the error
+ * bounds. The quantized formats store distances relative to the iso level, so every cell produces
+ * the same triangles as with floats and only the vertices move along their edges. Defaults to
+ * `SW_SAMPLES_F32`, which is exact. Must be set before the first step.
+ *
+ * Samples reused from the previous level are stored again. `SW_SAMPLES_F16` stores them unchanged.
+ * The integer formats quantize them again with the scale of their new block, so the error of a
+ * sample first evaluated `k` levels ago is at most `k + 1` half steps,
+ * `(k + 1) * band / 254` for 8 bit. Only the coarse lattice points accumulate this error, every
+ * level evaluates the other points anew.
+ *
+ * @param p
+ * @param format
+ * @param band Clamp of the integer formats around the iso level, a few steps of the finest level
+ */
+void sw_mc_progressive_set_format(sw_mc_progressive_t *p, sw_samples_format_t format, float band);
+
+/**
+ * @brief Compute the vertex normals from the kept samples like `sw_mc_process_sdf_chunk_normal`
+ * instead of calling the normal callback of the mesh.
+ *
+ * @param p
+ * @param enabled
+ */
+void sw_mc_progressive_set_lattice_normals(sw_mc_progressive_t *p, bool enabled);
+
+/**
+ * @brief Extract the next level into `m`, which is reset first. Triangles are emitted in the same
+ * order as `sw_mc_process_sdf_chunk_color` at that resolution.
+ *
+ * @param p
+ * @param m
+ * @param info If not `NULL`, receives details of the extracted level
+ * @param jobs Samples in parallel if not `NULL`
+ * @return bool `false` if all levels were extracted already
+ */
+bool sw_mc_progressive_step(sw_mc_progressive_t *p, sw_mesh_t *m, sw_mc_level_t *info,
+                            sw_jobs_t *jobs);
+
+/**
+ * @brief Run all levels of a progressive extraction, calling `f` after each one. `m` holds the
+ * finest mesh afterwards.
+ */
+void sw_mc_process_sdf_progressive(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk, int levels,
+                                   sw_mesh_t *m, sw_mc_level_func_t f, void *f_param,
+                                   sw_jobs_t *jobs);
@@ -0,0 +1,382 @@
+#include "mcstream.h"
+#include "mathhelper.h"
+#include "mtables.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <kinc/io/filereader.h>
+#include <kinc/io/filewriter.h>
+#include <kinc/log.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <util/file.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#define SW_MCSTREAM_MAGIC 0x534d5753u // "SWMS"
+#define SW_MCSTREAM_PATH_LEN 256
+#define SW_MCSTREAM_WRITE_BUFFER (1 << 16)
+
+// Cube edges as axis (0 = x, 1 = y, 2 = z) and offset of the lower end point from corner 0,
+// matching the corner order of `polygonise_color`
+static const int8_t sw_mcstream_edges[12][4] = {
+    {0, 0, 0, 0}, {2, 1, 0, 0}, {0, 0, 0, 1}, {2, 0, 0, 0}, {0, 0, 1, 0}, {2, 1, 1, 0},
+    {0, 0, 1, 1}, {2, 0, 1, 0}, {1, 0, 0, 0}, {1, 1, 0, 0}, {1, 1, 0, 1}, {1, 0, 0, 1},
+};
+
+typedef struct sw_mcstream {
+	const sw_mc_chunk_t *chunk;
+	int n; // Samples per side
+	float step;
+	kr_vec3_t bnl;
+	sw_density_color_func_t density;
+	void *density_param;
+	// SDF slabs are sampled on `jobs` instead, `density` stays serial
+	const sw_sdf_t *sdf;
+	sw_jobs_t *jobs;
+	kr_vec4_t *sample_slab;
+	int sample_z;
+	sw_mesh_normal_func_t fn;
+	void *fparam;
+	const sw_mcstream_sink_t *sink;
+	int z; // Current layer
+	kr_vec4_t *slab[2]; // Samples at the bottom and top of the current layer
+	// Vertex ids of the crossed edges, `-1` if not emitted yet. x and y edges per slab, z edges
+	// between the slabs
+	int64_t *xe[2];
+	int64_t *ye[2];
+	int64_t *ze;
+	sw_mcstream_stats_t stats;
+} sw_mcstream_t;
+
+static kr_vec3_t sw_mcstream_point(const sw_mcstream_t *s, int x, int y, int z) {
+	return (kr_vec3_t){.x = s->bnl.x + x * s->step,
+	                   .y = s->bnl.y + y * s->step,
+	                   .z = s->bnl.z + z * s->step};
+}
+
+static void sw_mcstream_sample_rows(void *param, int begin, int end, int slot) {
+	sw_mcstream_t *s = (sw_mcstream_t *)param;
+	sw_sdf_stack_frame_t *stack = sw_jobs_sdf_stack(s->jobs, s->sdf, slot);
+	for (int y = begin; y < end; ++y)
+		for (int x = 0; x < s->n; ++x)
+			s->sample_slab[y * s->n + x] =
+			    sw_sdf_compute_color(s->sdf, sw_mcstream_point(s, x, y, s->sample_z), stack);
+}
+
+static void sw_mcstream_sample(sw_mcstream_t *s, kr_vec4_t *slab, int z) {
+	if (s->jobs != NULL) {
+		s->sample_slab = slab;
+		s->sample_z = z;
+		int grain = sw_maxi(s->n / (sw_jobs_slot_count(s->jobs) * 4), 1);
+		sw_jobs_parallel_for(s->jobs, 0, s->n, grain, sw_mcstream_sample_rows, s);
+		return;
+	}
+	for (int y = 0; y < s->n; ++y)
+		for (int x = 0; x < s->n; ++x)
+			slab[y * s->n + x] = s->density(s->density_param, sw_mcstream_point(s, x, y, z));
+}
+
+static int64_t sw_mcstream_edge_vertex(sw_mcstream_t *s, int cx, int cy, int edge) {
+	int axis = sw_mcstream_edges[edge][0];
+	int x = cx + sw_mcstream_edges[edge][1];
+	int y = cy + sw_mcstream_edges[edge][2];
+	int level = sw_mcstream_edges[edge][3];
+	int n = s->n;
+	int64_t *slot;
+	if (axis == 0)
+		slot = &s->xe[level][y * (n - 1) + x];
+	else if (axis == 1)
+		slot = &s->ye[level][y * n + x];
+	else
+		slot = &s->ze[y * n + x];
+	if (*slot >= 0) return *slot;
+
+	// Interpolate from the lower end point, so the result does not depend on the visiting cell
+	kr_vec4_t va = s->slab[level][y * n + x];
+	kr_vec4_t vb = axis == 0   ? s->slab[level][y * n + x + 1]
+	               : axis == 1 ? s->slab[level][(y + 1) * n + x]
+	                           : s->slab[1][y * n + x];
+	int z = s->z + level;
+	kr_vec3_t pa = sw_mcstream_point(s, x, y, z);
+	kr_vec3_t pb = sw_mcstream_point(s, x + (axis == 0), y + (axis == 1), z + (axis == 2));
+	float iso = s->chunk->iso_level;
+	float t = (fabsf(vb.w - va.w) > 1e-5f) ? (iso - va.w) / (vb.w - va.w) : 0.5f;
+	t = fmaxf(fminf(t, 1.0f), 0.0f);
+	kr_vec3_t pos = kr_vec3_addv(pa, kr_vec3_mult(kr_vec3_subv(pb, pa), t));
+	kr_vec4_t c = (va.w < vb.w) ? va : vb;
+	kr_vec3_t normal =
+	    s->fn != NULL ? s->fn(s->fparam, pos) : (kr_vec3_t){.x = 0.0f, .y = 0.0f, .z = 0.0f};
+
+	s->sink->vertex(s->sink->param, pos, normal, (kr_vec3_t){.x = c.x, .y = c.y, .z = c.z});
+	*slot = (int64_t)s->stats.vertex_count++;
+	return *slot;
+}
+
+static void sw_mcstream_layer(sw_mcstream_t *s) {
+	int n = s->n;
+	float iso = s->chunk->iso_level;
+	for (int y = 0; y < n - 1; ++y) {
+		for (int x = 0; x < n - 1; ++x) {
+			const kr_vec4_t *b = &s->slab[0][y * n + x];
+			const kr_vec4_t *t = &s->slab[1][y * n + x];
+			uint8_t cubeindex = 0;
+			if (b[0].w < iso) cubeindex |= 1;
+			if (b[1].w < iso) cubeindex |= 2;
+			if (t[1].w < iso) cubeindex |= 4;
+			if (t[0].w < iso) cubeindex |= 8;
+			if (b[n].w < iso) cubeindex |= 16;
+			if (b[n + 1].w < iso) cubeindex |= 32;
+			if (t[n + 1].w < iso) cubeindex |= 64;
+			if (t[n].w < iso) cubeindex |= 128;
+			SW_STATS_INC(mc_cells);
+			if (edge_table[cubeindex] == 0) {
+				SW_STATS_INC(mc_cells_empty);
+				continue;
+			}
+			SW_STATS_INC(mc_cells_active);
+
+			int64_t ids[12];
+			for (int e = 0; e < 12; ++e)
+				if (edge_table[cubeindex] & (1 << e)) ids[e] = sw_mcstream_edge_vertex(s, x, y, e);
+			for (int i = 0; tri_table[cubeindex][i] != -1; i += 3) {
+				s->sink->triangle(s->sink->param, (uint64_t)ids[tri_table[cubeindex][i]],
+				                  (uint64_t)ids[tri_table[cubeindex][i + 1]],
+				                  (uint64_t)ids[tri_table[cubeindex][i + 2]]);
+				++s->stats.triangle_count;
+				SW_STATS_INC(triangles);
+			}
+		}
+	}
+}
+
+static sw_mcstream_stats_t sw_mcstream_run(sw_mcstream_t s) {
+	const sw_mc_chunk_t *chunk = s.chunk;
+	size_t samples = (size_t)s.n * s.n;
+	size_t edges = (size_t)(s.n - 1) * s.n;
+	s.stats.working_set = 2 * samples * sizeof(kr_vec4_t) + (4 * edges + samples) * sizeof(int64_t);
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	for (int i = 0; i < 2; ++i) {
+		s.slab[i] = (kr_vec4_t *)sw_scratch_alloc(samples * sizeof(kr_vec4_t));
+		s.xe[i] = (int64_t *)sw_scratch_alloc(edges * sizeof(int64_t));
+		s.ye[i] = (int64_t *)sw_scratch_alloc(edges * sizeof(int64_t));
+		memset(s.xe[i], 0xff, edges * sizeof(int64_t));
+		memset(s.ye[i], 0xff, edges * sizeof(int64_t));
+	}
+	s.ze = (int64_t *)sw_scratch_alloc(samples * sizeof(int64_t));
+
+	sw_mcstream_sample(&s, s.slab[1], 0);
+	for (int z = 0; z < chunk->steps; ++z) {
+		sw_trace_scope_t trace = sw_trace_begin("mcstream_layer");
+		// The top of the previous layer becomes the bottom, including its edge vertices
+		kr_vec4_t *slab = s.slab[0];
+		s.slab[0] = s.slab[1];
+		s.slab[1] = slab;
+		int64_t *xe = s.xe[0];
+		s.xe[0] = s.xe[1];
+		s.xe[1] = xe;
+		int64_t *ye = s.ye[0];
+		s.ye[0] = s.ye[1];
+		s.ye[1] = ye;
+		memset(s.xe[1], 0xff, edges * sizeof(int64_t));
+		memset(s.ye[1], 0xff, edges * sizeof(int64_t));
+		memset(s.ze, 0xff, samples * sizeof(int64_t));
+		sw_mcstream_sample(&s, s.slab[1], z + 1);
+		s.z = z;
+		sw_mcstream_layer(&s);
+		sw_trace_end(&trace, z);
+	}
+
+	sw_scratch_end(mark);
+	return s.stats;
+}
+
+static sw_mcstream_t sw_mcstream_init(const sw_mc_chunk_t *chunk, sw_mesh_normal_func_t fn,
+                                      void *fparam, const sw_mcstream_sink_t *sink) {
+	assert(chunk != NULL && chunk->steps > 0 && sink != NULL);
+	return (sw_mcstream_t){.chunk = chunk,
+	                       .n = chunk->steps + 1,
+	                       .step = (chunk->halfsidelen * 2.0f) / chunk->steps,
+	                       .bnl = kr_vec3_addf(chunk->origin, -chunk->halfsidelen),
+	                       .fn = fn,
+	                       .fparam = fparam,
+	                       .sink = sink};
+}
+
+sw_mcstream_stats_t sw_mc_stream_custom_chunk(const sw_mc_chunk_t *chunk,
+                                              sw_density_color_func_t density, void *density_param,
+                                              sw_mesh_normal_func_t fn, void *fparam,
+                                              const sw_mcstream_sink_t *sink) {
+	assert(density != NULL);
+	sw_mcstream_t s = sw_mcstream_init(chunk, fn, fparam, sink);
+	s.density = density;
+	s.density_param = density_param;
+	return sw_mcstream_run(s);
+}
+
+typedef struct sw_mcstream_sdf_arg {
+	const sw_sdf_t *sdf;
+	sw_sdf_stack_frame_t *stack;
+} sw_mcstream_sdf_arg_t;
+
+static kr_vec4_t sw_mcstream_sdf_density(void *a, kr_vec3_t p) {
+	sw_mcstream_sdf_arg_t *arg = (sw_mcstream_sdf_arg_t *)a;
+	return sw_sdf_compute_color(arg->sdf, p, arg->stack);
+}
+
+sw_mcstream_stats_t sw_mc_stream_sdf_chunk(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                           sw_mesh_normal_func_t fn, void *fparam,
+                                           const sw_mcstream_sink_t *sink, sw_jobs_t *jobs) {
+	assert(sdf != NULL);
+	sw_mcstream_t s = sw_mcstream_init(chunk, fn, fparam, sink);
+	if (jobs != NULL) {
+		s.sdf = sdf;
+		s.jobs = jobs;
+		return sw_mcstream_run(s);
+	}
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_mcstream_sdf_arg_t a = {
+	    .sdf = sdf, .stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf))};
+	s.density = sw_mcstream_sdf_density;
+	s.density_param = &a;
+	sw_mcstream_stats_t stats = sw_mcstream_run(s);
+	sw_scratch_end(mark);
+	return stats;
+}
+
+// File output
+
+typedef struct sw_mcstream_writer {
+	kinc_file_writer_t file;
+	uint8_t *buffer;
+	int top;
+} sw_mcstream_writer_t;
+
+static bool sw_mcstream_writer_open(sw_mcstream_writer_t *w, const char *filename) {
+	if (!kinc_file_writer_open(&w->file, filename)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for writing", filename);
+		return false;
+	}
+	w->buffer = (uint8_t *)sw_malloc(SW_MCSTREAM_WRITE_BUFFER);
+	assert(w->buffer != NULL);
+	w->top = 0;
+	return true;
+}
+
+static void sw_mcstream_writer_write(sw_mcstream_writer_t *w, const void *data, int size) {
+	if (w->top + size > SW_MCSTREAM_WRITE_BUFFER) {
+		kinc_file_writer_write(&w->file, w->buffer, w->top);
+		w->top = 0;
+	}
+	memcpy(w->buffer + w->top, data, size);
+	w->top += size;
+}
+
+static void sw_mcstream_writer_close(sw_mcstream_writer_t *w) {
+	if (w->top > 0) kinc_file_writer_write(&w->file, w->buffer, w->top);
+	kinc_file_writer_close(&w->file);
+	sw_free(w->buffer);
+}
+
+typedef struct sw_mcstream_file {
+	sw_mcstream_writer_t vertices;
+	sw_mcstream_writer_t indices;
+} sw_mcstream_file_t;
+
+static void sw_mcstream_file_vertex(void *param, kr_vec3_t pos, kr_vec3_t normal,
+                                    kr_vec3_t color) {
+	sw_mcstream_file_t *f = (sw_mcstream_file_t *)param;
+	float v[9] = {pos.x,    pos.y,    pos.z,   normal.x, normal.y,
+	              normal.z, color.x, color.y, color.z};
+	sw_mcstream_writer_write(&f->vertices, v, sizeof(v));
+}
+
+static void sw_mcstream_file_triangle(void *param, uint64_t a, uint64_t b, uint64_t c) {
+	sw_mcstream_file_t *f = (sw_mcstream_file_t *)param;
+	uint64_t tri[3] = {a, b, c};
+	sw_mcstream_writer_write(&f->indices, tri, sizeof(tri));
+}
+
+// Append a temporary file to `w` and delete it, converting 64 to 32 bit indices if requested
+static void sw_mcstream_append(sw_mcstream_writer_t *w, const char *filename, bool narrow) {
+	kinc_file_reader_t reader;
+	if (!kinc_file_reader_open(&reader, filename, KINC_FILE_TYPE_SAVE)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for reading", filename);
+		return;
+	}
+	size_t remaining = kinc_file_reader_size(&reader);
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	uint8_t *chunk = (uint8_t *)sw_scratch_alloc(SW_MCSTREAM_WRITE_BUFFER);
+	while (remaining > 0) {
+		size_t size = remaining < SW_MCSTREAM_WRITE_BUFFER ? remaining : SW_MCSTREAM_WRITE_BUFFER;
+		kinc_file_reader_read(&reader, chunk, size);
+		remaining -= size;
+		if (!narrow) {
+			sw_mcstream_writer_write(w, chunk, (int)size);
+			continue;
+		}
+		const uint64_t *wide = (const uint64_t *)chunk;
+		for (size_t i = 0; i < size / sizeof(uint64_t); ++i) {
+			uint32_t index = (uint32_t)wide[i];
+			sw_mcstream_writer_write(w, &index, sizeof(index));
+		}
+	}
+	sw_scratch_end(mark);
+	kinc_file_reader_close(&reader);
+	sw_file_delete(filename);
+}
+
+bool sw_mc_stream_sdf_chunk_to_file(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                    sw_mesh_normal_func_t fn, void *fparam,
+                                    sw_mcstream_index_t index, const char *filename,
+                                    sw_mcstream_stats_t *stats, sw_jobs_t *jobs) {
+	assert(filename != NULL && strlen(filename) < SW_MCSTREAM_PATH_LEN - 8);
+	char vertex_path[SW_MCSTREAM_PATH_LEN];
+	char index_path[SW_MCSTREAM_PATH_LEN];
+	snprintf(vertex_path, sizeof(vertex_path), "%s.vtmp", filename);
+	snprintf(index_path, sizeof(index_path), "%s.itmp", filename);
+
+	sw_mcstream_file_t f;
+	if (!sw_mcstream_writer_open(&f.vertices, vertex_path)) return false;
+	if (!sw_mcstream_writer_open(&f.indices, index_path)) {
+		sw_mcstream_writer_close(&f.vertices);
+		sw_file_delete(vertex_path);
+		return false;
+	}
+	sw_mcstream_sink_t sink = {.vertex = sw_mcstream_file_vertex,
+	                           .triangle = sw_mcstream_file_triangle,
+	                           .param = &f};
+	sw_mcstream_stats_t s = sw_mc_stream_sdf_chunk(sdf, chunk, fn, fparam, &sink, jobs);
+	s.working_set += 2 * SW_MCSTREAM_WRITE_BUFFER;
+	sw_mcstream_writer_close(&f.vertices);
+	sw_mcstream_writer_close(&f.indices);
+	if (stats != NULL) *stats = s;
+
+	bool narrow = index == SW_MCSTREAM_INDEX_32 ||
+	              (index == SW_MCSTREAM_INDEX_AUTO && s.vertex_count <= UINT32_MAX);
+	if (narrow && s.vertex_count > (uint64_t)UINT32_MAX + 1) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "%llu vertices do not fit 32 bit indices",
+		         (unsigned long long)s.vertex_count);
+		narrow = false;
+	}
+
+	sw_mcstream_writer_t out;
+	if (!sw_mcstream_writer_open(&out, filename)) {
+		sw_file_delete(vertex_path);
+		sw_file_delete(index_path);
+		return false;
+	}
+	sw_mcstream_file_header_t header = {.magic = SW_MCSTREAM_MAGIC,
+	                                    .version = SW_MCSTREAM_VERSION,
+	                                    .vertex_count = s.vertex_count,
+	                                    .index_count = s.triangle_count * 3,
+	                                    .vertex_stride = 9 * sizeof(float),
+	                                    .index_size = narrow ? 4 : 8};
+	sw_mcstream_writer_write(&out, &header, sizeof(header));
+	sw_mcstream_append(&out, vertex_path, false);
+	sw_mcstream_append(&out, index_path, narrow);
+	sw_mcstream_writer_close(&out);
+	return true;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file mcstream.h
+ * @brief Out-of-core Marching Cubes for very high resolutions. The chunk is swept in z-slabs, only
+ * two slabs of samples and the vertex ids on the edges between them are kept in memory, so memory
+ * is O(steps^2) regardless of the surface size. Finalized vertices and triangles are handed to a
+ * sink as soon as they are known.
+ */
+#pragma once
+
+#include "mc.h"
+#include "mesh.h"
+
+#include <krink/math/vector.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SW_MCSTREAM_VERSION 1
+
+typedef struct sw_mcstream_sink {
+	// Vertices are numbered in the order they are emitted, starting at `0`
+	void (*vertex)(void *param, kr_vec3_t pos, kr_vec3_t normal, kr_vec3_t color);
+	void (*triangle)(void *param, uint64_t a, uint64_t b, uint64_t c);
+	void *param;
+} sw_mcstream_sink_t;
+
+typedef struct sw_mcstream_stats {
+	uint64_t vertex_count;
+	uint64_t triangle_count;
+	size_t working_set; // Bytes held by the extraction itself
+} sw_mcstream_stats_t;
+
+typedef enum sw_mcstream_index {
+	SW_MCSTREAM_INDEX_AUTO, // 32 bit whenever the vertex count allows it
+	SW_MCSTREAM_INDEX_32,
+	SW_MCSTREAM_INDEX_64,
+} sw_mcstream_index_t;
+
+/**
+ * @brief File header written by `sw_mc_stream_sdf_chunk_to_file`. It is followed by
+ * `vertex_count` vertices in the layout of `sw_mesh_write_vert_buffer` and `index_count` indices
+ * of `index_size` bytes.
+ */
+typedef struct sw_mcstream_file_header {
+	uint32_t magic; // "SWMS"
+	uint32_t version;
+	uint64_t vertex_count;
+	uint64_t index_count;
+	uint32_t vertex_stride;
+	uint32_t index_size;
+} sw_mcstream_file_header_t;
+
+/**
+ * @brief Streaming counterpart of `sw_mc_process_custom_chunk_color`. Every grid point is sampled
+ * once and every crossed edge produces exactly one vertex. `density` is called from the calling
+ * thread only.
+ *
+ * @param chunk
+ * @param density
+ * @param density_param
+ * @param fn Vertex normals, zero normals are emitted if `NULL`
+ * @param fparam
+ * @param sink
+ * @return sw_mcstream_stats_t
+ */
+sw_mcstream_stats_t sw_mc_stream_custom_chunk(const sw_mc_chunk_t *chunk,
+                                              sw_density_color_func_t density, void *density_param,
+                                              sw_mesh_normal_func_t fn, void *fparam,
+                                              const sw_mcstream_sink_t *sink);
+
+/**
+ * @brief Like `sw_mc_stream_custom_chunk` for a SDF. With `jobs` every slab is sampled on the
+ * workers, the vertices and triangles are still emitted from the calling thread in the same order.
+ *
+ * @param sdf
+ * @param chunk
+ * @param fn
+ * @param fparam
+ * @param sink
+ * @param jobs May be `NULL`
+ * @return sw_mcstream_stats_t
+ */
+sw_mcstream_stats_t sw_mc_stream_sdf_chunk(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                           sw_mesh_normal_func_t fn, void *fparam,
+                                           const sw_mcstream_sink_t *sink, sw_jobs_t *jobs);
+
+/**
+ * @brief Stream the surface of a SDF straight into a file. Vertices and indices go to two
+ * temporary files next to `filename` first and are concatenated behind the header at the end.
+ *
+ * @param sdf
+ * @param chunk
+ * @param fn
+ * @param fparam
+ * @param index
+ * @param filename
+ * @param stats If not `NULL`, receives the extraction statistics
+ * @param jobs See `sw_mc_stream_sdf_chunk`
+ * @return bool
+ */
+bool sw_mc_stream_sdf_chunk_to_file(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk,
+                                    sw_mesh_normal_func_t fn, void *fparam,
+                                    sw_mcstream_index_t index, const char *filename,
+                                    sw_mcstream_stats_t *stats, sw_jobs_t *jobs);
@@ -1,68 +1,104 @@
 #include "mesh.h"
+#include "mesh_internal.h"
+#include "raymarch.h"
+#include "stats.h"
+#include "trace.h"
 
-#include <krink/memory.h>
 #include <sht/sht.h>
-#include <util/list.h>
+#include <util/memory.h>
+#include <util/scratch.h>
 
 #include <assert.h>
+#include <math.h>
 #include <stdint.h>
+#include <string.h>
 
-typedef struct sw_vertex {
-	kr_vec3_t pos;
-	kr_vec3_t normal;
-	kr_vec3_t color;
-	sw_list_int_t *tris;
-} sw_vertex_t;
-
-typedef struct sw_triangle {
-	int va;
-	int vb;
-	int vc;
-	kr_vec3_t face_normal_mag;
-} sw_triangle_t;
-
-struct sw_mesh {
-	sw_vertex_t *vertices;
-	sht_t *vert_id_map;
-	sw_triangle_t *triangles;
-	int next_vert;
-	int vert_cap;
-	int next_tris;
-	int tris_cap;
-	sw_mesh_normal_func_t fn;
-	void *fparam;
-};
+void *sw_mesh_internal_alloc(sw_mesh_t *m, size_t size) {
+	void *p = (m->arena != NULL) ? sw_arena_alloc(m->arena, size) : sw_malloc(size);
+	assert(p != NULL);
+	return p;
+}
 
-sw_mesh_t *sw_mesh_init(int reserve_vert, int reserve_tris, sw_mesh_normal_func_t fn, void *fparam) {
-	sw_mesh_t *m = (sw_mesh_t *)kr_malloc(sizeof(sw_mesh_t));
-	assert(m != NULL);
+void *sw_mesh_internal_realloc(sw_mesh_t *m, void *p, size_t old_size, size_t new_size) {
+	p = (m->arena != NULL) ? sw_arena_realloc(m->arena, p, old_size, new_size)
+	                       : sw_realloc(p, new_size);
+	assert(p != NULL);
+	return p;
+}
+
+void sw_mesh_internal_free(sw_mesh_t *m, void *p) {
+	// Arena memory is only released as a whole
+	if (m->arena == NULL) sw_free(p);
+}
+
+static int sw_mesh_lookup_cap(int verts) {
+	int cap = 16;
+	while (cap < verts * 2) cap *= 2;
+	return cap;
+}
+
+static void sw_mesh_setup(sw_mesh_t *m, int reserve_vert, int reserve_tris,
+                          sw_mesh_normal_func_t fn, void *fparam) {
 	reserve_vert = (reserve_vert > 0) ? reserve_vert : 16;
 	reserve_tris = (reserve_tris > 0) ? reserve_tris : 8;
-	m->vertices = (sw_vertex_t *)kr_malloc(reserve_vert * sizeof(sw_vertex_t));
+	m->vertices = (sw_vertex_t *)sw_mesh_internal_alloc(m, reserve_vert * sizeof(sw_vertex_t));
 	m->next_vert = 0;
 	m->vert_cap = reserve_vert;
-	m->vert_id_map = sht_init_alloc(sizeof(int), reserve_vert, 42, kr_malloc, kr_free);
-	m->triangles = (sw_triangle_t *)kr_malloc(reserve_tris * sizeof(sw_triangle_t));
+	m->lookup_cap = sw_mesh_lookup_cap(reserve_vert);
+	m->vert_lookup = (int *)sw_mesh_internal_alloc(m, m->lookup_cap * sizeof(int));
+	memset(m->vert_lookup, 0xff, m->lookup_cap * sizeof(int));
+	m->triangles = (sw_triangle_t *)sw_mesh_internal_alloc(m, reserve_tris * sizeof(sw_triangle_t));
 	m->next_tris = 0;
 	m->tris_cap = reserve_tris;
-	assert(m->vertices != NULL && m->triangles != NULL && m->vert_id_map != NULL);
 	m->fn = fn;
 	m->fparam = fparam;
+}
+
+sw_mesh_t *sw_mesh_init(int reserve_vert, int reserve_tris, sw_mesh_normal_func_t fn, void *fparam) {
+	sw_mesh_t *m = (sw_mesh_t *)sw_malloc(sizeof(sw_mesh_t));
+	assert(m != NULL);
+	m->arena = NULL;
+	sw_mesh_setup(m, reserve_vert, reserve_tris, fn, fparam);
+	return m;
+}
+
+sw_mesh_t *sw_mesh_init_arena(sw_arena_t *arena, int reserve_vert, int reserve_tris,
+                              sw_mesh_normal_func_t fn, void *fparam) {
+	assert(arena != NULL);
+	sw_mesh_t *m = (sw_mesh_t *)sw_arena_alloc(arena, sizeof(sw_mesh_t));
+	assert(m != NULL);
+	m->arena = arena;
+	sw_mesh_setup(m, reserve_vert, reserve_tris, fn, fparam);
 	return m;
 }
 
 void sw_mesh_destroy(sw_mesh_t *m) {
 	assert(m != NULL);
-	for (int i = 0; i < m->next_vert; ++i) sw_list_int_destroy(m->vertices[i].tris);
-	kr_free(m->vertices);
+	if (m->arena != NULL) return;
+	sw_free(m->vertices);
 	m->vertices = NULL;
-	sht_destroy(m->vert_id_map);
-	kr_free(m->triangles);
+	sw_free(m->vert_lookup);
+	m->vert_lookup = NULL;
+	sw_free(m->triangles);
 	m->triangles = NULL;
-	kr_free(m);
+	sw_free(m);
+}
+
+void sw_mesh_reset(sw_mesh_t *m) {
+	assert(m != NULL);
+	m->next_vert = 0;
+	m->next_tris = 0;
+	memset(m->vert_lookup, 0xff, m->lookup_cap * sizeof(int));
 }
 
-static kr_vec3_t sw_triangle_face_normal(kr_vec3_t a, kr_vec3_t b, kr_vec3_t c) {
+sw_mesh_t *sw_mesh_copy(const sw_mesh_t *src) {
+	assert(src != NULL);
+	sw_mesh_t *m = sw_mesh_init(src->vert_cap, src->tris_cap, src->fn, src->fparam);
+	sw_mesh_append(m, src);
+	return m;
+}
+
+kr_vec3_t sw_triangle_face_normal(kr_vec3_t a, kr_vec3_t b, kr_vec3_t c) {
 	kr_vec3_t u = kr_vec3_subv(b, a);
 	kr_vec3_t v = kr_vec3_subv(c, a);
 	return (kr_vec3_t){
@@ -71,33 +107,74 @@ static kr_vec3_t sw_triangle_face_normal(kr_vec3_t a, kr_vec3_t b, kr_vec3_t c)
 
 static void sw_resize_verts(sw_mesh_t *m) {
 	if (m->next_vert < m->vert_cap) return;
-	m->vertices = kr_realloc(m->vertices, m->vert_cap * 2 * sizeof(sw_vertex_t));
-	assert(m->vertices != 0);
+	m->vertices = sw_mesh_internal_realloc(m, m->vertices, m->vert_cap * sizeof(sw_vertex_t),
+	                                       m->vert_cap * 2 * sizeof(sw_vertex_t));
 	m->vert_cap *= 2;
 }
 
 static void sw_resize_tris(sw_mesh_t *m) {
 	if (m->next_tris < m->tris_cap) return;
-	m->triangles = kr_realloc(m->triangles, m->tris_cap * 2 * sizeof(sw_triangle_t));
-	assert(m->triangles != 0);
+	m->triangles = sw_mesh_internal_realloc(m, m->triangles, m->tris_cap * sizeof(sw_triangle_t),
+	                                        m->tris_cap * 2 * sizeof(sw_triangle_t));
 	m->tris_cap *= 2;
 }
 
-static int sw_add_vertex(sw_mesh_t *m, kr_vec3_t pos, kr_vec3_t color, int triangle_id) {
-	int *id = sht_get(m->vert_id_map, &pos, sizeof(pos));
-	int ret = -1;
-	if (id == NULL) {
-		sw_resize_verts(m);
-		m->vertices[m->next_vert].pos = pos;
-		m->vertices[m->next_vert].normal = m->fn(m->fparam, pos);
-		m->vertices[m->next_vert].color = color;
-		m->vertices[m->next_vert].tris = sw_list_int_init(4);
-		sht_set(m->vert_id_map, &pos, sizeof(kr_vec3_t), &m->next_vert);
-		ret = m->next_vert++;
+static uint32_t sw_mesh_hash_pos(kr_vec3_t pos) {
+	// Bitwise hash, matching positions have to be bit identical
+	uint32_t k[3];
+	memcpy(k, &pos, sizeof(k));
+	uint64_t h = ((uint64_t)k[0] << 32 | k[1]) * 0xff51afd7ed558ccdull;
+	h ^= (h >> 32) ^ ((uint64_t)k[2] * 0xc4ceb9fe1a85ec53ull);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 29;
+	return (uint32_t)h;
+}
+
+// Returns the slot holding `pos` or the empty slot where it would be inserted
+static int sw_mesh_lookup_slot(sw_mesh_t *m, kr_vec3_t pos) {
+	uint32_t mask = (uint32_t)m->lookup_cap - 1;
+	uint32_t i = sw_mesh_hash_pos(pos) & mask;
+	SW_STATS_INC(mesh_lookups);
+	for (;;) {
+		int id = m->vert_lookup[i];
+		if (id < 0 || memcmp(&m->vertices[id].pos, &pos, sizeof(kr_vec3_t)) == 0) return (int)i;
+		SW_STATS_INC(mesh_collisions);
+		i = (i + 1) & mask;
 	}
+}
+
+static void sw_mesh_lookup_insert(sw_mesh_t *m, int id) {
+	int slot = sw_mesh_lookup_slot(m, m->vertices[id].pos);
+	if (m->vert_lookup[slot] < 0) m->vert_lookup[slot] = id;
+}
+
+static void sw_mesh_lookup_rebuild(sw_mesh_t *m) {
+	int cap = sw_mesh_lookup_cap(m->vert_cap);
+	if (cap > m->lookup_cap) {
+		sw_mesh_internal_free(m, m->vert_lookup);
+		m->vert_lookup = (int *)sw_mesh_internal_alloc(m, cap * sizeof(int));
+		m->lookup_cap = cap;
+	}
+	memset(m->vert_lookup, 0xff, m->lookup_cap * sizeof(int));
+	for (int i = 0; i < m->next_vert; ++i) sw_mesh_lookup_insert(m, i);
+}
+
+// `normal` may be `NULL` to ask the normal callback of the mesh
+static int sw_add_vertex(sw_mesh_t *m, kr_vec3_t pos, kr_vec3_t color, const kr_vec3_t *normal) {
+	int slot = sw_mesh_lookup_slot(m, pos);
+	if (m->vert_lookup[slot] >= 0) return m->vert_lookup[slot];
+
+	sw_resize_verts(m);
+	int ret = m->next_vert++;
+	m->vertices[ret].pos = pos;
+	m->vertices[ret].normal = normal != NULL ? *normal : m->fn(m->fparam, pos);
+	m->vertices[ret].color = color;
+	// Keep the load factor at or below 0.5
+	if (m->next_vert * 2 > m->lookup_cap)
+		sw_mesh_lookup_rebuild(m);
 	else
-		ret = *id;
-	sw_list_int_push(m->vertices[ret].tris, triangle_id);
+		m->vert_lookup[slot] = ret;
 	return ret;
 }
 
@@ -106,13 +183,39 @@ void sw_mesh_add_triangle(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c, kr
 	sw_mesh_t *m = (sw_mesh_t *)param;
 	sw_resize_tris(m);
 	m->triangles[m->next_tris] =
-	    (sw_triangle_t){.va = sw_add_vertex(m, a, ca, m->next_tris),
-	                    .vb = sw_add_vertex(m, b, cb, m->next_tris),
-	                    .vc = sw_add_vertex(m, c, cc, m->next_tris),
+	    (sw_triangle_t){.va = sw_add_vertex(m, a, ca, NULL),
+	                    .vb = sw_add_vertex(m, b, cb, NULL),
+	                    .vc = sw_add_vertex(m, c, cc, NULL),
+	                    .face_normal_mag = sw_triangle_face_normal(a, b, c)};
+	++m->next_tris;
+}
+
+void sw_mesh_add_triangle_normal(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c, kr_vec3_t na,
+                                 kr_vec3_t nb, kr_vec3_t nc, kr_vec3_t ca, kr_vec3_t cb,
+                                 kr_vec3_t cc) {
+	sw_mesh_t *m = (sw_mesh_t *)param;
+	sw_resize_tris(m);
+	m->triangles[m->next_tris] =
+	    (sw_triangle_t){.va = sw_add_vertex(m, a, ca, &na),
+	                    .vb = sw_add_vertex(m, b, cb, &nb),
+	                    .vc = sw_add_vertex(m, c, cc, &nc),
 	                    .face_normal_mag = sw_triangle_face_normal(a, b, c)};
 	++m->next_tris;
 }
 
+void sw_mesh_aabb(sw_mesh_t *m, kr_vec3_t *min, kr_vec3_t *max) {
+	kr_vec3_t lo = (kr_vec3_t){0.0f, 0.0f, 0.0f};
+	kr_vec3_t hi = lo;
+	if (m->next_vert > 0) lo = hi = m->vertices[0].pos;
+	for (int i = 1; i < m->next_vert; ++i) {
+		kr_vec3_t p = m->vertices[i].pos;
+		lo = (kr_vec3_t){fminf(lo.x, p.x), fminf(lo.y, p.y), fminf(lo.z, p.z)};
+		hi = (kr_vec3_t){fmaxf(hi.x, p.x), fmaxf(hi.y, p.y), fmaxf(hi.z, p.z)};
+	}
+	*min = lo;
+	*max = hi;
+}
+
 int sw_mesh_vert_count(sw_mesh_t *m) {
 	return m->next_vert;
 }
@@ -121,38 +224,165 @@ int sw_mesh_tris_count(sw_mesh_t *m) {
 	return m->next_tris;
 }
 
-static kr_vec3_t sw_smooth_vert_normal(sw_mesh_t *m, int vertex_id) {
-	kr_vec3_t n = (kr_vec3_t){.x = 0.0f, .y = 0.0f, .z = 0.0f};
-	sw_list_int_t *tris = m->vertices[vertex_id].tris;
-	int count = sw_list_int_len(tris);
-	assert(count > 0);
+void sw_mesh_internal_rebuild(sw_mesh_t *m) {
+	for (int i = 0; i < m->next_tris; ++i) {
+		sw_triangle_t *t = &m->triangles[i];
+		t->face_normal_mag = sw_triangle_face_normal(
+		    m->vertices[t->va].pos, m->vertices[t->vb].pos, m->vertices[t->vc].pos);
+	}
+	sw_mesh_lookup_rebuild(m);
+}
+
+void sw_mesh_append(sw_mesh_t *dst, const sw_mesh_t *src) {
+	assert(dst != NULL && src != NULL && dst != src);
+	int vert_offset = dst->next_vert;
+	for (int i = 0; i < src->next_vert; ++i) {
+		sw_resize_verts(dst);
+		dst->vertices[dst->next_vert++] = src->vertices[i];
+	}
+	for (int i = 0; i < src->next_tris; ++i) {
+		sw_resize_tris(dst);
+		sw_triangle_t t = src->triangles[i];
+		t.va += vert_offset;
+		t.vb += vert_offset;
+		t.vc += vert_offset;
+		dst->triangles[dst->next_tris++] = t;
+	}
+	sw_mesh_lookup_rebuild(dst);
+}
+
+typedef struct sw_weld_cell {
+	int x, y, z;
+} sw_weld_cell_t;
+
+static sw_weld_cell_t sw_weld_cell(kr_vec3_t p, float inv_cell) {
+	return (sw_weld_cell_t){.x = (int)floorf(p.x * inv_cell),
+	                        .y = (int)floorf(p.y * inv_cell),
+	                        .z = (int)floorf(p.z * inv_cell)};
+}
+
+static int sw_weld_find(sw_mesh_t *m, sht_t *grid, const int *chain, sw_weld_cell_t c,
+                        kr_vec3_t p, float eps_sq) {
+	for (int dz = -1; dz <= 1; ++dz)
+		for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx) {
+				sw_weld_cell_t n = (sw_weld_cell_t){.x = c.x + dx, .y = c.y + dy, .z = c.z + dz};
+				int *head = sht_get(grid, &n, sizeof(n));
+				for (int r = head ? *head : -1; r >= 0; r = chain[r]) {
+					kr_vec3_t d = kr_vec3_subv(m->vertices[r].pos, p);
+					if (kr_vec3_dot(d, d) <= eps_sq) return r;
+				}
+			}
+	return -1;
+}
+
+int sw_mesh_weld(sw_mesh_t *m, float epsilon) {
+	assert(m != NULL && epsilon > 0.0f);
+	int count = m->next_vert;
+	if (count == 0) return 0;
+
+	sw_trace_scope_t trace = sw_trace_begin("weld");
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *remap = (int *)sw_scratch_alloc(count * sizeof(int));
+	int *merged = (int *)sw_scratch_alloc(count * sizeof(int));
+	int *chain = (int *)sw_scratch_alloc(count * sizeof(int));
+	sht_t *grid = sht_init_alloc(sizeof(int), count, 42, sw_malloc, sw_free);
+	assert(grid != NULL);
+
+	// Representatives are compacted in place: a new representative always lands on an index that
+	// is <= the vertex currently visited, so no unvisited vertex is ever overwritten.
+	float inv_cell = 1.0f / epsilon;
+	float eps_sq = epsilon * epsilon;
+	int reps = 0;
 	for (int i = 0; i < count; ++i) {
-		int tris_id = sw_list_int_get(tris, i);
-		kr_vec3_t face_n = m->triangles[tris_id].face_normal_mag;
-		// Experimental:
-		// Inverse of the squared length from the face normal vector to give smaller faces more
-		// weight
-		float inv_mag = 1.0f / (face_n.x * face_n.x + face_n.y * face_n.y + face_n.z * face_n.z);
-		n = kr_vec3_addv(n, kr_vec3_mult(face_n, inv_mag));
+		sw_vertex_t v = m->vertices[i];
+		sw_weld_cell_t c = sw_weld_cell(v.pos, inv_cell);
+		int r = sw_weld_find(m, grid, chain, c, v.pos, eps_sq);
+		if (r < 0) {
+			r = reps++;
+			m->vertices[r] = v;
+			merged[r] = 1;
+			int *head = sht_get(grid, &c, sizeof(c));
+			chain[r] = head ? *head : -1;
+			sht_set(grid, &c, sizeof(c), &r);
+		}
+		else {
+			m->vertices[r].normal = kr_vec3_addv(m->vertices[r].normal, v.normal);
+			m->vertices[r].color = kr_vec3_addv(m->vertices[r].color, v.color);
+			++merged[r];
+		}
+		remap[i] = r;
+	}
+
+	for (int i = 0; i < reps; ++i) {
+		if (merged[i] == 1) continue;
+		m->vertices[i].color = kr_vec3_mult(m->vertices[i].color, 1.0f / merged[i]);
+		kr_vec3_t n = m->vertices[i].normal;
+		if (kr_vec3_dot(n, n) > 0.0f) m->vertices[i].normal = kr_vec3_normalized(n);
+	}
+	m->next_vert = reps;
+
+	int tris = 0;
+	for (int i = 0; i < m->next_tris; ++i) {
+		sw_triangle_t t = m->triangles[i];
+		t.va = remap[t.va];
+		t.vb = remap[t.vb];
+		t.vc = remap[t.vc];
+		// Triangles smaller than epsilon collapse to a line or point
+		if (t.va == t.vb || t.vb == t.vc || t.vc == t.va) continue;
+		m->triangles[tris++] = t;
 	}
+	m->next_tris = tris;
+	sw_mesh_internal_rebuild(m);
+
+	sht_destroy(grid);
+	sw_scratch_end(mark);
+	sw_trace_end(&trace, count - reps);
+	return count - reps;
+}
+
+typedef struct sw_mesh_normals_arg {
+	sw_mesh_t *m;
+	const sw_sdf_t *sdf;
+	sw_jobs_t *jobs;
+} sw_mesh_normals_arg_t;
 
-	return kr_vec3_normalized(n);
+static void sw_mesh_sdf_normals_range(void *param, int begin, int end, int slot) {
+	sw_mesh_normals_arg_t *a = (sw_mesh_normals_arg_t *)param;
+	sw_trace_scope_t trace = sw_trace_begin("normals_block");
+	sw_sdf_stack_frame_t *stack = sw_jobs_sdf_stack(a->jobs, a->sdf, slot);
+	for (int i = begin; i < end; ++i)
+		a->m->vertices[i].normal =
+		    sw_raymarch_surface_normal(a->sdf, stack, a->m->vertices[i].pos);
+	sw_trace_end(&trace, begin);
+}
+
+void sw_mesh_sdf_normals(sw_mesh_t *m, const sw_sdf_t *sdf, sw_jobs_t *jobs) {
+	assert(m != NULL && sdf != NULL);
+	sw_trace_scope_t trace = sw_trace_begin("normals");
+	if (jobs == NULL) {
+		sw_scratch_mark_t mark = sw_scratch_begin();
+		sw_sdf_stack_frame_t *stack =
+		    (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf));
+		for (int i = 0; i < m->next_vert; ++i)
+			m->vertices[i].normal = sw_raymarch_surface_normal(sdf, stack, m->vertices[i].pos);
+		sw_scratch_end(mark);
+	}
+	else {
+		sw_mesh_normals_arg_t a = (sw_mesh_normals_arg_t){.m = m, .sdf = sdf, .jobs = jobs};
+		sw_jobs_parallel_for(jobs, 0, m->next_vert, 1024, sw_mesh_sdf_normals_range, &a);
+	}
+	sw_trace_end(&trace, m->next_vert);
 }
 
 void sw_mesh_write_vert_buffer(sw_mesh_t *m, float *buffer) {
+	sw_trace_scope_t trace = sw_trace_begin("write_vert_buffer");
 	for (int i = 0; i < m->next_vert; ++i) {
 		int offset = i * 9;
 		buffer[offset + 0] = m->vertices[i].pos.x;
 		buffer[offset + 1] = m->vertices[i].pos.y;
 		buffer[offset + 2] = m->vertices[i].pos.z;
 
-		/*
-		// Could be used to compute normal by analyzing adjacent faces of a vertex
-		kr_vec3_t n = sw_smooth_vert_normal(m, i);
-		buffer[offset + 3] = n.x;
-		buffer[offset + 4] = n.y;
-		buffer[offset + 5] = n.z;
-		*/
 		buffer[offset + 3] = m->vertices[i].normal.x;
 		buffer[offset + 4] = m->vertices[i].normal.y;
 		buffer[offset + 5] = m->vertices[i].normal.z;
@@ -161,12 +391,15 @@ void sw_mesh_write_vert_buffer(sw_mesh_t *m, float *buffer) {
 		buffer[offset + 7] = m->vertices[i].color.y;
 		buffer[offset + 8] = m->vertices[i].color.z;
 	}
+	sw_trace_end(&trace, m->next_vert);
 }
 
 void sw_mesh_write_index_buffer(sw_mesh_t *m, int *buffer) {
+	sw_trace_scope_t trace = sw_trace_begin("write_index_buffer");
 	for (int i = 0; i < m->next_tris; ++i) {
 		buffer[i * 3 + 0] = m->triangles[i].va;
 		buffer[i * 3 + 1] = m->triangles[i].vb;
 		buffer[i * 3 + 2] = m->triangles[i].vc;
 	}
+	sw_trace_end(&trace, m->next_tris);
 }
@@ -1,14 +1,191 @@
 #pragma once
 
+#include "jobs.h"
+#include "sdf.h"
+
 #include <krink/math/vector.h>
+#include <util/arena.h>
 
 typedef struct sw_mesh sw_mesh_t;
 typedef kr_vec3_t (*sw_mesh_normal_func_t)(void *, kr_vec3_t);
 
 sw_mesh_t *sw_mesh_init(int reserve_vert, int reserve_tris, sw_mesh_normal_func_t fn, void *fparam);
+/**
+ * @brief Create a mesh whose storage lives in `arena`. The mesh is released together with the
+ * arena, `sw_mesh_destroy` is a no-op for it. Growing the mesh past its reserve allocates from the
+ * arena again, so reserve generously when the arena is shared.
+ *
+ * @param arena
+ * @param reserve_vert
+ * @param reserve_tris
+ * @param fn
+ * @param fparam
+ * @return sw_mesh_t*
+ */
+sw_mesh_t *sw_mesh_init_arena(sw_arena_t *arena, int reserve_vert, int reserve_tris,
+                              sw_mesh_normal_func_t fn, void *fparam);
 void sw_mesh_destroy(sw_mesh_t *m);
+/**
+ * @brief Remove all vertices and triangles while keeping the allocated capacity, so a mesh can be
+ * regenerated every frame without touching the allocator.
+ *
+ * @param m
+ */
+void sw_mesh_reset(sw_mesh_t *m);
+
+/**
+ * @brief Create an independent copy of a mesh, sharing the normal callback of `src`.
+ *
+ * @param src
+ * @return sw_mesh_t*
+ */
+sw_mesh_t *sw_mesh_copy(const sw_mesh_t *src);
 void sw_mesh_add_triangle(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c, kr_vec3_t ca,
                           kr_vec3_t cb, kr_vec3_t cc);
+/**
+ * @brief Add a triangle with given vertex normals, the normal callback of the mesh is not called
+ * and may be `NULL` if only these are added. A vertex welded to an existing one keeps its normal.
+ */
+void sw_mesh_add_triangle_normal(void *param, kr_vec3_t a, kr_vec3_t b, kr_vec3_t c, kr_vec3_t na,
+                                 kr_vec3_t nb, kr_vec3_t nc, kr_vec3_t ca, kr_vec3_t cb,
+                                 kr_vec3_t cc);
+/**
+ * @brief Append all vertices and triangles of `src` to `dst`. Vertices are copied as is, use
+ * `sw_mesh_weld` afterwards to stitch separately meshed chunks together.
+ *
+ * @param dst
+ * @param src
+ */
+void sw_mesh_append(sw_mesh_t *dst, const sw_mesh_t *src);
+
+/**
+ * @brief Merge vertices that are closer than `epsilon` to each other. Positions are quantized into
+ * a spatial hash grid with a cell size of `epsilon` and only neighbouring cells are searched, so the
+ * pass runs in linear time. Normals and colors of merged vertices are averaged and triangles that
+ * collapse in the process are removed.
+ *
+ * @param m
+ * @param epsilon Welding tolerance, must be greater than `0`
+ * @return int The number of vertices removed
+ */
+int sw_mesh_weld(sw_mesh_t *m, float epsilon);
+
+/**
+ * @brief Reduce the triangle count using quadric error metric edge collapses. Boundary edges are
+ * kept in place and collapses between differently colored vertices are penalized, so color borders
+ * survive until late in the reduction. Stops once `target_tris` is reached, the next collapse
+ * would exceed `max_error` or no remaining collapse keeps the surface manifold without flipping
+ * triangles, so the result may stay above `target_tris`.
+ *
+ * @param m
+ * @param target_tris Triangle count to reduce to
+ * @param max_error Maximum geometric deviation (in world units) a single collapse may introduce
+ * @return int The resulting triangle count
+ */
+int sw_mesh_simplify(sw_mesh_t *m, int target_tris, float max_error);
+
+/**
+ * @brief Generate a LOD chain in one call. Every level is a new mesh simplified from the previous
+ * one (level `0` from `m`) to `ratio` times its triangle count. Generation stops early once a level
+ * cannot be reduced any further within `max_error`.
+ *
+ * @param m The source mesh, left untouched
+ * @param lods Receives `lod_count` meshes at most, release each with `sw_mesh_destroy`
+ * @param lod_count
+ * @param ratio Triangle ratio between consecutive levels in `(0, 1)`
+ * @param max_error See `sw_mesh_simplify`
+ * @return int The number of levels written to `lods`
+ */
+int sw_mesh_simplify_lods(const sw_mesh_t *m, sw_mesh_t **lods, int lod_count, float ratio,
+                          float max_error);
+
+typedef struct sw_mesh_cache_stats {
+	float acmr; // Average cache miss ratio, vertex shader invocations per triangle (0.5 - 3.0)
+	float atvr; // Average transformed vertex ratio, invocations per referenced vertex (>= 1.0)
+	int misses;
+} sw_mesh_cache_stats_t;
+
+/**
+ * @brief Simulate a FIFO post-transform vertex cache of `cache_size` entries over an index buffer.
+ *
+ * @param indices
+ * @param index_count
+ * @param vert_count
+ * @param cache_size Number of cache entries, 16 to 32 matches most desktop and mobile GPUs
+ * @return sw_mesh_cache_stats_t
+ */
+sw_mesh_cache_stats_t sw_analyze_vertex_cache(const int *indices, int index_count, int vert_count,
+                                              int cache_size);
+
+/**
+ * @brief Simulate the vertex cache efficiency of the index buffer `sw_mesh_write_index_buffer`
+ * would produce.
+ *
+ * @param m
+ * @param cache_size
+ * @return sw_mesh_cache_stats_t
+ */
+sw_mesh_cache_stats_t sw_mesh_analyze_vertex_cache(sw_mesh_t *m, int cache_size);
+
+/**
+ * @brief Reorder triangles for post-transform vertex cache reuse (Forsyth). The extraction order
+ * of the marching cubes scanlines reuses few vertices between consecutive rows.
+ *
+ * @param m
+ */
+void sw_mesh_optimize_vertex_cache(sw_mesh_t *m);
+
+/**
+ * @brief Reorder triangles to reduce overdraw independent of the view (Sander et al.). The vertex
+ * cache order is split into clusters whose ACMR stays close to the original, clusters lying
+ * further out along their normal are drawn first. The order is kept if the simulated ACMR would
+ * grow by more than `threshold`. Run this after `sw_mesh_optimize_vertex_cache`.
+ *
+ * @param m
+ * @param cache_size Simulated FIFO size
+ * @param threshold Allowed ACMR factor, `>= 1`, around 1.05 trades little cache efficiency
+ */
+void sw_mesh_optimize_overdraw(sw_mesh_t *m, int cache_size, float threshold);
+
+/**
+ * @brief Reorder vertices by first use in the index buffer for vertex fetch locality. Run this
+ * after `sw_mesh_optimize_vertex_cache`. Vertices not referenced by any triangle are removed.
+ *
+ * @param m
+ */
+void sw_mesh_optimize_vertex_fetch(sw_mesh_t *m);
+
+/**
+ * @brief Optional optimization stage before writing the buffers, runs the vertex cache, overdraw
+ * and vertex fetch optimizations and reports the simulated cache efficiency before and after.
+ *
+ * @param m
+ * @param cache_size Simulated FIFO size used for the reported statistics
+ * @param before Can be `NULL`
+ * @param after Can be `NULL`
+ */
+void sw_mesh_optimize(sw_mesh_t *m, int cache_size, sw_mesh_cache_stats_t *before,
+                      sw_mesh_cache_stats_t *after);
+
+/**
+ * @brief Replace all vertex normals by the SDF gradient at the vertex positions. Lets meshes be built
+ * with a cheap normal callback and get their normals computed in parallel afterwards.
+ *
+ * @param m
+ * @param sdf
+ * @param jobs May be `NULL`
+ */
+void sw_mesh_sdf_normals(sw_mesh_t *m, const sw_sdf_t *sdf, sw_jobs_t *jobs);
+
+/**
+ * @brief Axis aligned bounding box of all vertices, both are zero for an empty mesh.
+ *
+ * @param m
+ * @param min
+ * @param max
+ */
+void sw_mesh_aabb(sw_mesh_t *m, kr_vec3_t *min, kr_vec3_t *max);
+
 int sw_mesh_vert_count(sw_mesh_t *m);
 int sw_mesh_tris_count(sw_mesh_t *m);
 
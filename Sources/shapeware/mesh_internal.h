@@ -0,0 +1,55 @@
+#pragma once
+
+/*! \file mesh_internal.h
+    \brief Mesh layout shared between the mesh processing passes. Not part of the public API.
+*/
+
+#include "mesh.h"
+
+#include <stddef.h>
+#include <util/arena.h>
+
+typedef struct sw_vertex {
+	kr_vec3_t pos;
+	kr_vec3_t normal;
+	kr_vec3_t color;
+} sw_vertex_t;
+
+typedef struct sw_triangle {
+	int va;
+	int vb;
+	int vc;
+	kr_vec3_t face_normal_mag;
+} sw_triangle_t;
+
+struct sw_mesh {
+	sw_vertex_t *vertices;
+	sw_triangle_t *triangles;
+	int *vert_lookup; // Open addressing table of vertex ids keyed by position, `-1` = empty
+	int lookup_cap;   // Power of two
+	int next_vert;
+	int vert_cap;
+	int next_tris;
+	int tris_cap;
+	sw_arena_t *arena; // `NULL` for heap allocated meshes
+	sw_mesh_normal_func_t fn;
+	void *fparam;
+};
+
+kr_vec3_t sw_triangle_face_normal(kr_vec3_t a, kr_vec3_t b, kr_vec3_t c);
+
+/**
+ * @brief Allocate mesh storage from the arena of the mesh or the heap. Passes that replace one of
+ * the mesh arrays must use these instead of `sw_malloc`.
+ */
+void *sw_mesh_internal_alloc(sw_mesh_t *m, size_t size);
+void *sw_mesh_internal_realloc(sw_mesh_t *m, void *p, size_t old_size, size_t new_size);
+void sw_mesh_internal_free(sw_mesh_t *m, void *p);
+
+/**
+ * @brief Recompute face normals and the vertex lookup after a pass rewrote the vertex and/or
+ * triangle arrays.
+ *
+ * @param m
+ */
+void sw_mesh_internal_rebuild(sw_mesh_t *m);
@@ -0,0 +1,203 @@
+#include "meshcache.h"
+
+#include "raymarch.h"
+
+#include <assert.h>
+#include <kinc/io/filereader.h>
+#include <kinc/io/filewriter.h>
+#include <kinc/log.h>
+#include <stdio.h>
+#include <string.h>
+#include <util/file.h>
+#include <util/hash.h>
+#include <util/memory.h>
+
+#define SW_MESHCACHE_MAGIC 0x434d5753u // "SWMC"
+#define SW_MESHCACHE_VERSION 1
+#define SW_MESHCACHE_PATH_LEN 256
+
+typedef struct sw_meshcache_entry {
+	uint64_t key;
+	uint64_t size;
+	uint64_t last_used;
+} sw_meshcache_entry_t;
+
+typedef struct sw_meshcache_index_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t tick;
+	uint64_t count;
+} sw_meshcache_index_header_t;
+
+struct sw_meshcache {
+	char dir[SW_MESHCACHE_PATH_LEN];
+	uint64_t max_bytes;
+	uint64_t total;
+	uint64_t tick;
+	sw_meshcache_entry_t *entries;
+	int count;
+	int cap;
+};
+
+static void sw_meshcache_entry_path(const sw_meshcache_t *c, uint64_t key, char *path) {
+	snprintf(path, SW_MESHCACHE_PATH_LEN, "%s/%016llx.swm", c->dir, (unsigned long long)key);
+}
+
+static void sw_meshcache_index_path(const sw_meshcache_t *c, char *path) {
+	snprintf(path, SW_MESHCACHE_PATH_LEN, "%s/index.bin", c->dir);
+}
+
+static int sw_meshcache_find(const sw_meshcache_t *c, uint64_t key) {
+	for (int i = 0; i < c->count; ++i)
+		if (c->entries[i].key == key) return i;
+	return -1;
+}
+
+static void sw_meshcache_remove(sw_meshcache_t *c, int i) {
+	char path[SW_MESHCACHE_PATH_LEN];
+	sw_meshcache_entry_path(c, c->entries[i].key, path);
+	sw_file_delete(path);
+	c->total -= c->entries[i].size;
+	c->entries[i] = c->entries[--c->count];
+}
+
+static void sw_meshcache_push(sw_meshcache_t *c, sw_meshcache_entry_t e) {
+	if (c->count == c->cap) {
+		c->cap *= 2;
+		c->entries = (sw_meshcache_entry_t *)sw_realloc(c->entries,
+		                                                c->cap * sizeof(sw_meshcache_entry_t));
+		assert(c->entries != NULL);
+	}
+	c->entries[c->count++] = e;
+	c->total += e.size;
+}
+
+sw_meshcache_t *sw_meshcache_init(const char *dir, uint64_t max_bytes) {
+	assert(dir != NULL && strlen(dir) < SW_MESHCACHE_PATH_LEN - 32);
+	sw_meshcache_t *c = (sw_meshcache_t *)sw_malloc(sizeof(sw_meshcache_t));
+	assert(c != NULL);
+	strcpy(c->dir, dir);
+	c->max_bytes = max_bytes;
+	c->total = 0;
+	c->tick = 0;
+	c->count = 0;
+	c->cap = 64;
+	c->entries = (sw_meshcache_entry_t *)sw_malloc(c->cap * sizeof(sw_meshcache_entry_t));
+	assert(c->entries != NULL);
+
+	char path[SW_MESHCACHE_PATH_LEN];
+	sw_meshcache_index_path(c, path);
+	kinc_file_reader_t reader;
+	if (!kinc_file_reader_open(&reader, path, KINC_FILE_TYPE_SAVE)) return c;
+	sw_meshcache_index_header_t header;
+	size_t size = kinc_file_reader_size(&reader);
+	if (size >= sizeof(header)) kinc_file_reader_read(&reader, &header, sizeof(header));
+	if (size < sizeof(header) || header.magic != SW_MESHCACHE_MAGIC ||
+	    header.version != SW_MESHCACHE_VERSION ||
+	    size < sizeof(header) + header.count * sizeof(sw_meshcache_entry_t)) {
+		kinc_log(KINC_LOG_LEVEL_WARNING, "Ignoring invalid mesh cache index '%s'", path);
+		kinc_file_reader_close(&reader);
+		return c;
+	}
+	c->tick = header.tick;
+	for (uint64_t i = 0; i < header.count; ++i) {
+		sw_meshcache_entry_t e;
+		kinc_file_reader_read(&reader, &e, sizeof(e));
+		sw_meshcache_push(c, e);
+	}
+	kinc_file_reader_close(&reader);
+	return c;
+}
+
+void sw_meshcache_flush(sw_meshcache_t *c) {
+	assert(c != NULL);
+	char path[SW_MESHCACHE_PATH_LEN];
+	sw_meshcache_index_path(c, path);
+	kinc_file_writer_t writer;
+	if (!kinc_file_writer_open(&writer, path)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for writing", path);
+		return;
+	}
+	sw_meshcache_index_header_t header = {.magic = SW_MESHCACHE_MAGIC,
+	                                      .version = SW_MESHCACHE_VERSION,
+	                                      .tick = c->tick,
+	                                      .count = (uint64_t)c->count};
+	kinc_file_writer_write(&writer, &header, sizeof(header));
+	kinc_file_writer_write(&writer, c->entries, c->count * sizeof(sw_meshcache_entry_t));
+	kinc_file_writer_close(&writer);
+}
+
+void sw_meshcache_destroy(sw_meshcache_t *c) {
+	assert(c != NULL);
+	sw_meshcache_flush(c);
+	sw_free(c->entries);
+	sw_free(c);
+}
+
+uint64_t sw_meshcache_key(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk, const sw_vformat_t *f,
+                          const sw_meshcache_normals_t *normals) {
+	assert(sdf != NULL && chunk != NULL && f != NULL && normals != NULL);
+	uint64_t h = sw_mc_chunk_hash(chunk, sw_sdf_hash(sdf));
+	h = sw_hash_int(h, SW_MESHFILE_VERSION);
+	h = sw_hash_int(h, f->position);
+	h = sw_hash_int(h, f->normal);
+	h = sw_hash_int(h, f->color);
+	if (f->normal == SW_VFORMAT_NORMAL_NONE) return h;
+
+	h = sw_hash_int(h, normals->method);
+	switch (normals->method) {
+	case SW_MESHCACHE_NORMALS_GRADIENT: {
+		float epsilon = SW_RAYMARCH_NORMAL_EPSILON;
+		return sw_hash_bytes(h, &epsilon, sizeof(epsilon));
+	}
+	case SW_MESHCACHE_NORMALS_CUSTOM:
+		return sw_hash_bytes(h, &normals->settings, sizeof(normals->settings));
+	default:
+		// The lattice step is part of the chunk
+		return h;
+	}
+}
+
+bool sw_meshcache_lookup(sw_meshcache_t *c, uint64_t key, sw_meshfile_t *file) {
+	assert(c != NULL && file != NULL);
+	int i = sw_meshcache_find(c, key);
+	if (i < 0) return false;
+	char path[SW_MESHCACHE_PATH_LEN];
+	sw_meshcache_entry_path(c, key, path);
+	if (!sw_meshfile_load(path, file)) {
+		// Deleted or damaged behind our back
+		sw_meshcache_remove(c, i);
+		return false;
+	}
+	c->entries[i].last_used = ++c->tick;
+	return true;
+}
+
+bool sw_meshcache_insert(sw_meshcache_t *c, uint64_t key, sw_mesh_t **lods,
+                         const sw_meshlets_t *meshlets, int lod_count, const sw_vformat_t *f) {
+	assert(c != NULL);
+	int i = sw_meshcache_find(c, key);
+	if (i >= 0) sw_meshcache_remove(c, i);
+
+	uint64_t size = sw_meshfile_size(lods, meshlets, lod_count, f);
+	if (size > c->max_bytes) return false;
+	while (c->total + size > c->max_bytes) {
+		int oldest = 0;
+		for (int j = 1; j < c->count; ++j)
+			if (c->entries[j].last_used < c->entries[oldest].last_used) oldest = j;
+		sw_meshcache_remove(c, oldest);
+	}
+
+	char path[SW_MESHCACHE_PATH_LEN];
+	sw_meshcache_entry_path(c, key, path);
+	if (!sw_meshfile_store(lods, meshlets, lod_count, f, path)) return false;
+	sw_meshcache_push(c, (sw_meshcache_entry_t){.key = key, .size = size, .last_used = ++c->tick});
+	// Keep the index in sync with the directory in case the application does not shut down cleanly
+	sw_meshcache_flush(c);
+	return true;
+}
+
+uint64_t sw_meshcache_size(sw_meshcache_t *c) {
+	assert(c != NULL);
+	return c->total;
+}
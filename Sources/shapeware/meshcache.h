@@ -0,0 +1,91 @@
+/**
+ * @file meshcache.h
+ * @brief Content addressed on-disk cache of meshing results, so unchanged models skip meshing on
+ * startup. Entries are mesh files in a directory, evicted least recently used first once the cache
+ * exceeds its size limit.
+ */
+#pragma once
+
+#include "mc.h"
+#include "meshfile.h"
+#include "sdf.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct sw_meshcache sw_meshcache_t;
+
+typedef enum sw_meshcache_normal_method {
+	SW_MESHCACHE_NORMALS_NONE,     // Zero normals, or a vertex format without normals
+	SW_MESHCACHE_NORMALS_GRADIENT, // SDF gradient at the vertex, `sw_raymarch_surface_normal`
+	SW_MESHCACHE_NORMALS_LATTICE,  // Lattice differences, `sw_mc_process_sdf_chunk_normal`
+	SW_MESHCACHE_NORMALS_CUSTOM,   // Application callback
+} sw_meshcache_normal_method_t;
+
+typedef struct sw_meshcache_normals {
+	sw_meshcache_normal_method_t method;
+	uint64_t settings; // Hash of everything the custom callback depends on, ignored otherwise
+} sw_meshcache_normals_t;
+
+/**
+ * @brief Open a cache directory, reading its index if there is one.
+ *
+ * @param dir Existing directory, relative to the save path like `sw_graph_store`
+ * @param max_bytes Size limit of all entries together
+ * @return sw_meshcache_t*
+ */
+sw_meshcache_t *sw_meshcache_init(const char *dir, uint64_t max_bytes);
+
+/**
+ * @brief Write the index and release the cache, the entries stay on disk.
+ *
+ * @param c
+ */
+void sw_meshcache_destroy(sw_meshcache_t *c);
+
+/**
+ * @brief Key for everything that determines a stored mesh file: the evaluated graph, the chunk, the
+ * vertex format and how the normals were computed, including the finite difference step of the
+ * gradient. Settings of later passes (LODs, meshlets) can be chained on with `sw_hash_bytes`.
+ *
+ * @param sdf
+ * @param chunk
+ * @param f
+ * @param normals Ignored if `f` has no normals
+ * @return uint64_t
+ */
+uint64_t sw_meshcache_key(const sw_sdf_t *sdf, const sw_mc_chunk_t *chunk, const sw_vformat_t *f,
+                          const sw_meshcache_normals_t *normals);
+
+/**
+ * @brief Load the entry stored under `key` and mark it as recently used.
+ *
+ * @param c
+ * @param key
+ * @param file Release with `sw_meshfile_destroy`
+ * @return bool False on a cache miss
+ */
+bool sw_meshcache_lookup(sw_meshcache_t *c, uint64_t key, sw_meshfile_t *file);
+
+/**
+ * @brief Store meshes under `key`, replacing an existing entry, and evict the least recently used
+ * entries until the cache fits its limit again.
+ *
+ * @param c
+ * @param key
+ * @param lods See `sw_meshfile_write`
+ * @param meshlets
+ * @param lod_count
+ * @param f
+ * @return bool False if the meshes exceed the limit or the file could not be written
+ */
+bool sw_meshcache_insert(sw_meshcache_t *c, uint64_t key, sw_mesh_t **lods,
+                         const sw_meshlets_t *meshlets, int lod_count, const sw_vformat_t *f);
+
+/**
+ * @brief Write the index, including the recency of lookups since the last write.
+ *
+ * @param c
+ */
+void sw_meshcache_flush(sw_meshcache_t *c);
+uint64_t sw_meshcache_size(sw_meshcache_t *c);
@@ -0,0 +1,258 @@
+#include "meshfile.h"
+
+#include <assert.h>
+#include <kinc/io/filereader.h>
+#include <kinc/io/filewriter.h>
+#include <kinc/log.h>
+#include <string.h>
+#include <util/file.h>
+#include <util/memory.h>
+
+#define SW_MESHFILE_MAGIC 0x464d5753u // "SWMF"
+// Stored in native byte order, reads back differently on a host of the other byte order
+#define SW_MESHFILE_BYTE_ORDER 0x01020304u
+
+typedef struct sw_meshfile_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;
+	uint32_t position;
+	uint32_t normal;
+	uint32_t color;
+	uint32_t stride;
+	uint32_t lod_count;
+	uint32_t byte_order;
+	uint32_t pad[2];
+} sw_meshfile_header_t;
+
+typedef struct sw_meshfile_level_record {
+	float dequant_offset[3];
+	float dequant_scale[3];
+	float aabb_min[3];
+	float aabb_max[3];
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t index_size;
+	uint32_t meshlet_count;
+	uint32_t meshlet_vertex_count;
+	uint32_t meshlet_index_count;
+	uint64_t vertex_offset;
+	uint64_t index_offset;
+	uint64_t meshlet_offset;
+	uint64_t meshlet_vertex_offset;
+	uint64_t meshlet_index_offset;
+} sw_meshfile_level_record_t;
+
+static uint64_t sw_meshfile_align(uint64_t offset) {
+	return (offset + SW_MESHFILE_ALIGNMENT - 1) & ~(uint64_t)(SW_MESHFILE_ALIGNMENT - 1);
+}
+
+// Compute the section offsets of every level, returns the file size
+static uint64_t sw_meshfile_plan(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                                 const sw_vformat_t *f, sw_meshfile_level_record_t *records) {
+	assert(lods != NULL && f != NULL && lod_count > 0 && lod_count <= SW_MESHFILE_MAX_LODS);
+	int stride = sw_vformat_get_layout(f).stride;
+	uint64_t offset = sw_meshfile_align(sizeof(sw_meshfile_header_t) +
+	                                    lod_count * sizeof(sw_meshfile_level_record_t));
+	for (int i = 0; i < lod_count; ++i) {
+		sw_meshfile_level_record_t *r = &records[i];
+		memset(r, 0, sizeof(*r));
+		r->vertex_count = (uint32_t)sw_mesh_vert_count(lods[i]);
+		r->index_count = (uint32_t)sw_mesh_tris_count(lods[i]) * 3;
+		r->index_size = sw_mesh_index_buffer_fits_16bit(lods[i]) ? 2 : 4;
+		r->vertex_offset = offset;
+		offset = sw_meshfile_align(offset + (uint64_t)r->vertex_count * stride);
+		r->index_offset = offset;
+		offset = sw_meshfile_align(offset + (uint64_t)r->index_count * r->index_size);
+		if (meshlets == NULL) continue;
+		r->meshlet_count = (uint32_t)meshlets[i].meshlet_count;
+		r->meshlet_vertex_count = (uint32_t)meshlets[i].vertex_count;
+		r->meshlet_index_count = (uint32_t)meshlets[i].triangle_count * 3;
+		r->meshlet_offset = offset;
+		offset = sw_meshfile_align(offset + r->meshlet_count * sizeof(sw_meshlet_t));
+		r->meshlet_vertex_offset = offset;
+		offset = sw_meshfile_align(offset + r->meshlet_vertex_count * sizeof(int));
+		r->meshlet_index_offset = offset;
+		offset = sw_meshfile_align(offset + r->meshlet_index_count);
+	}
+	return offset;
+}
+
+size_t sw_meshfile_size(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                        const sw_vformat_t *f) {
+	sw_meshfile_level_record_t records[SW_MESHFILE_MAX_LODS];
+	return (size_t)sw_meshfile_plan(lods, meshlets, lod_count, f, records);
+}
+
+size_t sw_meshfile_write(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                         const sw_vformat_t *f, void *buffer) {
+	assert(buffer != NULL && ((uintptr_t)buffer & 7) == 0);
+	sw_meshfile_level_record_t records[SW_MESHFILE_MAX_LODS];
+	uint64_t size = sw_meshfile_plan(lods, meshlets, lod_count, f, records);
+	uint8_t *out = (uint8_t *)buffer;
+	// Padding between sections is zeroed for reproducible files
+	memset(out, 0, (size_t)size);
+
+	sw_meshfile_header_t header = {.magic = SW_MESHFILE_MAGIC,
+	                               .version = SW_MESHFILE_VERSION,
+	                               .file_size = size,
+	                               .position = (uint32_t)f->position,
+	                               .normal = (uint32_t)f->normal,
+	                               .color = (uint32_t)f->color,
+	                               .stride = (uint32_t)sw_vformat_get_layout(f).stride,
+	                               .lod_count = (uint32_t)lod_count,
+	                               .byte_order = SW_MESHFILE_BYTE_ORDER};
+	memcpy(out, &header, sizeof(header));
+
+	for (int i = 0; i < lod_count; ++i) {
+		sw_meshfile_level_record_t *r = &records[i];
+		sw_vformat_dequant_t dq;
+		sw_mesh_write_vert_buffer_format(lods[i], f, out + r->vertex_offset, &dq);
+		sw_mesh_write_index_buffer_auto(lods[i], out + r->index_offset);
+		kr_vec3_t min, max;
+		sw_mesh_aabb(lods[i], &min, &max);
+		memcpy(r->dequant_offset, &dq.offset, sizeof(r->dequant_offset));
+		memcpy(r->dequant_scale, &dq.scale, sizeof(r->dequant_scale));
+		memcpy(r->aabb_min, &min, sizeof(r->aabb_min));
+		memcpy(r->aabb_max, &max, sizeof(r->aabb_max));
+		if (meshlets != NULL) {
+			memcpy(out + r->meshlet_offset, meshlets[i].meshlets,
+			       r->meshlet_count * sizeof(sw_meshlet_t));
+			memcpy(out + r->meshlet_vertex_offset, meshlets[i].vertices,
+			       r->meshlet_vertex_count * sizeof(int));
+			memcpy(out + r->meshlet_index_offset, meshlets[i].triangles, r->meshlet_index_count);
+		}
+	}
+	memcpy(out + sizeof(header), records, lod_count * sizeof(sw_meshfile_level_record_t));
+	return (size_t)size;
+}
+
+// Kinc's file writer does not report failed writes, a disk running full shows in the file size
+static bool sw_meshfile_written(const char *filename, size_t size) {
+	kinc_file_reader_t reader;
+	if (!kinc_file_reader_open(&reader, filename, KINC_FILE_TYPE_SAVE)) return false;
+	bool complete = kinc_file_reader_size(&reader) == size;
+	kinc_file_reader_close(&reader);
+	return complete;
+}
+
+bool sw_meshfile_store(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                       const sw_vformat_t *f, const char *filename) {
+	size_t size = sw_meshfile_size(lods, meshlets, lod_count, f);
+	void *buffer = sw_malloc(size);
+	assert(buffer != NULL);
+	sw_meshfile_write(lods, meshlets, lod_count, f, buffer);
+
+	kinc_file_writer_t writer;
+	bool success = kinc_file_writer_open(&writer, filename);
+	if (!success) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for writing", filename);
+		sw_free(buffer);
+		return false;
+	}
+	kinc_file_writer_write(&writer, buffer, (int)size);
+	kinc_file_writer_close(&writer);
+	sw_free(buffer);
+	if (!sw_meshfile_written(filename, size)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to write %llu bytes to file '%s'",
+		         (unsigned long long)size, filename);
+		sw_file_delete(filename);
+		return false;
+	}
+	return true;
+}
+
+static bool sw_meshfile_section_ok(uint64_t offset, uint64_t bytes, uint64_t size) {
+	return (offset & (SW_MESHFILE_ALIGNMENT - 1)) == 0 && offset <= size && bytes <= size - offset;
+}
+
+bool sw_meshfile_view(const void *data, size_t size, sw_meshfile_t *view) {
+	assert(data != NULL && view != NULL && ((uintptr_t)data & 7) == 0);
+	const uint8_t *in = (const uint8_t *)data;
+	if (size < sizeof(sw_meshfile_header_t)) return false;
+	const sw_meshfile_header_t *header = (const sw_meshfile_header_t *)in;
+	if (header->magic != SW_MESHFILE_MAGIC || header->version != SW_MESHFILE_VERSION ||
+	    header->byte_order != SW_MESHFILE_BYTE_ORDER)
+		return false;
+	if (header->file_size > size || header->lod_count == 0 ||
+	    header->lod_count > SW_MESHFILE_MAX_LODS)
+		return false;
+	if (sizeof(sw_meshfile_header_t) + header->lod_count * sizeof(sw_meshfile_level_record_t) >
+	    size)
+		return false;
+	if (header->position > SW_VFORMAT_POSITION_U16 || header->normal > SW_VFORMAT_NORMAL_SNORM10 ||
+	    header->color > SW_VFORMAT_COLOR_RGBA8)
+		return false;
+
+	memset(view, 0, sizeof(*view));
+	view->format = (sw_vformat_t){.position = (sw_vformat_position_t)header->position,
+	                              .normal = (sw_vformat_normal_t)header->normal,
+	                              .color = (sw_vformat_color_t)header->color};
+	view->layout = sw_vformat_get_layout(&view->format);
+	if ((uint32_t)view->layout.stride != header->stride) return false;
+	view->lod_count = (int)header->lod_count;
+
+	const sw_meshfile_level_record_t *records =
+	    (const sw_meshfile_level_record_t *)(in + sizeof(sw_meshfile_header_t));
+	uint64_t file_size = header->file_size;
+	for (int i = 0; i < view->lod_count; ++i) {
+		const sw_meshfile_level_record_t *r = &records[i];
+		if (r->index_size != 2 && r->index_size != 4) return false;
+		if (!sw_meshfile_section_ok(r->vertex_offset, (uint64_t)r->vertex_count * header->stride,
+		                            file_size) ||
+		    !sw_meshfile_section_ok(r->index_offset, (uint64_t)r->index_count * r->index_size,
+		                            file_size))
+			return false;
+		sw_meshfile_level_t *l = &view->levels[i];
+		l->vertices = in + r->vertex_offset;
+		l->vertex_count = (int)r->vertex_count;
+		l->indices = in + r->index_offset;
+		l->index_count = (int)r->index_count;
+		l->index_size = (int)r->index_size;
+		memcpy(&l->dequant.offset, r->dequant_offset, sizeof(r->dequant_offset));
+		memcpy(&l->dequant.scale, r->dequant_scale, sizeof(r->dequant_scale));
+		memcpy(&l->aabb_min, r->aabb_min, sizeof(r->aabb_min));
+		memcpy(&l->aabb_max, r->aabb_max, sizeof(r->aabb_max));
+		if (r->meshlet_count == 0) continue;
+		if (!sw_meshfile_section_ok(r->meshlet_offset,
+		                            (uint64_t)r->meshlet_count * sizeof(sw_meshlet_t), file_size) ||
+		    !sw_meshfile_section_ok(r->meshlet_vertex_offset,
+		                            (uint64_t)r->meshlet_vertex_count * sizeof(int), file_size) ||
+		    !sw_meshfile_section_ok(r->meshlet_index_offset, r->meshlet_index_count, file_size))
+			return false;
+		l->meshlets = (const sw_meshlet_t *)(in + r->meshlet_offset);
+		l->meshlet_count = (int)r->meshlet_count;
+		l->meshlet_vertices = (const int *)(in + r->meshlet_vertex_offset);
+		l->meshlet_triangles = in + r->meshlet_index_offset;
+	}
+	return true;
+}
+
+bool sw_meshfile_load(const char *filename, sw_meshfile_t *file) {
+	assert(file != NULL);
+	kinc_file_reader_t reader;
+	bool success = kinc_file_reader_open(&reader, filename, KINC_FILE_TYPE_SAVE);
+	if (!success) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for reading", filename);
+		return false;
+	}
+	size_t size = kinc_file_reader_size(&reader);
+	void *data = sw_malloc(size > 0 ? size : 1);
+	assert(data != NULL);
+	kinc_file_reader_read(&reader, data, size);
+	kinc_file_reader_close(&reader);
+
+	if (!sw_meshfile_view(data, size, file)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "'%s' is not a valid mesh file", filename);
+		sw_free(data);
+		return false;
+	}
+	file->owned = data;
+	return true;
+}
+
+void sw_meshfile_destroy(sw_meshfile_t *file) {
+	assert(file != NULL);
+	if (file->owned != NULL) sw_free(file->owned);
+	memset(file, 0, sizeof(*file));
+}
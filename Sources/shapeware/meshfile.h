@@ -0,0 +1,110 @@
+/**
+ * @file meshfile.h
+ * @brief Versioned binary container for generated meshes. Every section is aligned, so a file that
+ * is mapped or read into memory in one piece can be used in place without parsing or copying.
+ *
+ * Layout: header, one level record per LOD, then per level the vertex stream, the index buffer and
+ * optionally the meshlets, vertex ids and local indices of `sw_meshlets_t`. Everything is stored in
+ * the native byte order of the writer, the header records it and files of the other byte order are
+ * rejected instead of swapped.
+ */
+#pragma once
+
+#include "mesh.h"
+#include "meshlet.h"
+#include "vformat.h"
+
+#include <krink/math/vector.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SW_MESHFILE_VERSION 2
+#define SW_MESHFILE_MAX_LODS 8
+// Alignment of every section relative to the start of the file. The start itself has to be aligned
+// to at least 8 bytes, page aligned `mmap` results and `sw_malloc` blocks are.
+#define SW_MESHFILE_ALIGNMENT 16
+
+typedef struct sw_meshfile_level {
+	const void *vertices; // `vertex_count * layout.stride` bytes
+	int vertex_count;
+	const void *indices; // `index_count * index_size` bytes
+	int index_count;
+	int index_size; // `2` or `4`
+	sw_vformat_dequant_t dequant;
+	kr_vec3_t aabb_min;
+	kr_vec3_t aabb_max;
+	const sw_meshlet_t *meshlets; // `NULL` when the level was stored without meshlets
+	int meshlet_count;
+	const int *meshlet_vertices;
+	const uint8_t *meshlet_triangles;
+} sw_meshfile_level_t;
+
+typedef struct sw_meshfile {
+	sw_vformat_t format;
+	sw_vformat_layout_t layout;
+	int lod_count;
+	sw_meshfile_level_t levels[SW_MESHFILE_MAX_LODS];
+	void *owned; // Buffer allocated by `sw_meshfile_load`, `NULL` for views
+} sw_meshfile_t;
+
+/**
+ * @brief Number of bytes `sw_meshfile_write` needs for the given meshes.
+ *
+ * @param lods Level `0` is the full detail mesh
+ * @param meshlets Either `NULL` or one entry per level
+ * @param lod_count At most `SW_MESHFILE_MAX_LODS`
+ * @param f Vertex format of all levels
+ * @return size_t
+ */
+size_t sw_meshfile_size(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                        const sw_vformat_t *f);
+
+/**
+ * @brief Serialize the meshes into `buffer`, which must hold `sw_meshfile_size` bytes and be 8
+ * byte aligned.
+ *
+ * @param lods
+ * @param meshlets
+ * @param lod_count
+ * @param f
+ * @param buffer
+ * @return size_t The number of bytes written
+ */
+size_t sw_meshfile_write(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                         const sw_vformat_t *f, void *buffer);
+
+/**
+ * @brief Serialize the meshes and save them to a file relative to the save path. An incomplete
+ * file is deleted again.
+ *
+ * @param lods
+ * @param meshlets
+ * @param lod_count
+ * @param f
+ * @param filename
+ * @return bool False if the file could not be opened or not be written completely
+ */
+bool sw_meshfile_store(sw_mesh_t **lods, const sw_meshlets_t *meshlets, int lod_count,
+                       const sw_vformat_t *f, const char *filename);
+
+/**
+ * @brief Validate a file in memory and point the level views into it. Nothing is copied, `data`
+ * has to outlive `view`.
+ *
+ * @param data Start of the file, 8 byte aligned
+ * @param size
+ * @param view
+ * @return bool False if the data is not a mesh file of this version and byte order or is truncated
+ */
+bool sw_meshfile_view(const void *data, size_t size, sw_meshfile_t *view);
+
+/**
+ * @brief Read a file saved with `sw_meshfile_store` into a single allocation and view it.
+ *
+ * @param filename
+ * @param file Release with `sw_meshfile_destroy`
+ * @return bool
+ */
+bool sw_meshfile_load(const char *filename, sw_meshfile_t *file);
+void sw_meshfile_destroy(sw_meshfile_t *file);
@@ -0,0 +1,290 @@
+#include "meshlet.h"
+
+#include "mesh_internal.h"
+
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef struct sw_meshlet_builder {
+	sw_mesh_t *m;
+	int max_verts;
+	int max_tris;
+	// Triangle adjacency per vertex in CSR layout
+	int *offsets;
+	int *adjacency;
+	bool *emitted;
+	// Local index of a vertex in the current meshlet, valid when `local_stamp` matches
+	int *local;
+	int *local_stamp;
+	// Unemitted triangles touching the current meshlet, valid when `cand_stamp` matches
+	int *candidates;
+	int candidate_count;
+	int *cand_stamp;
+	int stamp;
+	sw_meshlets_t *out;
+	int meshlet_cap;
+	int vertex_cap;
+	int triangle_cap;
+} sw_meshlet_builder_t;
+
+static int sw_meshlet_new_verts(sw_meshlet_builder_t *b, int tri) {
+	sw_triangle_t *t = &b->m->triangles[tri];
+	int idx[3] = {t->va, t->vb, t->vc};
+	int count = 0;
+	for (int k = 0; k < 3; ++k)
+		if (b->local_stamp[idx[k]] != b->stamp) ++count;
+	return count;
+}
+
+static void sw_meshlet_push_vertex(sw_meshlet_builder_t *b, int v) {
+	sw_meshlets_t *out = b->out;
+	if (out->vertex_count == b->vertex_cap) {
+		b->vertex_cap *= 2;
+		out->vertices = (int *)sw_realloc(out->vertices, b->vertex_cap * sizeof(int));
+		assert(out->vertices != NULL);
+	}
+	out->vertices[out->vertex_count++] = v;
+}
+
+static void sw_meshlet_add(sw_meshlet_builder_t *b, sw_meshlet_t *ml, int tri) {
+	sw_meshlets_t *out = b->out;
+	sw_triangle_t *t = &b->m->triangles[tri];
+	int idx[3] = {t->va, t->vb, t->vc};
+	if (out->triangle_count * 3 + 3 > b->triangle_cap) {
+		b->triangle_cap *= 2;
+		out->triangles = (uint8_t *)sw_realloc(out->triangles, b->triangle_cap);
+		assert(out->triangles != NULL);
+	}
+	for (int k = 0; k < 3; ++k) {
+		int v = idx[k];
+		if (b->local_stamp[v] != b->stamp) {
+			b->local_stamp[v] = b->stamp;
+			b->local[v] = ml->vertex_count++;
+			sw_meshlet_push_vertex(b, v);
+		}
+		out->triangles[out->triangle_count * 3 + k] = (uint8_t)b->local[v];
+	}
+	++out->triangle_count;
+	++ml->triangle_count;
+	b->emitted[tri] = true;
+
+	for (int k = 0; k < 3; ++k) {
+		for (int i = b->offsets[idx[k]]; i < b->offsets[idx[k] + 1]; ++i) {
+			int n = b->adjacency[i];
+			if (b->emitted[n] || b->cand_stamp[n] == b->stamp) continue;
+			b->cand_stamp[n] = b->stamp;
+			b->candidates[b->candidate_count++] = n;
+		}
+	}
+}
+
+// Prefer candidates that add the fewest vertices, ties go to the earliest extracted triangle
+static int sw_meshlet_best_candidate(sw_meshlet_builder_t *b, const sw_meshlet_t *ml) {
+	int best = -1;
+	int best_new = 4;
+	int live = 0;
+	for (int i = 0; i < b->candidate_count; ++i) {
+		int c = b->candidates[i];
+		if (b->emitted[c]) continue;
+		b->candidates[live++] = c;
+		int new_verts = sw_meshlet_new_verts(b, c);
+		if (ml->vertex_count + new_verts > b->max_verts) continue;
+		if (new_verts < best_new || (new_verts == best_new && c < best)) {
+			best = c;
+			best_new = new_verts;
+		}
+	}
+	b->candidate_count = live;
+	return best;
+}
+
+static void sw_meshlet_bounds(sw_meshlet_builder_t *b, sw_meshlet_t *ml) {
+	sw_mesh_t *m = b->m;
+	const int *verts = &b->out->vertices[ml->vertex_offset];
+	const uint8_t *tris = &b->out->triangles[ml->triangle_offset];
+
+	// Ritter: start from the two most distant points along the axis with the widest spread
+	kr_vec3_t pmin[3], pmax[3];
+	for (int a = 0; a < 3; ++a) pmin[a] = pmax[a] = m->vertices[verts[0]].pos;
+	for (int i = 1; i < ml->vertex_count; ++i) {
+		kr_vec3_t p = m->vertices[verts[i]].pos;
+		if (p.x < pmin[0].x) pmin[0] = p;
+		if (p.x > pmax[0].x) pmax[0] = p;
+		if (p.y < pmin[1].y) pmin[1] = p;
+		if (p.y > pmax[1].y) pmax[1] = p;
+		if (p.z < pmin[2].z) pmin[2] = p;
+		if (p.z > pmax[2].z) pmax[2] = p;
+	}
+	int axis = 0;
+	float spread = -1.0f;
+	for (int a = 0; a < 3; ++a) {
+		kr_vec3_t d = kr_vec3_subv(pmax[a], pmin[a]);
+		float sq = kr_vec3_dot(d, d);
+		if (sq > spread) {
+			spread = sq;
+			axis = a;
+		}
+	}
+	kr_vec3_t center = kr_vec3_mult(kr_vec3_addv(pmin[axis], pmax[axis]), 0.5f);
+	float radius = sqrtf(spread) * 0.5f;
+	for (int i = 0; i < ml->vertex_count; ++i) {
+		kr_vec3_t d = kr_vec3_subv(m->vertices[verts[i]].pos, center);
+		float dist = kr_vec3_length(d);
+		if (dist > radius) {
+			float grow = (dist - radius) * 0.5f;
+			center = kr_vec3_addv(center, kr_vec3_mult(d, grow / dist));
+			radius += grow;
+		}
+	}
+	ml->center = center;
+	ml->radius = radius;
+
+	// Normal cone from the normalized face normals, the apex is placed behind every triangle plane
+	kr_vec3_t normals[SW_MESHLET_MAX_TRIS];
+	kr_vec3_t axis_sum = (kr_vec3_t){.x = 0.0f, .y = 0.0f, .z = 0.0f};
+	for (int i = 0; i < ml->triangle_count; ++i) {
+		kr_vec3_t n = sw_triangle_face_normal(m->vertices[verts[tris[i * 3]]].pos,
+		                                      m->vertices[verts[tris[i * 3 + 1]]].pos,
+		                                      m->vertices[verts[tris[i * 3 + 2]]].pos);
+		float len = kr_vec3_length(n);
+		normals[i] = len > 0.0f ? kr_vec3_mult(n, 1.0f / len) : n;
+		axis_sum = kr_vec3_addv(axis_sum, normals[i]);
+	}
+	ml->cone_apex = center;
+	ml->cone_axis = (kr_vec3_t){.x = 0.0f, .y = 0.0f, .z = 1.0f};
+	ml->cone_cutoff = 1.0f;
+	float axis_len = kr_vec3_length(axis_sum);
+	if (axis_len < FLT_EPSILON) return;
+	kr_vec3_t cone_axis = kr_vec3_mult(axis_sum, 1.0f / axis_len);
+	ml->cone_axis = cone_axis;
+
+	float min_dot = 1.0f;
+	for (int i = 0; i < ml->triangle_count; ++i) {
+		if (normals[i].x == 0.0f && normals[i].y == 0.0f && normals[i].z == 0.0f) continue;
+		float d = kr_vec3_dot(normals[i], cone_axis);
+		if (d < min_dot) min_dot = d;
+	}
+	// The cone spans a hemisphere or more, every view direction sees some front face
+	if (min_dot <= 0.1f) return;
+
+	float min_t = FLT_MAX;
+	for (int i = 0; i < ml->triangle_count; ++i) {
+		float dn = kr_vec3_dot(normals[i], cone_axis);
+		if (dn <= 0.0f) continue;
+		kr_vec3_t p = m->vertices[verts[tris[i * 3]]].pos;
+		float t = kr_vec3_dot(kr_vec3_subv(p, center), normals[i]) / dn;
+		if (t < min_t) min_t = t;
+	}
+	ml->cone_apex = kr_vec3_addv(center, kr_vec3_mult(cone_axis, min_t));
+	ml->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+static void sw_meshlet_finish(sw_meshlet_builder_t *b, sw_meshlet_t *ml) {
+	if (ml->triangle_count == 0) return;
+	ml->triangle_offset *= 3;
+	sw_meshlet_bounds(b, ml);
+	sw_meshlets_t *out = b->out;
+	if (out->meshlet_count == b->meshlet_cap) {
+		b->meshlet_cap *= 2;
+		out->meshlets =
+		    (sw_meshlet_t *)sw_realloc(out->meshlets, b->meshlet_cap * sizeof(sw_meshlet_t));
+		assert(out->meshlets != NULL);
+	}
+	out->meshlets[out->meshlet_count++] = *ml;
+}
+
+int sw_mesh_build_meshlets(sw_mesh_t *m, int max_verts, int max_tris, sw_meshlets_t *out) {
+	assert(m != NULL && out != NULL);
+	assert(max_verts >= 3 && max_verts <= SW_MESHLET_MAX_VERTS);
+	assert(max_tris >= 1 && max_tris <= SW_MESHLET_MAX_TRIS);
+	int nv = m->next_vert;
+	int nt = m->next_tris;
+
+	sw_meshlet_builder_t b = {.m = m, .max_verts = max_verts, .max_tris = max_tris, .out = out};
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	b.offsets = (int *)sw_scratch_alloc((nv + 1) * sizeof(int));
+	b.adjacency = (int *)sw_scratch_alloc((nt * 3 + 1) * sizeof(int));
+	b.emitted = (bool *)sw_scratch_alloc((nt + 1) * sizeof(bool));
+	b.local = (int *)sw_scratch_alloc((nv + 1) * sizeof(int));
+	b.local_stamp = (int *)sw_scratch_alloc((nv + 1) * sizeof(int));
+	b.candidates = (int *)sw_scratch_alloc((nt + 1) * sizeof(int));
+	b.cand_stamp = (int *)sw_scratch_alloc((nt + 1) * sizeof(int));
+
+	memset(b.offsets, 0, (nv + 1) * sizeof(int));
+	for (int i = 0; i < nt; ++i) {
+		++b.offsets[m->triangles[i].va + 1];
+		++b.offsets[m->triangles[i].vb + 1];
+		++b.offsets[m->triangles[i].vc + 1];
+	}
+	for (int i = 0; i < nv; ++i) b.offsets[i + 1] += b.offsets[i];
+	// `local` doubles as insertion cursor while filling the adjacency
+	memcpy(b.local, b.offsets, nv * sizeof(int));
+	for (int i = 0; i < nt; ++i) {
+		b.adjacency[b.local[m->triangles[i].va]++] = i;
+		b.adjacency[b.local[m->triangles[i].vb]++] = i;
+		b.adjacency[b.local[m->triangles[i].vc]++] = i;
+		b.emitted[i] = false;
+		b.cand_stamp[i] = -1;
+	}
+	for (int i = 0; i < nv; ++i) b.local_stamp[i] = -1;
+
+	// Meshlets of a closed surface end up around 2/3 full on average
+	b.meshlet_cap = nt / (max_tris / 2 + 1) + 1;
+	b.vertex_cap = nt + 1;
+	b.triangle_cap = nt * 3 + 3;
+	*out = (sw_meshlets_t){0};
+	out->meshlets = (sw_meshlet_t *)sw_malloc(b.meshlet_cap * sizeof(sw_meshlet_t));
+	out->vertices = (int *)sw_malloc(b.vertex_cap * sizeof(int));
+	out->triangles = (uint8_t *)sw_malloc(b.triangle_cap);
+	assert(out->meshlets != NULL && out->vertices != NULL && out->triangles != NULL);
+
+	int seed = 0;
+	while (seed < nt) {
+		if (b.emitted[seed]) {
+			++seed;
+			continue;
+		}
+		sw_meshlet_t ml = (sw_meshlet_t){.vertex_offset = out->vertex_count,
+		                                 .triangle_offset = out->triangle_count};
+		b.candidate_count = 0;
+		int next = seed;
+		while (next >= 0) {
+			sw_meshlet_add(&b, &ml, next);
+			if (ml.triangle_count == max_tris) break;
+			next = sw_meshlet_best_candidate(&b, &ml);
+			if (next < 0 && b.candidate_count == 0) {
+				// Grown out the connected patch, continue with the next triangle in extraction
+				// order if it still fits
+				while (seed < nt && b.emitted[seed]) ++seed;
+				if (seed < nt && ml.vertex_count + sw_meshlet_new_verts(&b, seed) <= max_verts)
+					next = seed;
+			}
+		}
+		sw_meshlet_finish(&b, &ml);
+		++b.stamp;
+	}
+
+	sw_scratch_end(mark);
+	return out->meshlet_count;
+}
+
+void sw_meshlets_destroy(sw_meshlets_t *ml) {
+	assert(ml != NULL);
+	sw_free(ml->meshlets);
+	sw_free(ml->vertices);
+	sw_free(ml->triangles);
+	*ml = (sw_meshlets_t){0};
+}
+
+bool sw_meshlet_backfacing(const sw_meshlet_t *ml, kr_vec3_t camera_pos) {
+	kr_vec3_t view = kr_vec3_subv(ml->cone_apex, camera_pos);
+	float len = kr_vec3_length(view);
+	return ml->cone_cutoff < 1.0f && len > 0.0f &&
+	       kr_vec3_dot(view, ml->cone_axis) >= ml->cone_cutoff * len;
+}
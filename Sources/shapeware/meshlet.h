@@ -0,0 +1,59 @@
+/**
+ * @file meshlet.h
+ * @brief Partition a `sw_mesh_t` into small clusters for GPU driven culling.
+ */
+#pragma once
+
+#include "mesh.h"
+
+#include <krink/math/vector.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SW_MESHLET_MAX_VERTS 64
+#define SW_MESHLET_MAX_TRIS 124
+
+typedef struct sw_meshlet {
+	int vertex_offset;   // First entry in `sw_meshlets_t.vertices`
+	int triangle_offset; // First entry in `sw_meshlets_t.triangles`, 3 local indices per triangle
+	int vertex_count;
+	int triangle_count;
+	kr_vec3_t center; // Bounding sphere
+	float radius;
+	kr_vec3_t cone_apex; // Normal cone, see `sw_meshlet_backfacing`
+	kr_vec3_t cone_axis;
+	float cone_cutoff; // `1` when the cone is too wide to cull
+} sw_meshlet_t;
+
+typedef struct sw_meshlets {
+	sw_meshlet_t *meshlets;
+	int meshlet_count;
+	int *vertices; // Mesh vertex ids referenced by the local indices
+	int vertex_count;
+	uint8_t *triangles; // Local indices into the vertex range of the owning meshlet
+	int triangle_count;
+} sw_meshlets_t;
+
+/**
+ * @brief Split the triangles of `m` into meshlets. Clusters are grown greedily over shared
+ * vertices, seeded in triangle order, so the scanline locality of the marching cubes extraction
+ * carries over. Every meshlet gets a bounding sphere and a normal cone.
+ *
+ * @param m
+ * @param max_verts At most `SW_MESHLET_MAX_VERTS`, local indices are 8 bit
+ * @param max_tris
+ * @param out Release with `sw_meshlets_destroy`
+ * @return int The number of meshlets
+ */
+int sw_mesh_build_meshlets(sw_mesh_t *m, int max_verts, int max_tris, sw_meshlets_t *out);
+void sw_meshlets_destroy(sw_meshlets_t *ml);
+
+/**
+ * @brief Normal cone test, the same can be done on the GPU. Returns true when every triangle of the
+ * meshlet faces away from `camera_pos`.
+ *
+ * @param ml
+ * @param camera_pos
+ * @return bool
+ */
+bool sw_meshlet_backfacing(const sw_meshlet_t *ml, kr_vec3_t camera_pos);
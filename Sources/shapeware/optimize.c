@@ -0,0 +1,370 @@
+/*
+Vertex cache optimization adapted from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+Overdraw optimization after Sander, Nehab and Barczak "Fast Triangle Reordering for Vertex Locality
+and Reduced Overdraw".
+*/
+
+#include "mesh.h"
+#include "mesh_internal.h"
+
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Size of the LRU cache modelled while scoring, independent of the simulated FIFO size
+#define SW_OPT_LRU_SIZE 32
+#define SW_OPT_CACHE_DECAY_POWER 1.5f
+#define SW_OPT_LAST_TRI_SCORE 0.75f
+#define SW_OPT_VALENCE_BOOST_SCALE 2.0f
+#define SW_OPT_VALENCE_BOOST_POWER 0.5f
+// ACMR the overdraw pass of `sw_mesh_optimize` may give up, relative to the vertex cache order
+#define SW_OPT_OVERDRAW_THRESHOLD 1.05f
+
+sw_mesh_cache_stats_t sw_analyze_vertex_cache(const int *indices, int index_count, int vert_count,
+                                              int cache_size) {
+	assert(indices != NULL && index_count % 3 == 0 && cache_size > 0);
+	sw_mesh_cache_stats_t stats = (sw_mesh_cache_stats_t){0};
+	if (index_count == 0 || vert_count == 0) return stats;
+
+	// FIFO cache: a vertex is resident while fewer than `cache_size` misses happened since it was
+	// last loaded
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *loaded_at = (int *)sw_scratch_alloc(vert_count * sizeof(int));
+	for (int i = 0; i < vert_count; ++i) loaded_at[i] = -cache_size - 1;
+	int used = 0;
+	for (int i = 0; i < index_count; ++i) {
+		int v = indices[i];
+		assert(v >= 0 && v < vert_count);
+		if (stats.misses - loaded_at[v] > cache_size) {
+			if (loaded_at[v] < -cache_size) ++used;
+			loaded_at[v] = stats.misses++;
+		}
+	}
+	sw_scratch_end(mark);
+
+	stats.acmr = (float)stats.misses / (index_count / 3);
+	stats.atvr = (float)stats.misses / used;
+	return stats;
+}
+
+sw_mesh_cache_stats_t sw_mesh_analyze_vertex_cache(sw_mesh_t *m, int cache_size) {
+	assert(m != NULL);
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *indices = (int *)sw_scratch_alloc((m->next_tris * 3 + 1) * sizeof(int));
+	sw_mesh_write_index_buffer(m, indices);
+	sw_mesh_cache_stats_t stats =
+	    sw_analyze_vertex_cache(indices, m->next_tris * 3, m->next_vert, cache_size);
+	sw_scratch_end(mark);
+	return stats;
+}
+
+static float sw_opt_vertex_score(int cache_pos, int remaining) {
+	if (remaining == 0) return -1.0f;
+	float score = 0.0f;
+	if (cache_pos >= 0) {
+		if (cache_pos < 3)
+			score = SW_OPT_LAST_TRI_SCORE;
+		else {
+			float s = 1.0f - (float)(cache_pos - 3) / (SW_OPT_LRU_SIZE - 3);
+			score = powf(s, SW_OPT_CACHE_DECAY_POWER);
+		}
+	}
+	return score + SW_OPT_VALENCE_BOOST_SCALE * powf((float)remaining, -SW_OPT_VALENCE_BOOST_POWER);
+}
+
+static void sw_mesh_reorder_triangles(sw_mesh_t *m, const int *order) {
+	sw_triangle_t *sorted =
+	    (sw_triangle_t *)sw_mesh_internal_alloc(m, m->tris_cap * sizeof(sw_triangle_t));
+	for (int i = 0; i < m->next_tris; ++i) sorted[i] = m->triangles[order[i]];
+	sw_mesh_internal_free(m, m->triangles);
+	m->triangles = sorted;
+	sw_mesh_internal_rebuild(m);
+}
+
+void sw_mesh_optimize_vertex_cache(sw_mesh_t *m) {
+	assert(m != NULL);
+	int nv = m->next_vert;
+	int nt = m->next_tris;
+	if (nt == 0) return;
+
+	// Triangle adjacency per vertex in CSR layout, live triangles are kept at the front
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *offsets = (int *)sw_scratch_alloc((nv + 1) * sizeof(int));
+	int *remaining = (int *)sw_scratch_alloc(nv * sizeof(int));
+	int *adjacency = (int *)sw_scratch_alloc(nt * 3 * sizeof(int));
+	int *cache_pos = (int *)sw_scratch_alloc(nv * sizeof(int));
+	float *vert_score = (float *)sw_scratch_alloc(nv * sizeof(float));
+	float *tri_score = (float *)sw_scratch_alloc(nt * sizeof(float));
+	bool *emitted = (bool *)sw_scratch_alloc(nt * sizeof(bool));
+	int *order = (int *)sw_scratch_alloc(nt * sizeof(int));
+
+	memset(remaining, 0, nv * sizeof(int));
+	for (int i = 0; i < nt; ++i) {
+		++remaining[m->triangles[i].va];
+		++remaining[m->triangles[i].vb];
+		++remaining[m->triangles[i].vc];
+	}
+	offsets[0] = 0;
+	for (int i = 0; i < nv; ++i) offsets[i + 1] = offsets[i] + remaining[i];
+	memset(remaining, 0, nv * sizeof(int));
+	for (int i = 0; i < nt; ++i) {
+		int idx[3] = {m->triangles[i].va, m->triangles[i].vb, m->triangles[i].vc};
+		for (int k = 0; k < 3; ++k) adjacency[offsets[idx[k]] + remaining[idx[k]]++] = i;
+	}
+	for (int i = 0; i < nv; ++i) {
+		cache_pos[i] = -1;
+		vert_score[i] = sw_opt_vertex_score(-1, remaining[i]);
+	}
+	for (int i = 0; i < nt; ++i) {
+		emitted[i] = false;
+		tri_score[i] = vert_score[m->triangles[i].va] + vert_score[m->triangles[i].vb] +
+		               vert_score[m->triangles[i].vc];
+	}
+
+	int cache[SW_OPT_LRU_SIZE + 3];
+	int cache_len = 0;
+	int best = 0;
+	int scan = 0;
+	for (int out = 0; out < nt; ++out) {
+		if (best < 0) {
+			// Nothing adjacent to the cache left, continue with the best unemitted triangle
+			float best_score = -1.0f;
+			for (int i = scan; i < nt; ++i) {
+				if (emitted[i]) {
+					if (i == scan) ++scan;
+					continue;
+				}
+				if (tri_score[i] > best_score) {
+					best_score = tri_score[i];
+					best = i;
+				}
+			}
+		}
+		assert(best >= 0 && !emitted[best]);
+		order[out] = best;
+		emitted[best] = true;
+
+		int idx[3] = {m->triangles[best].va, m->triangles[best].vb, m->triangles[best].vc};
+		int new_cache[SW_OPT_LRU_SIZE + 3];
+		int new_len = 0;
+		for (int k = 0; k < 3; ++k) {
+			int v = idx[k];
+			// Remove the triangle from the live part of the adjacency of `v`
+			int *adj = &adjacency[offsets[v]];
+			for (int j = 0; j < remaining[v]; ++j) {
+				if (adj[j] == best) {
+					adj[j] = adj[remaining[v] - 1];
+					adj[remaining[v] - 1] = best;
+					break;
+				}
+			}
+			--remaining[v];
+			new_cache[new_len++] = v;
+		}
+		for (int i = 0; i < cache_len; ++i) {
+			int v = cache[i];
+			if (v != idx[0] && v != idx[1] && v != idx[2]) new_cache[new_len++] = v;
+		}
+		for (int i = SW_OPT_LRU_SIZE; i < new_len; ++i) cache_pos[new_cache[i]] = -1;
+		cache_len = new_len < SW_OPT_LRU_SIZE ? new_len : SW_OPT_LRU_SIZE;
+		memcpy(cache, new_cache, new_len * sizeof(int));
+
+		// Rescore everything touched by the cache update and pick the next triangle from it
+		for (int i = 0; i < new_len; ++i) {
+			int v = new_cache[i];
+			if (i < SW_OPT_LRU_SIZE) cache_pos[v] = i;
+			float score = sw_opt_vertex_score(cache_pos[v], remaining[v]);
+			float delta = score - vert_score[v];
+			vert_score[v] = score;
+			for (int j = 0; j < remaining[v]; ++j) tri_score[adjacency[offsets[v] + j]] += delta;
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for (int i = 0; i < cache_len; ++i) {
+			int v = cache[i];
+			for (int j = 0; j < remaining[v]; ++j) {
+				int t = adjacency[offsets[v] + j];
+				if (tri_score[t] > best_score) {
+					best_score = tri_score[t];
+					best = t;
+				}
+			}
+		}
+	}
+
+	sw_mesh_reorder_triangles(m, order);
+	sw_scratch_end(mark);
+}
+
+typedef struct sw_opt_cluster {
+	int begin;
+	int end;
+	float sort_key;
+} sw_opt_cluster_t;
+
+static int sw_opt_cluster_compare(const void *a, const void *b) {
+	float ka = ((const sw_opt_cluster_t *)a)->sort_key;
+	float kb = ((const sw_opt_cluster_t *)b)->sort_key;
+	if (ka != kb) return ka > kb ? -1 : 1;
+	// Keep the cache order of equal keys, `qsort` is not stable
+	return ((const sw_opt_cluster_t *)a)->begin - ((const sw_opt_cluster_t *)b)->begin;
+}
+
+// Misses of each triangle in a FIFO cache that is flushed at the start of every cluster
+static int sw_opt_triangle_misses(const sw_mesh_t *m, int tri, int *loaded_at, int *misses,
+                                  int cache_size) {
+	int idx[3] = {m->triangles[tri].va, m->triangles[tri].vb, m->triangles[tri].vc};
+	int count = 0;
+	for (int k = 0; k < 3; ++k) {
+		if (*misses - loaded_at[idx[k]] > cache_size) {
+			loaded_at[idx[k]] = (*misses)++;
+			++count;
+		}
+	}
+	return count;
+}
+
+// Sum of the corners, scaled by a third of the area weight
+static kr_vec3_t sw_opt_weighted_centroid(const sw_mesh_t *m, const sw_triangle_t *t, float area) {
+	kr_vec3_t c = kr_vec3_addv(kr_vec3_addv(m->vertices[t->va].pos, m->vertices[t->vb].pos),
+	                           m->vertices[t->vc].pos);
+	return kr_vec3_mult(c, area / 3.0f);
+}
+
+void sw_mesh_optimize_overdraw(sw_mesh_t *m, int cache_size, float threshold) {
+	assert(m != NULL && cache_size > 0 && threshold >= 1.0f);
+	int nv = m->next_vert;
+	int nt = m->next_tris;
+	if (nt == 0) return;
+
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *loaded_at = (int *)sw_scratch_alloc(nv * sizeof(int));
+	int *tri_misses = (int *)sw_scratch_alloc(nt * sizeof(int));
+	sw_opt_cluster_t *clusters =
+	    (sw_opt_cluster_t *)sw_scratch_alloc(nt * sizeof(sw_opt_cluster_t));
+	int *order = (int *)sw_scratch_alloc(nt * sizeof(int));
+
+	// Hard boundaries: triangles missing all three vertices start over with a cold cache anyway
+	int misses = 0;
+	for (int i = 0; i < nv; ++i) loaded_at[i] = -cache_size - 1;
+	for (int i = 0; i < nt; ++i)
+		tri_misses[i] = sw_opt_triangle_misses(m, i, loaded_at, &misses, cache_size);
+
+	// Soft boundaries: split a hard cluster as soon as the part since the last split, simulated
+	// from a cold cache, is within `threshold` of the ACMR of the whole hard cluster
+	int cluster_count = 0;
+	misses = 0;
+	for (int i = 0; i < nv; ++i) loaded_at[i] = -cache_size - 1;
+	for (int begin = 0; begin < nt;) {
+		int end = begin + 1;
+		int hard_misses = tri_misses[begin];
+		while (end < nt && tri_misses[end] != 3) hard_misses += tri_misses[end++];
+		float limit = threshold * hard_misses / (end - begin);
+
+		int start = begin;
+		int start_misses = misses;
+		for (int i = begin; i < end; ++i) {
+			sw_opt_triangle_misses(m, i, loaded_at, &misses, cache_size);
+			if (i + 1 < end && misses - start_misses <= limit * (i + 1 - start)) {
+				clusters[cluster_count++] = (sw_opt_cluster_t){.begin = start, .end = i + 1};
+				start = i + 1;
+				// Flush the simulated cache
+				misses += cache_size + 1;
+				start_misses = misses;
+			}
+		}
+		clusters[cluster_count++] = (sw_opt_cluster_t){.begin = start, .end = end};
+		begin = end;
+	}
+
+	// Draw clusters that lie further out along their average normal first, they are more likely to
+	// occlude the rest of the mesh from any view direction. Face normals are scaled by twice the
+	// triangle area, so the sums below are area weighted.
+	kr_vec3_t mesh_centroid = (kr_vec3_t){0};
+	float mesh_area = 0.0f;
+	for (int i = 0; i < nt; ++i) {
+		const sw_triangle_t *t = &m->triangles[i];
+		float area = kr_vec3_length(t->face_normal_mag);
+		mesh_centroid = kr_vec3_addv(mesh_centroid, sw_opt_weighted_centroid(m, t, area));
+		mesh_area += area;
+	}
+	if (mesh_area > 0.0f) mesh_centroid = kr_vec3_mult(mesh_centroid, 1.0f / mesh_area);
+	for (int i = 0; i < cluster_count; ++i) {
+		kr_vec3_t centroid = (kr_vec3_t){0};
+		kr_vec3_t normal = (kr_vec3_t){0};
+		float area = 0.0f;
+		for (int j = clusters[i].begin; j < clusters[i].end; ++j) {
+			const sw_triangle_t *t = &m->triangles[j];
+			float a = kr_vec3_length(t->face_normal_mag);
+			centroid = kr_vec3_addv(centroid, sw_opt_weighted_centroid(m, t, a));
+			normal = kr_vec3_addv(normal, t->face_normal_mag);
+			area += a;
+		}
+		float length = kr_vec3_length(normal);
+		if (area <= 0.0f || length <= 0.0f) {
+			clusters[i].sort_key = 0.0f;
+			continue;
+		}
+		centroid = kr_vec3_mult(centroid, 1.0f / area);
+		clusters[i].sort_key = kr_vec3_dot(kr_vec3_subv(centroid, mesh_centroid),
+		                                   kr_vec3_mult(normal, 1.0f / length));
+	}
+	qsort(clusters, cluster_count, sizeof(sw_opt_cluster_t), sw_opt_cluster_compare);
+
+	int out = 0;
+	for (int i = 0; i < cluster_count; ++i)
+		for (int j = clusters[i].begin; j < clusters[i].end; ++j) order[out++] = j;
+	assert(out == nt);
+
+	// The tail of a hard cluster is not bounded by the split rule, keep the cache order if the
+	// clusters lost more than `threshold` in total
+	int base_misses = 0;
+	for (int i = 0; i < nt; ++i) base_misses += tri_misses[i];
+	misses = 0;
+	for (int i = 0; i < nv; ++i) loaded_at[i] = -cache_size - 1;
+	for (int i = 0; i < nt; ++i)
+		sw_opt_triangle_misses(m, order[i], loaded_at, &misses, cache_size);
+	if (misses <= threshold * base_misses) sw_mesh_reorder_triangles(m, order);
+	sw_scratch_end(mark);
+}
+
+void sw_mesh_optimize_vertex_fetch(sw_mesh_t *m) {
+	assert(m != NULL);
+	int nv = m->next_vert;
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *remap = (int *)sw_scratch_alloc((nv + 1) * sizeof(int));
+	sw_vertex_t *sorted =
+	    (sw_vertex_t *)sw_mesh_internal_alloc(m, m->vert_cap * sizeof(sw_vertex_t));
+	for (int i = 0; i < nv; ++i) remap[i] = -1;
+
+	int next = 0;
+	for (int i = 0; i < m->next_tris; ++i) {
+		int *idx[3] = {&m->triangles[i].va, &m->triangles[i].vb, &m->triangles[i].vc};
+		for (int k = 0; k < 3; ++k) {
+			if (remap[*idx[k]] < 0) {
+				sorted[next] = m->vertices[*idx[k]];
+				remap[*idx[k]] = next++;
+			}
+			*idx[k] = remap[*idx[k]];
+		}
+	}
+	// Vertices that are not referenced by any triangle are dropped
+	sw_mesh_internal_free(m, m->vertices);
+	m->vertices = sorted;
+	m->next_vert = next;
+	sw_mesh_internal_rebuild(m);
+	sw_scratch_end(mark);
+}
+
+void sw_mesh_optimize(sw_mesh_t *m, int cache_size, sw_mesh_cache_stats_t *before,
+                      sw_mesh_cache_stats_t *after) {
+	if (before != NULL) *before = sw_mesh_analyze_vertex_cache(m, cache_size);
+	sw_mesh_optimize_vertex_cache(m);
+	sw_mesh_optimize_overdraw(m, cache_size, SW_OPT_OVERDRAW_THRESHOLD);
+	sw_mesh_optimize_vertex_fetch(m);
+	if (after != NULL) *after = sw_mesh_analyze_vertex_cache(m, cache_size);
+}
@@ -2,6 +2,7 @@
 
 #include "mathhelper.h"
 #include <math.h>
+#include <util/scratch.h>
 
 kr_vec3_t sw_raymarch_ray_direction(kr_vec3_t origin, kr_vec3_t look_at, kr_vec2_t frag_pos,
                                     float focal_length) {
@@ -17,27 +18,45 @@ kr_vec3_t sw_raymarch_ray_direction(kr_vec3_t origin, kr_vec3_t look_at, kr_vec2
 kr_vec3_t sw_raymarch_surface_pos(sw_sdf_t *sdf, sw_sdf_stack_frame_t *stack, kr_vec3_t origin,
                                   kr_vec3_t direction, int max_steps, float surf_dist,
                                   float max_dist, bool *hit) {
+	// Without a stack, share one scratch stack across all steps instead of one per evaluation
+	bool scratch = stack == NULL;
+	sw_scratch_mark_t mark;
+	if (scratch) {
+		mark = sw_scratch_begin();
+		stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf));
+	}
 	float offset = 0.0f;
-	*hit = true;
+	kr_vec3_t res = (kr_vec3_t){0.0f};
+	*hit = false;
 	for (int i = 0; i < max_steps; i++) {
 		kr_vec3_t p = kr_vec3_addv(origin, kr_vec3_mult(direction, offset));
 		float dist = sw_sdf_compute(sdf, p, stack);
 		offset += dist;
-		if (fabsf(dist) < surf_dist) return p;
+		if (fabsf(dist) < surf_dist) {
+			*hit = true;
+			res = p;
+			break;
+		}
 		if (offset > max_dist) break;
 	}
-	*hit = false;
-	return (kr_vec3_t){0.0f};
+	if (scratch) sw_scratch_end(mark);
+	return res;
 }
 
 kr_vec3_t sw_raymarch_surface_normal(const sw_sdf_t *sdf, sw_sdf_stack_frame_t *stack, kr_vec3_t pos) {
-	const float h = 0.001f;
+	const float h = SW_RAYMARCH_NORMAL_EPSILON;
 	const kr_vec3_t xyy = (kr_vec3_t){.x = 1.0f, .y = -1.0f, .z = -1.0f};
 	const kr_vec3_t yyx = (kr_vec3_t){.x = -1.0f, .y = -1.0f, .z = 1.0f};
 	const kr_vec3_t yxy = (kr_vec3_t){.x = -1.0f, .y = 1.0f, .z = -1.0f};
 	const kr_vec3_t xxx = (kr_vec3_t){.x = 1.0f, .y = 1.0f, .z = 1.0f};
 
-	return kr_vec3_normalized(kr_vec3_addv(
+	bool scratch = stack == NULL;
+	sw_scratch_mark_t mark;
+	if (scratch) {
+		mark = sw_scratch_begin();
+		stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf));
+	}
+	kr_vec3_t n = kr_vec3_normalized(kr_vec3_addv(
 	    kr_vec3_addv(
 	        kr_vec3_addv(
 	            kr_vec3_mult(xyy,
@@ -46,4 +65,6 @@ kr_vec3_t sw_raymarch_surface_normal(const sw_sdf_t *sdf, sw_sdf_stack_frame_t *
 	                         sw_sdf_compute(sdf, kr_vec3_addv(pos, kr_vec3_mult(yyx, h)), stack))),
 	        kr_vec3_mult(yxy, sw_sdf_compute(sdf, kr_vec3_addv(pos, kr_vec3_mult(yxy, h)), stack))),
 	    kr_vec3_mult(xxx, sw_sdf_compute(sdf, kr_vec3_addv(pos, kr_vec3_mult(xxx, h)), stack))));
+	if (scratch) sw_scratch_end(mark);
+	return n;
 }
@@ -4,6 +4,9 @@
 #include <krink/math/vector.h>
 #include <stdbool.h>
 
+// Finite difference step of `sw_raymarch_surface_normal`
+#define SW_RAYMARCH_NORMAL_EPSILON 0.001f
+
 kr_vec3_t sw_raymarch_ray_direction(kr_vec3_t origin, kr_vec3_t look_at, kr_vec2_t frag_pos,
                                     float focal_length);
 kr_vec3_t sw_raymarch_surface_pos(sw_sdf_t *sdf, sw_sdf_stack_frame_t *stack, kr_vec3_t origin,
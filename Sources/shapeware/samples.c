@@ -0,0 +1,181 @@
+#include "samples.h"
+
+#include "mathhelper.h"
+
+#include <util/half.h>
+#include <util/memory.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+
+struct sw_samples {
+	int size[3];
+	sw_samples_format_t format;
+	float band;
+	kr_vec4_t *values; // `SW_SAMPLES_F32` only
+	void *distance;
+	uint8_t *color; // RGB8
+	float *scales; // Per block, integer formats only
+	int row_blocks;
+};
+
+static size_t sw_samples_distance_size(sw_samples_format_t format) {
+	switch (format) {
+	case SW_SAMPLES_F16:
+	case SW_SAMPLES_I16:
+		return 2;
+	case SW_SAMPLES_I8:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static size_t sw_samples_count(const sw_samples_t *s) {
+	return (size_t)s->size[0] * s->size[1] * s->size[2];
+}
+
+static size_t sw_samples_row(const sw_samples_t *s, int y, int z) {
+	return (size_t)z * s->size[1] + y;
+}
+
+sw_samples_t *sw_samples_init(const int size[3], sw_samples_format_t format, float band) {
+	assert(size[0] > 0 && size[1] > 0 && size[2] > 0);
+	assert(format == SW_SAMPLES_F32 || format == SW_SAMPLES_F16 || band > 0.0f);
+	sw_samples_t *s = (sw_samples_t *)sw_malloc(sizeof(sw_samples_t));
+	assert(s != NULL);
+	*s = (sw_samples_t){.size = {size[0], size[1], size[2]},
+	                    .format = format,
+	                    .band = band,
+	                    .row_blocks = (size[0] + SW_SAMPLES_BLOCK - 1) / SW_SAMPLES_BLOCK};
+	size_t count = sw_samples_count(s);
+	if (format == SW_SAMPLES_F32) {
+		s->values = (kr_vec4_t *)sw_malloc(count * sizeof(kr_vec4_t));
+		assert(s->values != NULL);
+		return s;
+	}
+	s->distance = sw_malloc(count * sw_samples_distance_size(format));
+	s->color = (uint8_t *)sw_malloc(count * 3);
+	assert(s->distance != NULL && s->color != NULL);
+	if (format != SW_SAMPLES_F16) {
+		s->scales =
+		    (float *)sw_malloc((size_t)s->row_blocks * s->size[1] * s->size[2] * sizeof(float));
+		assert(s->scales != NULL);
+	}
+	return s;
+}
+
+void sw_samples_destroy(sw_samples_t *s) {
+	if (s == NULL) return;
+	sw_free(s->values);
+	sw_free(s->distance);
+	sw_free(s->color);
+	sw_free(s->scales);
+	sw_free(s);
+}
+
+size_t sw_samples_bytes(const sw_samples_t *s) {
+	assert(s != NULL);
+	size_t count = sw_samples_count(s);
+	if (s->format == SW_SAMPLES_F32) return count * sizeof(kr_vec4_t);
+	size_t bytes = count * (sw_samples_distance_size(s->format) + 3);
+	if (s->scales != NULL) bytes += (size_t)s->row_blocks * s->size[1] * s->size[2] * sizeof(float);
+	return bytes;
+}
+
+static uint8_t sw_samples_encode_color(float c) {
+	return (uint8_t)roundf(sw_clampf(c, 0.0f, 1.0f) * 255.0f);
+}
+
+static uint16_t sw_samples_encode_half(float d) {
+	// Beyond the largest half the distance would become infinite
+	uint16_t h = sw_half_from_float(sw_clampf(d, -SW_SAMPLES_HALF_MAX, SW_SAMPLES_HALF_MAX));
+	// Tiny negative distances would become -0, which is not inside anymore
+	if (d < 0.0f && (h & 0x7fffu) == 0) h = 0x8001u;
+	return h;
+}
+
+static int sw_samples_quantize(float d, float scale, float m, int qmax) {
+	if (scale <= 0.0f) return 0;
+	int q = (int)roundf(sw_clampf(d, -m, m) / scale);
+	if (q > qmax) q = qmax;
+	if (q < -qmax) q = -qmax;
+	if (d < 0.0f && q == 0) q = -1;
+	return q;
+}
+
+void sw_samples_store_row(sw_samples_t *s, int y, int z, const kr_vec4_t *row) {
+	assert(s != NULL && row != NULL && y >= 0 && y < s->size[1] && z >= 0 && z < s->size[2]);
+	int w = s->size[0];
+	size_t base = sw_samples_row(s, y, z) * w;
+	if (s->format == SW_SAMPLES_F32) {
+		for (int x = 0; x < w; ++x) s->values[base + x] = row[x];
+		return;
+	}
+	for (int x = 0; x < w; ++x) {
+		uint8_t *c = s->color + (base + x) * 3;
+		c[0] = sw_samples_encode_color(row[x].x);
+		c[1] = sw_samples_encode_color(row[x].y);
+		c[2] = sw_samples_encode_color(row[x].z);
+	}
+	if (s->format == SW_SAMPLES_F16) {
+		uint16_t *d = (uint16_t *)s->distance + base;
+		for (int x = 0; x < w; ++x) d[x] = sw_samples_encode_half(row[x].w);
+		return;
+	}
+
+	int qmax = s->format == SW_SAMPLES_I16 ? INT16_MAX : INT8_MAX;
+	float *scales = s->scales + sw_samples_row(s, y, z) * s->row_blocks;
+	for (int b = 0; b < s->row_blocks; ++b) {
+		int begin = b * SW_SAMPLES_BLOCK;
+		int end = sw_mini(begin + SW_SAMPLES_BLOCK, w);
+		float m = 0.0f;
+		for (int x = begin; x < end; ++x) m = fmaxf(m, fabsf(row[x].w));
+		m = fminf(m, s->band);
+		float scale = m / qmax;
+		scales[b] = scale;
+		for (int x = begin; x < end; ++x) {
+			int q = sw_samples_quantize(row[x].w, scale, m, qmax);
+			if (s->format == SW_SAMPLES_I16)
+				((int16_t *)s->distance)[base + x] = (int16_t)q;
+			else
+				((int8_t *)s->distance)[base + x] = (int8_t)q;
+		}
+	}
+}
+
+static float sw_samples_distance(const sw_samples_t *s, size_t row, size_t i, int x) {
+	switch (s->format) {
+	case SW_SAMPLES_F16:
+		return sw_half_to_float(((const uint16_t *)s->distance)[i]);
+	case SW_SAMPLES_I16:
+		return ((const int16_t *)s->distance)[i] *
+		       s->scales[row * s->row_blocks + x / SW_SAMPLES_BLOCK];
+	case SW_SAMPLES_I8:
+		return ((const int8_t *)s->distance)[i] *
+		       s->scales[row * s->row_blocks + x / SW_SAMPLES_BLOCK];
+	default:
+		return s->values[i].w;
+	}
+}
+
+static kr_vec4_t sw_samples_decode(const sw_samples_t *s, size_t row, int x) {
+	size_t i = row * s->size[0] + x;
+	if (s->format == SW_SAMPLES_F32) return s->values[i];
+	const uint8_t *c = s->color + i * 3;
+	return (kr_vec4_t){c[0] / 255.0f, c[1] / 255.0f, c[2] / 255.0f,
+	                   sw_samples_distance(s, row, i, x)};
+}
+
+void sw_samples_load_row(const sw_samples_t *s, int y, int z, kr_vec4_t *row) {
+	assert(s != NULL && row != NULL && y >= 0 && y < s->size[1] && z >= 0 && z < s->size[2]);
+	size_t r = sw_samples_row(s, y, z);
+	for (int x = 0; x < s->size[0]; ++x) row[x] = sw_samples_decode(s, r, x);
+}
+
+kr_vec4_t sw_samples_get(const sw_samples_t *s, int x, int y, int z) {
+	assert(s != NULL && x >= 0 && x < s->size[0] && y >= 0 && y < s->size[1] && z >= 0 &&
+	       z < s->size[2]);
+	return sw_samples_decode(s, sw_samples_row(s, y, z), x);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file samples.h
+ * @brief Compact storage for cached lattice samples (color and distance). Large grids cached across
+ * extraction passes take 16 bytes per sample as floats, the quantized formats take 4 to 5.
+ *
+ * Distances of the integer formats are clamped to `[-band, band]` and scaled per block of
+ * `SW_SAMPLES_BLOCK` samples along x, the error of a sample is at most half a step of its block,
+ * `min(band, max |d| of the block) / 254` for 8 bit and `/ 65534` for 16 bit. Half floats keep 11
+ * significant bits and are clamped to `SW_SAMPLES_HALF_MAX`. Colors of the quantized formats are
+ * RGB8 clamped to `[0, 1]`.
+ *
+ * Rounding never moves a value across zero: negative distances stay negative and the others stay
+ * non negative, so the inside / outside classification of the samples against 0 is exact and only
+ * the interpolated vertices move.
+ */
+#pragma once
+
+#include <krink/math/vector.h>
+#include <stddef.h>
+
+#define SW_SAMPLES_BLOCK 16
+#define SW_SAMPLES_HALF_MAX 65504.0f
+
+typedef enum sw_samples_format {
+	SW_SAMPLES_F32, // Float color and distance, 16 bytes, exact
+	SW_SAMPLES_F16, // Half distance, 5 bytes
+	SW_SAMPLES_I16, // Block scaled 16 bit distance, 5 bytes plus a float per block
+	SW_SAMPLES_I8,  // Block scaled 8 bit distance, 4 bytes plus a float per block
+} sw_samples_format_t;
+
+typedef struct sw_samples sw_samples_t;
+
+/**
+ * @brief Allocate a grid, the content is undefined until stored.
+ *
+ * @param size Samples per axis
+ * @param format
+ * @param band Clamp of the integer formats, should cover a few lattice steps
+ * @return sw_samples_t*
+ */
+sw_samples_t *sw_samples_init(const int size[3], sw_samples_format_t format, float band);
+void sw_samples_destroy(sw_samples_t *s);
+
+size_t sw_samples_bytes(const sw_samples_t *s);
+
+/**
+ * @brief Store a row of samples along x, `w` being the distance. Different rows may be stored
+ * concurrently.
+ *
+ * @param s
+ * @param y
+ * @param z
+ * @param row `size[0]` samples
+ */
+void sw_samples_store_row(sw_samples_t *s, int y, int z, const kr_vec4_t *row);
+
+/**
+ * @brief Dequantize a row of samples along x.
+ *
+ * @param s
+ * @param y
+ * @param z
+ * @param row Receives `size[0]` samples
+ */
+void sw_samples_load_row(const sw_samples_t *s, int y, int z, kr_vec4_t *row);
+
+kr_vec4_t sw_samples_get(const sw_samples_t *s, int x, int y, int z);
@@ -5,13 +5,20 @@
 #include "ops.h"
 #include "shapes.h"
 #include "shared.h"
+#include "stats.h"
+#include "trace.h"
 #include "transform.h"
 #include <assert.h>
 #include <kinc/log.h>
+#ifdef SW_STATS_ENABLED
+#include <kinc/system.h>
+#endif
 #include <krink/math/matrix.h>
-#include <krink/memory.h>
 #include <math.h>
+#include <util/hash.h>
 #include <util/list.h>
+#include <util/memory.h>
+#include <util/scratch.h>
 
 struct sw_sdf_stack_frame {
 	int node_id;
@@ -20,6 +27,10 @@ struct sw_sdf_stack_frame {
 	sw_type_t node_type;
 	void *data;
 	kr_vec3_t pos;
+#ifdef SW_STATS_ENABLED
+	double start;
+	double child_time;
+#endif
 };
 
 struct sw_sdf {
@@ -48,11 +59,10 @@ static void sw_sdf_populate_empty_to_root(sw_sdf_t *sdf, sw_graph_t *g, int star
 		sdf->empty_count = 0;
 		return;
 	}
-	sw_node_t *n = sw_graph_get_node(g, start_node);
+	// The children are evaluated in the space of the start node, its own transforms included
 	sw_list_int_t *path = sw_list_int_init(8);
-	while (n->parent >= 0) {
-		sw_list_int_push(path, n->parent);
-	}
+	for (int id = start_node; id >= 0; id = sw_graph_get_node(g, id)->parent)
+		sw_list_int_push(path, id);
 	sdf->empty_count = sw_list_int_len(path);
 	while (sw_list_int_len(path) > 0) {
 		int node_id = sw_list_int_pop(path);
@@ -62,7 +72,15 @@ static void sw_sdf_populate_empty_to_root(sw_sdf_t *sdf, sw_graph_t *g, int star
 	sw_list_int_destroy(path);
 }
 
-static void sw_sdf_traverse(sw_sdf_t *sdf, sw_graph_t *g, int parent, int depth) {
+static bool sw_sdf_is_excluded(int node_id, const int *exclude, int exclude_count) {
+	for (int i = 0; i < exclude_count; ++i) {
+		if (exclude[i] == node_id) return true;
+	}
+	return false;
+}
+
+static void sw_sdf_traverse(sw_sdf_t *sdf, sw_graph_t *g, int parent, int depth, const int *exclude,
+                            int exclude_count) {
 	sdf->max_stack_depth = (sdf->max_stack_depth < depth) ? depth : sdf->max_stack_depth;
 	sw_node_t *n = NULL;
 	sw_iter_t it;
@@ -70,45 +88,142 @@ static void sw_sdf_traverse(sw_sdf_t *sdf, sw_graph_t *g, int parent, int depth)
 		if (sw_sdf_is_dummy(n->type)) continue;
 		if (n->type == SW_TRANSFORM_TRANSLATION || n->type == SW_TRANSFORM_ROTATION) continue;
 		int node_id = sw_graph_get_node_id(g, n);
+		if (sw_sdf_is_excluded(node_id, exclude, exclude_count)) continue;
 		sw_list_int_push(sdf->nodes, node_id);
 		sw_list_int_push(sdf->nodes, sw_sdf_find_of_type(g, node_id, SW_TRANSFORM_TRANSLATION));
 		sw_list_int_push(sdf->nodes, sw_sdf_find_of_type(g, node_id, SW_TRANSFORM_ROTATION));
 		sw_list_int_push(sdf->stack_direction, 1);
-		sw_sdf_traverse(sdf, g, node_id, depth + 1);
+		sw_sdf_traverse(sdf, g, node_id, depth + 1, exclude, exclude_count);
 		sw_list_int_push(sdf->stack_direction, -1);
 	}
 }
 
-sw_sdf_t *sw_sdf_generate(sw_graph_t *g, int start_node) {
-	sw_sdf_t *sdf = (sw_sdf_t *)kr_malloc(sizeof(sw_sdf_t));
+static sw_sdf_t *sw_sdf_generate_internal(sw_graph_t *g, int start_node, bool to_root,
+                                           const int *exclude, int exclude_count) {
+	sw_trace_scope_t trace = sw_trace_begin("sdf_generate");
+	sw_sdf_t *sdf = (sw_sdf_t *)sw_malloc(sizeof(sw_sdf_t));
 	assert(sdf);
 	sdf->g = g;
 	sdf->nodes = sw_list_int_init(g->size * 3);
 	sdf->stack_direction = sw_list_int_init(g->size * 2);
 	sdf->max_stack_depth = -1;
-	sw_sdf_populate_empty_to_root(sdf, g, start_node);
-	sw_sdf_traverse(sdf, g, start_node, 0);
+	sw_stats_reserve_nodes(g->node_cap);
+	sw_sdf_populate_empty_to_root(sdf, g, to_root ? start_node : -1);
+	sw_sdf_traverse(sdf, g, start_node, 0, exclude, exclude_count);
+	sw_trace_end(&trace, g->size);
 	return sdf;
 }
 
+sw_sdf_t *sw_sdf_generate(sw_graph_t *g, int start_node) {
+	return sw_sdf_generate_internal(g, start_node, true, NULL, 0);
+}
+
+sw_sdf_t *sw_sdf_generate_local(sw_graph_t *g, int start_node) {
+	assert(start_node >= 0);
+	return sw_sdf_generate_internal(g, start_node, false, NULL, 0);
+}
+
+sw_sdf_t *sw_sdf_generate_excluding(sw_graph_t *g, int start_node, const int *exclude,
+                                    int exclude_count) {
+	assert(exclude != NULL || exclude_count == 0);
+	return sw_sdf_generate_internal(g, start_node, true, exclude, exclude_count);
+}
+
 void sw_sdf_destroy(sw_sdf_t *sdf) {
 	assert(sdf);
 	if (sdf->nodes) sw_list_int_destroy(sdf->nodes);
 	if (sdf->stack_direction) sw_list_int_destroy(sdf->stack_direction);
-	kr_free(sdf);
+	sw_free(sdf);
 }
 
-sw_sdf_stack_frame_t *sw_sdf_stack_init(const sw_sdf_t *sdf) {
+static uint64_t sw_sdf_hash_transform(const sw_sdf_t *sdf, uint64_t h, int node_id) {
+	if (node_id < 0) return sw_hash_int(h, -1);
+	sw_node_t *n = sw_graph_get_node(sdf->g, node_id);
+	h = sw_hash_int(h, n->type);
+	return sw_hash_bytes(h, sw_graph_get_data(sdf->g, n), n->size);
+}
+
+// Position of a node in the instruction stream, node ids change when the graph is edited
+static int sw_sdf_node_ordinal(const sw_sdf_t *sdf, int node_id) {
+	int count = (sw_list_int_len(sdf->nodes) - sdf->empty_count * 2) / 3;
+	for (int i = 0; i < count; ++i) {
+		if (sw_list_int_get(sdf->nodes, sdf->empty_count * 2 + i * 3) == node_id) return i;
+	}
+	return -1;
+}
+
+uint64_t sw_sdf_hash(const sw_sdf_t *sdf) {
+	assert(sdf != NULL);
+	uint64_t h = sw_hash_int(SW_HASH_SEED, sdf->empty_count);
+	for (int i = 0; i < sdf->empty_count * 2; ++i)
+		h = sw_sdf_hash_transform(sdf, h, sw_list_int_get(sdf->nodes, i));
+
+	int node_top = sdf->empty_count * 2;
+	int instruction_count = sw_list_int_len(sdf->stack_direction);
+	for (int i = 0; i < instruction_count; ++i) {
+		int direction = sw_list_int_get(sdf->stack_direction, i);
+		h = sw_hash_int(h, direction);
+		if (direction == -1) continue;
+
+		sw_node_t *n = sw_graph_get_node(sdf->g, sw_list_int_get(sdf->nodes, node_top++));
+		h = sw_hash_int(h, n->type);
+		if (n->type == SW_CSG_SUBTRACTION) {
+			sw_csg_subtraction_t csg = *(sw_csg_subtraction_t *)sw_graph_get_data(sdf->g, n);
+			csg.subtractor_id = sw_sdf_node_ordinal(sdf, csg.subtractor_id);
+			h = sw_hash_bytes(h, &csg, sizeof(csg));
+		}
+		else if (n->type == SW_CSG_SMOOTH_SUBTRACTION) {
+			sw_csg_smooth_subtraction_t csg =
+			    *(sw_csg_smooth_subtraction_t *)sw_graph_get_data(sdf->g, n);
+			csg.subtractor_id = sw_sdf_node_ordinal(sdf, csg.subtractor_id);
+			h = sw_hash_bytes(h, &csg, sizeof(csg));
+		}
+		else if (n->size > 0)
+			h = sw_hash_bytes(h, sw_graph_get_data(sdf->g, n), n->size);
+		h = sw_sdf_hash_transform(sdf, h, sw_list_int_get(sdf->nodes, node_top++));
+		h = sw_sdf_hash_transform(sdf, h, sw_list_int_get(sdf->nodes, node_top++));
+	}
+	return h;
+}
+
+uint32_t sw_sdf_mirror_flags(const sw_sdf_t *sdf) {
+	assert(sdf != NULL);
+	// Positions are transformed before reaching the mirror
+	for (int i = 0; i < sdf->empty_count * 2; ++i) {
+		if (sw_list_int_get(sdf->nodes, i) >= 0) return 0;
+	}
+	int instruction_count = sw_list_int_len(sdf->stack_direction);
+	if (instruction_count < 2) return 0;
+	// The first node is only popped by the last instruction
+	int depth = 0;
+	for (int i = 0; i < instruction_count - 1; ++i) {
+		depth += sw_list_int_get(sdf->stack_direction, i);
+		if (depth == 0) return 0;
+	}
+	int node_top = sdf->empty_count * 2;
+	if (sw_list_int_get(sdf->nodes, node_top + 1) >= 0 ||
+	    sw_list_int_get(sdf->nodes, node_top + 2) >= 0)
+		return 0;
+	sw_node_t *n = sw_graph_get_node(sdf->g, sw_list_int_get(sdf->nodes, node_top));
+	if (n->type != SW_OPS_MIRROR) return 0;
+	return ((sw_ops_mirror_t *)sw_graph_get_data(sdf->g, n))->mirror_flags &
+	       (SW_MIRROR_X | SW_MIRROR_Y | SW_MIRROR_Z);
+}
+
+size_t sw_sdf_stack_size(const sw_sdf_t *sdf) {
 	// TODO: Verify that the additional frame is needed!
-	sw_sdf_stack_frame_t *stack = (sw_sdf_stack_frame_t *)kr_malloc((sdf->max_stack_depth + 1) *
-	                                                                sizeof(sw_sdf_stack_frame_t));
+	return (sdf->max_stack_depth + 1) * sizeof(sw_sdf_stack_frame_t);
+}
+
+sw_sdf_stack_frame_t *sw_sdf_stack_init(const sw_sdf_t *sdf) {
+	sw_sdf_stack_frame_t *stack = (sw_sdf_stack_frame_t *)sw_malloc(sw_sdf_stack_size(sdf));
 	assert(stack != NULL);
 	return stack;
 }
 
 void sw_sdf_stack_destroy(sw_sdf_stack_frame_t *stack) {
 	assert(stack != NULL);
-	kr_free(stack);
+	sw_free(stack);
 }
 
 static kr_vec3_t sw_sdf_transform(const sw_sdf_t *sdf, kr_vec3_t pos, int translation,
@@ -171,10 +286,10 @@ static kr_vec4_t sw_sdf_compute_stack_frame_pop(sw_sdf_stack_frame_t *frame) {
 
 kr_vec4_t sw_sdf_compute_color(const sw_sdf_t *sdf, kr_vec3_t pos, sw_sdf_stack_frame_t *stack) {
 	sw_sdf_stack_frame_t *frames = NULL;
+	sw_scratch_mark_t mark;
 	if (stack == NULL) {
-		int stack_size = sdf->max_stack_depth + 1;
-		frames = (sw_sdf_stack_frame_t *)kr_malloc(stack_size * sizeof(sw_sdf_stack_frame_t));
-		assert(frames);
+		mark = sw_scratch_begin();
+		frames = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf));
 	}
 	else
 		frames = stack;
@@ -190,9 +305,21 @@ kr_vec4_t sw_sdf_compute_color(const sw_sdf_t *sdf, kr_vec3_t pos, sw_sdf_stack_
 	kr_vec4_t res = (kr_vec4_t){.x = 0.0f, .y = 0.0f, .z = 0.0f, .w = INFINITY};
 
 	int instruction_count = sw_list_int_len(sdf->stack_direction);
+	SW_STATS_ADD(instructions, instruction_count);
+#ifdef SW_STATS_ENABLED
+	bool sample = (sw_stats.sdf_evals++ % SW_STATS_NODE_SAMPLE_RATE) == 0;
+#endif
 	for (int i = 0; i < instruction_count; ++i) {
 		if (sw_list_int_get(sdf->stack_direction, i) == -1) { // POP
 			kr_vec4_t tmp_dist = sw_sdf_compute_stack_frame_pop(&frames[stack_top - 1]);
+#ifdef SW_STATS_ENABLED
+			if (sample) {
+				sw_sdf_stack_frame_t *f = &frames[stack_top - 1];
+				double total = kinc_time() - f->start;
+				sw_stats_node_sample(f->node_id, total - f->child_time, total);
+				if (stack_top > 1) frames[stack_top - 2].child_time += total;
+			}
+#endif
 			if (stack_top > 1)
 				pos = frames[stack_top - 2].pos;
 			else
@@ -244,11 +371,17 @@ kr_vec4_t sw_sdf_compute_color(const sw_sdf_t *sdf, kr_vec3_t pos, sw_sdf_stack_
 		frames[stack_top].data = n->size > 0 ? sw_graph_get_data(sdf->g, n) : NULL;
 		frames[stack_top].dist_a = (kr_vec4_t){0.0f, 0.0f, 0.0f, INFINITY};
 		frames[stack_top++].dist_b = (kr_vec4_t){0.0f, 0.0f, 0.0f, INFINITY};
+#ifdef SW_STATS_ENABLED
+		if (sample) {
+			frames[stack_top - 1].start = kinc_time();
+			frames[stack_top - 1].child_time = 0.0;
+		}
+#endif
 		sw_sdf_compute_stack_frame_push(&frames[stack_top - 1]);
 		pos = frames[stack_top - 1].pos;
 	}
 
-	if (stack == NULL) kr_free(frames);
+	if (stack == NULL) sw_scratch_end(mark);
 	return res;
 }
 
@@ -2,6 +2,8 @@
 
 #include "graph.h"
 #include <krink/math/vector.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct sw_sdf sw_sdf_t;
 typedef struct sw_sdf_stack_frame sw_sdf_stack_frame_t;
@@ -15,8 +17,50 @@ typedef struct sw_sdf_stack_frame sw_sdf_stack_frame_t;
  */
 sw_sdf_t *sw_sdf_generate(sw_graph_t *g, int start_node);
 
+/**
+ * @brief Generate a SDF of the children of a node in its local space, the transforms of the node
+ * and its ancestors are not applied.
+ *
+ * @param g
+ * @param start_node
+ * @return sw_sdf_t*
+ */
+sw_sdf_t *sw_sdf_generate_local(sw_graph_t *g, int start_node);
+
+/**
+ * @brief Like `sw_sdf_generate`, but leaves out the given nodes and their subtrees, e.g. parts that
+ * are meshed separately.
+ *
+ * @param g
+ * @param start_node
+ * @param exclude
+ * @param exclude_count
+ * @return sw_sdf_t*
+ */
+sw_sdf_t *sw_sdf_generate_excluding(sw_graph_t *g, int start_node, const int *exclude,
+                                    int exclude_count);
+
 void sw_sdf_destroy(sw_sdf_t *sdf);
 
+/**
+ * @brief Structural hash of everything the SDF evaluates: node types, parameters, transforms and
+ * topology. Names, dummies and node ids do not contribute, so renaming nodes or reordering unrelated
+ * parts of the graph keeps the hash.
+ *
+ * @param sdf
+ * @return uint64_t
+ */
+uint64_t sw_sdf_hash(const sw_sdf_t *sdf);
+
+/**
+ * @brief Mirror symmetry of the whole SDF: the flags of a `SW_OPS_MIRROR` node without transforms
+ * that is the only node at the top level, i.e. everything is evaluated through it.
+ *
+ * @param sdf
+ * @return uint32_t `sw_ops_mirror_flag_t` bits, `0` if the SDF is not known to be symmetric
+ */
+uint32_t sw_sdf_mirror_flags(const sw_sdf_t *sdf);
+
 /**
  * @brief Initialize a stack of the right size for SDF computation. Use this to avoid allocation
  * when computing multiple points for a given SDF.
@@ -26,6 +70,15 @@ void sw_sdf_destroy(sw_sdf_t *sdf);
  */
 sw_sdf_stack_frame_t *sw_sdf_stack_init(const sw_sdf_t *sdf);
 
+/**
+ * @brief Bytes needed by a stack for `sdf`, to place it in caller provided memory such as scratch
+ * allocations.
+ *
+ * @param sdf
+ * @return size_t
+ */
+size_t sw_sdf_stack_size(const sw_sdf_t *sdf);
+
 void sw_sdf_stack_destroy(sw_sdf_stack_frame_t *stack);
 
 /**
@@ -33,8 +86,8 @@ void sw_sdf_stack_destroy(sw_sdf_stack_frame_t *stack);
  *
  * @param sdf
  * @param pos The position to evaluate the SDF
- * @param stack If not `NULL`, a previously initialized stack will be used, otherwise the stack will
- * be allocated and subsequently freed for each call of this.
+ * @param stack If not `NULL`, a previously initialized stack will be used, otherwise a stack is
+ * taken from the scratch memory of the calling thread for each call of this.
  * @return float
  */
 float sw_sdf_compute(const sw_sdf_t *sdf, kr_vec3_t pos, sw_sdf_stack_frame_t *stack);
@@ -44,8 +97,8 @@ float sw_sdf_compute(const sw_sdf_t *sdf, kr_vec3_t pos, sw_sdf_stack_frame_t *s
  *
  * @param sdf
  * @param pos
- * @param stack If not `NULL`, a previously initialized stack will be used, otherwise the stack will
- * be allocated and subsequently freed for each call of this.
+ * @param stack If not `NULL`, a previously initialized stack will be used, otherwise a stack is
+ * taken from the scratch memory of the calling thread for each call of this.
  * @return kr_vec4_t xyz = rgb, w = distance
  */
 kr_vec4_t sw_sdf_compute_color(const sw_sdf_t *sdf, kr_vec3_t pos, sw_sdf_stack_frame_t *stack);
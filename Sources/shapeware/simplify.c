@@ -0,0 +1,464 @@
+/*
+Quadric error metric simplification, adapted from:
+Garland, Heckbert - Surface Simplification Using Quadric Error Metrics (SIGGRAPH 1997)
+*/
+
+#include "mesh.h"
+#include "mesh_internal.h"
+#include "trace.h"
+
+#include <sht/sht.h>
+#include <util/list.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Minimum cosine between a triangle normal before and after a collapse
+#define SW_SIMPLIFY_MAX_FLIP 0.2f
+// Weight of the squared color difference relative to the squared mesh extent
+#define SW_SIMPLIFY_COLOR_WEIGHT 0.01f
+
+// Symmetric 4x4 matrix, upper triangle: a2 ab ac ad b2 bc bd c2 cd d2 plus accumulated area
+typedef struct sw_quadric {
+	double q[10];
+	double w;
+} sw_quadric_t;
+
+typedef struct sw_collapse {
+	float cost;
+	int u, v;
+	int stamp_u, stamp_v;
+	kr_vec3_t pos;
+	int keep_color; // 0 = u, 1 = v, 2 = average
+} sw_collapse_t;
+
+typedef struct sw_heap {
+	sw_collapse_t *items;
+	int len;
+	int cap;
+} sw_heap_t;
+
+typedef struct sw_simplify {
+	sw_mesh_t *m;
+	sw_quadric_t *quadrics;
+	sw_list_int_t **vtris;
+	int *stamps;
+	bool *locked;
+	bool *dead_tris;
+	sw_heap_t heap;
+	sw_heap_t rejected; // Unordered, collapses refused by the link or flip tests
+	sw_scratch_mark_t mark; // Scope of the per vertex and per triangle arrays
+	float color_weight;
+	int live_tris;
+} sw_simplify_t;
+
+static void sw_quadric_add_plane(sw_quadric_t *q, kr_vec3_t n, float d, float w) {
+	double a = n.x, b = n.y, c = n.z, dd = d;
+	q->q[0] += w * a * a;
+	q->q[1] += w * a * b;
+	q->q[2] += w * a * c;
+	q->q[3] += w * a * dd;
+	q->q[4] += w * b * b;
+	q->q[5] += w * b * c;
+	q->q[6] += w * b * dd;
+	q->q[7] += w * c * c;
+	q->q[8] += w * c * dd;
+	q->q[9] += w * dd * dd;
+	q->w += w;
+}
+
+static sw_quadric_t sw_quadric_sum(const sw_quadric_t *a, const sw_quadric_t *b) {
+	sw_quadric_t r;
+	for (int i = 0; i < 10; ++i) r.q[i] = a->q[i] + b->q[i];
+	r.w = a->w + b->w;
+	return r;
+}
+
+// Area normalized squared distance of `p` to the planes accumulated in `q`
+static float sw_quadric_error(const sw_quadric_t *q, kr_vec3_t p) {
+	double x = p.x, y = p.y, z = p.z;
+	const double *m = q->q;
+	double e = m[0] * x * x + 2.0 * m[1] * x * y + 2.0 * m[2] * x * z + 2.0 * m[3] * x +
+	           m[4] * y * y + 2.0 * m[5] * y * z + 2.0 * m[6] * y + m[7] * z * z + 2.0 * m[8] * z +
+	           m[9];
+	return (float)(fabs(e) / (q->w > 0.0 ? q->w : 1.0));
+}
+
+static void sw_heap_push(sw_heap_t *h, sw_collapse_t c) {
+	if (h->len >= h->cap) {
+		h->cap = h->cap > 0 ? h->cap * 2 : 64;
+		h->items = (sw_collapse_t *)sw_realloc(h->items, h->cap * sizeof(sw_collapse_t));
+		assert(h->items != NULL);
+	}
+	int i = h->len++;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (h->items[parent].cost <= c.cost) break;
+		h->items[i] = h->items[parent];
+		i = parent;
+	}
+	h->items[i] = c;
+}
+
+// Plain array use of the heap storage, without ordering
+static void sw_heap_append(sw_heap_t *h, sw_collapse_t c) {
+	if (h->len >= h->cap) {
+		h->cap = h->cap > 0 ? h->cap * 2 : 64;
+		h->items = (sw_collapse_t *)sw_realloc(h->items, h->cap * sizeof(sw_collapse_t));
+		assert(h->items != NULL);
+	}
+	h->items[h->len++] = c;
+}
+
+static sw_collapse_t sw_heap_pop(sw_heap_t *h) {
+	assert(h->len > 0);
+	sw_collapse_t top = h->items[0];
+	sw_collapse_t last = h->items[--h->len];
+	int i = 0;
+	for (;;) {
+		int child = i * 2 + 1;
+		if (child >= h->len) break;
+		if (child + 1 < h->len && h->items[child + 1].cost < h->items[child].cost) ++child;
+		if (last.cost <= h->items[child].cost) break;
+		h->items[i] = h->items[child];
+		i = child;
+	}
+	if (h->len > 0) h->items[i] = last;
+	return top;
+}
+
+static void sw_simplify_push_edge(sw_simplify_t *s, int u, int v) {
+	if (s->locked[u] && s->locked[v]) return;
+	sw_vertex_t *vu = &s->m->vertices[u];
+	sw_vertex_t *vv = &s->m->vertices[v];
+	sw_quadric_t q = sw_quadric_sum(&s->quadrics[u], &s->quadrics[v]);
+
+	sw_collapse_t c = (sw_collapse_t){
+	    .u = u, .v = v, .stamp_u = s->stamps[u], .stamp_v = s->stamps[v], .cost = INFINITY};
+	// Locked vertices must not move, so they are the only valid target
+	if (!s->locked[v]) {
+		c.cost = sw_quadric_error(&q, vu->pos);
+		c.pos = vu->pos;
+		c.keep_color = 0;
+	}
+	if (!s->locked[u]) {
+		float e = sw_quadric_error(&q, vv->pos);
+		if (e < c.cost) {
+			c.cost = e;
+			c.pos = vv->pos;
+			c.keep_color = 1;
+		}
+	}
+	if (!s->locked[u] && !s->locked[v]) {
+		kr_vec3_t mid = kr_vec3_mult(kr_vec3_addv(vu->pos, vv->pos), 0.5f);
+		float e = sw_quadric_error(&q, mid);
+		if (e < c.cost) {
+			c.cost = e;
+			c.pos = mid;
+			c.keep_color = 2;
+		}
+	}
+	kr_vec3_t dc = kr_vec3_subv(vu->color, vv->color);
+	c.cost += kr_vec3_dot(dc, dc) * s->color_weight;
+	sw_heap_push(&s->heap, c);
+}
+
+static int sw_simplify_other(const sw_triangle_t *t, int v, int nth) {
+	int idx[3] = {t->va, t->vb, t->vc};
+	for (int i = 0; i < 3; ++i)
+		if (idx[i] == v) return idx[(i + 1 + nth) % 3];
+	assert(false);
+	return -1;
+}
+
+static bool sw_simplify_has_vertex(const sw_triangle_t *t, int v) {
+	return t->va == v || t->vb == v || t->vc == v;
+}
+
+// Link condition: an interior edge may only share its two opposite vertices
+static bool sw_simplify_link_ok(sw_simplify_t *s, int u, int v) {
+	int shared = 0;
+	sw_list_int_t *tu = s->vtris[u];
+	sw_list_int_t *tv = s->vtris[v];
+	for (int i = 0; i < sw_list_int_len(tu); ++i) {
+		int ti = sw_list_int_get(tu, i);
+		if (s->dead_tris[ti]) continue;
+		for (int k = 0; k < 2; ++k) {
+			int a = sw_simplify_other(&s->m->triangles[ti], u, k);
+			if (a == v) continue;
+			bool found = false;
+			for (int j = 0; j < sw_list_int_len(tv) && !found; ++j) {
+				int tj = sw_list_int_get(tv, j);
+				if (s->dead_tris[tj]) continue;
+				found = sw_simplify_has_vertex(&s->m->triangles[tj], a);
+			}
+			if (found) ++shared;
+		}
+	}
+	// Every shared neighbour is counted twice, once per adjacent triangle around `u`
+	return shared <= 4;
+}
+
+static bool sw_simplify_flips(sw_simplify_t *s, int moved, int other, kr_vec3_t pos) {
+	sw_list_int_t *tris = s->vtris[moved];
+	for (int i = 0; i < sw_list_int_len(tris); ++i) {
+		int ti = sw_list_int_get(tris, i);
+		if (s->dead_tris[ti]) continue;
+		sw_triangle_t *t = &s->m->triangles[ti];
+		if (sw_simplify_has_vertex(t, other)) continue;
+		kr_vec3_t p[3] = {s->m->vertices[t->va].pos, s->m->vertices[t->vb].pos,
+		                  s->m->vertices[t->vc].pos};
+		kr_vec3_t before = sw_triangle_face_normal(p[0], p[1], p[2]);
+		if (t->va == moved) p[0] = pos;
+		if (t->vb == moved) p[1] = pos;
+		if (t->vc == moved) p[2] = pos;
+		kr_vec3_t after = sw_triangle_face_normal(p[0], p[1], p[2]);
+		float lb = kr_vec3_length(before);
+		float la = kr_vec3_length(after);
+		if (la <= 1e-12f) return true;
+		if (lb > 1e-12f && kr_vec3_dot(before, after) < SW_SIMPLIFY_MAX_FLIP * la * lb) return true;
+	}
+	return false;
+}
+
+static void sw_simplify_collapse(sw_simplify_t *s, const sw_collapse_t *c) {
+	sw_mesh_t *m = s->m;
+	// `keep` survives and moves to the target position, `removed` is merged into it
+	int keep = s->locked[c->u] ? c->u : c->v;
+	int removed = keep == c->u ? c->v : c->u;
+
+	sw_vertex_t *vk = &m->vertices[keep];
+	sw_vertex_t *vr = &m->vertices[removed];
+	if (c->keep_color == 2) {
+		vk->color = kr_vec3_mult(kr_vec3_addv(vk->color, vr->color), 0.5f);
+		kr_vec3_t n = kr_vec3_addv(vk->normal, vr->normal);
+		if (kr_vec3_dot(n, n) > 0.0f) vk->normal = kr_vec3_normalized(n);
+	}
+	else if ((c->keep_color == 0) != (keep == c->u)) {
+		vk->color = vr->color;
+		vk->normal = vr->normal;
+	}
+	vk->pos = c->pos;
+	s->quadrics[keep] = sw_quadric_sum(&s->quadrics[keep], &s->quadrics[removed]);
+
+	sw_list_int_t *tr = s->vtris[removed];
+	for (int i = 0; i < sw_list_int_len(tr); ++i) {
+		int ti = sw_list_int_get(tr, i);
+		if (s->dead_tris[ti]) continue;
+		sw_triangle_t *t = &m->triangles[ti];
+		if (sw_simplify_has_vertex(t, keep)) {
+			s->dead_tris[ti] = true;
+			--s->live_tris;
+			continue;
+		}
+		if (t->va == removed) t->va = keep;
+		if (t->vb == removed) t->vb = keep;
+		if (t->vc == removed) t->vc = keep;
+		sw_list_int_push(s->vtris[keep], ti);
+	}
+	sw_list_int_clear(tr);
+	s->stamps[removed] = -1;
+	++s->stamps[keep];
+
+	// Drop dead triangles from the surviving list and queue the new edges around it
+	sw_list_int_t *tk = s->vtris[keep];
+	int len = sw_list_int_len(tk);
+	sw_list_int_t *live = sw_list_int_init(len);
+	for (int i = 0; i < len; ++i) {
+		int ti = sw_list_int_get(tk, i);
+		if (!s->dead_tris[ti]) sw_list_int_push(live, ti);
+	}
+	sw_list_int_destroy(tk);
+	s->vtris[keep] = live;
+	for (int i = 0; i < sw_list_int_len(live); ++i) {
+		sw_triangle_t *t = &m->triangles[sw_list_int_get(live, i)];
+		// Edges shared by two triangles get queued twice, the stale copy is skipped when popped
+		sw_simplify_push_edge(s, keep, sw_simplify_other(t, keep, 0));
+		sw_simplify_push_edge(s, keep, sw_simplify_other(t, keep, 1));
+	}
+}
+
+static uint64_t sw_simplify_edge_key(int a, int b) {
+	return (a < b) ? ((uint64_t)(uint32_t)a << 32) | (uint32_t)b
+	               : ((uint64_t)(uint32_t)b << 32) | (uint32_t)a;
+}
+
+static void sw_simplify_init(sw_simplify_t *s, sw_mesh_t *m) {
+	int nv = m->next_vert;
+	int nt = m->next_tris;
+	s->m = m;
+	s->mark = sw_scratch_begin();
+	s->quadrics = (sw_quadric_t *)sw_scratch_alloc(nv * sizeof(sw_quadric_t));
+	s->vtris = (sw_list_int_t **)sw_scratch_alloc(nv * sizeof(sw_list_int_t *));
+	s->stamps = (int *)sw_scratch_alloc(nv * sizeof(int));
+	s->locked = (bool *)sw_scratch_alloc(nv * sizeof(bool));
+	s->dead_tris = (bool *)sw_scratch_alloc(nt * sizeof(bool));
+	s->heap = (sw_heap_t){.items = NULL, .len = 0, .cap = 0};
+	s->rejected = (sw_heap_t){.items = NULL, .len = 0, .cap = 0};
+	s->live_tris = nt;
+
+	for (int i = 0; i < nv; ++i) {
+		s->quadrics[i] = (sw_quadric_t){0};
+		s->vtris[i] = sw_list_int_init(8);
+		s->stamps[i] = 0;
+		s->locked[i] = false;
+	}
+	kr_vec3_t lo, hi;
+	sw_mesh_aabb(m, &lo, &hi);
+	kr_vec3_t extent = kr_vec3_subv(hi, lo);
+	s->color_weight = kr_vec3_dot(extent, extent) * SW_SIMPLIFY_COLOR_WEIGHT;
+
+	for (int i = 0; i < nt; ++i) {
+		sw_triangle_t *t = &m->triangles[i];
+		s->dead_tris[i] = false;
+		kr_vec3_t n = sw_triangle_face_normal(m->vertices[t->va].pos, m->vertices[t->vb].pos,
+		                                      m->vertices[t->vc].pos);
+		float area2 = kr_vec3_length(n);
+		if (area2 > 0.0f) {
+			n = kr_vec3_mult(n, 1.0f / area2);
+			float d = -kr_vec3_dot(n, m->vertices[t->va].pos);
+			sw_quadric_add_plane(&s->quadrics[t->va], n, d, area2 * 0.5f);
+			sw_quadric_add_plane(&s->quadrics[t->vb], n, d, area2 * 0.5f);
+			sw_quadric_add_plane(&s->quadrics[t->vc], n, d, area2 * 0.5f);
+		}
+		sw_list_int_push(s->vtris[t->va], i);
+		sw_list_int_push(s->vtris[t->vb], i);
+		sw_list_int_push(s->vtris[t->vc], i);
+	}
+
+	// Lock vertices on boundary and non-manifold edges, queue every edge once
+	sht_t *edges = sht_init_alloc(sizeof(int), nt * 3, 42, sw_malloc, sw_free);
+	assert(edges != NULL);
+	for (int i = 0; i < nt; ++i) {
+		int idx[3] = {m->triangles[i].va, m->triangles[i].vb, m->triangles[i].vc};
+		for (int k = 0; k < 3; ++k) {
+			uint64_t key = sw_simplify_edge_key(idx[k], idx[(k + 1) % 3]);
+			int *count = sht_get(edges, &key, sizeof(key));
+			int c = count ? *count + 1 : 1;
+			sht_set(edges, &key, sizeof(key), &c);
+		}
+	}
+	for (int i = 0; i < nt; ++i) {
+		int idx[3] = {m->triangles[i].va, m->triangles[i].vb, m->triangles[i].vc};
+		for (int k = 0; k < 3; ++k) {
+			uint64_t key = sw_simplify_edge_key(idx[k], idx[(k + 1) % 3]);
+			if (*(int *)sht_get(edges, &key, sizeof(key)) != 2) {
+				s->locked[idx[k]] = true;
+				s->locked[idx[(k + 1) % 3]] = true;
+			}
+		}
+	}
+	for (int i = 0; i < nt; ++i) {
+		int idx[3] = {m->triangles[i].va, m->triangles[i].vb, m->triangles[i].vc};
+		for (int k = 0; k < 3; ++k) {
+			uint64_t key = sw_simplify_edge_key(idx[k], idx[(k + 1) % 3]);
+			int *count = sht_get(edges, &key, sizeof(key));
+			if (*count <= 0) continue;
+			*count = 0;
+			sw_simplify_push_edge(s, idx[k], idx[(k + 1) % 3]);
+		}
+	}
+	sht_destroy(edges);
+}
+
+static void sw_simplify_finish(sw_simplify_t *s) {
+	sw_mesh_t *m = s->m;
+	int nv = m->next_vert;
+	int *remap = (int *)sw_scratch_alloc(nv * sizeof(int));
+	for (int i = 0; i < nv; ++i) {
+		sw_list_int_destroy(s->vtris[i]);
+		remap[i] = -1;
+	}
+
+	for (int i = 0; i < m->next_tris; ++i) {
+		if (s->dead_tris[i]) continue;
+		const sw_triangle_t *t = &m->triangles[i];
+		remap[t->va] = remap[t->vb] = remap[t->vc] = 0;
+	}
+	// Numbered in ascending order, so a vertex only ever moves to a lower or equal index and the
+	// compaction can happen in place
+	int verts = 0;
+	for (int i = 0; i < nv; ++i) {
+		if (remap[i] < 0) continue;
+		remap[i] = verts++;
+		m->vertices[remap[i]] = m->vertices[i];
+	}
+
+	int tris = 0;
+	for (int i = 0; i < m->next_tris; ++i) {
+		if (s->dead_tris[i]) continue;
+		sw_triangle_t t = m->triangles[i];
+		t.va = remap[t.va];
+		t.vb = remap[t.vb];
+		t.vc = remap[t.vc];
+		m->triangles[tris++] = t;
+	}
+	m->next_vert = verts;
+	m->next_tris = tris;
+	sw_mesh_internal_rebuild(m);
+
+	sw_free(s->heap.items);
+	sw_free(s->rejected.items);
+	sw_scratch_end(s->mark);
+}
+
+int sw_mesh_simplify(sw_mesh_t *m, int target_tris, float max_error) {
+	assert(m != NULL);
+	if (m->next_tris <= target_tris) return m->next_tris;
+
+	sw_trace_scope_t trace = sw_trace_begin("simplify");
+	sw_simplify_t s;
+	sw_simplify_init(&s, m);
+	float max_cost = max_error * max_error;
+	for (;;) {
+		int collapsed = 0;
+		while (s.live_tris > target_tris && s.heap.len > 0) {
+			sw_collapse_t c = sw_heap_pop(&s.heap);
+			if (c.cost > max_cost) break;
+			if (s.stamps[c.u] != c.stamp_u || s.stamps[c.v] != c.stamp_v) continue;
+			if (!sw_simplify_link_ok(&s, c.u, c.v) || sw_simplify_flips(&s, c.u, c.v, c.pos) ||
+			    sw_simplify_flips(&s, c.v, c.u, c.pos)) {
+				sw_heap_append(&s.rejected, c);
+				continue;
+			}
+			sw_simplify_collapse(&s, &c);
+			++collapsed;
+		}
+		if (s.live_tris <= target_tris || collapsed == 0 || s.rejected.len == 0) break;
+		// Collapses next to a refused edge change its neighbourhood without touching its stamps,
+		// so it may have become valid. Requeue the ones still current with a fresh cost, every
+		// round collapses at least one edge so this terminates.
+		int rejected = s.rejected.len;
+		s.rejected.len = 0;
+		for (int i = 0; i < rejected; ++i) {
+			sw_collapse_t c = s.rejected.items[i];
+			if (s.stamps[c.u] != c.stamp_u || s.stamps[c.v] != c.stamp_v) continue;
+			sw_simplify_push_edge(&s, c.u, c.v);
+		}
+	}
+	sw_simplify_finish(&s);
+	sw_trace_end(&trace, m->next_tris);
+	return m->next_tris;
+}
+
+int sw_mesh_simplify_lods(const sw_mesh_t *m, sw_mesh_t **lods, int lod_count, float ratio,
+                          float max_error) {
+	assert(m != NULL && lods != NULL && ratio > 0.0f && ratio < 1.0f);
+	const sw_mesh_t *prev = m;
+	for (int i = 0; i < lod_count; ++i) {
+		sw_mesh_t *lod = sw_mesh_copy(prev);
+		int before = lod->next_tris;
+		int after = sw_mesh_simplify(lod, (int)(before * ratio), max_error);
+		if (after >= before) {
+			sw_mesh_destroy(lod);
+			return i;
+		}
+		lods[i] = lod;
+		prev = lod;
+	}
+	return lod_count;
+}
@@ -0,0 +1,120 @@
+#include "stats.h"
+
+#ifdef SW_STATS_ENABLED
+
+#include <assert.h>
+#include <kinc/log.h>
+#include <kinc/threads/atomic.h>
+#include <string.h>
+#include <util/memory.h>
+
+sw_stats_t sw_stats;
+static uint64_t sw_stats_allocation_base;
+
+const sw_stats_t *sw_stats_get(void) {
+	// Allocations are only counted by the allocation layer
+	sw_stats.allocations = sw_memory_get_stats().allocations - sw_stats_allocation_base;
+	return &sw_stats;
+}
+
+static sw_stats_node_t *sw_stats_node_at(int node_id) {
+	return &sw_stats.node_chunks[node_id / SW_STATS_NODE_CHUNK][node_id % SW_STATS_NODE_CHUNK];
+}
+
+void sw_stats_reset(void) {
+	sw_stats_node_t *chunks[SW_STATS_MAX_NODE_CHUNKS];
+	memcpy(chunks, sw_stats.node_chunks, sizeof(chunks));
+	int node_cap = sw_stats.node_cap;
+	memset(&sw_stats, 0, sizeof(sw_stats));
+	memcpy(sw_stats.node_chunks, chunks, sizeof(chunks));
+	for (int i = 0; i < node_cap / SW_STATS_NODE_CHUNK; ++i)
+		memset(chunks[i], 0, SW_STATS_NODE_CHUNK * sizeof(sw_stats_node_t));
+	sw_stats.node_cap = node_cap;
+	sw_stats_allocation_base = sw_memory_get_stats().allocations;
+}
+
+void sw_stats_reserve_nodes(int node_cap) {
+	int max_cap = SW_STATS_NODE_CHUNK * SW_STATS_MAX_NODE_CHUNKS;
+	if (node_cap > max_cap) node_cap = max_cap;
+	int cap = sw_stats.node_cap;
+	if (node_cap <= cap) return;
+	for (; cap < node_cap; cap += SW_STATS_NODE_CHUNK) {
+		sw_stats_node_t *chunk =
+		    (sw_stats_node_t *)sw_malloc(SW_STATS_NODE_CHUNK * sizeof(sw_stats_node_t));
+		assert(chunk != NULL);
+		memset(chunk, 0, SW_STATS_NODE_CHUNK * sizeof(sw_stats_node_t));
+		sw_stats.node_chunks[cap / SW_STATS_NODE_CHUNK] = chunk;
+	}
+	// Samplers on other workers only touch chunks below the published capacity
+	KINC_ATOMIC_EXCHANGE_32(&sw_stats.node_cap, cap);
+}
+
+void sw_stats_node_sample(int node_id, double self_time, double total_time) {
+	assert(node_id >= 0);
+	if (node_id >= sw_stats.node_cap) return;
+	sw_stats_node_t *n = sw_stats_node_at(node_id);
+	++n->samples;
+	n->self_time += self_time;
+	n->total_time += total_time;
+}
+
+const sw_stats_node_t *sw_stats_node(int node_id) {
+	assert(node_id >= 0);
+	return node_id < sw_stats.node_cap ? sw_stats_node_at(node_id) : NULL;
+}
+
+static double sw_stats_total_self_time(int count) {
+	double total = 0.0;
+	for (int i = 0; i < count && i < sw_stats.node_cap; ++i)
+		total += sw_stats_node_at(i)->self_time;
+	return total;
+}
+
+void sw_stats_heat_map(const sw_graph_t *g, float *heat) {
+	assert(g != NULL && heat != NULL);
+	double total = sw_stats_total_self_time(g->node_cap);
+	for (int i = 0; i < g->node_cap; ++i) {
+		heat[i] = (i < sw_stats.node_cap && total > 0.0)
+		              ? (float)(sw_stats_node_at(i)->self_time / total)
+		              : 0.0f;
+	}
+}
+
+void sw_stats_log(sw_graph_t *g) {
+	sw_stats_get();
+	kinc_log(KINC_LOG_LEVEL_INFO,
+	         "SDF evals %llu, instructions %llu, MC cells %llu (%llu empty, %llu active), "
+	         "triangles %llu, mesh lookups %llu (%llu collisions), allocations %llu",
+	         (unsigned long long)sw_stats.sdf_evals, (unsigned long long)sw_stats.instructions,
+	         (unsigned long long)sw_stats.mc_cells, (unsigned long long)sw_stats.mc_cells_empty,
+	         (unsigned long long)sw_stats.mc_cells_active, (unsigned long long)sw_stats.triangles,
+	         (unsigned long long)sw_stats.mesh_lookups,
+	         (unsigned long long)sw_stats.mesh_collisions,
+	         (unsigned long long)sw_stats.allocations);
+
+	int node_cap = sw_stats.node_cap;
+	double total = sw_stats_total_self_time(node_cap);
+	if (total <= 0.0) return;
+	// Selection by descending self time, graphs are small enough
+	bool *done = (bool *)sw_malloc(node_cap * sizeof(bool));
+	assert(done != NULL);
+	memset(done, 0, node_cap * sizeof(bool));
+	for (;;) {
+		int best = -1;
+		for (int i = 0; i < node_cap; ++i) {
+			sw_stats_node_t *n = sw_stats_node_at(i);
+			if (done[i] || n->samples == 0) continue;
+			if (best < 0 || n->self_time > sw_stats_node_at(best)->self_time) best = i;
+		}
+		if (best < 0) break;
+		done[best] = true;
+		sw_stats_node_t *n = sw_stats_node_at(best);
+		const char *name = (g != NULL && best < g->node_cap) ? g->nodes[best].name : "";
+		kinc_log(KINC_LOG_LEVEL_INFO, "Node %d '%s': %5.1f%% self, %.3f us self, %.3f us total",
+		         best, name, 100.0 * n->self_time / total, 1e6 * n->self_time / n->samples,
+		         1e6 * n->total_time / n->samples);
+	}
+	sw_free(done);
+}
+
+#endif
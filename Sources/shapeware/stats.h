@@ -0,0 +1,101 @@
+/**
+ * @file stats.h
+ * @brief Opt-in runtime statistics. Define `SW_STATS_ENABLED` for the whole build (e.g.
+ * `project.addDefine('SW_STATS_ENABLED')`) to collect them, otherwise every counter and query
+ * compiles to nothing. Counters are global and not synchronized, collect them from one thread, they
+ * are approximate while work runs on a job context (see `jobs.h`).
+ */
+#pragma once
+
+#include "graph.h"
+
+#include <stdint.h>
+
+// One in this many SDF evaluations is timed per node
+#define SW_STATS_NODE_SAMPLE_RATE 64
+// Per node samples are allocated in chunks that never move, nodes beyond the last chunk are not
+// sampled
+#define SW_STATS_NODE_CHUNK 256
+#define SW_STATS_MAX_NODE_CHUNKS 256
+
+typedef struct sw_stats_node {
+	uint64_t samples;
+	double self_time;  // Seconds spent in the node itself
+	double total_time; // Seconds including its children
+} sw_stats_node_t;
+
+typedef struct sw_stats {
+	uint64_t sdf_evals;
+	uint64_t instructions; // Interpreter push and pop steps
+	uint64_t mc_cells;
+	uint64_t mc_cells_empty; // Entirely inside or outside the surface
+	uint64_t mc_cells_active;
+	uint64_t triangles;
+	uint64_t mesh_lookups; // Vertex lookups in `sw_mesh_t`
+	uint64_t mesh_collisions; // Additional probes needed by those lookups
+	uint64_t allocations; // `sw_malloc` and `sw_realloc` calls, taken from `sw_memory_get_stats`
+	sw_stats_node_t *node_chunks[SW_STATS_MAX_NODE_CHUNKS]; // Use `sw_stats_node`
+	volatile int node_cap; // Nodes with samples allocated, published after their chunk
+} sw_stats_t;
+
+#ifdef SW_STATS_ENABLED
+
+extern sw_stats_t sw_stats;
+
+#define SW_STATS_ADD(field, n) (sw_stats.field += (uint64_t)(n))
+#define SW_STATS_INC(field) (++sw_stats.field)
+
+const sw_stats_t *sw_stats_get(void);
+void sw_stats_reset(void);
+
+/**
+ * @brief Allocate per node samples for at least `node_cap` nodes. Done when a SDF is generated.
+ * Existing samples never move, so workers may keep sampling other SDFs meanwhile.
+ *
+ * @param node_cap
+ */
+void sw_stats_reserve_nodes(int node_cap);
+
+/**
+ * @brief Add a timing sample, ignored for nodes that were not reserved.
+ */
+void sw_stats_node_sample(int node_id, double self_time, double total_time);
+
+/**
+ * @brief Samples of a node, `NULL` if none were reserved for it.
+ */
+const sw_stats_node_t *sw_stats_node(int node_id);
+
+/**
+ * @brief Share of the sampled self time per node, suitable to color the graph as a heat map. The
+ * shares of all nodes add up to `1`.
+ *
+ * @param g
+ * @param heat Must hold `g->node_cap` entries, nodes without samples get `0`, all of them without
+ * `SW_STATS_ENABLED`
+ */
+void sw_stats_heat_map(const sw_graph_t *g, float *heat);
+
+/**
+ * @brief Log the counters and the nodes ordered by cost.
+ *
+ * @param g Used for node names, may be `NULL`
+ */
+void sw_stats_log(sw_graph_t *g);
+
+#else
+
+#define SW_STATS_ADD(field, n) ((void)0)
+#define SW_STATS_INC(field) ((void)0)
+
+static inline const sw_stats_t *sw_stats_get(void) {
+	return NULL;
+}
+static inline void sw_stats_reset(void) {}
+static inline void sw_stats_reserve_nodes(int node_cap) {}
+static inline void sw_stats_heat_map(const sw_graph_t *g, float *heat) {
+	for (int i = 0; i < g->node_cap; ++i) heat[i] = 0.0f;
+}
+static inline void sw_stats_log(sw_graph_t *g) {}
+
+#endif
@@ -0,0 +1,171 @@
+#include "trace.h"
+
+#include <kinc/io/filewriter.h>
+#include <kinc/log.h>
+#include <kinc/system.h>
+#include <kinc/threads/atomic.h>
+#include <kinc/threads/threadlocal.h>
+#include <util/memory.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SW_TRACE_LINE 256
+
+typedef struct sw_trace_event {
+	const char *name;
+	double start;
+	double duration;
+	int thread;
+	int arg;
+} sw_trace_event_t;
+
+typedef struct sw_trace_thread {
+	const char *name;
+	int index;
+} sw_trace_thread_t;
+
+static volatile int sw_trace_state = 0; // 0 uninitialized, 1 initializing, 2 ready
+static kinc_thread_local_t sw_trace_tls; // Thread id + 1
+static volatile int sw_trace_next_thread = 0;
+static sw_trace_thread_t sw_trace_threads[SW_TRACE_MAX_THREADS];
+
+static volatile int sw_trace_on = 0;
+static sw_trace_event_t *sw_trace_events = NULL;
+static unsigned sw_trace_capacity = 0;
+static volatile int sw_trace_next = 0; // Total events recorded, wraps around
+static double sw_trace_origin = 0.0;
+
+static int sw_trace_fetch_add(volatile int *p) {
+	for (;;) {
+		int old = *p;
+		if (KINC_ATOMIC_COMPARE_EXCHANGE(p, old, (int)((unsigned)old + 1u))) return old;
+	}
+}
+
+static int sw_trace_thread_id(void) {
+	if (sw_trace_state != 2) {
+		if (KINC_ATOMIC_COMPARE_EXCHANGE(&sw_trace_state, 0, 1)) {
+			kinc_thread_local_init(&sw_trace_tls);
+			KINC_ATOMIC_EXCHANGE_32(&sw_trace_state, 2);
+		}
+		else
+			while (sw_trace_state != 2)
+				;
+	}
+	int id = (int)(intptr_t)kinc_thread_local_get(&sw_trace_tls) - 1;
+	if (id < 0) {
+		id = sw_trace_fetch_add(&sw_trace_next_thread);
+		kinc_thread_local_set(&sw_trace_tls, (void *)(intptr_t)(id + 1));
+	}
+	return id;
+}
+
+void sw_trace_start(int capacity) {
+	assert(capacity >= 0);
+	unsigned cap = 1;
+	while (cap < (unsigned)(capacity > 0 ? capacity : SW_TRACE_DEFAULT_CAPACITY)) cap <<= 1;
+	if (cap != sw_trace_capacity) {
+		sw_free(sw_trace_events);
+		sw_trace_events = (sw_trace_event_t *)sw_malloc(cap * sizeof(sw_trace_event_t));
+		assert(sw_trace_events != NULL);
+		sw_trace_capacity = cap;
+	}
+	sw_trace_next = 0;
+	sw_trace_origin = kinc_time();
+	KINC_ATOMIC_EXCHANGE_32(&sw_trace_on, 1);
+}
+
+void sw_trace_stop(void) {
+	KINC_ATOMIC_EXCHANGE_32(&sw_trace_on, 0);
+}
+
+bool sw_trace_active(void) {
+	return sw_trace_on != 0;
+}
+
+void sw_trace_release(void) {
+	assert(!sw_trace_on);
+	sw_free(sw_trace_events);
+	sw_trace_events = NULL;
+	sw_trace_capacity = 0;
+	sw_trace_next = 0;
+}
+
+void sw_trace_thread_name(const char *name, int index) {
+	int id = sw_trace_thread_id();
+	if (id >= SW_TRACE_MAX_THREADS) return;
+	sw_trace_threads[id] = (sw_trace_thread_t){.name = name, .index = index};
+}
+
+sw_trace_scope_t sw_trace_begin(const char *name) {
+	if (!sw_trace_on) return (sw_trace_scope_t){.name = NULL, .start = 0.0};
+	return (sw_trace_scope_t){.name = name, .start = kinc_time()};
+}
+
+void sw_trace_end(const sw_trace_scope_t *scope, int arg) {
+	if (scope->name == NULL || !sw_trace_on) return;
+	double end = kinc_time();
+	unsigned i = (unsigned)sw_trace_fetch_add(&sw_trace_next) & (sw_trace_capacity - 1);
+	sw_trace_events[i] = (sw_trace_event_t){.name = scope->name,
+	                                        .start = scope->start - sw_trace_origin,
+	                                        .duration = end - scope->start,
+	                                        .thread = sw_trace_thread_id(),
+	                                        .arg = arg};
+}
+
+static void sw_trace_print(kinc_file_writer_t *w, const char *line, int len) {
+	// `snprintf` returns the untruncated length
+	if (len >= SW_TRACE_LINE) len = SW_TRACE_LINE - 1;
+	if (len > 0) kinc_file_writer_write(w, (void *)line, len);
+}
+
+bool sw_trace_write(const char *filename) {
+	kinc_file_writer_t writer;
+	if (!kinc_file_writer_open(&writer, filename)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Unable to open file '%s' for writing", filename);
+		return false;
+	}
+	unsigned total = (unsigned)sw_trace_next;
+	unsigned count = total < sw_trace_capacity ? total : sw_trace_capacity;
+	char line[SW_TRACE_LINE];
+	int len = snprintf(line, sizeof(line),
+	                   "{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": %u}, "
+	                   "\"traceEvents\": [\n",
+	                   total - count);
+	sw_trace_print(&writer, line, len);
+
+	bool first = true;
+	int threads = sw_trace_next_thread < SW_TRACE_MAX_THREADS ? sw_trace_next_thread
+	                                                          : SW_TRACE_MAX_THREADS;
+	for (int i = 0; i < threads; ++i) {
+		if (sw_trace_threads[i].name == NULL) continue;
+		if (sw_trace_threads[i].index >= 0)
+			len = snprintf(line, sizeof(line),
+			               "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+			               "\"args\": {\"name\": \"%s %d\"}}",
+			               first ? "" : ",\n", i, sw_trace_threads[i].name,
+			               sw_trace_threads[i].index);
+		else
+			len = snprintf(line, sizeof(line),
+			               "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+			               "\"args\": {\"name\": \"%s\"}}",
+			               first ? "" : ",\n", i, sw_trace_threads[i].name);
+		sw_trace_print(&writer, line, len);
+		first = false;
+	}
+	for (unsigned n = total - count; n != total; ++n) {
+		const sw_trace_event_t *e = &sw_trace_events[n & (sw_trace_capacity - 1)];
+		len = snprintf(line, sizeof(line),
+		               "%s{\"name\": \"%s\", \"cat\": \"shapeware\", \"ph\": \"X\", \"pid\": 1, "
+		               "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"arg\": %d}}",
+		               first ? "" : ",\n", e->name, e->thread, e->start * 1e6, e->duration * 1e6,
+		               e->arg);
+		sw_trace_print(&writer, line, len);
+		first = false;
+	}
+	sw_trace_print(&writer, "\n]}\n", 4);
+	kinc_file_writer_close(&writer);
+	return true;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file trace.h
+ * @brief Timeline of the pipeline in the Chrome trace format, open the written file in
+ * chrome://tracing or ui.perfetto.dev. Tracing is switched on and off at runtime, scopes record into
+ * a fixed size ring buffer shared by all threads, the oldest events are overwritten when it is
+ * full. While tracing is off a scope costs a single branch.
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#define SW_TRACE_DEFAULT_CAPACITY (1 << 16)
+// Threads beyond this many are traced but not named
+#define SW_TRACE_MAX_THREADS 128
+
+typedef struct sw_trace_scope {
+	const char *name; // `NULL` if tracing was off at `sw_trace_begin`
+	double start;
+} sw_trace_scope_t;
+
+/**
+ * @brief Clear the buffer and start recording.
+ *
+ * @param capacity Events kept, rounded up to a power of two, `0` for `SW_TRACE_DEFAULT_CAPACITY`
+ */
+void sw_trace_start(int capacity);
+
+/**
+ * @brief Stop recording, the events stay available for `sw_trace_write`.
+ */
+void sw_trace_stop(void);
+
+bool sw_trace_active(void);
+
+/**
+ * @brief Free the buffer, tracing must be stopped and no traced work may be running.
+ */
+void sw_trace_release(void);
+
+/**
+ * @brief Name the calling thread in the timeline, as "`name` `index`" if `index` is not negative.
+ *
+ * @param name Must outlive the trace, usually a literal
+ * @param index
+ */
+void sw_trace_thread_name(const char *name, int index);
+
+/**
+ * @brief Open a scope, close it with `sw_trace_end` on the same thread.
+ *
+ * @param name Must outlive the trace, usually a literal
+ * @return sw_trace_scope_t
+ */
+sw_trace_scope_t sw_trace_begin(const char *name);
+
+/**
+ * @brief Record the scope as a complete event.
+ *
+ * @param scope
+ * @param arg Shown with the event, e.g. the first layer of a block
+ */
+void sw_trace_end(const sw_trace_scope_t *scope, int arg);
+
+/**
+ * @brief Write the buffered events as a JSON trace, call while no traced work is running.
+ *
+ * @param filename
+ * @return bool
+ */
+bool sw_trace_write(const char *filename);
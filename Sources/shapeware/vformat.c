@@ -0,0 +1,203 @@
+#include "vformat.h"
+
+#include "mathhelper.h"
+#include "mesh_internal.h"
+#include "trace.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+sw_vformat_t sw_vformat_default(void) {
+	return (sw_vformat_t){.position = SW_VFORMAT_POSITION_F32,
+	                      .normal = SW_VFORMAT_NORMAL_F32,
+	                      .color = SW_VFORMAT_COLOR_F32};
+}
+
+sw_vformat_t sw_vformat_compact(void) {
+	return (sw_vformat_t){.position = SW_VFORMAT_POSITION_U16,
+	                      .normal = SW_VFORMAT_NORMAL_OCT16,
+	                      .color = SW_VFORMAT_COLOR_RGBA8};
+}
+
+static int sw_vformat_position_size(sw_vformat_position_t p) {
+	return p == SW_VFORMAT_POSITION_U16 ? 8 : 12;
+}
+
+static int sw_vformat_normal_size(sw_vformat_normal_t n) {
+	switch (n) {
+	case SW_VFORMAT_NORMAL_F32:
+		return 12;
+	case SW_VFORMAT_NORMAL_OCT16:
+	case SW_VFORMAT_NORMAL_SNORM10:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static int sw_vformat_color_size(sw_vformat_color_t c) {
+	switch (c) {
+	case SW_VFORMAT_COLOR_F32:
+		return 12;
+	case SW_VFORMAT_COLOR_RGBA8:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+sw_vformat_layout_t sw_vformat_get_layout(const sw_vformat_t *f) {
+	sw_vformat_layout_t l = (sw_vformat_layout_t){.position_offset = 0};
+	int offset = sw_vformat_position_size(f->position);
+	l.normal_offset = f->normal != SW_VFORMAT_NORMAL_NONE ? offset : -1;
+	offset += sw_vformat_normal_size(f->normal);
+	l.color_offset = f->color != SW_VFORMAT_COLOR_NONE ? offset : -1;
+	offset += sw_vformat_color_size(f->color);
+	l.stride = offset;
+	return l;
+}
+
+void sw_vformat_add_to_structure(const sw_vformat_t *f, kinc_g4_vertex_structure_t *structure,
+                                 const char *pos_name, const char *nor_name, const char *col_name) {
+	kinc_g4_vertex_structure_add(structure, pos_name,
+	                             f->position == SW_VFORMAT_POSITION_U16
+	                                 ? KINC_G4_VERTEX_DATA_U16_4X_NORMALIZED
+	                                 : KINC_G4_VERTEX_DATA_F32_3X);
+	switch (f->normal) {
+	case SW_VFORMAT_NORMAL_F32:
+		kinc_g4_vertex_structure_add(structure, nor_name, KINC_G4_VERTEX_DATA_F32_3X);
+		break;
+	case SW_VFORMAT_NORMAL_OCT16:
+		kinc_g4_vertex_structure_add(structure, nor_name, KINC_G4_VERTEX_DATA_I16_2X_NORMALIZED);
+		break;
+	case SW_VFORMAT_NORMAL_SNORM10:
+		kinc_g4_vertex_structure_add(structure, nor_name, KINC_G4_VERTEX_DATA_U32_1X);
+		break;
+	default:
+		break;
+	}
+	switch (f->color) {
+	case SW_VFORMAT_COLOR_F32:
+		kinc_g4_vertex_structure_add(structure, col_name, KINC_G4_VERTEX_DATA_F32_3X);
+		break;
+	case SW_VFORMAT_COLOR_RGBA8:
+		kinc_g4_vertex_structure_add(structure, col_name, KINC_G4_VERTEX_DATA_U8_4X_NORMALIZED);
+		break;
+	default:
+		break;
+	}
+}
+
+static int16_t sw_snorm16(float v) {
+	return (int16_t)roundf(sw_clampf(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+static uint32_t sw_snorm10(float v) {
+	return (uint32_t)((int32_t)roundf(sw_clampf(v, -1.0f, 1.0f) * 511.0f)) & 0x3ffu;
+}
+
+static uint8_t sw_unorm8(float v) {
+	return (uint8_t)roundf(sw_clampf(v, 0.0f, 1.0f) * 255.0f);
+}
+
+static kr_vec2_t sw_oct_encode(kr_vec3_t n) {
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (l1 <= 0.0f) return (kr_vec2_t){0.0f, 0.0f};
+	kr_vec2_t o = (kr_vec2_t){n.x / l1, n.y / l1};
+	if (n.z < 0.0f) {
+		// Fold the lower hemisphere over the diagonals
+		float x = o.x;
+		o.x = (1.0f - fabsf(o.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		o.y = (1.0f - fabsf(x)) * (o.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return o;
+}
+
+void sw_mesh_write_vert_buffer_format(sw_mesh_t *m, const sw_vformat_t *f, void *buffer,
+                                      sw_vformat_dequant_t *dequant) {
+	assert(m != NULL && f != NULL && buffer != NULL);
+	sw_trace_scope_t trace = sw_trace_begin("write_vert_buffer");
+	sw_vformat_layout_t l = sw_vformat_get_layout(f);
+	kr_vec3_t lo, hi;
+	sw_mesh_aabb(m, &lo, &hi);
+	kr_vec3_t extent = kr_vec3_subv(hi, lo);
+	kr_vec3_t inv = (kr_vec3_t){extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+	                            extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+	                            extent.z > 0.0f ? 1.0f / extent.z : 0.0f};
+	if (dequant != NULL) *dequant = (sw_vformat_dequant_t){.offset = lo, .scale = extent};
+
+	uint8_t *out = (uint8_t *)buffer;
+	for (int i = 0; i < m->next_vert; ++i, out += l.stride) {
+		sw_vertex_t *v = &m->vertices[i];
+		if (f->position == SW_VFORMAT_POSITION_U16) {
+			kr_vec3_t t = sw_vec3_multv(kr_vec3_subv(v->pos, lo), inv);
+			uint16_t q[4] = {(uint16_t)roundf(sw_clampf(t.x, 0.0f, 1.0f) * 65535.0f),
+			                 (uint16_t)roundf(sw_clampf(t.y, 0.0f, 1.0f) * 65535.0f),
+			                 (uint16_t)roundf(sw_clampf(t.z, 0.0f, 1.0f) * 65535.0f), 0};
+			memcpy(out + l.position_offset, q, sizeof(q));
+		}
+		else {
+			float p[3] = {v->pos.x, v->pos.y, v->pos.z};
+			memcpy(out + l.position_offset, p, sizeof(p));
+		}
+
+		switch (f->normal) {
+		case SW_VFORMAT_NORMAL_F32: {
+			float n[3] = {v->normal.x, v->normal.y, v->normal.z};
+			memcpy(out + l.normal_offset, n, sizeof(n));
+		} break;
+		case SW_VFORMAT_NORMAL_OCT16: {
+			kr_vec2_t o = sw_oct_encode(v->normal);
+			int16_t n[2] = {sw_snorm16(o.x), sw_snorm16(o.y)};
+			memcpy(out + l.normal_offset, n, sizeof(n));
+		} break;
+		case SW_VFORMAT_NORMAL_SNORM10: {
+			uint32_t n = sw_snorm10(v->normal.x) | (sw_snorm10(v->normal.y) << 10) |
+			             (sw_snorm10(v->normal.z) << 20);
+			memcpy(out + l.normal_offset, &n, sizeof(n));
+		} break;
+		default:
+			break;
+		}
+
+		switch (f->color) {
+		case SW_VFORMAT_COLOR_F32: {
+			float c[3] = {v->color.x, v->color.y, v->color.z};
+			memcpy(out + l.color_offset, c, sizeof(c));
+		} break;
+		case SW_VFORMAT_COLOR_RGBA8: {
+			uint8_t c[4] = {sw_unorm8(v->color.x), sw_unorm8(v->color.y), sw_unorm8(v->color.z),
+			                255};
+			memcpy(out + l.color_offset, c, sizeof(c));
+		} break;
+		default:
+			break;
+		}
+	}
+	sw_trace_end(&trace, m->next_vert);
+}
+
+bool sw_mesh_index_buffer_fits_16bit(sw_mesh_t *m) {
+	return m->next_vert < 65536;
+}
+
+void sw_mesh_write_index_buffer_16bit(sw_mesh_t *m, uint16_t *buffer) {
+	assert(sw_mesh_index_buffer_fits_16bit(m));
+	sw_trace_scope_t trace = sw_trace_begin("write_index_buffer");
+	for (int i = 0; i < m->next_tris; ++i) {
+		buffer[i * 3 + 0] = (uint16_t)m->triangles[i].va;
+		buffer[i * 3 + 1] = (uint16_t)m->triangles[i].vb;
+		buffer[i * 3 + 2] = (uint16_t)m->triangles[i].vc;
+	}
+	sw_trace_end(&trace, m->next_tris);
+}
+
+int sw_mesh_write_index_buffer_auto(sw_mesh_t *m, void *buffer) {
+	if (sw_mesh_index_buffer_fits_16bit(m)) {
+		sw_mesh_write_index_buffer_16bit(m, (uint16_t *)buffer);
+		return 2;
+	}
+	sw_mesh_write_index_buffer(m, (int *)buffer);
+	return 4;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file vformat.h
+ * @brief Compact vertex and index buffer layouts for `sw_mesh_t`.
+ */
+#pragma once
+
+#include "mesh.h"
+
+#include <kinc/graphics4/vertexstructure.h>
+#include <krink/math/vector.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum sw_vformat_position {
+	SW_VFORMAT_POSITION_F32, // 3 x float, 12 bytes
+	SW_VFORMAT_POSITION_U16, // 4 x uint16 quantized to the mesh AABB (w = 0), 8 bytes
+} sw_vformat_position_t;
+
+typedef enum sw_vformat_normal {
+	SW_VFORMAT_NORMAL_NONE,
+	SW_VFORMAT_NORMAL_F32,     // 3 x float, 12 bytes
+	SW_VFORMAT_NORMAL_OCT16,   // Octahedron encoded, 2 x snorm16, 4 bytes
+	SW_VFORMAT_NORMAL_SNORM10, // 10:10:10:2 snorm packed into one uint32, 4 bytes
+} sw_vformat_normal_t;
+
+typedef enum sw_vformat_color {
+	SW_VFORMAT_COLOR_NONE,
+	SW_VFORMAT_COLOR_F32,   // 3 x float, 12 bytes
+	SW_VFORMAT_COLOR_RGBA8, // 4 x unorm8 (a = 255), 4 bytes
+} sw_vformat_color_t;
+
+typedef struct sw_vformat {
+	sw_vformat_position_t position;
+	sw_vformat_normal_t normal;
+	sw_vformat_color_t color;
+} sw_vformat_t;
+
+typedef struct sw_vformat_layout {
+	int stride;
+	int position_offset;
+	int normal_offset; // -1 when not present
+	int color_offset;  // -1 when not present
+} sw_vformat_layout_t;
+
+/**
+ * @brief Quantized positions decode as `offset + scale * unorm`, where unorm is in `[0, 1]`.
+ */
+typedef struct sw_vformat_dequant {
+	kr_vec3_t offset;
+	kr_vec3_t scale;
+} sw_vformat_dequant_t;
+
+/**
+ * @brief Default layout matching `sw_mesh_write_vert_buffer`: position, normal, color as floats.
+ *
+ * @return sw_vformat_t
+ */
+sw_vformat_t sw_vformat_default(void);
+
+/**
+ * @brief Compact layout: 16 bit positions, oct encoded normals and RGBA8 colors (16 bytes).
+ *
+ * @return sw_vformat_t
+ */
+sw_vformat_t sw_vformat_compact(void);
+
+sw_vformat_layout_t sw_vformat_get_layout(const sw_vformat_t *f);
+
+/**
+ * @brief Add the attributes of a layout to a vertex structure in the order they are written. The
+ * 10:10:10:2 normals are exposed as a single `uint32` and have to be unpacked in the shader.
+ *
+ * @param f
+ * @param structure An initialized vertex structure
+ * @param pos_name
+ * @param nor_name
+ * @param col_name
+ */
+void sw_vformat_add_to_structure(const sw_vformat_t *f, kinc_g4_vertex_structure_t *structure,
+                                 const char *pos_name, const char *nor_name, const char *col_name);
+
+/**
+ * @brief Writes the vertex buffer using the given layout, `buffer` must hold
+ * `sw_mesh_vert_count(m) * layout.stride` bytes.
+ *
+ * @param m
+ * @param f
+ * @param buffer
+ * @param dequant If not `NULL`, receives the parameters to decode quantized positions
+ */
+void sw_mesh_write_vert_buffer_format(sw_mesh_t *m, const sw_vformat_t *f, void *buffer,
+                                      sw_vformat_dequant_t *dequant);
+
+/**
+ * @brief Whether all indices of the mesh fit into 16 bit.
+ *
+ * @param m
+ * @return bool
+ */
+bool sw_mesh_index_buffer_fits_16bit(sw_mesh_t *m);
+
+void sw_mesh_write_index_buffer_16bit(sw_mesh_t *m, uint16_t *buffer);
+
+/**
+ * @brief Writes 16 bit indices whenever the vertex count allows it, 32 bit otherwise.
+ *
+ * @param m
+ * @param buffer Must hold `sw_mesh_tris_count(m) * 3` indices of the returned size
+ * @return int The size of a single index in bytes, `2` or `4`
+ */
+int sw_mesh_write_index_buffer_auto(sw_mesh_t *m, void *buffer);
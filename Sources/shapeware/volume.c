@@ -0,0 +1,374 @@
+#include "volume.h"
+
+#include "mathhelper.h"
+#include "trace.h"
+
+#include <util/half.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+typedef struct sw_volume_build {
+	const sw_sdf_t *sdf;
+	sw_volume_t *v;
+	sw_jobs_t *jobs;
+	float *samples; // Level 0
+	float *bounds[2]; // Bounds of the previous and the current level
+	int level;
+	int *bricks; // Brick of every pool entry
+} sw_volume_build_t;
+
+sw_volume_desc_t sw_volume_default_desc(void) {
+	return (sw_volume_desc_t){.min = {-1.0f, -1.0f, -1.0f},
+	                          .max = {1.0f, 1.0f, 1.0f},
+	                          .res = {64, 64, 64},
+	                          .format = SW_VOLUME_R16F,
+	                          .range = 1.0f,
+	                          .color = false,
+	                          .brick_size = 0,
+	                          .mip_count = 0};
+}
+
+size_t sw_volume_texel_size(sw_volume_format_t format) {
+	return format == SW_VOLUME_R16F ? 2 : 1;
+}
+
+static int sw_volume_log2(int x) {
+	int l = 0;
+	while ((1 << (l + 1)) <= x) ++l;
+	return l;
+}
+
+static size_t sw_volume_index(const int *size, int x, int y, int z) {
+	return ((size_t)z * size[1] + y) * size[0] + x;
+}
+
+// Encode a distance, rounding down for lower bounds. `SW_VOLUME_R8` clamps lower bounds below
+// `-range` up to it, which only keeps their sign
+static void sw_volume_encode(const sw_volume_desc_t *desc, float d, bool down, void *dst,
+                             size_t i) {
+	if (desc->format == SW_VOLUME_R16F) {
+		uint16_t h = sw_half_from_float(d);
+		if (down && sw_half_to_float(h) > d) {
+			if (h == 0)
+				h = 0x8001u; // Smallest negative subnormal
+			else if ((h & 0x8000u) == 0)
+				--h;
+			else
+				++h;
+		}
+		((uint16_t *)dst)[i] = h;
+	}
+	else {
+		float t = (sw_clampf(d, -desc->range, desc->range) / desc->range * 0.5f + 0.5f) * 255.0f;
+		((uint8_t *)dst)[i] = (uint8_t)(down ? floorf(t) : roundf(t));
+	}
+}
+
+static float sw_volume_decode(const sw_volume_desc_t *desc, const void *src, size_t i) {
+	if (desc->format == SW_VOLUME_R16F) return sw_half_to_float(((const uint16_t *)src)[i]);
+	return (((const uint8_t *)src)[i] / 255.0f - 0.5f) * 2.0f * desc->range;
+}
+
+static void sw_volume_encode_color(kr_vec4_t c, uint8_t *dst) {
+	dst[0] = (uint8_t)roundf(sw_clampf(c.x, 0.0f, 1.0f) * 255.0f);
+	dst[1] = (uint8_t)roundf(sw_clampf(c.y, 0.0f, 1.0f) * 255.0f);
+	dst[2] = (uint8_t)roundf(sw_clampf(c.z, 0.0f, 1.0f) * 255.0f);
+	dst[3] = 255;
+}
+
+// Sampling
+
+static void sw_volume_sample_slices(void *param, int begin, int end, int slot) {
+	sw_volume_build_t *b = (sw_volume_build_t *)param;
+	sw_volume_t *v = b->v;
+	const sw_volume_level_t *l = &v->levels[0];
+	sw_trace_scope_t trace = sw_trace_begin("volume_sample");
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_sdf_stack_frame_t *stack =
+	    b->jobs != NULL ? sw_jobs_sdf_stack(b->jobs, b->sdf, slot)
+	                    : (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(b->sdf));
+	// Bricks copy their color from the dense texture
+	uint8_t *color = v->color;
+	for (int z = begin; z < end; ++z) {
+		for (int y = 0; y < l->size[1]; ++y) {
+			for (int x = 0; x < l->size[0]; ++x) {
+				kr_vec3_t p = {v->desc.min.x + (x + 0.5f) * l->texel.x,
+				               v->desc.min.y + (y + 0.5f) * l->texel.y,
+				               v->desc.min.z + (z + 0.5f) * l->texel.z};
+				size_t i = sw_volume_index(l->size, x, y, z);
+				if (color != NULL) {
+					kr_vec4_t c = sw_sdf_compute_color(b->sdf, p, stack);
+					sw_volume_encode_color(c, &color[i * 4]);
+					b->samples[i] = c.w;
+				}
+				else
+					b->samples[i] = sw_sdf_compute(b->sdf, p, stack);
+				if (l->distance != NULL)
+					sw_volume_encode(&v->desc, b->samples[i], false, l->distance, i);
+			}
+		}
+	}
+	sw_scratch_end(mark);
+	sw_trace_end(&trace, begin);
+}
+
+// Bounds
+
+static void sw_volume_reduce_slices(void *param, int begin, int end, int slot) {
+	sw_volume_build_t *b = (sw_volume_build_t *)param;
+	sw_volume_t *v = b->v;
+	const sw_volume_level_t *src = &v->levels[b->level - 1];
+	const sw_volume_level_t *dst = &v->levels[b->level];
+	const float *in = b->bounds[0];
+	float *out = b->bounds[1];
+	int first[3], last[3];
+	for (int z = begin; z < end; ++z) {
+		// Texels of the previous level overlapping this texel, sizes are not always halved evenly
+		first[2] = z * src->size[2] / dst->size[2];
+		last[2] = ((z + 1) * src->size[2] + dst->size[2] - 1) / dst->size[2] - 1;
+		for (int y = 0; y < dst->size[1]; ++y) {
+			first[1] = y * src->size[1] / dst->size[1];
+			last[1] = ((y + 1) * src->size[1] + dst->size[1] - 1) / dst->size[1] - 1;
+			for (int x = 0; x < dst->size[0]; ++x) {
+				first[0] = x * src->size[0] / dst->size[0];
+				last[0] = ((x + 1) * src->size[0] + dst->size[0] - 1) / dst->size[0] - 1;
+				float m = INFINITY;
+				for (int sz = first[2]; sz <= last[2]; ++sz)
+					for (int sy = first[1]; sy <= last[1]; ++sy)
+						for (int sx = first[0]; sx <= last[0]; ++sx)
+							m = fminf(m, in[sw_volume_index(src->size, sx, sy, sz)]);
+				size_t i = sw_volume_index(dst->size, x, y, z);
+				out[i] = m;
+				sw_volume_encode(&v->desc, m, true, dst->distance, i);
+			}
+		}
+	}
+}
+
+static void sw_volume_build_levels(sw_volume_build_t *b) {
+	sw_volume_t *v = b->v;
+	const sw_volume_level_t *l0 = &v->levels[0];
+	size_t count = (size_t)l0->size[0] * l0->size[1] * l0->size[2];
+	// Every point of a texel is within half its diagonal of the sample
+	float half_diagonal = kr_vec3_length(l0->texel) * 0.5f;
+	b->bounds[0] = (float *)sw_malloc(count * sizeof(float));
+	b->bounds[1] = (float *)sw_malloc(count * sizeof(float));
+	assert(b->bounds[0] != NULL && b->bounds[1] != NULL);
+	for (size_t i = 0; i < count; ++i) b->bounds[0][i] = b->samples[i] - half_diagonal;
+	for (b->level = 1; b->level < v->level_count; ++b->level) {
+		sw_jobs_parallel_for(b->jobs, 0, v->levels[b->level].size[2], 1, sw_volume_reduce_slices,
+		                     b);
+		float *tmp = b->bounds[0];
+		b->bounds[0] = b->bounds[1];
+		b->bounds[1] = tmp;
+	}
+	sw_free(b->bounds[0]);
+	sw_free(b->bounds[1]);
+}
+
+// Bricks
+
+static void sw_volume_fill_bricks(void *param, int begin, int end, int slot) {
+	sw_volume_build_t *b = (sw_volume_build_t *)param;
+	sw_volume_t *v = b->v;
+	const int *size = v->levels[0].size;
+	int bs = v->desc.brick_size, stride = v->brick_stride;
+	size_t brick_texels = (size_t)stride * stride * stride;
+	for (int e = begin; e < end; ++e) {
+		int brick = b->bricks[e];
+		int bx = brick % v->bricks[0], by = brick / v->bricks[0] % v->bricks[1],
+		    bz = brick / (v->bricks[0] * v->bricks[1]);
+		size_t o = (size_t)e * brick_texels;
+		for (int z = 0; z < stride; ++z) {
+			int gz = sw_mini(bz * bs + z, size[2] - 1);
+			for (int y = 0; y < stride; ++y) {
+				int gy = sw_mini(by * bs + y, size[1] - 1);
+				for (int x = 0; x < stride; ++x, ++o) {
+					int gx = sw_mini(bx * bs + x, size[0] - 1);
+					size_t i = sw_volume_index(size, gx, gy, gz);
+					sw_volume_encode(&v->desc, b->samples[i], false, v->brick_pool, o);
+					if (v->brick_color != NULL)
+						memcpy(&v->brick_color[o * 4], &v->color[i * 4], 4);
+				}
+			}
+		}
+	}
+}
+
+static void sw_volume_build_bricks(sw_volume_build_t *b) {
+	sw_volume_t *v = b->v;
+	const int *size = v->levels[0].size;
+	int bs = v->desc.brick_size;
+	for (int a = 0; a < 3; ++a) v->bricks[a] = size[a] / bs;
+	int brick_total = v->bricks[0] * v->bricks[1] * v->bricks[2];
+	v->brick_stride = bs + 1;
+	v->brick_table = (int32_t *)sw_malloc(brick_total * sizeof(int32_t));
+	b->bricks = (int *)sw_malloc(brick_total * sizeof(int));
+	assert(v->brick_table != NULL && b->bricks != NULL);
+
+	// The surface can only pass through a texel whose sample is within half its diagonal
+	float half_diagonal = kr_vec3_length(v->levels[0].texel) * 0.5f;
+	for (int brick = 0; brick < brick_total; ++brick) {
+		int bx = brick % v->bricks[0], by = brick / v->bricks[0] % v->bricks[1],
+		    bz = brick / (v->bricks[0] * v->bricks[1]);
+		bool surface = false;
+		for (int z = 0; z < bs && !surface; ++z)
+			for (int y = 0; y < bs && !surface; ++y)
+				for (int x = 0; x < bs && !surface; ++x)
+					surface = fabsf(b->samples[sw_volume_index(size, bx * bs + x, by * bs + y,
+					                                           bz * bs + z)]) <= half_diagonal;
+		v->brick_table[brick] = surface ? v->brick_count : -1;
+		if (surface) b->bricks[v->brick_count++] = brick;
+	}
+
+	size_t brick_texels = (size_t)v->brick_stride * v->brick_stride * v->brick_stride;
+	v->brick_pool =
+	    sw_malloc((v->brick_count * brick_texels + 1) * sw_volume_texel_size(v->desc.format));
+	assert(v->brick_pool != NULL);
+	if (v->desc.color) {
+		v->brick_color = (uint8_t *)sw_malloc((v->brick_count * brick_texels + 1) * 4);
+		assert(v->brick_color != NULL);
+	}
+	sw_jobs_parallel_for(b->jobs, 0, v->brick_count, 16, sw_volume_fill_bricks, b);
+	sw_free(b->bricks);
+}
+
+sw_volume_t *sw_sdf_export_volume(const sw_sdf_t *sdf, const sw_volume_desc_t *desc,
+                                  sw_jobs_t *jobs) {
+	assert(sdf != NULL && desc != NULL);
+	assert(desc->res[0] > 0 && desc->res[1] > 0 && desc->res[2] > 0);
+	assert(desc->max.x > desc->min.x && desc->max.y > desc->min.y && desc->max.z > desc->min.z);
+	assert(desc->format != SW_VOLUME_R8 || desc->range > 0.0f);
+	int bs = desc->brick_size;
+	// A brick size of 1 would bound empty bricks with the bricked level 0 itself
+	assert(bs == 0 || (bs >= 2 && (bs & (bs - 1)) == 0 && desc->res[0] % bs == 0 &&
+	                   desc->res[1] % bs == 0 && desc->res[2] % bs == 0));
+	sw_trace_scope_t trace = sw_trace_begin("volume_export");
+
+	sw_volume_t *v = (sw_volume_t *)sw_malloc(sizeof(sw_volume_t));
+	assert(v != NULL);
+	*v = (sw_volume_t){.desc = *desc};
+	int full = 1 + sw_volume_log2(sw_maxi(sw_maxi(desc->res[0], desc->res[1]), desc->res[2]));
+	v->level_count = desc->mip_count > 0 && desc->mip_count < full ? desc->mip_count : full;
+	// Empty bricks are bounded by the level matching the brick grid
+	if (bs > 0) v->level_count = sw_maxi(v->level_count, 1 + sw_volume_log2(bs));
+	v->levels = (sw_volume_level_t *)sw_malloc(v->level_count * sizeof(sw_volume_level_t));
+	assert(v->levels != NULL);
+	kr_vec3_t extent = kr_vec3_subv(desc->max, desc->min);
+	for (int i = 0; i < v->level_count; ++i) {
+		sw_volume_level_t *l = &v->levels[i];
+		for (int a = 0; a < 3; ++a) l->size[a] = sw_maxi(desc->res[a] >> i, 1);
+		l->texel = (kr_vec3_t){extent.x / l->size[0], extent.y / l->size[1], extent.z / l->size[2]};
+		l->distance = NULL;
+		if (i == 0 && bs > 0) continue;
+		size_t count = (size_t)l->size[0] * l->size[1] * l->size[2];
+		l->distance = sw_malloc(count * sw_volume_texel_size(desc->format));
+		assert(l->distance != NULL);
+	}
+
+	size_t count = (size_t)desc->res[0] * desc->res[1] * desc->res[2];
+	sw_volume_build_t b = {.sdf = sdf, .v = v, .jobs = jobs};
+	b.samples = (float *)sw_malloc(count * sizeof(float));
+	assert(b.samples != NULL);
+	if (desc->color) {
+		v->color = (uint8_t *)sw_malloc(count * 4);
+		assert(v->color != NULL);
+	}
+	sw_jobs_parallel_for(jobs, 0, desc->res[2], 1, sw_volume_sample_slices, &b);
+	sw_volume_build_levels(&b);
+	if (bs > 0) {
+		sw_volume_build_bricks(&b);
+		// Only the bricks keep the color
+		sw_free(v->color);
+		v->color = NULL;
+	}
+	sw_free(b.samples);
+	sw_trace_end(&trace, (int)count);
+	return v;
+}
+
+void sw_volume_destroy(sw_volume_t *v) {
+	assert(v != NULL);
+	for (int i = 0; i < v->level_count; ++i) sw_free(v->levels[i].distance);
+	sw_free(v->levels);
+	sw_free(v->color);
+	sw_free(v->brick_table);
+	sw_free(v->brick_pool);
+	sw_free(v->brick_color);
+	sw_free(v);
+}
+
+// CPU sampling
+
+static int sw_volume_texel_index(const sw_volume_t *v, const sw_volume_level_t *l, int axis,
+                                 float p) {
+	float min = axis == 0 ? v->desc.min.x : axis == 1 ? v->desc.min.y : v->desc.min.z;
+	float texel = axis == 0 ? l->texel.x : axis == 1 ? l->texel.y : l->texel.z;
+	return sw_mini(sw_maxi((int)floorf((p - min) / texel), 0), l->size[axis] - 1);
+}
+
+float sw_volume_bound(const sw_volume_t *v, int level, kr_vec3_t pos) {
+	assert(v != NULL && level >= 0 && level < v->level_count);
+	const sw_volume_level_t *l = &v->levels[level];
+	int x = sw_volume_texel_index(v, l, 0, pos.x), y = sw_volume_texel_index(v, l, 1, pos.y),
+	    z = sw_volume_texel_index(v, l, 2, pos.z);
+	if (l->distance != NULL)
+		return sw_volume_decode(&v->desc, l->distance, sw_volume_index(l->size, x, y, z));
+	// Bricked level 0
+	int bs = v->desc.brick_size;
+	int brick = ((z / bs) * v->bricks[1] + y / bs) * v->bricks[0] + x / bs;
+	if (v->brick_table[brick] < 0) return sw_volume_bound(v, sw_volume_log2(bs), pos);
+	int s = v->brick_stride;
+	size_t o = (size_t)v->brick_table[brick] * s * s * s;
+	return sw_volume_decode(&v->desc, v->brick_pool,
+	                        o + ((size_t)(z % bs) * s + y % bs) * s + x % bs);
+}
+
+float sw_volume_sample(const sw_volume_t *v, kr_vec3_t pos) {
+	assert(v != NULL);
+	const sw_volume_level_t *l = &v->levels[0];
+	float p[3] = {(pos.x - v->desc.min.x) / l->texel.x - 0.5f,
+	              (pos.y - v->desc.min.y) / l->texel.y - 0.5f,
+	              (pos.z - v->desc.min.z) / l->texel.z - 0.5f};
+	int t0[3], t1[3];
+	float f[3];
+	for (int a = 0; a < 3; ++a) {
+		// Clamp to edge
+		float c = sw_clampf(p[a], 0.0f, (float)(l->size[a] - 1));
+		t0[a] = sw_mini((int)floorf(c), l->size[a] - 1);
+		t1[a] = sw_mini(t0[a] + 1, l->size[a] - 1);
+		f[a] = c - t0[a];
+	}
+
+	const void *src = l->distance;
+	size_t base = 0;
+	int size[3] = {l->size[0], l->size[1], l->size[2]};
+	if (src == NULL) {
+		// The brick of the lower corner holds all eight texels
+		int bs = v->desc.brick_size;
+		int brick = ((t0[2] / bs) * v->bricks[1] + t0[1] / bs) * v->bricks[0] + t0[0] / bs;
+		if (v->brick_table[brick] < 0) return sw_volume_bound(v, sw_volume_log2(bs), pos);
+		int s = v->brick_stride;
+		src = v->brick_pool;
+		base = (size_t)v->brick_table[brick] * s * s * s;
+		for (int a = 0; a < 3; ++a) {
+			int origin = t0[a] / bs * bs;
+			t1[a] = t0[a] + (t1[a] - t0[a]) - origin;
+			t0[a] -= origin;
+			size[a] = s;
+		}
+	}
+	float c[8];
+	for (int i = 0; i < 8; ++i) {
+		int x = i & 1 ? t1[0] : t0[0], y = i & 2 ? t1[1] : t0[1], z = i & 4 ? t1[2] : t0[2];
+		c[i] = sw_volume_decode(&v->desc, src, base + sw_volume_index(size, x, y, z));
+	}
+	float x0 = c[0] + (c[1] - c[0]) * f[0], x1 = c[2] + (c[3] - c[2]) * f[0];
+	float x2 = c[4] + (c[5] - c[4]) * f[0], x3 = c[6] + (c[7] - c[6]) * f[0];
+	float y0 = x0 + (x1 - x0) * f[1], y1 = x2 + (x3 - x2) * f[1];
+	return y0 + (y1 - y0) * f[2];
+}
@@ -0,0 +1,102 @@
+/**
+ * @file volume.h
+ * @brief Baking of a SDF into 3D textures for ray marching on the GPU. Texel `i` samples the center
+ * `min + (i + 0.5) * (max - min) / res`, so normalized texture coordinates are
+ * `(p - min) / (max - min)`. All buffers are tightly packed with x fastest, then y, then z, and can
+ * be uploaded as they are.
+ *
+ * Level 0 holds the sampled distances. Every further level holds a lower bound of the distance
+ * anywhere within each of its texels, following the GPU mip sizes `max(1, size >> 1)`, to skip
+ * empty space. The bounds assume a distance field that is at most 1-Lipschitz, ops that distort
+ * space like twist or displacement may overestimate. With `SW_VOLUME_R8` bounds below `-range`
+ * are stored as `-range` and are no lower bounds anymore, only the sign is kept. Any negative
+ * bound already means the texel may contain the surface, so this never lets a ray skip it.
+ *
+ * With bricks, level 0 is split into cubes of `brick_size` texels. Only bricks the surface may pass
+ * through are stored, level `log2(brick_size)` of the chain is then the grid of bricks and gives
+ * the bound for the empty ones.
+ */
+#pragma once
+
+#include "jobs.h"
+#include "sdf.h"
+
+#include <krink/math/vector.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum sw_volume_format {
+	SW_VOLUME_R16F, // Half float distance, 2 bytes
+	SW_VOLUME_R8,   // Unorm distance over `[-range, range]`, 0.5 is the surface, 1 byte
+} sw_volume_format_t;
+
+typedef struct sw_volume_desc {
+	kr_vec3_t min;
+	kr_vec3_t max;
+	int res[3]; // Texels of level 0 per axis
+	sw_volume_format_t format;
+	float range;    // `SW_VOLUME_R8` only, distances are clamped to it
+	bool color;     // Add a RGBA8 color texture for level 0
+	int brick_size; // `0` for a dense level 0, otherwise a power of two `>= 2` dividing `res`
+	int mip_count;  // Levels including level 0, `0` for the full chain
+} sw_volume_desc_t;
+
+typedef struct sw_volume_level {
+	int size[3];
+	kr_vec3_t texel; // Extent of a texel
+	void *distance;  // `NULL` for a bricked level 0
+} sw_volume_level_t;
+
+typedef struct sw_volume {
+	sw_volume_desc_t desc;
+	int level_count;
+	sw_volume_level_t *levels;
+	uint8_t *color; // Dense RGBA8 of level 0, `NULL` when bricked or without color
+
+	// Bricked level 0
+	int bricks[3];         // Bricks per axis
+	int32_t *brick_table;  // Index into the pool per brick, -1 for empty bricks
+	int brick_count;       // Bricks in the pool
+	int brick_stride;      // `brick_size + 1`, every brick repeats the first texels of the next
+	void *brick_pool;      // `brick_stride`^3 texels per brick, for filtering within a brick
+	uint8_t *brick_color;  // RGBA8 laid out like `brick_pool`, `NULL` without color
+} sw_volume_t;
+
+sw_volume_desc_t sw_volume_default_desc(void);
+
+size_t sw_volume_texel_size(sw_volume_format_t format);
+
+/**
+ * @brief Sample a SDF into 3D textures, see the file description for the layout.
+ *
+ * @param sdf
+ * @param desc Copied
+ * @param jobs Workers the slices are sampled on, may be `NULL`
+ * @return sw_volume_t*
+ */
+sw_volume_t *sw_sdf_export_volume(const sw_sdf_t *sdf, const sw_volume_desc_t *desc,
+                                  sw_jobs_t *jobs);
+
+void sw_volume_destroy(sw_volume_t *v);
+
+/**
+ * @brief Trilinear filtered and decoded distance of level 0 as the GPU would sample it. Within an
+ * empty brick this is the bound of the brick level instead.
+ *
+ * @param v
+ * @param pos
+ * @return float
+ */
+float sw_volume_sample(const sw_volume_t *v, kr_vec3_t pos);
+
+/**
+ * @brief Decoded value of the texel of `level` containing `pos`, for levels above 0 a lower bound
+ * of the distance anywhere in the texel.
+ *
+ * @param v
+ * @param level
+ * @param pos Clamped to the bounds
+ * @return float
+ */
+float sw_volume_bound(const sw_volume_t *v, int level, kr_vec3_t pos);
@@ -0,0 +1,406 @@
+#include "world.h"
+
+#include "trace.h"
+
+#include <util/hash.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct sw_world_entry {
+	sw_world_chunk_t c;
+	const sw_sdf_t *sdf;
+	const sw_world_desc_t *desc;
+	sw_mc_task_t *task; // `NULL` once the chunk is ready
+	sw_mesh_t *mesh;    // Owned by the task while it runs
+	uint64_t last_used; // Last update that wanted or showed the chunk
+	bool ready;
+	bool dead; // Freed by the next compaction
+} sw_world_entry_t;
+
+typedef struct sw_world_wanted {
+	sw_world_key_t key;
+	float distance;
+} sw_world_wanted_t;
+
+struct sw_world {
+	sw_world_desc_t desc;
+	sw_jobs_t *jobs;
+	const sw_sdf_t *sdf;
+	uint64_t version;
+	uint64_t tick;
+	uint64_t bytes;
+	int pending;
+
+	sw_world_entry_t **entries;
+	int count;
+	int cap;
+	int *lookup; // Open addressing over `entries`, -1 for empty slots
+	int lookup_cap;
+
+	sw_world_wanted_t *wanted;
+	int wanted_cap;
+	const sw_world_chunk_t **visible; // Pointers into `entries`, valid until the next update
+	int visible_count;
+	int visible_cap;
+};
+
+sw_world_desc_t sw_world_default_desc(void) {
+	return (sw_world_desc_t){.chunk_size = 4.0f,
+	                         .steps = 64,
+	                         .lod_count = 4,
+	                         .lod_distance = 8.0f,
+	                         .iso_level = 0.0f,
+	                         .evict_scale = 1.5f,
+	                         .max_bytes = 256ull * 1024 * 1024,
+	                         .max_tasks = 8,
+	                         .format = sw_vformat_compact()};
+}
+
+static kr_vec3_t zero_normal(void *param, kr_vec3_t pos) {
+	return (kr_vec3_t){0.0f, 0.0f, 0.0f};
+}
+
+// Lookup
+
+static int sw_world_slot(const sw_world_t *w, const sw_world_key_t *key) {
+	uint64_t h = sw_hash_bytes(SW_HASH_SEED, key, sizeof(*key));
+	int mask = w->lookup_cap - 1;
+	int slot = (int)(h & (uint64_t)mask);
+	while (w->lookup[slot] >= 0 &&
+	       memcmp(&w->entries[w->lookup[slot]]->c.key, key, sizeof(*key)) != 0)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+static sw_world_entry_t *sw_world_find(const sw_world_t *w, const sw_world_key_t *key) {
+	int i = w->lookup[sw_world_slot(w, key)];
+	return i >= 0 ? w->entries[i] : NULL;
+}
+
+static void sw_world_rebuild_lookup(sw_world_t *w) {
+	int cap = 16;
+	while (cap < w->count * 2) cap *= 2;
+	if (cap != w->lookup_cap) {
+		sw_free(w->lookup);
+		w->lookup = (int *)sw_malloc(cap * sizeof(int));
+		assert(w->lookup != NULL);
+		w->lookup_cap = cap;
+	}
+	memset(w->lookup, 0xff, w->lookup_cap * sizeof(int));
+	for (int i = 0; i < w->count; ++i) w->lookup[sw_world_slot(w, &w->entries[i]->c.key)] = i;
+}
+
+static void sw_world_add(sw_world_t *w, sw_world_entry_t *e) {
+	if (w->count == w->cap) {
+		w->cap *= 2;
+		w->entries =
+		    (sw_world_entry_t **)sw_realloc(w->entries, w->cap * sizeof(sw_world_entry_t *));
+		assert(w->entries != NULL);
+	}
+	w->entries[w->count++] = e;
+	// Keep the load factor at or below 0.5
+	if (w->count * 2 > w->lookup_cap)
+		sw_world_rebuild_lookup(w);
+	else
+		w->lookup[sw_world_slot(w, &e->c.key)] = w->count - 1;
+}
+
+static void sw_world_free_entry(sw_world_t *w, sw_world_entry_t *e) {
+	if (e->ready) {
+		if (w->desc.evict != NULL) w->desc.evict(w->desc.param, &e->c);
+		w->bytes -= e->c.bytes;
+	}
+	sw_free(e->c.vertices);
+	sw_free(e->c.indices);
+	sw_free(e);
+}
+
+static void sw_world_compact(sw_world_t *w) {
+	int count = 0;
+	for (int i = 0; i < w->count; ++i) {
+		if (w->entries[i]->dead)
+			sw_world_free_entry(w, w->entries[i]);
+		else
+			w->entries[count++] = w->entries[i];
+	}
+	if (count == w->count) return;
+	w->count = count;
+	sw_world_rebuild_lookup(w);
+}
+
+// Meshing
+
+static void sw_world_chunk_done(void *param, sw_mc_task_t *task, bool completed) {
+	sw_world_entry_t *e = (sw_world_entry_t *)param;
+	if (completed) {
+		sw_trace_scope_t trace = sw_trace_begin("world_chunk_buffers");
+		sw_mesh_sdf_normals(e->mesh, e->sdf, NULL);
+		sw_world_chunk_t *c = &e->c;
+		c->vertex_count = sw_mesh_vert_count(e->mesh);
+		c->vertex_stride = sw_vformat_get_layout(&e->desc->format).stride;
+		c->index_count = sw_mesh_tris_count(e->mesh) * 3;
+		c->index_size = sw_mesh_index_buffer_fits_16bit(e->mesh) ? 2 : 4;
+		// One more element each, so empty chunks still get valid buffers
+		c->vertices = sw_malloc((size_t)(c->vertex_count + 1) * c->vertex_stride);
+		c->indices = sw_malloc((size_t)(c->index_count + 1) * c->index_size);
+		assert(c->vertices != NULL && c->indices != NULL);
+		sw_mesh_write_vert_buffer_format(e->mesh, &e->desc->format, c->vertices, &c->dequant);
+		sw_mesh_write_index_buffer_auto(e->mesh, c->indices);
+		c->bytes = (uint64_t)c->vertex_count * c->vertex_stride +
+		           (uint64_t)c->index_count * c->index_size;
+		sw_trace_end(&trace, c->vertex_count);
+	}
+	sw_mesh_destroy(e->mesh);
+	e->mesh = NULL;
+}
+
+static void sw_world_schedule(sw_world_t *w, const sw_world_key_t *key) {
+	sw_world_entry_t *e = (sw_world_entry_t *)sw_malloc(sizeof(sw_world_entry_t));
+	assert(e != NULL);
+	float size = w->desc.chunk_size;
+	int steps = w->desc.steps >> key->lod;
+	*e = (sw_world_entry_t){
+	    .c = {.key = *key,
+	          .chunk = {.origin = {(key->x + 0.5f) * size, (key->y + 0.5f) * size,
+	                               (key->z + 0.5f) * size},
+	                    .halfsidelen = size * 0.5f,
+	                    .steps = steps > 0 ? steps : 1,
+	                    .iso_level = w->desc.iso_level}},
+	    .sdf = w->sdf,
+	    .desc = &w->desc,
+	    .mesh = sw_mesh_init(1024, 1024, zero_normal, NULL),
+	    .last_used = w->tick};
+	sw_world_add(w, e);
+	++w->pending;
+	e->task = sw_mc_submit(w->sdf, &e->c.chunk, sw_mesh_add_triangle, e->mesh,
+	                       sw_world_chunk_done, e, w->jobs);
+}
+
+// Finish a task that is done, `true` if the chunk is ready
+static bool sw_world_collect(sw_world_t *w, sw_world_entry_t *e) {
+	bool completed = sw_mc_task_wait(e->task);
+	e->task = NULL;
+	--w->pending;
+	if (!completed) {
+		e->dead = true;
+		return false;
+	}
+	e->ready = true;
+	w->bytes += e->c.bytes;
+	if (w->desc.ready != NULL) w->desc.ready(w->desc.param, &e->c);
+	return true;
+}
+
+// Cancel and wait for all pending chunks
+static void sw_world_drain(sw_world_t *w) {
+	for (int i = 0; i < w->count; ++i) {
+		sw_world_entry_t *e = w->entries[i];
+		if (e->task == NULL) continue;
+		sw_mc_task_cancel(e->task);
+		// A chunk that completed before the cancellation is kept
+		sw_world_collect(w, e);
+	}
+	sw_world_compact(w);
+}
+
+// Public
+
+sw_world_t *sw_world_init(const sw_world_desc_t *desc, sw_jobs_t *jobs) {
+	assert(desc != NULL && desc->chunk_size > 0.0f && desc->steps > 0 && desc->lod_count > 0 &&
+	       desc->max_tasks > 0);
+	sw_world_t *w = (sw_world_t *)sw_malloc(sizeof(sw_world_t));
+	assert(w != NULL);
+	*w = (sw_world_t){.desc = *desc, .jobs = jobs, .cap = 64};
+	w->entries = (sw_world_entry_t **)sw_malloc(w->cap * sizeof(sw_world_entry_t *));
+	assert(w->entries != NULL);
+	sw_world_rebuild_lookup(w);
+	return w;
+}
+
+void sw_world_destroy(sw_world_t *w) {
+	assert(w != NULL);
+	sw_world_drain(w);
+	for (int i = 0; i < w->count; ++i) sw_world_free_entry(w, w->entries[i]);
+	sw_free(w->entries);
+	sw_free(w->lookup);
+	sw_free(w->wanted);
+	sw_free(w->visible);
+	sw_free(w);
+}
+
+void sw_world_set_sdf(sw_world_t *w, const sw_sdf_t *sdf, uint64_t version) {
+	assert(w != NULL);
+	sw_world_drain(w);
+	w->sdf = sdf;
+	w->version = version;
+	w->visible_count = 0;
+}
+
+static float sw_world_distance(const sw_world_t *w, kr_vec3_t p, int x, int y, int z) {
+	// Distance to the chunk bounds, zero inside
+	float size = w->desc.chunk_size;
+	float dx = fmaxf(fmaxf(x * size - p.x, p.x - (x + 1) * size), 0.0f);
+	float dy = fmaxf(fmaxf(y * size - p.y, p.y - (y + 1) * size), 0.0f);
+	float dz = fmaxf(fmaxf(z * size - p.z, p.z - (z + 1) * size), 0.0f);
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static int sw_world_lod(const sw_world_t *w, float distance) {
+	int lod = 0;
+	for (float limit = w->desc.lod_distance; distance > limit && lod < w->desc.lod_count - 1;
+	     limit *= 2.0f)
+		++lod;
+	return lod;
+}
+
+static void sw_world_show(sw_world_t *w, sw_world_entry_t *e) {
+	if (w->visible_count == w->visible_cap) {
+		w->visible_cap = w->visible_cap > 0 ? w->visible_cap * 2 : 64;
+		w->visible = (const sw_world_chunk_t **)sw_realloc(
+		    w->visible, w->visible_cap * sizeof(sw_world_chunk_t *));
+		assert(w->visible != NULL);
+	}
+	w->visible[w->visible_count++] = &e->c;
+	e->last_used = w->tick;
+}
+
+// Stand in with the closest cached LOD until the wanted one is ready
+static void sw_world_show_wanted(sw_world_t *w, const sw_world_key_t *key) {
+	sw_world_entry_t *e = sw_world_find(w, key);
+	if (e != NULL && e->ready) {
+		sw_world_show(w, e);
+		return;
+	}
+	for (int d = 1; d < w->desc.lod_count; ++d) {
+		for (int s = -1; s <= 1; s += 2) {
+			sw_world_key_t k = *key;
+			k.lod += s * d;
+			if (k.lod < 0 || k.lod >= w->desc.lod_count) continue;
+			sw_world_entry_t *other = sw_world_find(w, &k);
+			if (other != NULL && other->ready) {
+				sw_world_show(w, other);
+				return;
+			}
+		}
+	}
+}
+
+static int sw_world_compare_wanted(const void *a, const void *b) {
+	float da = ((const sw_world_wanted_t *)a)->distance;
+	float db = ((const sw_world_wanted_t *)b)->distance;
+	return (da > db) - (da < db);
+}
+
+static int sw_world_compare_lru(const void *a, const void *b) {
+	const sw_world_entry_t *ea = *(sw_world_entry_t *const *)a;
+	const sw_world_entry_t *eb = *(sw_world_entry_t *const *)b;
+	return (ea->last_used > eb->last_used) - (ea->last_used < eb->last_used);
+}
+
+static void sw_world_evict(sw_world_t *w, kr_vec3_t camera, float radius) {
+	float far = radius * w->desc.evict_scale;
+	uint64_t bytes = w->bytes;
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_world_entry_t **lru =
+	    (sw_world_entry_t **)sw_scratch_alloc((w->count + 1) * sizeof(sw_world_entry_t *));
+	int candidates = 0;
+	for (int i = 0; i < w->count; ++i) {
+		sw_world_entry_t *e = w->entries[i];
+		// Chunks in use this update are never evicted
+		if (!e->ready || e->last_used == w->tick) continue;
+		if (sw_world_distance(w, camera, e->c.key.x, e->c.key.y, e->c.key.z) > far) {
+			e->dead = true;
+			bytes -= e->c.bytes;
+		}
+		else
+			lru[candidates++] = e;
+	}
+	if (bytes > w->desc.max_bytes) {
+		qsort(lru, candidates, sizeof(sw_world_entry_t *), sw_world_compare_lru);
+		for (int i = 0; i < candidates && bytes > w->desc.max_bytes; ++i) {
+			lru[i]->dead = true;
+			bytes -= lru[i]->c.bytes;
+		}
+	}
+	sw_scratch_end(mark);
+	sw_world_compact(w);
+}
+
+void sw_world_update(sw_world_t *w, kr_vec3_t camera, float radius) {
+	assert(w != NULL && radius >= 0.0f);
+	if (w->sdf == NULL) return;
+	sw_trace_scope_t trace = sw_trace_begin("world_update");
+	++w->tick;
+
+	for (int i = 0; i < w->count; ++i) {
+		sw_world_entry_t *e = w->entries[i];
+		if (e->task != NULL && sw_mc_task_done(e->task)) sw_world_collect(w, e);
+	}
+	sw_world_compact(w);
+
+	// Wanted chunks: all chunks intersecting the view sphere, nearest first
+	float size = w->desc.chunk_size;
+	int x0 = (int)floorf((camera.x - radius) / size), x1 = (int)floorf((camera.x + radius) / size);
+	int y0 = (int)floorf((camera.y - radius) / size), y1 = (int)floorf((camera.y + radius) / size);
+	int z0 = (int)floorf((camera.z - radius) / size), z1 = (int)floorf((camera.z + radius) / size);
+	int wanted = 0;
+	for (int z = z0; z <= z1; ++z) {
+		for (int y = y0; y <= y1; ++y) {
+			for (int x = x0; x <= x1; ++x) {
+				float d = sw_world_distance(w, camera, x, y, z);
+				if (d > radius) continue;
+				if (wanted == w->wanted_cap) {
+					w->wanted_cap = w->wanted_cap > 0 ? w->wanted_cap * 2 : 256;
+					w->wanted = (sw_world_wanted_t *)sw_realloc(
+					    w->wanted, w->wanted_cap * sizeof(sw_world_wanted_t));
+					assert(w->wanted != NULL);
+				}
+				w->wanted[wanted++] = (sw_world_wanted_t){
+				    .key = {.version = w->version, .x = x, .y = y, .z = z, .lod = sw_world_lod(w, d)},
+				    .distance = d};
+			}
+		}
+	}
+	qsort(w->wanted, wanted, sizeof(sw_world_wanted_t), sw_world_compare_wanted);
+
+	for (int i = 0; i < wanted; ++i) {
+		sw_world_entry_t *e = sw_world_find(w, &w->wanted[i].key);
+		if (e != NULL)
+			e->last_used = w->tick;
+		else if (w->pending < w->desc.max_tasks)
+			sw_world_schedule(w, &w->wanted[i].key);
+	}
+	for (int i = 0; i < w->count; ++i) {
+		sw_world_entry_t *e = w->entries[i];
+		if (e->task != NULL && e->last_used != w->tick) sw_mc_task_cancel(e->task);
+		// Without a job context the chunks scheduled above are done already
+		if (w->jobs == NULL && e->task != NULL && sw_mc_task_done(e->task)) sw_world_collect(w, e);
+	}
+	sw_world_compact(w);
+
+	w->visible_count = 0;
+	for (int i = 0; i < wanted; ++i) sw_world_show_wanted(w, &w->wanted[i].key);
+
+	sw_world_evict(w, camera, radius);
+	sw_trace_end(&trace, w->visible_count);
+}
+
+int sw_world_visible(sw_world_t *w, const sw_world_chunk_t **chunks, int max) {
+	assert(w != NULL && (chunks != NULL || max == 0));
+	int count = w->visible_count < max ? w->visible_count : max;
+	if (count > 0) memcpy(chunks, w->visible, count * sizeof(sw_world_chunk_t *));
+	return count;
+}
+
+sw_world_stats_t sw_world_get_stats(sw_world_t *w) {
+	assert(w != NULL);
+	return (sw_world_stats_t){.ready = w->count - w->pending,
+	                          .pending = w->pending,
+	                          .visible = w->visible_count,
+	                          .bytes = w->bytes};
+}
@@ -0,0 +1,114 @@
+/**
+ * @file world.h
+ * @brief Chunk manager for large or unbounded scenes, e.g. built with `SW_OPS_REPEAT_INF`. Space is
+ * divided into cubic chunks, the chunks around the camera are meshed in the background nearest
+ * first, with a lower resolution further away. Meshed chunks are kept as vertex and index buffers
+ * in a memory bounded least recently used cache keyed by graph version, chunk coordinates and LOD.
+ */
+#pragma once
+
+#include "jobs.h"
+#include "mc.h"
+#include "sdf.h"
+#include "vformat.h"
+
+#include <krink/math/vector.h>
+#include <stdint.h>
+
+typedef struct sw_world sw_world_t;
+
+typedef struct sw_world_key {
+	uint64_t version;
+	int32_t x, y, z;
+	int32_t lod;
+} sw_world_key_t;
+
+typedef struct sw_world_chunk {
+	sw_world_key_t key;
+	sw_mc_chunk_t chunk;
+	void *vertices; // In the layout of `sw_world_desc_t::format`
+	int vertex_count;
+	int vertex_stride;
+	void *indices;
+	int index_count;
+	int index_size; // 2 or 4 bytes, see `sw_mesh_write_index_buffer_auto`
+	sw_vformat_dequant_t dequant;
+	uint64_t bytes; // Size of both buffers
+} sw_world_chunk_t;
+
+typedef void (*sw_world_chunk_func_t)(void *param, const sw_world_chunk_t *chunk);
+
+typedef struct sw_world_desc {
+	float chunk_size; // Side length of a chunk
+	int steps;        // Marching Cubes steps per chunk at LOD 0
+	int lod_count;    // LOD `i` uses `steps >> i` steps
+	float lod_distance; // LOD 0 up to this distance, every further LOD doubles it
+	float iso_level;
+	float evict_scale; // Chunks further than the view radius times this are evicted right away
+	uint64_t max_bytes; // Budget of all cached buffers
+	int max_tasks;      // Chunks meshed concurrently
+	sw_vformat_t format;
+	sw_world_chunk_func_t ready; // A chunk was meshed, may be `NULL`
+	sw_world_chunk_func_t evict; // A chunk is about to be freed, may be `NULL`
+	void *param;
+} sw_world_desc_t;
+
+typedef struct sw_world_stats {
+	int ready;
+	int pending;
+	int visible;
+	uint64_t bytes;
+} sw_world_stats_t;
+
+sw_world_desc_t sw_world_default_desc(void);
+
+/**
+ * @brief Create a world. Nothing is meshed until a SDF is set.
+ *
+ * @param desc Copied
+ * @param jobs Workers the chunks are meshed on, with `NULL` every update meshes its chunks serially
+ * @return sw_world_t*
+ */
+sw_world_t *sw_world_init(const sw_world_desc_t *desc, sw_jobs_t *jobs);
+
+/**
+ * @brief Cancel all pending chunks and free the cache, `evict` is called for every cached chunk.
+ *
+ * @param w
+ */
+void sw_world_destroy(sw_world_t *w);
+
+/**
+ * @brief Switch to a new SDF. Pending chunks of the previous SDF are cancelled and waited for, so
+ * it may be destroyed afterwards. Cached chunks of other versions stay until they are evicted and
+ * are reused when switching back.
+ *
+ * @param w
+ * @param sdf Has to stay valid until it is replaced or the world is destroyed
+ * @param version Identifies the graph state, e.g. `sw_sdf_hash(sdf)`
+ */
+void sw_world_set_sdf(sw_world_t *w, const sw_sdf_t *sdf, uint64_t version);
+
+/**
+ * @brief Collect finished chunks, schedule missing chunks within `radius` of `camera` nearest first,
+ * cancel pending chunks that left the view and evict chunks that are too far away or exceed the
+ * budget, least recently used first. Call once per frame.
+ *
+ * @param w
+ * @param camera
+ * @param radius
+ */
+void sw_world_update(sw_world_t *w, kr_vec3_t camera, float radius);
+
+/**
+ * @brief Chunks to draw for the view of the last update. A chunk whose wanted LOD is not meshed yet
+ * is represented by a cached chunk of another LOD if there is one.
+ *
+ * @param w
+ * @param chunks Receives up to `max` chunks, valid until the next update
+ * @param max
+ * @return int Number of chunks written
+ */
+int sw_world_visible(sw_world_t *w, const sw_world_chunk_t **chunks, int max);
+
+sw_world_stats_t sw_world_get_stats(sw_world_t *w);
@@ -0,0 +1,77 @@
+#include "arena.h"
+#include "memory.h"
+
+#include <assert.h>
+#include <string.h>
+
+static size_t sw_arena_align(size_t v) {
+	return (v + (SW_ARENA_ALIGNMENT - 1)) & ~(size_t)(SW_ARENA_ALIGNMENT - 1);
+}
+
+void sw_arena_init(sw_arena_t *a, size_t capacity) {
+	assert(a);
+	a->base = (uint8_t *)sw_malloc(capacity + SW_ARENA_ALIGNMENT);
+	assert(a->base);
+	a->cap = capacity + SW_ARENA_ALIGNMENT;
+	a->owned = true;
+	sw_arena_reset(a);
+}
+
+void sw_arena_init_buffer(sw_arena_t *a, void *buffer, size_t capacity) {
+	assert(a && buffer);
+	a->base = (uint8_t *)buffer;
+	a->cap = capacity;
+	a->owned = false;
+	sw_arena_reset(a);
+}
+
+void sw_arena_destroy(sw_arena_t *a) {
+	assert(a);
+	if (a->owned && a->base != NULL) sw_free(a->base);
+	a->base = NULL;
+	a->cap = 0;
+	a->top = 0;
+	a->last = 0;
+}
+
+void sw_arena_reset(sw_arena_t *a) {
+	assert(a);
+	// Start at the first aligned address inside the block
+	size_t start = sw_arena_align((uintptr_t)a->base) - (uintptr_t)a->base;
+	a->top = start;
+	a->last = start;
+}
+
+void *sw_arena_alloc(sw_arena_t *a, size_t size) {
+	assert(a);
+	size_t offset = sw_arena_align(a->top);
+	if (offset + size > a->cap) return NULL;
+	a->last = offset;
+	a->top = offset + size;
+	return a->base + offset;
+}
+
+void *sw_arena_realloc(sw_arena_t *a, void *p, size_t old_size, size_t new_size) {
+	assert(a);
+	if (p == NULL) return sw_arena_alloc(a, new_size);
+	if ((uint8_t *)p == a->base + a->last) {
+		if (a->last + new_size > a->cap) return NULL;
+		a->top = a->last + new_size;
+		return p;
+	}
+	void *n = sw_arena_alloc(a, new_size);
+	if (n == NULL) return NULL;
+	memcpy(n, p, old_size < new_size ? old_size : new_size);
+	return n;
+}
+
+size_t sw_arena_used(const sw_arena_t *a) {
+	assert(a);
+	return a->top;
+}
+
+void sw_arena_rewind(sw_arena_t *a, size_t used) {
+	assert(a && used <= a->top);
+	a->top = used;
+	a->last = used;
+}
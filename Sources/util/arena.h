@@ -0,0 +1,57 @@
+#pragma once
+
+/*! \file arena.h
+    \brief Bump allocator, individual allocations are never freed, the whole arena is released at
+    once in O(1).
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SW_ARENA_ALIGNMENT 16
+
+typedef struct sw_arena {
+	uint8_t *base;
+	size_t cap;
+	size_t top;
+	size_t last; // Offset of the most recent allocation, can be grown in place
+	bool owned;
+} sw_arena_t;
+
+/**
+ * @brief Initialize an arena backed by a single `sw_malloc` allocation of `capacity` bytes.
+ */
+void sw_arena_init(sw_arena_t *a, size_t capacity);
+
+/**
+ * @brief Initialize an arena on caller provided memory, the arena never frees it.
+ */
+void sw_arena_init_buffer(sw_arena_t *a, void *buffer, size_t capacity);
+void sw_arena_destroy(sw_arena_t *a);
+
+/**
+ * @brief Allocate `size` bytes aligned to `SW_ARENA_ALIGNMENT`.
+ *
+ * @return void* `NULL` if the arena is exhausted
+ */
+void *sw_arena_alloc(sw_arena_t *a, size_t size);
+
+/**
+ * @brief Grow an allocation. The most recent allocation grows in place, everything else is copied
+ * to a new allocation and the old space is only reclaimed on reset.
+ *
+ * @return void* `NULL` if the arena is exhausted, `p` stays valid in that case
+ */
+void *sw_arena_realloc(sw_arena_t *a, void *p, size_t old_size, size_t new_size);
+
+/**
+ * @brief Release all allocations at once.
+ */
+void sw_arena_reset(sw_arena_t *a);
+size_t sw_arena_used(const sw_arena_t *a);
+
+/**
+ * @brief Release everything allocated after `sw_arena_used` returned `used`.
+ */
+void sw_arena_rewind(sw_arena_t *a, size_t used);
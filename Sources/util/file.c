@@ -0,0 +1,15 @@
+#include "file.h"
+
+#include <kinc/system.h>
+
+#include <stdio.h>
+
+#define SW_FILE_PATH_LEN 512
+
+bool sw_file_delete(const char *path) {
+	// Kinc has no file deletion, the file writer resolves paths against the save path
+	char full[SW_FILE_PATH_LEN];
+	int len = snprintf(full, sizeof(full), "%s%s", kinc_internal_save_path(), path);
+	if (len < 0 || len >= (int)sizeof(full)) return false;
+	return remove(full) == 0;
+}
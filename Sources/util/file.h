@@ -0,0 +1,15 @@
+#pragma once
+
+/*! \file file.h
+    \brief File system helpers missing from Kinc.
+*/
+
+#include <stdbool.h>
+
+/**
+ * @brief Delete a file relative to the save path, the same path `kinc_file_writer_open` writes to.
+ *
+ * @param path
+ * @return bool False if the file did not exist or could not be deleted
+ */
+bool sw_file_delete(const char *path);
@@ -0,0 +1,58 @@
+#pragma once
+
+/*! \file half.h
+    \brief IEEE 754 binary16 conversion for GPU formats, rounding to nearest even.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+static inline uint16_t sw_half_from_float(float f) {
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint16_t sign = (uint16_t)((x >> 16) & 0x8000u);
+	uint32_t abs = x & 0x7fffffffu;
+	if (abs >= 0x7f800000u) // Inf and NaN, NaN stays quiet
+		return (uint16_t)(sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u));
+	if (abs >= 0x477ff000u) return (uint16_t)(sign | 0x7c00u); // Rounds to above 65504
+	if (abs < 0x38800000u) {                                   // Subnormal or zero
+		if (abs < 0x33000000u) return sign;
+		uint32_t e = abs >> 23;
+		uint32_t m = (abs & 0x7fffffu) | 0x800000u;
+		uint32_t shift = 126u - e;
+		uint32_t r = m >> shift;
+		uint32_t rest = m & ((1u << shift) - 1u);
+		uint32_t halfway = 1u << (shift - 1u);
+		if (rest > halfway || (rest == halfway && (r & 1u))) ++r;
+		return (uint16_t)(sign | r);
+	}
+	uint32_t r = abs - 0x38000000u; // Rebias the exponent from 127 to 15
+	uint32_t rest = r & 0x1fffu;
+	r >>= 13;
+	if (rest > 0x1000u || (rest == 0x1000u && (r & 1u))) ++r;
+	return (uint16_t)(sign | r);
+}
+
+static inline float sw_half_to_float(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+	uint32_t e = (h >> 10) & 0x1fu;
+	uint32_t m = h & 0x3ffu;
+	uint32_t x;
+	if (e == 0x1fu)
+		x = sign | 0x7f800000u | (m << 13);
+	else if (e != 0)
+		x = sign | ((e + 112u) << 23) | (m << 13);
+	else if (m == 0)
+		x = sign;
+	else { // Subnormal, normalize the mantissa
+		e = 113u;
+		while ((m & 0x400u) == 0) {
+			m <<= 1;
+			--e;
+		}
+		x = sign | (e << 23) | ((m & 0x3ffu) << 13);
+	}
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
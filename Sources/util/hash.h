@@ -0,0 +1,23 @@
+#pragma once
+
+/*! \file hash.h
+    \brief 64 bit FNV-1a, stable across runs and platforms for content addressing.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SW_HASH_SEED 0xcbf29ce484222325ull
+
+static inline uint64_t sw_hash_bytes(uint64_t h, const void *data, size_t size) {
+	const uint8_t *p = (const uint8_t *)data;
+	for (size_t i = 0; i < size; ++i) {
+		h ^= p[i];
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+static inline uint64_t sw_hash_int(uint64_t h, int32_t v) {
+	return sw_hash_bytes(h, &v, sizeof(v));
+}
@@ -1,7 +1,7 @@
 #include "list.h"
+#include "memory.h"
 
 #include <assert.h>
-#include <krink/memory.h>
 
 typedef struct sw_list_int {
 	int *arr;
@@ -10,12 +10,12 @@ typedef struct sw_list_int {
 } sw_list_int_t;
 
 sw_list_int_t *sw_list_int_init(int reserve) {
-	sw_list_int_t *lst = (sw_list_int_t *)kr_malloc(sizeof(sw_list_int_t));
+	sw_list_int_t *lst = (sw_list_int_t *)sw_malloc(sizeof(sw_list_int_t));
 	assert(lst);
 	lst->cap = reserve;
 	lst->len = 0;
 	if (reserve > 0) {
-		lst->arr = (int *)kr_malloc(reserve * sizeof(int));
+		lst->arr = (int *)sw_malloc(reserve * sizeof(int));
 		assert(lst->arr);
 	}
 	else
@@ -25,8 +25,8 @@ sw_list_int_t *sw_list_int_init(int reserve) {
 
 void sw_list_int_destroy(sw_list_int_t *lst) {
 	assert(lst);
-	if (lst->arr != NULL) kr_free(lst->arr);
-	kr_free(lst);
+	if (lst->arr != NULL) sw_free(lst->arr);
+	sw_free(lst);
 }
 
 int sw_list_int_len(sw_list_int_t *lst) {
@@ -38,11 +38,11 @@ void sw_list_int_push(sw_list_int_t *lst, int el) {
 	assert(lst);
 	if (lst->len >= lst->cap) {
 		if (lst->cap > 0) {
-			lst->arr = (int *)kr_realloc(lst->arr, 2 * lst->cap * sizeof(int));
+			lst->arr = (int *)sw_realloc(lst->arr, 2 * lst->cap * sizeof(int));
 			lst->cap *= 2;
 		}
 		else {
-			lst->arr = (int *)kr_malloc(sizeof(int));
+			lst->arr = (int *)sw_malloc(sizeof(int));
 			lst->cap = 1;
 		}
 		assert(lst->arr);
@@ -0,0 +1,86 @@
+#include "memory.h"
+
+#include <kinc/threads/atomic.h>
+#include <kinc/threads/mutex.h>
+#include <krink/memory.h>
+
+#include <assert.h>
+
+// Size of the allocation in front of the returned pointer, keeps 16 byte alignment
+#define SW_MEMORY_HEADER 16
+
+static volatile int sw_memory_state = 0; // 0 uninitialized, 1 initializing, 2 ready
+static kinc_mutex_t sw_memory_lock;
+static sw_memory_stats_t sw_memory_stats;
+
+static void sw_memory_ensure_lock(void) {
+	if (sw_memory_state == 2) return;
+	if (KINC_ATOMIC_COMPARE_EXCHANGE(&sw_memory_state, 0, 1)) {
+		kinc_mutex_init(&sw_memory_lock);
+		KINC_ATOMIC_EXCHANGE_32(&sw_memory_state, 2);
+	}
+	else
+		while (sw_memory_state != 2)
+			;
+}
+
+static void sw_memory_track(size_t freed, size_t allocated) {
+	sw_memory_stats.current += allocated;
+	sw_memory_stats.current -= freed;
+	if (sw_memory_stats.current > sw_memory_stats.peak)
+		sw_memory_stats.peak = sw_memory_stats.current;
+}
+
+void *sw_malloc(size_t size) {
+	sw_memory_ensure_lock();
+	kinc_mutex_lock(&sw_memory_lock);
+	uint8_t *p = (uint8_t *)kr_malloc(size + SW_MEMORY_HEADER);
+	if (p != NULL) {
+		*(size_t *)p = size;
+		sw_memory_track(0, size);
+		++sw_memory_stats.allocations;
+	}
+	kinc_mutex_unlock(&sw_memory_lock);
+	return p != NULL ? p + SW_MEMORY_HEADER : NULL;
+}
+
+void *sw_realloc(void *p, size_t size) {
+	if (p == NULL) return sw_malloc(size);
+	sw_memory_ensure_lock();
+	kinc_mutex_lock(&sw_memory_lock);
+	uint8_t *block = (uint8_t *)p - SW_MEMORY_HEADER;
+	size_t old_size = *(size_t *)block;
+	uint8_t *n = (uint8_t *)kr_realloc(block, size + SW_MEMORY_HEADER);
+	if (n != NULL) {
+		*(size_t *)n = size;
+		sw_memory_track(old_size, size);
+		++sw_memory_stats.allocations;
+	}
+	kinc_mutex_unlock(&sw_memory_lock);
+	return n != NULL ? n + SW_MEMORY_HEADER : NULL;
+}
+
+void sw_free(void *p) {
+	if (p == NULL) return;
+	sw_memory_ensure_lock();
+	kinc_mutex_lock(&sw_memory_lock);
+	uint8_t *block = (uint8_t *)p - SW_MEMORY_HEADER;
+	sw_memory_track(*(size_t *)block, 0);
+	kr_free(block);
+	kinc_mutex_unlock(&sw_memory_lock);
+}
+
+sw_memory_stats_t sw_memory_get_stats(void) {
+	sw_memory_ensure_lock();
+	kinc_mutex_lock(&sw_memory_lock);
+	sw_memory_stats_t stats = sw_memory_stats;
+	kinc_mutex_unlock(&sw_memory_lock);
+	return stats;
+}
+
+void sw_memory_reset_peak(void) {
+	sw_memory_ensure_lock();
+	kinc_mutex_lock(&sw_memory_lock);
+	sw_memory_stats.peak = sw_memory_stats.current;
+	kinc_mutex_unlock(&sw_memory_lock);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+/*! \file memory.h
+    \brief Allocation layer of the library on top of `kr_malloc`. Calls are serialized by a lock, so
+    the library can allocate from several threads, and the bytes in use are tracked.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct sw_memory_stats {
+	size_t current;
+	size_t peak; // Since the last `sw_memory_reset_peak`
+	uint64_t allocations;
+} sw_memory_stats_t;
+
+void *sw_malloc(size_t size);
+void *sw_realloc(void *p, size_t size);
+void sw_free(void *p);
+
+sw_memory_stats_t sw_memory_get_stats(void);
+
+/**
+ * @brief Restart peak tracking at the current usage, read the peak of a single operation with
+ * `sw_memory_get_stats` afterwards.
+ */
+void sw_memory_reset_peak(void);
@@ -0,0 +1,109 @@
+#include "arena.h"
+#include "memory.h"
+#include "scratch.h"
+
+#include <kinc/threads/atomic.h>
+#include <kinc/threads/threadlocal.h>
+
+#include <assert.h>
+
+// Overflow allocations are chained through a header in front of the returned memory
+typedef struct sw_scratch_overflow {
+	struct sw_scratch_overflow *next;
+	size_t size;
+} sw_scratch_overflow_t;
+
+#define SW_SCRATCH_OVERFLOW_HEADER                                                                 \
+	((sizeof(sw_scratch_overflow_t) + SW_ARENA_ALIGNMENT - 1) & ~(size_t)(SW_ARENA_ALIGNMENT - 1))
+
+typedef struct sw_scratch {
+	sw_arena_t arena;
+	sw_scratch_overflow_t *overflow;
+	size_t overflow_size;
+	size_t peak;
+} sw_scratch_t;
+
+static volatile int sw_scratch_state = 0; // 0 uninitialized, 1 initializing, 2 ready
+static kinc_thread_local_t sw_scratch_tls;
+static size_t sw_scratch_size = SW_SCRATCH_DEFAULT_SIZE;
+
+static sw_scratch_t *sw_scratch_get(void) {
+	if (sw_scratch_state != 2) {
+		if (KINC_ATOMIC_COMPARE_EXCHANGE(&sw_scratch_state, 0, 1)) {
+			kinc_thread_local_init(&sw_scratch_tls);
+			KINC_ATOMIC_EXCHANGE_32(&sw_scratch_state, 2);
+		}
+		else
+			while (sw_scratch_state != 2)
+				;
+	}
+	sw_scratch_t *s = (sw_scratch_t *)kinc_thread_local_get(&sw_scratch_tls);
+	if (s == NULL) {
+		s = (sw_scratch_t *)sw_malloc(sizeof(sw_scratch_t));
+		assert(s != NULL);
+		sw_arena_init(&s->arena, sw_scratch_size);
+		s->overflow = NULL;
+		s->overflow_size = 0;
+		s->peak = 0;
+		kinc_thread_local_set(&sw_scratch_tls, s);
+	}
+	return s;
+}
+
+void sw_scratch_set_size(size_t size) {
+	sw_scratch_size = size;
+}
+
+sw_scratch_mark_t sw_scratch_begin(void) {
+	sw_scratch_t *s = sw_scratch_get();
+	return (sw_scratch_mark_t){.used = sw_arena_used(&s->arena), .overflow = s->overflow};
+}
+
+void *sw_scratch_alloc(size_t size) {
+	sw_scratch_t *s = sw_scratch_get();
+	void *p = sw_arena_alloc(&s->arena, size);
+	if (p == NULL) {
+		sw_scratch_overflow_t *o =
+		    (sw_scratch_overflow_t *)sw_malloc(SW_SCRATCH_OVERFLOW_HEADER + size);
+		assert(o != NULL);
+		o->next = s->overflow;
+		o->size = size;
+		s->overflow = o;
+		s->overflow_size += size;
+		p = (uint8_t *)o + SW_SCRATCH_OVERFLOW_HEADER;
+	}
+	size_t used = sw_arena_used(&s->arena) + s->overflow_size;
+	if (used > s->peak) s->peak = used;
+	return p;
+}
+
+void sw_scratch_end(sw_scratch_mark_t mark) {
+	sw_scratch_t *s = sw_scratch_get();
+	while (s->overflow != mark.overflow) {
+		assert(s->overflow != NULL);
+		sw_scratch_overflow_t *next = s->overflow->next;
+		s->overflow_size -= s->overflow->size;
+		sw_free(s->overflow);
+		s->overflow = next;
+	}
+	sw_arena_rewind(&s->arena, mark.used);
+}
+
+size_t sw_scratch_peak(void) {
+	return sw_scratch_get()->peak;
+}
+
+void sw_scratch_reset_peak(void) {
+	sw_scratch_t *s = sw_scratch_get();
+	s->peak = sw_arena_used(&s->arena) + s->overflow_size;
+}
+
+void sw_scratch_thread_release(void) {
+	if (sw_scratch_state != 2) return;
+	sw_scratch_t *s = (sw_scratch_t *)kinc_thread_local_get(&sw_scratch_tls);
+	if (s == NULL) return;
+	assert(s->overflow == NULL);
+	sw_arena_destroy(&s->arena);
+	sw_free(s);
+	kinc_thread_local_set(&sw_scratch_tls, NULL);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/*! \file scratch.h
+    \brief Per thread scratch memory for temporaries. Allocations are released in bulk by ending the
+    scope they were made in, scopes nest. Requests that do not fit into the arena of the thread fall
+    back to `sw_malloc` and are released the same way.
+*/
+
+#include <stddef.h>
+
+#define SW_SCRATCH_DEFAULT_SIZE (64 * 1024)
+
+typedef struct sw_scratch_mark {
+	size_t used;
+	void *overflow;
+} sw_scratch_mark_t;
+
+/**
+ * @brief Capacity of scratch arenas created after this call, each thread creates its arena on first
+ * use.
+ */
+void sw_scratch_set_size(size_t size);
+
+sw_scratch_mark_t sw_scratch_begin(void);
+
+/**
+ * @brief Allocate from the scratch memory of the calling thread, aligned to `SW_ARENA_ALIGNMENT`.
+ * Valid until the enclosing `sw_scratch_end`.
+ */
+void *sw_scratch_alloc(size_t size);
+void sw_scratch_end(sw_scratch_mark_t mark);
+
+/**
+ * @brief Highest scratch usage of the calling thread in bytes since the last reset, including
+ * overflow allocations.
+ */
+size_t sw_scratch_peak(void);
+void sw_scratch_reset_peak(void);
+
+/**
+ * @brief Free the scratch arena of the calling thread, call before a thread that used the library
+ * exits. Must not be inside a scope.
+ */
+void sw_scratch_thread_release(void);
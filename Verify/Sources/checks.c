@@ -0,0 +1,682 @@
+#include "checks.h"
+
+#include <kinc/log.h>
+#include <shapeware/csg.h>
+#include <shapeware/mc.h>
+#include <shapeware/mcstream.h>
+#include <shapeware/meshlet.h>
+#include <shapeware/ops.h>
+#include <shapeware/shapes.h>
+#include <shapeware/transform.h>
+#include <shapeware/volume.h>
+#include <sht/sht.h>
+#include <util/memory.h>
+#include <util/scratch.h>
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SW_VERIFY_SHAPE_COUNT (SW_SHAPE_OCTAHEDRON - SW_SHAPE_SPHERE + 1)
+#define SW_VERIFY_OP_COUNT (SW_OPS_SIN_DISPLACEMENT - SW_OPS_MIRROR + 1)
+#define SW_VERIFY_CSG_COUNT (SW_CSG_SMOOTH_INTERSECTION - SW_CSG_UNION + 1)
+#define SW_VERIFY_MAX_DATA 64
+#define SW_VERIFY_CACHE_SIZE 16
+#define SW_VERIFY_OVERDRAW_THRESHOLD 1.05f
+// Slack of the normal cone test for the rounding of the normalized face normals
+#define SW_VERIFY_CONE_EPSILON 1e-4f
+#define SW_VERIFY_BRICK_SIZE 4
+// Slack of the volume bounds for the rounding of the reference distances
+#define SW_VERIFY_BOUND_EPSILON 1e-4f
+#define SW_VERIFY_BISECTIONS 24
+
+typedef struct sw_verify_gen {
+	sw_graph_t *g;
+	uint32_t rng;
+	int shape;
+	int op;
+	int csg;
+} sw_verify_gen_t;
+
+static uint32_t sw_verify_next(uint32_t *rng) {
+	*rng = *rng * 1664525u + 1013904223u;
+	return *rng >> 8;
+}
+
+// Uniform in [lo, hi)
+static float sw_verify_rand(uint32_t *rng, float lo, float hi) {
+	return lo + (hi - lo) * (sw_verify_next(rng) / 16777216.0f);
+}
+
+sw_verify_options_t sw_verify_default_options(void) {
+	return (sw_verify_options_t){
+	    .seed = 1, .samples = 4096, .halfsidelen = 1.5f, .tolerance = 1e-5f, .steps = 24};
+}
+
+#define SW_VERIFY_SHAPE_CASE(T, name)                                                              \
+	case T: {                                                                                      \
+		sw_shapes_##name##_t d = sw_shapes_default_##name();                                       \
+		memcpy(data, &d, sizeof(d));                                                               \
+		*material = offsetof(sw_shapes_##name##_t, m);                                             \
+		return sizeof(d);                                                                          \
+	}
+
+static int sw_verify_shape_data(sw_type_t t, uint8_t *data, size_t *material) {
+	switch (t) {
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_SPHERE, sphere)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_ELLIPSOID, ellipsoid)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_BOX, box)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_BOX_FRAME, box_frame)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_TORUS, torus)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_CAPPED_TORUS, capped_torus)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_LINK, link)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_PLANE, plane)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_HEX_PRISM, hex_prism)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_TRI_PRISM, tri_prism)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_CAPSULE, capsule)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_CAPPED_CYLINDER, capped_cylinder)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_CAPPED_CONE, capped_cone)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_SOLID_ANGLE, solid_angle)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_CUT_SPHERE, cut_sphere)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_CUT_HOLLOW_SPHERE, cut_hollow_sphere)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_DEATH_STAR, death_star)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_ROUND_CONE, round_cone)
+		SW_VERIFY_SHAPE_CASE(SW_SHAPE_OCTAHEDRON, octahedron)
+	default:
+		assert(false);
+		return 0;
+	}
+}
+
+#define SW_VERIFY_OP_CASE(T, name)                                                                 \
+	case T: {                                                                                      \
+		sw_ops_##name##_t d = sw_ops_default_##name();                                             \
+		memcpy(data, &d, sizeof(d));                                                               \
+		return sizeof(d);                                                                          \
+	}
+
+static int sw_verify_op_data(sw_type_t t, uint8_t *data) {
+	switch (t) {
+		SW_VERIFY_OP_CASE(SW_OPS_MIRROR, mirror)
+		SW_VERIFY_OP_CASE(SW_OPS_ROUND, round)
+		SW_VERIFY_OP_CASE(SW_OPS_ONION, onion)
+		SW_VERIFY_OP_CASE(SW_OPS_ELONGATE, elongate)
+		SW_VERIFY_OP_CASE(SW_OPS_BEND, bend)
+		SW_VERIFY_OP_CASE(SW_OPS_REPEAT, repeat)
+		SW_VERIFY_OP_CASE(SW_OPS_REPEAT_INF, repeat_inf)
+		SW_VERIFY_OP_CASE(SW_OPS_STEP_REDUCTION, step_reduction)
+		SW_VERIFY_OP_CASE(SW_OPS_TWIST, twist)
+		SW_VERIFY_OP_CASE(SW_OPS_SIN_DISPLACEMENT, sin_displacement)
+	default:
+		assert(false);
+		return 0;
+	}
+}
+
+static void sw_verify_add_transforms(sw_verify_gen_t *gen, int id) {
+	if (sw_verify_next(&gen->rng) % 3 != 0) {
+		sw_transform_translation_t t = (sw_transform_translation_t){
+		    .x = sw_verify_rand(&gen->rng, -0.75f, 0.75f),
+		    .y = sw_verify_rand(&gen->rng, -0.75f, 0.75f),
+		    .z = sw_verify_rand(&gen->rng, -0.75f, 0.75f)};
+		sw_graph_insert_node(gen->g, id, SW_TRANSFORM_TRANSLATION, "", &t, sizeof(t));
+	}
+	if (sw_verify_next(&gen->rng) % 3 == 0) {
+		sw_transform_rotation_t r =
+		    (sw_transform_rotation_t){.x = sw_verify_rand(&gen->rng, -3.14159f, 3.14159f),
+		                              .y = sw_verify_rand(&gen->rng, -3.14159f, 3.14159f),
+		                              .z = sw_verify_rand(&gen->rng, -3.14159f, 3.14159f)};
+		sw_graph_insert_node(gen->g, id, SW_TRANSFORM_ROTATION, "", &r, sizeof(r));
+	}
+}
+
+static int sw_verify_gen_node(sw_verify_gen_t *gen, int parent, int depth) {
+	uint8_t data[SW_VERIFY_MAX_DATA];
+	uint32_t kind = depth > 0 ? sw_verify_next(&gen->rng) % 5 : 0;
+	if (kind < 2) {
+		sw_type_t t = SW_SHAPE_SPHERE + gen->shape++ % SW_VERIFY_SHAPE_COUNT;
+		size_t material;
+		int size = sw_verify_shape_data(t, data, &material);
+		assert(size <= SW_VERIFY_MAX_DATA);
+		sw_material_t *m = (sw_material_t *)(data + material);
+		m->r = sw_verify_rand(&gen->rng, 0.0f, 1.0f);
+		m->g = sw_verify_rand(&gen->rng, 0.0f, 1.0f);
+		m->b = sw_verify_rand(&gen->rng, 0.0f, 1.0f);
+		int id = sw_graph_insert_node(gen->g, parent, t, "", data, size);
+		sw_verify_add_transforms(gen, id);
+		return id;
+	}
+	if (kind < 3) {
+		sw_type_t t = SW_OPS_MIRROR + gen->op++ % SW_VERIFY_OP_COUNT;
+		int size = sw_verify_op_data(t, data);
+		int id = sw_graph_insert_node(gen->g, parent, t, "", data, size);
+		sw_verify_gen_node(gen, id, depth - 1);
+		return id;
+	}
+
+	sw_type_t t = SW_CSG_UNION + gen->csg++ % SW_VERIFY_CSG_COUNT;
+	int size = 0;
+	if (t == SW_CSG_SMOOTH_UNION || t == SW_CSG_SMOOTH_INTERSECTION) {
+		sw_csg_smooth_t d = (sw_csg_smooth_t){.k = sw_verify_rand(&gen->rng, 0.01f, 0.3f)};
+		memcpy(data, &d, sizeof(d));
+		size = sizeof(d);
+	}
+	else if (t == SW_CSG_SUBTRACTION) {
+		sw_csg_subtraction_t d = (sw_csg_subtraction_t){.subtractor_id = -1};
+		memcpy(data, &d, sizeof(d));
+		size = sizeof(d);
+	}
+	else if (t == SW_CSG_SMOOTH_SUBTRACTION) {
+		sw_csg_smooth_subtraction_t d = (sw_csg_smooth_subtraction_t){
+		    .k = sw_verify_rand(&gen->rng, 0.01f, 0.3f), .subtractor_id = -1};
+		memcpy(data, &d, sizeof(d));
+		size = sizeof(d);
+	}
+	int id = sw_graph_insert_node(gen->g, parent, t, "", size > 0 ? data : NULL, size);
+	sw_verify_gen_node(gen, id, depth - 1);
+	int b = sw_verify_gen_node(gen, id, depth - 1);
+	// Inserting the children may have moved the graph data
+	if (t == SW_CSG_SUBTRACTION)
+		((sw_csg_subtraction_t *)sw_graph_get_data(gen->g, sw_graph_get_node(gen->g, id)))
+		    ->subtractor_id = b;
+	else if (t == SW_CSG_SMOOTH_SUBTRACTION)
+		((sw_csg_smooth_subtraction_t *)sw_graph_get_data(gen->g, sw_graph_get_node(gen->g, id)))
+		    ->subtractor_id = b;
+	if (sw_verify_next(&gen->rng) % 4 == 0) sw_verify_add_transforms(gen, id);
+	return id;
+}
+
+void sw_verify_random_graph(sw_graph_t *g, uint32_t seed, int roots, int depth) {
+	assert(g != NULL && g->size == 0 && roots > 0 && depth >= 0);
+	sw_verify_gen_t gen = (sw_verify_gen_t){.g = g, .rng = seed};
+	gen.shape = sw_verify_next(&gen.rng) % SW_VERIFY_SHAPE_COUNT;
+	gen.op = sw_verify_next(&gen.rng) % SW_VERIFY_OP_COUNT;
+	gen.csg = sw_verify_next(&gen.rng) % SW_VERIFY_CSG_COUNT;
+	for (int i = 0; i < roots; ++i) sw_verify_gen_node(&gen, -1, depth);
+}
+
+static float sw_verify_error(float ref, float v, float tolerance) {
+	float scale = fabsf(ref) > 1.0f ? fabsf(ref) : 1.0f;
+	return fabsf(ref - v) / scale / tolerance;
+}
+
+sw_verify_report_t sw_verify_evaluator(const sw_sdf_t *sdf, const sw_verify_evaluator_t *e,
+                                       const sw_verify_options_t *options) {
+	assert(sdf != NULL && e != NULL && options != NULL);
+	sw_verify_report_t r = (sw_verify_report_t){0};
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_sdf_stack_frame_t *stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf));
+	uint32_t rng = options->seed;
+	float worst = -1.0f;
+	float h = options->halfsidelen;
+	for (int i = 0; i < options->samples; ++i) {
+		kr_vec3_t p = (kr_vec3_t){.x = sw_verify_rand(&rng, -h, h),
+		                          .y = sw_verify_rand(&rng, -h, h),
+		                          .z = sw_verify_rand(&rng, -h, h)};
+		kr_vec4_t ref = sw_sdf_compute_color(sdf, p, stack);
+		kr_vec4_t v = e->eval(e->param, p);
+		++r.samples;
+		if (!isfinite(v.w) || (e->color && (!isfinite(v.x) || !isfinite(v.y) || !isfinite(v.z)))) {
+			// Only a failure if the reference is finite there
+			if (isfinite(ref.w)) {
+				++r.non_finite;
+				++r.failures;
+			}
+			continue;
+		}
+		float dist = fabsf(ref.w - v.w);
+		float color = 0.0f;
+		float err = sw_verify_error(ref.w, v.w, options->tolerance);
+		if (e->color) {
+			color = fmaxf(fabsf(ref.x - v.x), fmaxf(fabsf(ref.y - v.y), fabsf(ref.z - v.z)));
+			err = fmaxf(err, color / options->tolerance);
+		}
+		if (dist > r.max_distance_error) r.max_distance_error = dist;
+		if (color > r.max_color_error) r.max_color_error = color;
+		if (err > 1.0f) ++r.failures;
+		if (err > worst) {
+			worst = err;
+			r.worst_pos = p;
+		}
+	}
+	sw_scratch_end(mark);
+	return r;
+}
+
+static uint64_t sw_verify_edge_key(int a, int b) {
+	return (a < b) ? ((uint64_t)(uint32_t)a << 32) | (uint32_t)b
+	               : ((uint64_t)(uint32_t)b << 32) | (uint32_t)a;
+}
+
+sw_verify_topology_t sw_verify_mesh_topology(sw_mesh_t *m) {
+	assert(m != NULL);
+	sw_verify_topology_t t = (sw_verify_topology_t){.vertices = sw_mesh_vert_count(m),
+	                                                .triangles = sw_mesh_tris_count(m)};
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	int *indices = (int *)sw_scratch_alloc((t.triangles * 3 + 1) * sizeof(int));
+	sw_mesh_write_index_buffer(m, indices);
+	sht_t *edges = sht_init_alloc(sizeof(int), t.triangles * 3 + 1, 42, sw_malloc, sw_free);
+	assert(edges != NULL);
+	for (int i = 0; i < t.triangles * 3; ++i) {
+		int a = indices[i];
+		int b = indices[i % 3 == 2 ? i - 2 : i + 1];
+		uint64_t key = sw_verify_edge_key(a, b);
+		int *count = (int *)sht_get(edges, &key, sizeof(key));
+		int c = count != NULL ? *count + 1 : 1;
+		if (c == 1) {
+			++t.edges;
+			++t.boundary_edges;
+		}
+		else if (c == 2)
+			--t.boundary_edges;
+		else if (c == 3)
+			++t.nonmanifold_edges;
+		sht_set(edges, &key, sizeof(key), &c);
+	}
+	sht_destroy(edges);
+	sw_scratch_end(mark);
+	t.euler = t.vertices - t.edges + t.triangles;
+	return t;
+}
+
+bool sw_verify_topology_equal(const sw_verify_topology_t *a, const sw_verify_topology_t *b) {
+	return a->vertices == b->vertices && a->triangles == b->triangles && a->edges == b->edges &&
+	       a->boundary_edges == b->boundary_edges && a->nonmanifold_edges == b->nonmanifold_edges &&
+	       a->euler == b->euler;
+}
+
+// Built-in evaluators
+
+typedef struct sw_verify_sdf_arg {
+	const sw_sdf_t *sdf;
+	sw_sdf_stack_frame_t *stack;
+} sw_verify_sdf_arg_t;
+
+static kr_vec4_t sw_verify_eval_color(void *param, kr_vec3_t pos) {
+	sw_verify_sdf_arg_t *a = (sw_verify_sdf_arg_t *)param;
+	return sw_sdf_compute_color(a->sdf, pos, a->stack);
+}
+
+static kr_vec4_t sw_verify_eval_distance(void *param, kr_vec3_t pos) {
+	sw_verify_sdf_arg_t *a = (sw_verify_sdf_arg_t *)param;
+	return (kr_vec4_t){.w = sw_sdf_compute(a->sdf, pos, a->stack)};
+}
+
+static kr_vec3_t sw_verify_zero_normal(void *param, kr_vec3_t pos) {
+	return (kr_vec3_t){0};
+}
+
+typedef struct sw_verify_stream_arg {
+	sw_mesh_t *m;
+	kr_vec3_t *pos;
+	kr_vec3_t *color;
+	int count;
+	int cap;
+} sw_verify_stream_arg_t;
+
+static void sw_verify_stream_vertex(void *param, kr_vec3_t pos, kr_vec3_t normal, kr_vec3_t color) {
+	sw_verify_stream_arg_t *a = (sw_verify_stream_arg_t *)param;
+	if (a->count == a->cap) {
+		a->cap = a->cap == 0 ? 1024 : a->cap * 2;
+		a->pos = (kr_vec3_t *)sw_realloc(a->pos, a->cap * sizeof(kr_vec3_t));
+		a->color = (kr_vec3_t *)sw_realloc(a->color, a->cap * sizeof(kr_vec3_t));
+		assert(a->pos != NULL && a->color != NULL);
+	}
+	a->pos[a->count] = pos;
+	a->color[a->count++] = color;
+}
+
+static void sw_verify_stream_triangle(void *param, uint64_t x, uint64_t y, uint64_t z) {
+	sw_verify_stream_arg_t *a = (sw_verify_stream_arg_t *)param;
+	sw_mesh_add_triangle(a->m, a->pos[x], a->pos[y], a->pos[z], a->color[x], a->color[y],
+	                     a->color[z]);
+}
+
+static int sw_verify_check_evaluator(const sw_sdf_t *sdf, const sw_verify_evaluator_t *e,
+                                     const sw_verify_options_t *options) {
+	sw_verify_report_t r = sw_verify_evaluator(sdf, e, options);
+	if (r.failures == 0) return 0;
+	kinc_log(KINC_LOG_LEVEL_ERROR,
+	         "Evaluator %s: %d of %d samples differ (%d non finite), max distance error %g, max "
+	         "color error %g, worst at (%g, %g, %g)",
+	         e->name, r.failures, r.samples, r.non_finite, r.max_distance_error, r.max_color_error,
+	         r.worst_pos.x, r.worst_pos.y, r.worst_pos.z);
+	return 1;
+}
+
+static bool sw_verify_meshes_identical(sw_mesh_t *a, sw_mesh_t *b) {
+	int nv = sw_mesh_vert_count(a);
+	int nt = sw_mesh_tris_count(a);
+	if (nv != sw_mesh_vert_count(b) || nt != sw_mesh_tris_count(b)) return false;
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	float *va = (float *)sw_scratch_alloc((nv * 9 + 1) * sizeof(float));
+	float *vb = (float *)sw_scratch_alloc((nv * 9 + 1) * sizeof(float));
+	int *ia = (int *)sw_scratch_alloc((nt * 3 + 1) * sizeof(int));
+	int *ib = (int *)sw_scratch_alloc((nt * 3 + 1) * sizeof(int));
+	sw_mesh_write_vert_buffer(a, va);
+	sw_mesh_write_vert_buffer(b, vb);
+	sw_mesh_write_index_buffer(a, ia);
+	sw_mesh_write_index_buffer(b, ib);
+	bool equal = memcmp(va, vb, nv * 9 * sizeof(float)) == 0 &&
+	             memcmp(ia, ib, nt * 3 * sizeof(int)) == 0;
+	sw_scratch_end(mark);
+	return equal;
+}
+
+typedef struct sw_verify_triangle {
+	int v[3];
+} sw_verify_triangle_t;
+
+// Rotates the smallest vertex id to the front, the winding is kept
+static sw_verify_triangle_t sw_verify_triangle(int a, int b, int c) {
+	if (b < a && b < c) return (sw_verify_triangle_t){{b, c, a}};
+	if (c < a && c < b) return (sw_verify_triangle_t){{c, a, b}};
+	return (sw_verify_triangle_t){{a, b, c}};
+}
+
+static int sw_verify_triangle_compare(const void *a, const void *b) {
+	const int *ta = ((const sw_verify_triangle_t *)a)->v;
+	const int *tb = ((const sw_verify_triangle_t *)b)->v;
+	for (int k = 0; k < 3; ++k)
+		if (ta[k] != tb[k]) return ta[k] < tb[k] ? -1 : 1;
+	return 0;
+}
+
+static bool sw_verify_meshlet_ranges(const sw_meshlets_t *ml, const sw_meshlet_t *l, int max_verts,
+                                     int max_tris) {
+	return l->vertex_count > 0 && l->vertex_count <= max_verts && l->triangle_count > 0 &&
+	       l->triangle_count <= max_tris && l->vertex_offset >= 0 &&
+	       l->vertex_offset + l->vertex_count <= ml->vertex_count && l->triangle_offset >= 0 &&
+	       l->triangle_offset + l->triangle_count * 3 <= ml->triangle_count * 3;
+}
+
+// Checks the limits and ranges of every meshlet, that the meshlets cover every triangle of `m`
+// exactly once with the same winding and that every face normal lies inside the normal cone
+static int sw_verify_check_meshlets(sw_mesh_t *m, int max_verts, int max_tris) {
+	int nv = sw_mesh_vert_count(m);
+	int nt = sw_mesh_tris_count(m);
+	sw_meshlets_t ml;
+	sw_mesh_build_meshlets(m, max_verts, max_tris, &ml);
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	float *verts = (float *)sw_scratch_alloc((nv * 9 + 1) * sizeof(float));
+	int *indices = (int *)sw_scratch_alloc((nt * 3 + 1) * sizeof(int));
+	sw_verify_triangle_t *expected =
+	    (sw_verify_triangle_t *)sw_scratch_alloc((nt + 1) * sizeof(sw_verify_triangle_t));
+	sw_verify_triangle_t *found =
+	    (sw_verify_triangle_t *)sw_scratch_alloc((nt + 1) * sizeof(sw_verify_triangle_t));
+	sw_mesh_write_vert_buffer(m, verts);
+	sw_mesh_write_index_buffer(m, indices);
+	for (int i = 0; i < nt; ++i)
+		expected[i] = sw_verify_triangle(indices[i * 3], indices[i * 3 + 1], indices[i * 3 + 2]);
+
+	int bad_meshlets = 0;
+	int bad_indices = 0;
+	int outside_cone = 0;
+	int found_count = 0;
+	for (int i = 0; i < ml.meshlet_count; ++i) {
+		const sw_meshlet_t *l = &ml.meshlets[i];
+		if (!sw_verify_meshlet_ranges(&ml, l, max_verts, max_tris)) {
+			++bad_meshlets;
+			continue;
+		}
+		// Minimum cosine between a face normal and the axis, a cutoff of 1 disables the cone
+		float cone_cos =
+		    l->cone_cutoff < 1.0f ? sqrtf(1.0f - l->cone_cutoff * l->cone_cutoff) : -1.0f;
+		for (int t = 0; t < l->triangle_count; ++t) {
+			int id[3];
+			bool valid = true;
+			for (int k = 0; k < 3; ++k) {
+				int local = ml.triangles[l->triangle_offset + t * 3 + k];
+				valid = valid && local < l->vertex_count;
+				id[k] = valid ? ml.vertices[l->vertex_offset + local] : -1;
+				valid = valid && id[k] >= 0 && id[k] < nv;
+			}
+			if (!valid) {
+				++bad_indices;
+				continue;
+			}
+			if (found_count < nt) found[found_count] = sw_verify_triangle(id[0], id[1], id[2]);
+			++found_count;
+
+			const float *a = &verts[id[0] * 9];
+			const float *b = &verts[id[1] * 9];
+			const float *c = &verts[id[2] * 9];
+			kr_vec3_t u = (kr_vec3_t){b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			kr_vec3_t v = (kr_vec3_t){c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+			kr_vec3_t n = (kr_vec3_t){u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z,
+			                          u.x * v.y - u.y * v.x};
+			float len = kr_vec3_length(n);
+			if (len > 0.0f &&
+			    kr_vec3_dot(n, l->cone_axis) / len < cone_cos - SW_VERIFY_CONE_EPSILON)
+				++outside_cone;
+		}
+	}
+
+	bool covered = found_count == nt && ml.triangle_count == nt;
+	if (covered) {
+		qsort(expected, nt, sizeof(sw_verify_triangle_t), sw_verify_triangle_compare);
+		qsort(found, nt, sizeof(sw_verify_triangle_t), sw_verify_triangle_compare);
+		covered = nt == 0 || memcmp(expected, found, nt * sizeof(sw_verify_triangle_t)) == 0;
+	}
+	sw_scratch_end(mark);
+	sw_meshlets_destroy(&ml);
+
+	int failed = (bad_meshlets > 0) + (bad_indices > 0) + !covered + (outside_cone > 0);
+	if (failed > 0)
+		kinc_log(KINC_LOG_LEVEL_ERROR,
+		         "Meshlets (%d verts, %d tris): %d out of range, %d bad local indices, %d of %d "
+		         "triangles found%s, %d normals outside the cone",
+		         max_verts, max_tris, bad_meshlets, bad_indices, found_count, nt,
+		         covered ? "" : " (not exactly once)", outside_cone);
+	return failed;
+}
+
+// Runs the optimization passes one by one on `m` and checks the simulated ACMR between them
+static int sw_verify_check_optimize(sw_mesh_t *m, const sw_verify_topology_t *ref) {
+	int failed = 0;
+	sw_mesh_cache_stats_t before = sw_mesh_analyze_vertex_cache(m, SW_VERIFY_CACHE_SIZE);
+	sw_mesh_optimize_vertex_cache(m);
+	sw_mesh_cache_stats_t cache = sw_mesh_analyze_vertex_cache(m, SW_VERIFY_CACHE_SIZE);
+	sw_mesh_optimize_overdraw(m, SW_VERIFY_CACHE_SIZE, SW_VERIFY_OVERDRAW_THRESHOLD);
+	sw_mesh_cache_stats_t overdraw = sw_mesh_analyze_vertex_cache(m, SW_VERIFY_CACHE_SIZE);
+	sw_mesh_optimize_vertex_fetch(m);
+	sw_mesh_cache_stats_t after = sw_mesh_analyze_vertex_cache(m, SW_VERIFY_CACHE_SIZE);
+	if (cache.acmr > before.acmr || overdraw.misses > SW_VERIFY_OVERDRAW_THRESHOLD * cache.misses ||
+	    after.misses != overdraw.misses) {
+		kinc_log(KINC_LOG_LEVEL_ERROR,
+		         "Mesh optimization ACMR: extraction %f, vertex cache %f, overdraw %f, "
+		         "vertex fetch %f",
+		         before.acmr, cache.acmr, overdraw.acmr, after.acmr);
+		++failed;
+	}
+	sw_verify_topology_t optimized = sw_verify_mesh_topology(m);
+	if (!sw_verify_topology_equal(ref, &optimized)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "Mesh optimization changes the topology");
+		++failed;
+	}
+	return failed;
+}
+
+static int sw_verify_check_meshes(const sw_sdf_t *sdf, const sw_verify_options_t *options,
+                                  sw_jobs_t *jobs) {
+	int failed = 0;
+	sw_mc_chunk_t chunk = (sw_mc_chunk_t){.halfsidelen = options->halfsidelen,
+	                                      .steps = options->steps};
+	sw_mesh_t *serial = sw_mesh_init(1024, 1024, sw_verify_zero_normal, NULL);
+	sw_mc_process_sdf_chunk_color(sdf, &chunk, sw_mesh_add_triangle, serial, NULL);
+	sw_verify_topology_t ref = sw_verify_mesh_topology(serial);
+
+	if (jobs != NULL) {
+		sw_mesh_t *parallel = sw_mesh_init(1024, 1024, sw_verify_zero_normal, NULL);
+		sw_mc_process_sdf_chunk_color(sdf, &chunk, sw_mesh_add_triangle, parallel, jobs);
+		if (!sw_verify_meshes_identical(serial, parallel)) {
+			kinc_log(KINC_LOG_LEVEL_ERROR, "Parallel Marching Cubes differs from the serial result");
+			++failed;
+		}
+		sw_mesh_destroy(parallel);
+	}
+
+	sw_verify_stream_arg_t a = (sw_verify_stream_arg_t){
+	    .m = sw_mesh_init(1024, 1024, sw_verify_zero_normal, NULL)};
+	sw_mcstream_sink_t sink = (sw_mcstream_sink_t){
+	    .vertex = sw_verify_stream_vertex, .triangle = sw_verify_stream_triangle, .param = &a};
+	sw_mc_stream_sdf_chunk(sdf, &chunk, sw_verify_zero_normal, NULL, &sink, jobs);
+	sw_verify_topology_t streamed = sw_verify_mesh_topology(a.m);
+	if (!sw_verify_topology_equal(&ref, &streamed)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR,
+		         "Streaming Marching Cubes topology differs: V %d/%d T %d/%d E %d/%d boundary "
+		         "%d/%d non manifold %d/%d",
+		         ref.vertices, streamed.vertices, ref.triangles, streamed.triangles, ref.edges,
+		         streamed.edges, ref.boundary_edges, streamed.boundary_edges,
+		         ref.nonmanifold_edges, streamed.nonmanifold_edges);
+		++failed;
+	}
+	sw_free(a.pos);
+	sw_free(a.color);
+	sw_mesh_destroy(a.m);
+
+	failed += sw_verify_check_meshlets(serial, SW_MESHLET_MAX_VERTS, SW_MESHLET_MAX_TRIS);
+	// Small limits, so most meshlets end at one of them
+	failed += sw_verify_check_meshlets(serial, 16, 8);
+	failed += sw_verify_check_optimize(serial, &ref);
+	sw_mesh_destroy(serial);
+	return failed;
+}
+
+// The volume bounds only hold for distances that change at most as fast as the distance to the
+// surface. Measured with the generated parameters, bend, twist and displacement exceed that and the
+// hex prism is discontinuous.
+static bool sw_verify_lipschitz(const sw_graph_t *g) {
+	for (int i = 0; i < g->node_cap; ++i) {
+		sw_type_t t = g->nodes[i].type;
+		if (t == SW_OPS_BEND || t == SW_OPS_TWIST || t == SW_OPS_SIN_DISPLACEMENT ||
+		    t == SW_SHAPE_HEX_PRISM)
+			return false;
+	}
+	return true;
+}
+
+// How far the largest bound of the levels above 0 exceeds the distance `d` at `p`. Empty bricks
+// reuse the brick level, so it covers them as well. `SW_VOLUME_R8` stores no bounds below `-range`.
+static float sw_verify_volume_excess(const sw_volume_t *v, kr_vec3_t p, float d) {
+	if (v->desc.format == SW_VOLUME_R8) d = fmaxf(d, -v->desc.range);
+	float excess = -INFINITY;
+	for (int l = 1; l < v->level_count; ++l) excess = fmaxf(excess, sw_volume_bound(v, l, p) - d);
+	return excess;
+}
+
+// Samples the SDF at random points of the exported volume and at surface points bisected between
+// consecutive samples of different sign. No bound may exceed the distance at any of them.
+static int sw_verify_check_volume(const sw_sdf_t *sdf, const sw_volume_desc_t *desc,
+                                  const sw_verify_options_t *options, sw_jobs_t *jobs) {
+	sw_volume_t *v = sw_sdf_export_volume(sdf, desc, jobs);
+	sw_scratch_mark_t mark = sw_scratch_begin();
+	sw_sdf_stack_frame_t *stack = (sw_sdf_stack_frame_t *)sw_scratch_alloc(sw_sdf_stack_size(sdf));
+	uint32_t rng = options->seed;
+	int samples = 0, above = 0, surface = 0, surface_above = 0;
+	float worst = 0.0f;
+	kr_vec3_t prev = desc->min;
+	float prev_d = sw_sdf_compute(sdf, prev, stack);
+	for (int i = 0; i < options->samples; ++i) {
+		kr_vec3_t p = (kr_vec3_t){.x = sw_verify_rand(&rng, desc->min.x, desc->max.x),
+		                          .y = sw_verify_rand(&rng, desc->min.y, desc->max.y),
+		                          .z = sw_verify_rand(&rng, desc->min.z, desc->max.z)};
+		float d = sw_sdf_compute(sdf, p, stack);
+		if (!isfinite(d)) continue;
+		float excess = sw_verify_volume_excess(v, p, d);
+		++samples;
+		if (excess > SW_VERIFY_BOUND_EPSILON) ++above;
+		worst = fmaxf(worst, excess);
+
+		if ((d < 0.0f) != (prev_d < 0.0f)) {
+			// The segment stays inside the volume, `a` keeps the sign of `d`
+			kr_vec3_t a = p, b = prev;
+			float da = d;
+			for (int k = 0; k < SW_VERIFY_BISECTIONS; ++k) {
+				kr_vec3_t m = kr_vec3_mult(kr_vec3_addv(a, b), 0.5f);
+				float dm = sw_sdf_compute(sdf, m, stack);
+				if ((dm < 0.0f) == (da < 0.0f)) {
+					a = m;
+					da = dm;
+				}
+				else
+					b = m;
+			}
+			excess = sw_verify_volume_excess(v, a, da);
+			++surface;
+			if (excess > SW_VERIFY_BOUND_EPSILON) ++surface_above;
+			worst = fmaxf(worst, excess);
+		}
+		prev = p;
+		prev_d = d;
+	}
+	sw_scratch_end(mark);
+	sw_volume_destroy(v);
+
+	if (above == 0 && surface_above == 0) return 0;
+	kinc_log(KINC_LOG_LEVEL_ERROR,
+	         "Volume bounds (%s, brick size %d) exceed the distance at %d of %d samples and %d of "
+	         "%d surface points, by up to %f",
+	         desc->format == SW_VOLUME_R8 ? "R8" : "R16F", desc->brick_size, above, samples,
+	         surface_above, surface, worst);
+	return 1;
+}
+
+static int sw_verify_check_volumes(const sw_sdf_t *sdf, const sw_verify_options_t *options,
+                                   sw_jobs_t *jobs) {
+	float h = options->halfsidelen;
+	int res = (options->steps + SW_VERIFY_BRICK_SIZE - 1) / SW_VERIFY_BRICK_SIZE *
+	          SW_VERIFY_BRICK_SIZE;
+	sw_volume_desc_t desc = sw_volume_default_desc();
+	desc.min = (kr_vec3_t){-h, -h, -h};
+	desc.max = (kr_vec3_t){h, h, h};
+	desc.res[0] = desc.res[1] = desc.res[2] = res;
+	int failed = sw_verify_check_volume(sdf, &desc, options, jobs);
+	// Quantized and bricked, distances beyond the half side length are clamped
+	desc.format = SW_VOLUME_R8;
+	desc.range = h;
+	desc.brick_size = SW_VERIFY_BRICK_SIZE;
+	failed += sw_verify_check_volume(sdf, &desc, options, jobs);
+	return failed;
+}
+
+int sw_verify_graph(sw_graph_t *g, const sw_verify_options_t *options, sw_jobs_t *jobs) {
+	assert(g != NULL && options != NULL);
+	int failed = 0;
+	sw_sdf_t *sdf = sw_sdf_generate(g, -1);
+
+	sw_verify_sdf_arg_t no_stack = (sw_verify_sdf_arg_t){.sdf = sdf, .stack = NULL};
+	sw_verify_evaluator_t e = (sw_verify_evaluator_t){
+	    .name = "scratch_stack", .eval = sw_verify_eval_color, .param = &no_stack, .color = true};
+	failed += sw_verify_check_evaluator(sdf, &e, options);
+
+	sw_verify_sdf_arg_t own_stack = (sw_verify_sdf_arg_t){.sdf = sdf, .stack = sw_sdf_stack_init(sdf)};
+	e = (sw_verify_evaluator_t){
+	    .name = "distance", .eval = sw_verify_eval_distance, .param = &own_stack, .color = false};
+	failed += sw_verify_check_evaluator(sdf, &e, options);
+	sw_sdf_stack_destroy(own_stack.stack);
+
+	// The interpreter has to be independent of where the graph lives
+	sw_graph_t copy;
+	sw_graph_deep_copy(&copy, g);
+	sw_sdf_t *copy_sdf = sw_sdf_generate(&copy, -1);
+	sw_verify_sdf_arg_t copied =
+	    (sw_verify_sdf_arg_t){.sdf = copy_sdf, .stack = sw_sdf_stack_init(copy_sdf)};
+	e = (sw_verify_evaluator_t){
+	    .name = "deep_copy", .eval = sw_verify_eval_color, .param = &copied, .color = true};
+	failed += sw_verify_check_evaluator(sdf, &e, options);
+	if (sw_sdf_hash(sdf) != sw_sdf_hash(copy_sdf)) {
+		kinc_log(KINC_LOG_LEVEL_ERROR, "SDF hash changes with a deep copy of the graph");
+		++failed;
+	}
+	sw_sdf_stack_destroy(copied.stack);
+	sw_sdf_destroy(copy_sdf);
+	sw_graph_destroy(&copy);
+
+	failed += sw_verify_check_meshes(sdf, options, jobs);
+	if (sw_verify_lipschitz(g)) failed += sw_verify_check_volumes(sdf, options, jobs);
+	sw_sdf_destroy(sdf);
+	return failed;
+}
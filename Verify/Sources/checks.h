@@ -0,0 +1,88 @@
+/**
+ * @file checks.h
+ * @brief Differential checks of evaluators and mesh extractors against the reference interpreter
+ * `sw_sdf_compute_color`. Random graphs cover every shape, op and CSG type, faster evaluation paths
+ * are compared point by point and extracted meshes topologically. Part of the verify target only,
+ * not of the library.
+ */
+#pragma once
+
+#include <krink/math/vector.h>
+#include <shapeware/graph.h>
+#include <shapeware/jobs.h>
+#include <shapeware/mesh.h>
+#include <shapeware/sdf.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef kr_vec4_t (*sw_verify_eval_func_t)(void *param, kr_vec3_t pos);
+
+typedef struct sw_verify_evaluator {
+	const char *name;
+	sw_verify_eval_func_t eval;
+	void *param;
+	bool color; // Whether the evaluator produces color, otherwise only `w` is compared
+} sw_verify_evaluator_t;
+
+typedef struct sw_verify_options {
+	uint32_t seed;
+	int samples;       // Random points per evaluator
+	float halfsidelen; // Points and meshes cover the cube of this half side length around the origin
+	float tolerance;   // Relative to the magnitude of the reference, absolute below 1
+	int steps;         // Marching Cubes resolution of the mesh checks
+} sw_verify_options_t;
+
+typedef struct sw_verify_report {
+	int samples;
+	int failures; // Samples exceeding the tolerance
+	int non_finite;
+	float max_distance_error;
+	float max_color_error;
+	kr_vec3_t worst_pos;
+} sw_verify_report_t;
+
+typedef struct sw_verify_topology {
+	int vertices;
+	int triangles;
+	int edges;
+	int boundary_edges;    // Used by a single triangle
+	int nonmanifold_edges; // Used by more than two triangles
+	int euler;             // V - E + F
+} sw_verify_topology_t;
+
+sw_verify_options_t sw_verify_default_options(void);
+
+/**
+ * @brief Fill an empty graph with `roots` random top level subtrees of at most `depth` levels.
+ * Shapes, ops and CSG types are taken round robin from a random start, so a graph with enough nodes
+ * contains all of them. CSG nodes always get exactly two children.
+ *
+ * @param g
+ * @param seed
+ * @param roots
+ * @param depth
+ */
+void sw_verify_random_graph(sw_graph_t *g, uint32_t seed, int roots, int depth);
+
+/**
+ * @brief Compare `e` against the reference interpreter at `options->samples` random points.
+ */
+sw_verify_report_t sw_verify_evaluator(const sw_sdf_t *sdf, const sw_verify_evaluator_t *e,
+                                       const sw_verify_options_t *options);
+
+sw_verify_topology_t sw_verify_mesh_topology(sw_mesh_t *m);
+bool sw_verify_topology_equal(const sw_verify_topology_t *a, const sw_verify_topology_t *b);
+
+/**
+ * @brief Run every built-in check on a graph: the evaluation variants of the interpreter against
+ * the reference, serial against parallel Marching Cubes (exact), in-core against streaming
+ * Marching Cubes (topology), the invariants of the meshlets built from the mesh, the simulated ACMR
+ * between the mesh optimization passes and, for graphs without space distorting ops, that the
+ * bounds of exported volumes never exceed the distance. Failures are logged.
+ *
+ * @param g
+ * @param options
+ * @param jobs Parallel extraction is skipped when `NULL`
+ * @return int Number of failed checks
+ */
+int sw_verify_graph(sw_graph_t *g, const sw_verify_options_t *options, sw_jobs_t *jobs);
@@ -0,0 +1,61 @@
+/*
+Headless check target, runs the differential checks of checks.h on a fixed set of random graphs,
+serially and on a job system. Exits non-zero if any check fails, so it can gate CI.
+
+Usage: shapeware-verify [--graphs <count>] [--threads <n>]
+
+`--graphs` defaults to 64, `--threads` to 2 workers for the parallel extraction checks.
+*/
+
+#include "checks.h"
+
+#include <kinc/log.h>
+#include <krink/system.h>
+#include <shapeware/graph.h>
+#include <shapeware/jobs.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VERIFY_MEMORY (256ull * 1024ull * 1024ull)
+
+int kickstart(int argc, char **argv) {
+	int graphs = 64;
+	int threads = 2;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--graphs") == 0 && i + 1 < argc)
+			graphs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+	}
+
+	void *mem = malloc(VERIFY_MEMORY);
+	assert(mem != NULL);
+	kr_init(mem, VERIFY_MEMORY, NULL, 0);
+
+	sw_jobs_t *jobs = sw_jobs_init(threads > 0 ? threads : 1, 0);
+	sw_verify_options_t options = sw_verify_default_options();
+	int failed_graphs = 0;
+	for (int i = 0; i < graphs; ++i) {
+		sw_graph_t g;
+		sw_graph_init(&g, 32, 1024);
+		// Fixed seeds, a failure reproduces with the same graph
+		sw_verify_random_graph(&g, (uint32_t)i + 1, 3, 4);
+		options.seed = (uint32_t)i + 1;
+		int failed = sw_verify_graph(&g, &options, jobs);
+		if (failed > 0) {
+			kinc_log(KINC_LOG_LEVEL_ERROR, "Graph %d failed %d checks", i + 1, failed);
+			++failed_graphs;
+		}
+		sw_graph_destroy(&g);
+	}
+	sw_jobs_destroy(jobs);
+	kr_destroy();
+	free(mem);
+
+	printf("%d of %d graphs passed\n", graphs - failed_graphs, graphs);
+	return failed_graphs > 0 ? 1 : 0;
+}
@@ -0,0 +1,9 @@
+let project = new Project('shapeware-verify');
+
+const shapeware = await project.addProject('..');
+shapeware.useAsLibrary();
+
+project.addFile('Sources/**');
+project.cmd = true;
+project.flatten();
+resolve(project);